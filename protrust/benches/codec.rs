@@ -0,0 +1,871 @@
+//! Benchmarks for reading and writing messages with each reader and writer backend.
+//!
+//! Every benchmark reads or writes one message from a fixed corpus per iteration and sets the bytes
+//! processed per iteration, so the results are reported in MB/s. The messages per second of a benchmark
+//! is `1_000_000_000 / ns_per_iter`.
+//!
+//! The corpus covers these message shapes:
+//!  * `scalars`: one of every scalar type
+//!  * `strings`: a few short strings and a larger byte string
+//!  * `blobs`: the string message with a 256 KiB byte string, which the vectored writer references
+//!    instead of copying into its buffer
+//!  * `packed`: packed arrays of 10,000 samples of varint and fixed size values
+//!  * `nested`: a message nested 32 levels deep
+//!  * `nested_cached_*`: a message nested 8, 32, and 96 levels deep that caches its size, so
+//!    writing it sizes each level once instead of once per level above it
+//!  * `unknown`: the scalar message read into a message with no known fields
+//!  * `unknown_raw`: the unknown message with its fields stored as they're encoded
+//!  * `extensions`: a message with 16 message extension fields
+//!
+//! Run with `cargo bench`.
+
+#![feature(test)]
+
+extern crate test;
+
+use protrust::{Message, Mergable, UnknownFieldSet};
+use protrust::collections::RepeatedField;
+use protrust::extend::{ExtendableMessage, Extension, ExtensionRegistry, ExtensionSet, RegistryBuilder};
+use protrust::io::{read, write, reverse::ReverseWriter, CachedSize, CodedReader, CodedWriter, FieldNumber, Input, Length, LengthBuilder, Output};
+use protrust::io::read::UnknownFieldHandling;
+use protrust::raw;
+use std::sync::Once;
+use test::{black_box, Bencher};
+
+const fn num(n: u32) -> FieldNumber {
+    unsafe { FieldNumber::new_unchecked(n) }
+}
+
+#[derive(Default, Clone, Debug, PartialEq)]
+struct Scalars {
+    int32: i32,
+    int64: i64,
+    uint32: u32,
+    uint64: u64,
+    sint32: i32,
+    sint64: i64,
+    fixed32: u32,
+    fixed64: u64,
+    sfixed32: i32,
+    sfixed64: i64,
+    boolean: bool,
+    unknown_fields: UnknownFieldSet,
+}
+
+impl Message for Scalars {
+    fn merge_from<T: Input>(&mut self, input: &mut CodedReader<T>) -> read::Result<()> {
+        while let Some(field) = input.read_field()? {
+            match field.tag() {
+                8 => field.merge_value::<raw::Int32>(num(1), &mut self.int32)?,
+                16 => field.merge_value::<raw::Int64>(num(2), &mut self.int64)?,
+                24 => field.merge_value::<raw::Uint32>(num(3), &mut self.uint32)?,
+                32 => field.merge_value::<raw::Uint64>(num(4), &mut self.uint64)?,
+                40 => field.merge_value::<raw::Sint32>(num(5), &mut self.sint32)?,
+                48 => field.merge_value::<raw::Sint64>(num(6), &mut self.sint64)?,
+                61 => field.merge_value::<raw::Fixed32>(num(7), &mut self.fixed32)?,
+                65 => field.merge_value::<raw::Fixed64>(num(8), &mut self.fixed64)?,
+                77 => field.merge_value::<raw::Sfixed32>(num(9), &mut self.sfixed32)?,
+                81 => field.merge_value::<raw::Sfixed64>(num(10), &mut self.sfixed64)?,
+                88 => field.merge_value::<raw::Bool>(num(11), &mut self.boolean)?,
+                _ => field.check_and_try_add_field_to(&mut self.unknown_fields)?.or_skip()?,
+            }
+        }
+        Ok(())
+    }
+    fn clear(&mut self) {
+        self.int32 = 0;
+        self.int64 = 0;
+        self.uint32 = 0;
+        self.uint64 = 0;
+        self.sint32 = 0;
+        self.sint64 = 0;
+        self.fixed32 = 0;
+        self.fixed64 = 0;
+        self.sfixed32 = 0;
+        self.sfixed64 = 0;
+        self.boolean = false;
+        self.unknown_fields.clear();
+    }
+    fn calculate_size(&self) -> Option<Length> {
+        LengthBuilder::new()
+            .add_field::<raw::Int32>(num(1), &self.int32)?
+            .add_field::<raw::Int64>(num(2), &self.int64)?
+            .add_field::<raw::Uint32>(num(3), &self.uint32)?
+            .add_field::<raw::Uint64>(num(4), &self.uint64)?
+            .add_field::<raw::Sint32>(num(5), &self.sint32)?
+            .add_field::<raw::Sint64>(num(6), &self.sint64)?
+            .add_field::<raw::Fixed32>(num(7), &self.fixed32)?
+            .add_field::<raw::Fixed64>(num(8), &self.fixed64)?
+            .add_field::<raw::Sfixed32>(num(9), &self.sfixed32)?
+            .add_field::<raw::Sfixed64>(num(10), &self.sfixed64)?
+            .add_field::<raw::Bool>(num(11), &self.boolean)?
+            .add_fields(&self.unknown_fields)
+            .map(LengthBuilder::build)
+    }
+    fn write_to<T: Output>(&self, output: &mut CodedWriter<T>) -> write::Result {
+        output.write_field::<raw::Int32>(num(1), &self.int32)?;
+        output.write_field::<raw::Int64>(num(2), &self.int64)?;
+        output.write_field::<raw::Uint32>(num(3), &self.uint32)?;
+        output.write_field::<raw::Uint64>(num(4), &self.uint64)?;
+        output.write_field::<raw::Sint32>(num(5), &self.sint32)?;
+        output.write_field::<raw::Sint64>(num(6), &self.sint64)?;
+        output.write_field::<raw::Fixed32>(num(7), &self.fixed32)?;
+        output.write_field::<raw::Fixed64>(num(8), &self.fixed64)?;
+        output.write_field::<raw::Sfixed32>(num(9), &self.sfixed32)?;
+        output.write_field::<raw::Sfixed64>(num(10), &self.sfixed64)?;
+        output.write_field::<raw::Bool>(num(11), &self.boolean)?;
+        output.write_fields(&self.unknown_fields)
+    }
+    fn write_reverse(&self, output: &mut ReverseWriter) -> write::Result {
+        output.write_fields(&self.unknown_fields)?;
+        output.write_field::<raw::Bool>(num(11), &self.boolean)?;
+        output.write_field::<raw::Sfixed64>(num(10), &self.sfixed64)?;
+        output.write_field::<raw::Sfixed32>(num(9), &self.sfixed32)?;
+        output.write_field::<raw::Fixed64>(num(8), &self.fixed64)?;
+        output.write_field::<raw::Fixed32>(num(7), &self.fixed32)?;
+        output.write_field::<raw::Sint64>(num(6), &self.sint64)?;
+        output.write_field::<raw::Sint32>(num(5), &self.sint32)?;
+        output.write_field::<raw::Uint64>(num(4), &self.uint64)?;
+        output.write_field::<raw::Uint32>(num(3), &self.uint32)?;
+        output.write_field::<raw::Int64>(num(2), &self.int64)?;
+        output.write_field::<raw::Int32>(num(1), &self.int32)?;
+        Ok(())
+    }
+    fn is_initialized(&self) -> bool {
+        true
+    }
+    fn unknown_fields(&self) -> &UnknownFieldSet {
+        &self.unknown_fields
+    }
+    fn unknown_fields_mut(&mut self) -> &mut UnknownFieldSet {
+        &mut self.unknown_fields
+    }
+}
+
+#[derive(Default, Clone, Debug, PartialEq)]
+struct Strings {
+    name: String,
+    description: String,
+    tags: RepeatedField<String>,
+    payload: Vec<u8>,
+    unknown_fields: UnknownFieldSet,
+}
+
+impl Message for Strings {
+    fn merge_from<T: Input>(&mut self, input: &mut CodedReader<T>) -> read::Result<()> {
+        while let Some(field) = input.read_field()? {
+            match field.tag() {
+                10 => field.merge_value::<raw::String>(num(1), &mut self.name)?,
+                18 => field.merge_value::<raw::String>(num(2), &mut self.description)?,
+                26 => field.add_entries_to::<_, raw::String>(num(3), &mut self.tags)?,
+                34 => field.merge_value::<raw::Bytes<_>>(num(4), &mut self.payload)?,
+                _ => field.check_and_try_add_field_to(&mut self.unknown_fields)?.or_skip()?,
+            }
+        }
+        Ok(())
+    }
+    fn clear(&mut self) {
+        self.name.clear();
+        self.description.clear();
+        self.tags.clear();
+        self.payload.clear();
+        self.unknown_fields.clear();
+    }
+    fn calculate_size(&self) -> Option<Length> {
+        LengthBuilder::new()
+            .add_field::<raw::String>(num(1), &self.name)?
+            .add_field::<raw::String>(num(2), &self.description)?
+            .add_values::<_, raw::String>(&self.tags, num(3))?
+            .add_field::<raw::Bytes<_>>(num(4), &self.payload)?
+            .add_fields(&self.unknown_fields)
+            .map(LengthBuilder::build)
+    }
+    fn write_to<T: Output>(&self, output: &mut CodedWriter<T>) -> write::Result {
+        output.write_field::<raw::String>(num(1), &self.name)?;
+        output.write_field::<raw::String>(num(2), &self.description)?;
+        output.write_values::<_, raw::String>(&self.tags, num(3))?;
+        output.write_field::<raw::Bytes<_>>(num(4), &self.payload)?;
+        output.write_fields(&self.unknown_fields)
+    }
+    fn write_reverse(&self, output: &mut ReverseWriter) -> write::Result {
+        output.write_fields(&self.unknown_fields)?;
+        output.write_field::<raw::Bytes<_>>(num(4), &self.payload)?;
+        output.write_values::<_, raw::String>(&self.tags, num(3))?;
+        output.write_field::<raw::String>(num(2), &self.description)?;
+        output.write_field::<raw::String>(num(1), &self.name)?;
+        Ok(())
+    }
+    fn is_initialized(&self) -> bool {
+        true
+    }
+    fn unknown_fields(&self) -> &UnknownFieldSet {
+        &self.unknown_fields
+    }
+    fn unknown_fields_mut(&mut self) -> &mut UnknownFieldSet {
+        &mut self.unknown_fields
+    }
+}
+
+#[derive(Default, Clone, Debug, PartialEq)]
+struct Packed {
+    samples: RepeatedField<i32>,
+    deltas: RepeatedField<i64>,
+    timestamps: RepeatedField<u64>,
+    unknown_fields: UnknownFieldSet,
+}
+
+impl Message for Packed {
+    fn merge_from<T: Input>(&mut self, input: &mut CodedReader<T>) -> read::Result<()> {
+        while let Some(field) = input.read_field()? {
+            match field.tag() {
+                10 => field.add_entries_to::<_, raw::Packed<raw::Int32>>(num(1), &mut self.samples)?,
+                18 => field.add_entries_to::<_, raw::Packed<raw::Sint64>>(num(2), &mut self.deltas)?,
+                26 => field.add_entries_to::<_, raw::Packed<raw::Fixed64>>(num(3), &mut self.timestamps)?,
+                _ => field.check_and_try_add_field_to(&mut self.unknown_fields)?.or_skip()?,
+            }
+        }
+        Ok(())
+    }
+    fn clear(&mut self) {
+        self.samples.clear();
+        self.deltas.clear();
+        self.timestamps.clear();
+        self.unknown_fields.clear();
+    }
+    fn calculate_size(&self) -> Option<Length> {
+        LengthBuilder::new()
+            .add_values::<_, raw::Packed<raw::Int32>>(&self.samples, num(1))?
+            .add_values::<_, raw::Packed<raw::Sint64>>(&self.deltas, num(2))?
+            .add_values::<_, raw::Packed<raw::Fixed64>>(&self.timestamps, num(3))?
+            .add_fields(&self.unknown_fields)
+            .map(LengthBuilder::build)
+    }
+    fn write_to<T: Output>(&self, output: &mut CodedWriter<T>) -> write::Result {
+        output.write_values::<_, raw::Packed<raw::Int32>>(&self.samples, num(1))?;
+        output.write_values::<_, raw::Packed<raw::Sint64>>(&self.deltas, num(2))?;
+        output.write_values::<_, raw::Packed<raw::Fixed64>>(&self.timestamps, num(3))?;
+        output.write_fields(&self.unknown_fields)
+    }
+    fn write_reverse(&self, output: &mut ReverseWriter) -> write::Result {
+        output.write_fields(&self.unknown_fields)?;
+        output.write_values::<_, raw::Packed<raw::Fixed64>>(&self.timestamps, num(3))?;
+        output.write_values::<_, raw::Packed<raw::Sint64>>(&self.deltas, num(2))?;
+        output.write_values::<_, raw::Packed<raw::Int32>>(&self.samples, num(1))?;
+        Ok(())
+    }
+    fn is_initialized(&self) -> bool {
+        true
+    }
+    fn unknown_fields(&self) -> &UnknownFieldSet {
+        &self.unknown_fields
+    }
+    fn unknown_fields_mut(&mut self) -> &mut UnknownFieldSet {
+        &mut self.unknown_fields
+    }
+}
+
+#[derive(Default, Clone, Debug, PartialEq)]
+struct Nested {
+    depth: i32,
+    child: RepeatedField<Nested>,
+    unknown_fields: UnknownFieldSet,
+}
+
+impl Message for Nested {
+    fn merge_from<T: Input>(&mut self, input: &mut CodedReader<T>) -> read::Result<()> {
+        while let Some(field) = input.read_field()? {
+            match field.tag() {
+                8 => field.merge_value::<raw::Int32>(num(1), &mut self.depth)?,
+                18 => field.add_entries_to::<_, raw::Message<Nested>>(num(2), &mut self.child)?,
+                _ => field.check_and_try_add_field_to(&mut self.unknown_fields)?.or_skip()?,
+            }
+        }
+        Ok(())
+    }
+    fn clear(&mut self) {
+        self.depth = 0;
+        self.child.clear();
+        self.unknown_fields.clear();
+    }
+    fn calculate_size(&self) -> Option<Length> {
+        LengthBuilder::new()
+            .add_field::<raw::Int32>(num(1), &self.depth)?
+            .add_values::<_, raw::Message<Nested>>(&self.child, num(2))?
+            .add_fields(&self.unknown_fields)
+            .map(LengthBuilder::build)
+    }
+    fn write_to<T: Output>(&self, output: &mut CodedWriter<T>) -> write::Result {
+        output.write_field::<raw::Int32>(num(1), &self.depth)?;
+        output.write_values::<_, raw::Message<Nested>>(&self.child, num(2))?;
+        output.write_fields(&self.unknown_fields)
+    }
+    fn write_reverse(&self, output: &mut ReverseWriter) -> write::Result {
+        output.write_fields(&self.unknown_fields)?;
+        output.write_values::<_, raw::Message<Nested>>(&self.child, num(2))?;
+        output.write_field::<raw::Int32>(num(1), &self.depth)?;
+        Ok(())
+    }
+    fn is_initialized(&self) -> bool {
+        true
+    }
+    fn unknown_fields(&self) -> &UnknownFieldSet {
+        &self.unknown_fields
+    }
+    fn unknown_fields_mut(&mut self) -> &mut UnknownFieldSet {
+        &mut self.unknown_fields
+    }
+}
+
+#[derive(Default, Clone, Debug, PartialEq)]
+struct CachedNested {
+    depth: i32,
+    child: RepeatedField<CachedNested>,
+    cached_size: CachedSize,
+    unknown_fields: UnknownFieldSet,
+}
+
+impl Message for CachedNested {
+    fn merge_from<T: Input>(&mut self, input: &mut CodedReader<T>) -> read::Result<()> {
+        while let Some(field) = input.read_field()? {
+            match field.tag() {
+                8 => field.merge_value::<raw::Int32>(num(1), &mut self.depth)?,
+                18 => field.add_entries_to::<_, raw::Message<CachedNested>>(num(2), &mut self.child)?,
+                _ => field.check_and_try_add_field_to(&mut self.unknown_fields)?.or_skip()?,
+            }
+        }
+        Ok(())
+    }
+    fn clear(&mut self) {
+        self.depth = 0;
+        self.child.clear();
+        self.unknown_fields.clear();
+    }
+    fn calculate_size(&self) -> Option<Length> {
+        LengthBuilder::new()
+            .add_field::<raw::Int32>(num(1), &self.depth)?
+            .add_values::<_, raw::Message<CachedNested>>(&self.child, num(2))?
+            .add_fields(&self.unknown_fields)
+            .map(LengthBuilder::build)
+    }
+    fn compute_and_cache_size(&self) -> Option<Length> {
+        let size = self.calculate_size()?;
+        self.cached_size.set(size);
+        Some(size)
+    }
+    fn cached_size(&self) -> Option<Length> {
+        Some(self.cached_size.get())
+    }
+    fn write_to<T: Output>(&self, output: &mut CodedWriter<T>) -> write::Result {
+        output.write_field::<raw::Int32>(num(1), &self.depth)?;
+        output.write_values::<_, raw::Message<CachedNested>>(&self.child, num(2))?;
+        output.write_fields(&self.unknown_fields)
+    }
+    fn write_reverse(&self, output: &mut ReverseWriter) -> write::Result {
+        output.write_fields(&self.unknown_fields)?;
+        output.write_values::<_, raw::Message<CachedNested>>(&self.child, num(2))?;
+        output.write_field::<raw::Int32>(num(1), &self.depth)?;
+        Ok(())
+    }
+    fn is_initialized(&self) -> bool {
+        true
+    }
+    fn unknown_fields(&self) -> &UnknownFieldSet {
+        &self.unknown_fields
+    }
+    fn unknown_fields_mut(&mut self) -> &mut UnknownFieldSet {
+        &mut self.unknown_fields
+    }
+}
+
+#[derive(Default, Clone, Debug, PartialEq)]
+struct Unknown {
+    unknown_fields: UnknownFieldSet,
+}
+
+impl Message for Unknown {
+    fn merge_from<T: Input>(&mut self, input: &mut CodedReader<T>) -> read::Result<()> {
+        while let Some(field) = input.read_field()? {
+            field.check_and_try_add_field_to(&mut self.unknown_fields)?.or_skip()?;
+        }
+        Ok(())
+    }
+    fn clear(&mut self) {
+        self.unknown_fields.clear();
+    }
+    fn calculate_size(&self) -> Option<Length> {
+        Length::of_fields(&self.unknown_fields)
+    }
+    fn write_to<T: Output>(&self, output: &mut CodedWriter<T>) -> write::Result {
+        output.write_fields(&self.unknown_fields)
+    }
+    fn write_reverse(&self, output: &mut ReverseWriter) -> write::Result {
+        output.write_fields(&self.unknown_fields)
+    }
+    fn is_initialized(&self) -> bool {
+        true
+    }
+    fn unknown_fields(&self) -> &UnknownFieldSet {
+        &self.unknown_fields
+    }
+    fn unknown_fields_mut(&mut self) -> &mut UnknownFieldSet {
+        &mut self.unknown_fields
+    }
+}
+
+#[derive(Default, Clone, Debug, PartialEq)]
+struct Extended {
+    extensions: ExtensionSet<Extended>,
+    unknown_fields: UnknownFieldSet,
+}
+
+impl ExtendableMessage for Extended {
+    fn extensions(&self) -> &ExtensionSet<Self> {
+        &self.extensions
+    }
+    fn extensions_mut(&mut self) -> &mut ExtensionSet<Self> {
+        &mut self.extensions
+    }
+}
+
+impl Message for Extended {
+    fn merge_from<T: Input>(&mut self, input: &mut CodedReader<T>) -> read::Result<()> {
+        self.extensions.replace_registry(input.registry());
+        while let Some(field) = input.read_field()? {
+            field.check_and_try_add_field_to(&mut self.extensions)?
+                .or_try(&mut self.unknown_fields)?
+                .or_skip()?;
+        }
+        Ok(())
+    }
+    fn clear(&mut self) {
+        self.extensions.clear();
+        self.unknown_fields.clear();
+    }
+    fn calculate_size(&self) -> Option<Length> {
+        LengthBuilder::new()
+            .add_fields(&self.extensions)?
+            .add_fields(&self.unknown_fields)
+            .map(LengthBuilder::build)
+    }
+    fn write_to<T: Output>(&self, output: &mut CodedWriter<T>) -> write::Result {
+        output.write_fields(&self.extensions)?;
+        output.write_fields(&self.unknown_fields)
+    }
+    fn write_reverse(&self, output: &mut ReverseWriter) -> write::Result {
+        output.write_fields(&self.unknown_fields)?;
+        output.write_fields(&self.extensions)?;
+        Ok(())
+    }
+    fn is_initialized(&self) -> bool {
+        true
+    }
+    fn unknown_fields(&self) -> &UnknownFieldSet {
+        &self.unknown_fields
+    }
+    fn unknown_fields_mut(&mut self) -> &mut UnknownFieldSet {
+        &mut self.unknown_fields
+    }
+}
+
+#[derive(Default, Clone, Debug, PartialEq)]
+struct Entry {
+    id: i64,
+    label: String,
+    unknown_fields: UnknownFieldSet,
+}
+
+impl Mergable for Entry {
+    fn merge(&mut self, other: &Self) {
+        if other.id != 0 {
+            self.id = other.id;
+        }
+        if !other.label.is_empty() {
+            self.label = other.label.clone();
+        }
+        self.unknown_fields.merge(&other.unknown_fields);
+    }
+}
+
+impl Message for Entry {
+    fn merge_from<T: Input>(&mut self, input: &mut CodedReader<T>) -> read::Result<()> {
+        while let Some(field) = input.read_field()? {
+            match field.tag() {
+                8 => field.merge_value::<raw::Int64>(num(1), &mut self.id)?,
+                18 => field.merge_value::<raw::String>(num(2), &mut self.label)?,
+                _ => field.check_and_try_add_field_to(&mut self.unknown_fields)?.or_skip()?,
+            }
+        }
+        Ok(())
+    }
+    fn clear(&mut self) {
+        self.id = 0;
+        self.label.clear();
+        self.unknown_fields.clear();
+    }
+    fn calculate_size(&self) -> Option<Length> {
+        LengthBuilder::new()
+            .add_field::<raw::Int64>(num(1), &self.id)?
+            .add_field::<raw::String>(num(2), &self.label)?
+            .add_fields(&self.unknown_fields)
+            .map(LengthBuilder::build)
+    }
+    fn write_to<T: Output>(&self, output: &mut CodedWriter<T>) -> write::Result {
+        output.write_field::<raw::Int64>(num(1), &self.id)?;
+        output.write_field::<raw::String>(num(2), &self.label)?;
+        output.write_fields(&self.unknown_fields)
+    }
+    fn write_reverse(&self, output: &mut ReverseWriter) -> write::Result {
+        output.write_fields(&self.unknown_fields)?;
+        output.write_field::<raw::String>(num(2), &self.label)?;
+        output.write_field::<raw::Int64>(num(1), &self.id)?;
+        Ok(())
+    }
+    fn is_initialized(&self) -> bool {
+        true
+    }
+    fn unknown_fields(&self) -> &UnknownFieldSet {
+        &self.unknown_fields
+    }
+    fn unknown_fields_mut(&mut self) -> &mut UnknownFieldSet {
+        &mut self.unknown_fields
+    }
+}
+
+static EXTENSIONS: [Extension<Extended, raw::Message<Entry>>; 16] = [
+    Extension::with_no_default(num(100)), Extension::with_no_default(num(101)),
+    Extension::with_no_default(num(102)), Extension::with_no_default(num(103)),
+    Extension::with_no_default(num(104)), Extension::with_no_default(num(105)),
+    Extension::with_no_default(num(106)), Extension::with_no_default(num(107)),
+    Extension::with_no_default(num(108)), Extension::with_no_default(num(109)),
+    Extension::with_no_default(num(110)), Extension::with_no_default(num(111)),
+    Extension::with_no_default(num(112)), Extension::with_no_default(num(113)),
+    Extension::with_no_default(num(114)), Extension::with_no_default(num(115)),
+];
+
+fn registry() -> &'static ExtensionRegistry {
+    static INIT: Once = Once::new();
+    static mut REGISTRY: Option<&'static ExtensionRegistry> = None;
+
+    INIT.call_once(|| {
+        let mut builder = RegistryBuilder::new();
+        for ext in &EXTENSIONS {
+            builder = builder.add_identifier(ext).ok().expect("extension numbers are unique");
+        }
+        unsafe { REGISTRY = Some(Box::leak(Box::new(builder.build()))); }
+    });
+    unsafe { REGISTRY.expect("registry was initialized") }
+}
+
+/// A deterministic xorshift generator so the corpus is the same on every run
+struct Rng(u64);
+
+impl Rng {
+    fn next(&mut self) -> u64 {
+        self.0 ^= self.0 << 13;
+        self.0 ^= self.0 >> 7;
+        self.0 ^= self.0 << 17;
+        self.0
+    }
+}
+
+fn scalars() -> Scalars {
+    Scalars {
+        int32: -150,
+        int64: 1 << 40,
+        uint32: 300,
+        uint64: u64::max_value() / 3,
+        sint32: -2,
+        sint64: -(1 << 33),
+        fixed32: 0xdead_beef,
+        fixed64: 0x0123_4567_89ab_cdef,
+        sfixed32: -1,
+        sfixed64: i64::min_value(),
+        boolean: true,
+        unknown_fields: UnknownFieldSet::new(),
+    }
+}
+
+fn strings() -> Strings {
+    Strings {
+        name: "protrust".to_string(),
+        description: "A protobuf implementation for Rust with a focus on speed and correctness".to_string(),
+        tags: (0..16).map(|i| format!("tag-{}", i)).collect(),
+        payload: (0..4096u32).map(|i| i as u8).collect(),
+        unknown_fields: UnknownFieldSet::new(),
+    }
+}
+
+fn blobs() -> Strings {
+    Strings {
+        payload: (0..256 * 1024u32).map(|i| i as u8).collect(),
+        ..strings()
+    }
+}
+
+fn packed() -> Packed {
+    let mut rng = Rng(0x2545_f491_4f6c_dd1d);
+    Packed {
+        samples: (0..10_000).map(|_| (rng.next() >> 48) as i32 - 0x8000).collect(),
+        deltas: (0..10_000).map(|_| (rng.next() >> 40) as i64 - (1 << 23)).collect(),
+        timestamps: (0..10_000u64).map(|i| 1_577_836_800_000 + i * 250).collect(),
+        unknown_fields: UnknownFieldSet::new(),
+    }
+}
+
+fn nested(levels: i32) -> Nested {
+    (0..levels).fold(Nested::default(), |child, depth| Nested {
+        depth,
+        child: vec![child],
+        unknown_fields: UnknownFieldSet::new(),
+    })
+}
+
+fn cached_nested(levels: i32) -> CachedNested {
+    (0..levels).fold(CachedNested::default(), |child, depth| CachedNested {
+        depth,
+        child: vec![child],
+        ..CachedNested::default()
+    })
+}
+
+fn extended() -> Extended {
+    let mut message = Extended::default();
+    message.extensions.replace_registry(Some(registry()));
+    for (i, ext) in EXTENSIONS.iter().enumerate() {
+        let entry = Entry { id: i as i64 * 1_000_003, label: format!("extension value {}", i), ..Entry::default() };
+        message.extensions.field(ext).expect("registered extension").or_insert(entry);
+    }
+    message
+}
+
+fn encode<M: Message>(message: &M) -> Vec<u8> {
+    let len = message.calculate_size().expect("message fits in a length").get() as usize;
+    let mut data = vec![0; len];
+    message.write_to(&mut CodedWriter::with_slice(&mut data)).expect("message fits in its size");
+    data
+}
+
+fn read_slice<M: Message>(b: &mut Bencher, data: &[u8], options: &read::Builder) {
+    b.bytes = data.len() as u64;
+    b.iter(|| {
+        let mut message = M::default();
+        message.merge_from(&mut options.with_slice(black_box(data))).unwrap();
+        message
+    });
+}
+
+fn read_stream<M: Message>(b: &mut Bencher, data: &[u8], options: &read::Builder) {
+    b.bytes = data.len() as u64;
+    b.iter(|| {
+        let mut message = M::default();
+        message.merge_from(&mut options.with_stream(black_box(data))).unwrap();
+        message
+    });
+}
+
+fn read_any<M: Message>(b: &mut Bencher, data: &[u8], options: &read::Builder) {
+    b.bytes = data.len() as u64;
+    b.iter(|| {
+        let mut message = M::default();
+        message.merge_from(&mut options.with_slice(black_box(data)).as_any()).unwrap();
+        message
+    });
+}
+
+fn write_slice<M: Message>(b: &mut Bencher, message: &M) {
+    let mut data = encode(message);
+    b.bytes = data.len() as u64;
+    b.iter(|| {
+        let len = message.calculate_size().unwrap().get() as usize;
+        black_box(message).write_to(&mut CodedWriter::with_slice(&mut data[..len])).unwrap();
+    });
+}
+
+fn write_slice_unchecked<M: Message>(b: &mut Bencher, message: &M) {
+    let mut data = encode(message);
+    b.bytes = data.len() as u64;
+    b.iter(|| {
+        let len = message.calculate_size().unwrap().get() as usize;
+        black_box(message).write_to(&mut unsafe { CodedWriter::with_slice_unchecked(&mut data[..len]) }).unwrap();
+    });
+}
+
+fn write_stream<M: Message>(b: &mut Bencher, message: &M) {
+    let mut data = Vec::with_capacity(encode(message).len());
+    b.bytes = data.capacity() as u64;
+    b.iter(|| {
+        data.clear();
+        let mut output = CodedWriter::with_stream(&mut data);
+        black_box(message).write_to(&mut output).unwrap();
+        output.flush().unwrap();
+    });
+}
+
+fn write_vectored<M: Message>(b: &mut Bencher, message: &M) {
+    let mut data = Vec::with_capacity(encode(message).len());
+    b.bytes = data.capacity() as u64;
+    b.iter(|| {
+        data.clear();
+        let mut output = CodedWriter::with_vectored(&mut data);
+        black_box(message).write_to(&mut output).unwrap();
+        output.flush().unwrap();
+    });
+}
+
+fn write_reverse<M: Message>(b: &mut Bencher, message: &M) {
+    let mut writer = ReverseWriter::with_capacity(encode(message).len());
+    b.bytes = encode(message).len() as u64;
+    b.iter(|| {
+        writer.clear();
+        writer.write_message(black_box(message)).unwrap();
+    });
+}
+
+fn write_vec<M: Message>(b: &mut Bencher, message: &M) {
+    let mut data = Vec::with_capacity(encode(message).len());
+    b.bytes = data.capacity() as u64;
+    b.iter(|| {
+        data.clear();
+        black_box(message).write_to_vec(&mut data).unwrap();
+    });
+}
+
+fn to_bytes<M: Message>(b: &mut Bencher, message: &M) {
+    b.bytes = encode(message).len() as u64;
+    b.iter(|| black_box(message).to_bytes().unwrap());
+}
+
+macro_rules! shape {
+    ($name:ident: $t:ty = $message:expr, read $read:ty, options $options:expr) => {
+        mod $name {
+            use super::*;
+
+            fn data() -> Vec<u8> {
+                encode(&$message)
+            }
+
+            #[bench]
+            fn read_slice(b: &mut Bencher) {
+                super::read_slice::<$read>(b, &data(), &$options);
+            }
+            #[bench]
+            fn read_stream(b: &mut Bencher) {
+                super::read_stream::<$read>(b, &data(), &$options);
+            }
+            #[bench]
+            fn read_any(b: &mut Bencher) {
+                super::read_any::<$read>(b, &data(), &$options);
+            }
+            #[bench]
+            fn write_slice(b: &mut Bencher) {
+                super::write_slice::<$t>(b, &$message);
+            }
+            #[bench]
+            fn write_slice_unchecked(b: &mut Bencher) {
+                super::write_slice_unchecked::<$t>(b, &$message);
+            }
+            #[bench]
+            fn write_stream(b: &mut Bencher) {
+                super::write_stream::<$t>(b, &$message);
+            }
+            #[bench]
+            fn write_vectored(b: &mut Bencher) {
+                super::write_vectored::<$t>(b, &$message);
+            }
+            #[bench]
+            fn write_reverse(b: &mut Bencher) {
+                super::write_reverse::<$t>(b, &$message);
+            }
+            #[bench]
+            fn write_vec(b: &mut Bencher) {
+                super::write_vec::<$t>(b, &$message);
+            }
+            #[bench]
+            fn to_bytes(b: &mut Bencher) {
+                super::to_bytes::<$t>(b, &$message);
+            }
+        }
+    };
+    ($name:ident: $t:ty = $message:expr) => {
+        shape!($name: $t = $message, read $t, options read::Builder::new());
+    };
+}
+
+shape!(scalars: Scalars = scalars());
+shape!(strings: Strings = strings());
+shape!(blobs: Strings = blobs());
+shape!(packed: Packed = packed());
+shape!(nested: Nested = nested(32));
+shape!(nested_cached_8: CachedNested = cached_nested(8));
+shape!(nested_cached_32: CachedNested = cached_nested(32));
+shape!(nested_cached_96: CachedNested = cached_nested(96));
+shape!(unknown: Unknown = {
+    let mut message = Unknown::default();
+    message.merge_from(&mut CodedReader::with_slice(&encode(&scalars()))).unwrap();
+    message
+});
+shape!(unknown_raw: Unknown = {
+    let mut message = Unknown::default();
+    message.merge_from(&mut read::Builder::new().unknown_fields(UnknownFieldHandling::StoreRaw).with_slice(&encode(&scalars()))).unwrap();
+    message
+}, read Unknown, options read::Builder::new().unknown_fields(UnknownFieldHandling::StoreRaw));
+shape!(extensions: Extended = extended(), read Extended, options read::Builder::new().registry(Some(registry())));
+
+/// Writes 16 length delimited 64 KiB blobs, copying them into a stream's buffer, referencing them for one
+/// call each like a message's bytes fields, or borrowing them until the writer is flushed
+mod vectored {
+    use super::*;
+
+    fn blobs() -> Vec<Vec<u8>> {
+        (0..16u8).map(|i| vec![i; 64 * 1024]).collect()
+    }
+
+    fn len(blobs: &[Vec<u8>]) -> usize {
+        blobs.iter().map(|b| b.len() + 3).sum()
+    }
+
+    #[bench]
+    fn copied(b: &mut Bencher) {
+        let blobs = blobs();
+        let mut data = Vec::with_capacity(len(&blobs));
+        b.bytes = data.capacity() as u64;
+        b.iter(|| {
+            data.clear();
+            let mut output = CodedWriter::with_stream(&mut data);
+            for blob in &blobs {
+                output.write_length_delimited(black_box(blob)).unwrap();
+            }
+            output.flush().unwrap();
+        });
+    }
+
+    #[bench]
+    fn referenced(b: &mut Bencher) {
+        let blobs = blobs();
+        let mut data = Vec::with_capacity(len(&blobs));
+        b.bytes = data.capacity() as u64;
+        b.iter(|| {
+            data.clear();
+            let mut output = CodedWriter::with_vectored(&mut data);
+            for blob in &blobs {
+                output.write_length_delimited(black_box(blob)).unwrap();
+            }
+            output.flush().unwrap();
+        });
+    }
+
+    #[bench]
+    fn borrowed(b: &mut Bencher) {
+        let blobs = blobs();
+        let mut data = Vec::with_capacity(len(&blobs));
+        b.bytes = data.capacity() as u64;
+        b.iter(|| {
+            data.clear();
+            let mut output = CodedWriter::with_vectored(&mut data);
+            for blob in &blobs {
+                output.write_borrowed_length_delimited(black_box(blob)).unwrap();
+            }
+            output.flush().unwrap();
+        });
+    }
+}
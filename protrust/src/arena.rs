@@ -0,0 +1,800 @@
+//! Defines an arena allocator and containers that can allocate their values in it.
+//!
+//! An arena can be given to a [`CodedReader`](../io/read/struct.CodedReader.html) over a slice with
+//! [`CodedReader::with_slice_in`](../io/read/struct.CodedReader.html#method.with_slice_in). Values read into
+//! arena-aware containers with [`BorrowedValue`](../raw/trait.BorrowedValue.html) are then bump allocated from
+//! large chunks owned by the arena instead of from the global allocator. The containers borrow the arena, and its
+//! chunks are freed in one go when it's dropped.
+//!
+//! An arena is only used from one thread at a time, so allocating from it doesn't need any synchronization.
+//! Each thread reading messages should use its own arena. The containers can't be sent between threads either,
+//! since they can allocate from the arena they borrow.
+//!
+//! Containers created without an arena allocate from the global allocator, so they can be used
+//! in generated code whether or not a message is read with an arena.
+//!
+//! # Examples
+//!
+//! ```
+//! use protrust::arena::{Arena, ArenaBytes};
+//! use protrust::io::CodedReader;
+//!
+//! let arena = Arena::new();
+//! let data = [3, 1, 2, 3];
+//! let mut reader = CodedReader::with_slice_in(&data, &arena);
+//!
+//! let value = reader.read_arena_bytes()?;
+//! assert_eq!(value.as_ref(), &[1, 2, 3]);
+//! assert!(value.is_in_arena());
+//! # Ok::<(), protrust::io::read::Error>(())
+//! ```
+
+use crate::io::ByteString;
+use std::alloc::{self, Layout};
+use std::borrow::Borrow;
+use std::cell::{Cell, RefCell};
+use std::cmp;
+use std::fmt::{self, Debug, Formatter};
+use std::hash::{Hash, Hasher};
+use std::iter::FromIterator;
+use std::marker::PhantomData;
+use std::mem;
+use std::ops::{Deref, DerefMut};
+use std::ptr::{self, NonNull};
+use std::slice;
+
+const DEFAULT_CHUNK_SIZE: usize = 4096;
+const MAX_CHUNK_SIZE: usize = 1024 * 1024;
+const CHUNK_ALIGN: usize = 16;
+
+/// A bump allocator. Containers allocated in the arena borrow it, and all its memory is freed when it's dropped.
+///
+/// Memory allocated in the arena is never reused until the arena is dropped. The arena can be moved to another
+/// thread, but it can't be shared between threads.
+pub struct Arena {
+    /// The next free byte in the current chunk
+    position: Cell<usize>,
+    /// The end of the current chunk
+    end: Cell<usize>,
+    /// The size of the next chunk to allocate
+    next_size: Cell<usize>,
+    /// Every chunk allocated by the arena
+    chunks: RefCell<Vec<(NonNull<u8>, Layout)>>,
+}
+
+// the chunks are only reachable through borrows of the arena, which can't be sent with it
+unsafe impl Send for Arena { }
+
+impl Arena {
+    /// Creates a new arena with the default initial chunk size
+    pub fn new() -> Self {
+        Self::with_chunk_size(DEFAULT_CHUNK_SIZE)
+    }
+    /// Creates a new arena that allocates a first chunk of the specified size when it's first used.
+    /// Chunks double in size as more are allocated, up to 1 MiB.
+    pub fn with_chunk_size(size: usize) -> Self {
+        Arena {
+            position: Cell::new(0),
+            end: Cell::new(0),
+            next_size: Cell::new(cmp::max(size, 1)),
+            chunks: RefCell::new(Vec::new()),
+        }
+    }
+    /// Returns the number of bytes in all the chunks allocated by the arena
+    pub fn allocated_bytes(&self) -> usize {
+        self.chunks.borrow().iter().map(|(_, layout)| layout.size()).sum()
+    }
+
+    /// Allocates memory for the layout. The memory lives as long as the arena.
+    #[inline]
+    fn alloc(&self, layout: Layout) -> NonNull<u8> {
+        if layout.size() == 0 {
+            return unsafe { NonNull::new_unchecked(layout.align() as *mut u8) };
+        }
+        let start = match self.position.get().checked_add(layout.align() - 1) {
+            Some(p) => p & !(layout.align() - 1),
+            None => usize::max_value(),
+        };
+        match start.checked_add(layout.size()) {
+            Some(end) if end <= self.end.get() => {
+                self.position.set(end);
+                unsafe { NonNull::new_unchecked(start as *mut u8) }
+            },
+            _ => self.alloc_chunk(layout),
+        }
+    }
+    #[cold]
+    fn alloc_chunk(&self, layout: Layout) -> NonNull<u8> {
+        let align = cmp::max(layout.align(), CHUNK_ALIGN);
+        let size = cmp::max(self.next_size.get(), layout.size());
+        let chunk_layout = Layout::from_size_align(size, align).expect("arena chunk size overflow");
+        let chunk = match NonNull::new(unsafe { alloc::alloc(chunk_layout) }) {
+            Some(chunk) => chunk,
+            None => alloc::handle_alloc_error(chunk_layout),
+        };
+        self.chunks.borrow_mut().push((chunk, chunk_layout));
+        self.next_size.set(cmp::min(self.next_size.get().saturating_mul(2), MAX_CHUNK_SIZE));
+
+        let start = chunk.as_ptr() as usize;
+        let end = start + size;
+        // only switch to the new chunk if it has more room left than the current one,
+        // since large values get their own chunk
+        if end - (start + layout.size()) >= self.end.get() - self.position.get() {
+            self.position.set(start + layout.size());
+            self.end.set(end);
+        }
+        chunk
+    }
+    fn alloc_array<T>(&self, len: usize) -> NonNull<T> {
+        let size = mem::size_of::<T>().checked_mul(len).expect("capacity overflow");
+        let layout = Layout::from_size_align(size, mem::align_of::<T>()).expect("capacity overflow");
+        self.alloc(layout).cast()
+    }
+}
+
+impl Drop for Arena {
+    fn drop(&mut self) {
+        for &(chunk, layout) in self.chunks.get_mut().iter() {
+            unsafe { alloc::dealloc(chunk.as_ptr(), layout); }
+        }
+    }
+}
+
+impl Default for Arena {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+impl Debug for Arena {
+    fn fmt(&self, f: &mut Formatter) -> fmt::Result {
+        f.debug_struct("Arena")
+            .field("allocated_bytes", &self.allocated_bytes())
+            .finish()
+    }
+}
+
+/// A value allocated in an arena, or on the heap if the box was created without one.
+pub struct ArenaBox<'a, T> {
+    ptr: NonNull<T>,
+    arena: Option<&'a Arena>,
+    _value: PhantomData<T>,
+}
+
+impl<'a, T> ArenaBox<'a, T> {
+    /// Allocates the value on the heap
+    pub fn new(value: T) -> Self {
+        let ptr = unsafe { NonNull::new_unchecked(Box::into_raw(Box::new(value))) };
+        Self { ptr, arena: None, _value: PhantomData }
+    }
+    /// Allocates the value in the specified arena
+    pub fn new_in(value: T, arena: &'a Arena) -> Self {
+        let ptr = arena.alloc_array::<T>(1);
+        unsafe { ptr::write(ptr.as_ptr(), value); }
+        Self { ptr, arena: Some(arena), _value: PhantomData }
+    }
+    /// Allocates the value in the arena if one is specified, or on the heap if not
+    pub fn new_maybe_in(value: T, arena: Option<&'a Arena>) -> Self {
+        match arena {
+            Some(arena) => Self::new_in(value, arena),
+            None => Self::new(value),
+        }
+    }
+    /// Gets the arena the value is allocated in
+    pub fn arena(&self) -> Option<&'a Arena> {
+        self.arena
+    }
+}
+
+impl<T> Drop for ArenaBox<'_, T> {
+    fn drop(&mut self) {
+        unsafe {
+            match self.arena {
+                Some(_) => ptr::drop_in_place(self.ptr.as_ptr()),
+                None => drop(Box::from_raw(self.ptr.as_ptr())),
+            }
+        }
+    }
+}
+
+impl<T> Deref for ArenaBox<'_, T> {
+    type Target = T;
+
+    fn deref(&self) -> &T {
+        unsafe { self.ptr.as_ref() }
+    }
+}
+
+impl<T> DerefMut for ArenaBox<'_, T> {
+    fn deref_mut(&mut self) -> &mut T {
+        unsafe { self.ptr.as_mut() }
+    }
+}
+
+impl<T: Default> Default for ArenaBox<'_, T> {
+    fn default() -> Self {
+        Self::new(T::default())
+    }
+}
+
+impl<T: Clone> Clone for ArenaBox<'_, T> {
+    /// Clones the value into the same arena as this value
+    fn clone(&self) -> Self {
+        Self::new_maybe_in(T::clone(self), self.arena())
+    }
+}
+
+impl<T: PartialEq> PartialEq for ArenaBox<'_, T> {
+    fn eq(&self, other: &Self) -> bool {
+        T::eq(self, other)
+    }
+}
+
+impl<T: Eq> Eq for ArenaBox<'_, T> { }
+
+impl<T: Debug> Debug for ArenaBox<'_, T> {
+    fn fmt(&self, f: &mut Formatter) -> fmt::Result {
+        T::fmt(self, f)
+    }
+}
+
+/// A string of bytes allocated in an arena, or on the heap if it was created without one.
+pub struct ArenaBytes<'a> {
+    ptr: NonNull<u8>,
+    len: usize,
+    arena: Option<&'a Arena>,
+}
+
+impl<'a> ArenaBytes<'a> {
+    /// Creates a new empty string of bytes
+    pub fn new() -> Self {
+        Self::from(Vec::new())
+    }
+    /// Creates a new zeroed string of bytes of the specified length in the arena if one is specified,
+    /// or on the heap if not
+    pub fn zeroed_in(len: usize, arena: Option<&'a Arena>) -> Self {
+        match arena {
+            Some(arena) => {
+                let ptr = arena.alloc_array::<u8>(len);
+                unsafe { ptr::write_bytes(ptr.as_ptr(), 0, len); }
+                Self { ptr, len, arena: Some(arena) }
+            },
+            None => Self::from(vec![0; len]),
+        }
+    }
+    /// Copies the bytes into the specified arena
+    pub fn copy_in(value: &[u8], arena: &'a Arena) -> Self {
+        let ptr = arena.alloc_array::<u8>(value.len());
+        unsafe { ptr::copy_nonoverlapping(value.as_ptr(), ptr.as_ptr(), value.len()); }
+        Self { ptr, len: value.len(), arena: Some(arena) }
+    }
+    /// Returns whether the bytes are allocated in an arena
+    pub fn is_in_arena(&self) -> bool {
+        self.arena.is_some()
+    }
+}
+
+impl Drop for ArenaBytes<'_> {
+    fn drop(&mut self) {
+        if self.arena.is_none() {
+            unsafe { drop(Box::from_raw(slice::from_raw_parts_mut(self.ptr.as_ptr(), self.len))); }
+        }
+    }
+}
+
+impl From<Vec<u8>> for ArenaBytes<'_> {
+    fn from(value: Vec<u8>) -> Self {
+        let len = value.len();
+        let ptr = Box::into_raw(value.into_boxed_slice()) as *mut u8;
+        Self { ptr: unsafe { NonNull::new_unchecked(ptr) }, len, arena: None }
+    }
+}
+
+impl From<&[u8]> for ArenaBytes<'_> {
+    fn from(value: &[u8]) -> Self {
+        Self::from(value.to_vec())
+    }
+}
+
+impl Default for ArenaBytes<'_> {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+impl Clone for ArenaBytes<'_> {
+    /// Clones the bytes into the same arena as this value
+    fn clone(&self) -> Self {
+        match self.arena {
+            Some(arena) => Self::copy_in(self, arena),
+            None => Self::from(self.as_ref()),
+        }
+    }
+}
+
+impl Deref for ArenaBytes<'_> {
+    type Target = [u8];
+
+    fn deref(&self) -> &[u8] {
+        unsafe { slice::from_raw_parts(self.ptr.as_ptr(), self.len) }
+    }
+}
+
+impl DerefMut for ArenaBytes<'_> {
+    fn deref_mut(&mut self) -> &mut [u8] {
+        unsafe { slice::from_raw_parts_mut(self.ptr.as_ptr(), self.len) }
+    }
+}
+
+impl AsRef<[u8]> for ArenaBytes<'_> {
+    fn as_ref(&self) -> &[u8] {
+        self
+    }
+}
+
+impl AsMut<[u8]> for ArenaBytes<'_> {
+    fn as_mut(&mut self) -> &mut [u8] {
+        self
+    }
+}
+
+impl Borrow<[u8]> for ArenaBytes<'_> {
+    fn borrow(&self) -> &[u8] {
+        self
+    }
+}
+
+impl PartialEq for ArenaBytes<'_> {
+    fn eq(&self, other: &Self) -> bool {
+        self.as_ref() == other.as_ref()
+    }
+}
+
+impl Eq for ArenaBytes<'_> { }
+
+impl Hash for ArenaBytes<'_> {
+    fn hash<H: Hasher>(&self, state: &mut H) {
+        self.as_ref().hash(state)
+    }
+}
+
+impl Debug for ArenaBytes<'_> {
+    fn fmt(&self, f: &mut Formatter) -> fmt::Result {
+        f.debug_list().entries(self.iter()).finish()
+    }
+}
+
+impl ByteString for ArenaBytes<'_> {
+    fn new(len: usize) -> Self {
+        Self::zeroed_in(len, None)
+    }
+    fn from_slice(value: &[u8]) -> Self {
+        Self::from(value)
+    }
+}
+
+enum Storage<'a, T> {
+    Heap(Vec<T>),
+    Arena {
+        ptr: NonNull<T>,
+        len: usize,
+        cap: usize,
+        arena: &'a Arena,
+    },
+}
+
+/// A growable list of values allocated in an arena, or on the heap if the list was created without one.
+///
+/// Growing a list in an arena allocates a larger buffer in the arena and leaves the
+/// old buffer unused until the arena is freed.
+pub struct ArenaVec<'a, T> {
+    storage: Storage<'a, T>,
+    _values: PhantomData<T>,
+}
+
+impl<'a, T> ArenaVec<'a, T> {
+    /// Creates a new empty list on the heap
+    pub fn new() -> Self {
+        Self::from(Vec::new())
+    }
+    /// Creates a new empty list in the specified arena
+    pub fn new_in(arena: &'a Arena) -> Self {
+        let cap = if mem::size_of::<T>() == 0 { usize::max_value() } else { 0 };
+        Self { storage: Storage::Arena { ptr: NonNull::dangling(), len: 0, cap, arena }, _values: PhantomData }
+    }
+    /// Gets the arena the list allocates in
+    pub fn arena(&self) -> Option<&'a Arena> {
+        match self.storage {
+            Storage::Heap(_) => None,
+            Storage::Arena { arena, .. } => Some(arena),
+        }
+    }
+    /// Moves the list into the arena if it's empty and on the heap.
+    /// Lists that already contain values or are already in an arena are not moved.
+    pub fn use_arena(&mut self, arena: &'a Arena) {
+        if let Storage::Heap(v) = &self.storage {
+            if v.capacity() == 0 {
+                *self = Self::new_in(arena);
+            }
+        }
+    }
+    /// Returns the number of values the list can hold without reallocating
+    pub fn capacity(&self) -> usize {
+        match &self.storage {
+            Storage::Heap(v) => v.capacity(),
+            Storage::Arena { cap, .. } => *cap,
+        }
+    }
+    /// Appends a value to the end of the list
+    pub fn push(&mut self, value: T) {
+        match &mut self.storage {
+            Storage::Heap(v) => v.push(value),
+            Storage::Arena { ptr, len, cap, arena } => {
+                if *len == *cap {
+                    let new_cap = cmp::max(cap.checked_mul(2).expect("capacity overflow"), 4);
+                    let new_ptr = arena.alloc_array::<T>(new_cap);
+                    unsafe { ptr::copy_nonoverlapping(ptr.as_ptr(), new_ptr.as_ptr(), *len); }
+                    *ptr = new_ptr;
+                    *cap = new_cap;
+                }
+                unsafe { ptr::write(ptr.as_ptr().add(*len), value); }
+                *len += 1;
+            }
+        }
+    }
+    /// Removes the last value from the list and returns it, or None if the list is empty
+    pub fn pop(&mut self) -> Option<T> {
+        match &mut self.storage {
+            Storage::Heap(v) => v.pop(),
+            Storage::Arena { ptr, len, .. } => {
+                if *len == 0 {
+                    None
+                } else {
+                    *len -= 1;
+                    Some(unsafe { ptr::read(ptr.as_ptr().add(*len)) })
+                }
+            }
+        }
+    }
+    /// Removes all values from the list, keeping its capacity
+    pub fn clear(&mut self) {
+        match &mut self.storage {
+            Storage::Heap(v) => v.clear(),
+            Storage::Arena { ptr, len, .. } => {
+                let values: *mut [T] = unsafe { slice::from_raw_parts_mut(ptr.as_ptr(), *len) };
+                *len = 0;
+                unsafe { ptr::drop_in_place(values); }
+            }
+        }
+    }
+}
+
+impl<T> Drop for ArenaVec<'_, T> {
+    fn drop(&mut self) {
+        if let Storage::Arena { .. } = self.storage {
+            self.clear();
+        }
+    }
+}
+
+impl<T> Deref for ArenaVec<'_, T> {
+    type Target = [T];
+
+    fn deref(&self) -> &[T] {
+        match &self.storage {
+            Storage::Heap(v) => v,
+            Storage::Arena { ptr, len, .. } => unsafe { slice::from_raw_parts(ptr.as_ptr(), *len) },
+        }
+    }
+}
+
+impl<T> DerefMut for ArenaVec<'_, T> {
+    fn deref_mut(&mut self) -> &mut [T] {
+        match &mut self.storage {
+            Storage::Heap(v) => v,
+            Storage::Arena { ptr, len, .. } => unsafe { slice::from_raw_parts_mut(ptr.as_ptr(), *len) },
+        }
+    }
+}
+
+impl<T> Default for ArenaVec<'_, T> {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+impl<T: Clone> Clone for ArenaVec<'_, T> {
+    /// Clones the list into the same arena as this list
+    fn clone(&self) -> Self {
+        let mut clone = match self.arena() {
+            Some(arena) => Self::new_in(arena),
+            None => Self::new(),
+        };
+        clone.extend(self.iter().cloned());
+        clone
+    }
+}
+
+impl<T> Extend<T> for ArenaVec<'_, T> {
+    fn extend<I: IntoIterator<Item = T>>(&mut self, iter: I) {
+        for value in iter {
+            self.push(value);
+        }
+    }
+}
+
+impl<T> FromIterator<T> for ArenaVec<'_, T> {
+    fn from_iter<I: IntoIterator<Item = T>>(iter: I) -> Self {
+        Self::from(Vec::from_iter(iter))
+    }
+}
+
+impl<T> From<Vec<T>> for ArenaVec<'_, T> {
+    fn from(value: Vec<T>) -> Self {
+        Self { storage: Storage::Heap(value), _values: PhantomData }
+    }
+}
+
+impl<'a, T> IntoIterator for &'a ArenaVec<'_, T> {
+    type Item = &'a T;
+    type IntoIter = slice::Iter<'a, T>;
+
+    fn into_iter(self) -> Self::IntoIter {
+        self.iter()
+    }
+}
+
+impl<'a, T> IntoIterator for &'a mut ArenaVec<'_, T> {
+    type Item = &'a mut T;
+    type IntoIter = slice::IterMut<'a, T>;
+
+    fn into_iter(self) -> Self::IntoIter {
+        self.iter_mut()
+    }
+}
+
+impl<T: PartialEq> PartialEq for ArenaVec<'_, T> {
+    fn eq(&self, other: &Self) -> bool {
+        <[T]>::eq(&**self, &**other)
+    }
+}
+
+impl<T: Eq> Eq for ArenaVec<'_, T> { }
+
+impl<T: Debug> Debug for ArenaVec<'_, T> {
+    fn fmt(&self, f: &mut Formatter) -> fmt::Result {
+        <[T]>::fmt(self, f)
+    }
+}
+
+#[cfg(test)]
+mod test {
+    use super::{Arena, ArenaBox, ArenaBytes, ArenaVec};
+    use std::ptr;
+    use std::rc::Rc;
+    use std::thread;
+
+    #[test]
+    fn allocations_share_chunks() {
+        let arena = Arena::with_chunk_size(64);
+        let a = ArenaBox::new_in(1u64, &arena);
+        let b = ArenaBox::new_in(2u64, &arena);
+        assert_eq!((*a, *b), (1, 2));
+        assert_eq!(arena.allocated_bytes(), 64);
+    }
+
+    #[test]
+    fn allocations_are_aligned() {
+        let arena = Arena::new();
+        let _byte = ArenaBytes::copy_in(&[1], &arena);
+        let value = ArenaBox::new_in(5u128, &arena);
+        assert_eq!(&*value as *const u128 as usize % std::mem::align_of::<u128>(), 0);
+    }
+
+    #[test]
+    fn large_allocation_gets_own_chunk() {
+        let arena = Arena::with_chunk_size(16);
+        let small = ArenaBytes::copy_in(&[1; 8], &arena);
+        let large = ArenaBytes::copy_in(&[2; 100], &arena);
+        let next = ArenaBytes::copy_in(&[3; 8], &arena);
+        assert_eq!(small.as_ref(), &[1; 8]);
+        assert_eq!(large.as_ref(), &[2; 100][..]);
+        assert_eq!(next.as_ref(), &[3; 8]);
+    }
+
+    #[test]
+    fn vec_grows_in_arena() {
+        let arena = Arena::new();
+        let mut values = ArenaVec::new_in(&arena);
+        for i in 0..100 {
+            values.push(i);
+        }
+        assert_eq!(values.len(), 100);
+        assert!(values.iter().copied().eq(0..100));
+        assert_eq!(values.pop(), Some(99));
+        assert!(ptr::eq(values.arena().unwrap(), &arena));
+    }
+
+    #[test]
+    fn arena_moves_between_threads() {
+        let arena = Arena::with_chunk_size(64);
+        drop(ArenaBytes::copy_in(&[1, 2, 3], &arena));
+        let arena = thread::spawn(move || {
+            let value = ArenaBytes::copy_in(&[4, 5, 6], &arena);
+            assert_eq!(value.as_ref(), &[4, 5, 6]);
+            drop(value);
+            arena
+        }).join().unwrap();
+        // the second value fit in the first chunk
+        assert_eq!(arena.allocated_bytes(), 64);
+    }
+
+    #[test]
+    fn drops_values() {
+        let counter = Rc::new(());
+        let arena = Arena::new();
+        let mut values = ArenaVec::new_in(&arena);
+        for _ in 0..10 {
+            values.push(counter.clone());
+        }
+        let boxed = ArenaBox::new_in(counter.clone(), &arena);
+        assert_eq!(Rc::strong_count(&counter), 12);
+        drop(values);
+        drop(boxed);
+        assert_eq!(Rc::strong_count(&counter), 1);
+    }
+
+    #[test]
+    fn clone_stays_in_arena() {
+        let arena = Arena::new();
+        let mut values = ArenaVec::new_in(&arena);
+        values.push(ArenaBytes::copy_in(&[1], &arena));
+        let clone = values.clone();
+        assert_eq!(clone, values);
+        assert!(clone.arena().is_some());
+        assert!(clone[0].is_in_arena());
+    }
+
+    mod message {
+        use crate::{BorrowedMessage, Message, UnknownFieldSet};
+        use crate::arena::{Arena, ArenaBox, ArenaBytes, ArenaVec};
+        use crate::io::{read, write, CodedReader, CodedWriter, FieldNumber, Input, Length, LengthBuilder, Output};
+        use crate::raw;
+        use std::ptr;
+
+        #[derive(Default, Clone, Debug, PartialEq)]
+        struct Request<'a> {
+            data: ArenaBytes<'a>,
+            children: ArenaVec<'a, Request<'a>>,
+            parent: Option<ArenaBox<'a, Request<'a>>>,
+            unknown_fields: UnknownFieldSet,
+        }
+
+        impl Request<'_> {
+            const DATA_NUMBER: FieldNumber = unsafe { FieldNumber::new_unchecked(1) };
+            const CHILDREN_NUMBER: FieldNumber = unsafe { FieldNumber::new_unchecked(2) };
+            const PARENT_NUMBER: FieldNumber = unsafe { FieldNumber::new_unchecked(3) };
+        }
+
+        impl Message for Request<'_> {
+            fn merge_from<T: Input>(&mut self, input: &mut CodedReader<T>) -> read::Result<()> {
+                while let Some(field) = input.read_field()? {
+                    match field.tag() {
+                        10 => field.merge_value::<raw::Bytes<ArenaBytes>>(Self::DATA_NUMBER, &mut self.data)?,
+                        18 => field.add_entries_to::<_, raw::Message<Request>>(Self::CHILDREN_NUMBER, &mut self.children)?,
+                        26 => match &mut self.parent {
+                            Some(parent) => field.merge_value::<raw::InArena<raw::Message<Request>>>(Self::PARENT_NUMBER, parent)?,
+                            None => self.parent = Some(field.read_value::<raw::InArena<raw::Message<Request>>>(Self::PARENT_NUMBER)?),
+                        },
+                        _ => field.check_and_try_add_field_to(&mut self.unknown_fields)?.or_skip()?,
+                    }
+                }
+                Ok(())
+            }
+            fn calculate_size(&self) -> Option<Length> {
+                let mut builder = LengthBuilder::new();
+                if !self.data.is_empty() {
+                    builder = builder.add_field::<raw::Bytes<ArenaBytes>>(Self::DATA_NUMBER, &self.data)?;
+                }
+                builder = builder.add_values::<_, raw::Message<Request>>(&self.children, Self::CHILDREN_NUMBER)?;
+                if let Some(parent) = &self.parent {
+                    builder = builder.add_field::<raw::InArena<raw::Message<Request>>>(Self::PARENT_NUMBER, parent)?;
+                }
+                Some(builder.add_fields(&self.unknown_fields)?.build())
+            }
+            fn write_to<T: Output>(&self, output: &mut CodedWriter<T>) -> write::Result {
+                if !self.data.is_empty() {
+                    output.write_field::<raw::Bytes<ArenaBytes>>(Self::DATA_NUMBER, &self.data)?;
+                }
+                output.write_values::<_, raw::Message<Request>>(&self.children, Self::CHILDREN_NUMBER)?;
+                if let Some(parent) = &self.parent {
+                    output.write_field::<raw::InArena<raw::Message<Request>>>(Self::PARENT_NUMBER, parent)?;
+                }
+                output.write_fields(&self.unknown_fields)
+            }
+            fn is_initialized(&self) -> bool {
+                true
+            }
+            fn unknown_fields(&self) -> &UnknownFieldSet {
+                &self.unknown_fields
+            }
+            fn unknown_fields_mut(&mut self) -> &mut UnknownFieldSet {
+                &mut self.unknown_fields
+            }
+        }
+
+        impl<'a> BorrowedMessage<'a> for Request<'a> {
+            fn merge_from_slice<A: read::SliceArena<'a>>(&mut self, input: &mut CodedReader<read::Slice<'a, A>>) -> read::Result<()> {
+                while let Some(field) = input.read_field()? {
+                    match field.tag() {
+                        10 => field.merge_borrowed_value::<raw::Bytes<ArenaBytes>>(Self::DATA_NUMBER, &mut self.data)?,
+                        18 => field.add_borrowed_entries_to::<_, raw::Message<Request>>(Self::CHILDREN_NUMBER, &mut self.children)?,
+                        26 => match &mut self.parent {
+                            Some(parent) => field.merge_borrowed_value::<raw::InArena<raw::Message<Request>>>(Self::PARENT_NUMBER, parent)?,
+                            None => self.parent = Some(field.read_borrowed_value::<raw::InArena<raw::Message<Request>>>(Self::PARENT_NUMBER)?),
+                        },
+                        _ => field.check_and_try_add_field_to(&mut self.unknown_fields)?.or_skip()?,
+                    }
+                }
+                Ok(())
+            }
+        }
+
+        // data: [1, 2], children: [{ data: [3] }, { data: [4] }], parent: { data: [5] }
+        const INPUT: [u8; 19] = [10, 2, 1, 2, 18, 3, 10, 1, 3, 18, 3, 10, 1, 4, 26, 3, 10, 1, 5];
+
+        #[test]
+        fn read_into_arena() {
+            let arena = Arena::new();
+            let mut reader = CodedReader::with_slice_in(&INPUT, &arena);
+            let mut request = Request::default();
+            request.merge_from_slice(&mut reader).expect("input is valid protobuf data");
+
+            assert_eq!(request.data.as_ref(), &[1, 2]);
+            assert!(request.data.is_in_arena());
+            assert!(ptr::eq(request.children.arena().unwrap(), &arena));
+            assert_eq!(request.children.len(), 2);
+            assert_eq!(request.children[0].data.as_ref(), &[3]);
+            assert_eq!(request.children[1].data.as_ref(), &[4]);
+            assert!(request.children.iter().all(|c| c.data.is_in_arena()));
+            let parent = request.parent.as_ref().unwrap();
+            assert!(ptr::eq(parent.arena().unwrap(), &arena));
+            assert_eq!(parent.data.as_ref(), &[5]);
+            assert!(parent.data.is_in_arena());
+
+            let mut output = [0u8; 19];
+            assert_eq!(request.calculate_size(), Length::new(19));
+            request.write_to(&mut CodedWriter::with_slice(&mut output)).expect("size calculated ahead of time");
+            assert_eq!(output, INPUT);
+        }
+
+        #[test]
+        fn read_without_arena() {
+            let mut reader = CodedReader::with_slice(&INPUT);
+            let mut request = Request::default();
+            request.merge_from(&mut reader).expect("input is valid protobuf data");
+
+            assert!(!request.data.is_in_arena());
+            assert!(request.children.arena().is_none());
+            assert!(request.parent.as_ref().unwrap().arena().is_none());
+            assert_eq!(request.children[1].data.as_ref(), &[4]);
+
+            // borrowed reads without an arena also use the heap
+            let mut borrowed = Request::default();
+            borrowed.merge_from_slice(&mut CodedReader::with_slice(&INPUT)).expect("input is valid protobuf data");
+            assert_eq!(borrowed, request);
+            assert!(!borrowed.data.is_in_arena());
+            assert!(borrowed.children.arena().is_none());
+        }
+    }
+
+    #[test]
+    fn heap_fallback() {
+        let mut values = ArenaVec::new();
+        values.push(1);
+        assert!(values.arena().is_none());
+        assert_eq!(&*values, &[1]);
+        assert!(!ArenaBytes::from(vec![1]).is_in_arena());
+        assert!(ArenaBox::new(1).arena().is_none());
+    }
+}
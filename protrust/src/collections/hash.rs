@@ -0,0 +1,148 @@
+//! Defines a fast hasher for map fields.
+//!
+//! Map fields use the standard library's SipHash by default. A map field can opt into the small multiplicative hasher
+//! here with `MapField<K, V, BuildMapHasher>`, which is much faster for the short strings and integers used as map keys.
+//! Each builder starts its hashers from a random seed, but the hash isn't keyed the way SipHash is and isn't resistant
+//! to collision attacks, so it should only be used for maps read from trusted sources.
+
+use std::collections::hash_map::RandomState;
+use std::convert::TryInto;
+use std::hash::{BuildHasher, Hasher};
+
+/// The state for building [`MapHasher`](struct.MapHasher.html)s in a map field, holding a random seed
+#[derive(Clone, Debug)]
+pub struct BuildMapHasher {
+    seed: u64,
+}
+
+impl BuildMapHasher {
+    /// Creates a new builder with a random seed
+    pub fn new() -> Self {
+        Self { seed: RandomState::new().build_hasher().finish() }
+    }
+}
+
+impl Default for BuildMapHasher {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+impl BuildHasher for BuildMapHasher {
+    type Hasher = MapHasher;
+
+    #[inline]
+    fn build_hasher(&self) -> MapHasher {
+        MapHasher { hash: self.seed }
+    }
+}
+
+const SEED: u64 = 0x51_7c_c1_b7_27_22_0a_95;
+
+/// A fast non-cryptographic hasher for map field keys, hashing a word of input at a time.
+#[derive(Default, Clone, Copy, Debug)]
+pub struct MapHasher {
+    hash: u64,
+}
+
+impl MapHasher {
+    #[inline]
+    fn add(&mut self, word: u64) {
+        self.hash = (self.hash.rotate_left(5) ^ word).wrapping_mul(SEED);
+    }
+}
+
+impl Hasher for MapHasher {
+    #[inline]
+    fn write(&mut self, mut bytes: &[u8]) {
+        while bytes.len() >= 8 {
+            self.add(u64::from_le_bytes(bytes[..8].try_into().unwrap()));
+            bytes = &bytes[8..];
+        }
+        if bytes.len() >= 4 {
+            self.add(u64::from(u32::from_le_bytes(bytes[..4].try_into().unwrap())));
+            bytes = &bytes[4..];
+        }
+        for &byte in bytes {
+            self.add(u64::from(byte));
+        }
+    }
+    #[inline]
+    fn write_u8(&mut self, i: u8) {
+        self.add(u64::from(i));
+    }
+    #[inline]
+    fn write_u16(&mut self, i: u16) {
+        self.add(u64::from(i));
+    }
+    #[inline]
+    fn write_u32(&mut self, i: u32) {
+        self.add(u64::from(i));
+    }
+    #[inline]
+    fn write_u64(&mut self, i: u64) {
+        self.add(i);
+    }
+    #[inline]
+    fn write_usize(&mut self, i: usize) {
+        self.add(i as u64);
+    }
+    #[inline]
+    fn finish(&self) -> u64 {
+        self.hash
+    }
+}
+
+#[cfg(test)]
+mod test {
+    use std::hash::{BuildHasher, Hash, Hasher};
+    use super::{BuildMapHasher, MapHasher};
+
+    thread_local! {
+        static STATE: BuildMapHasher = BuildMapHasher::new();
+    }
+
+    fn hash<T: Hash + ?Sized>(value: &T) -> u64 {
+        STATE.with(|state| hash_with(state, value))
+    }
+
+    fn hash_with<T: Hash + ?Sized>(state: &BuildMapHasher, value: &T) -> u64 {
+        let mut hasher = state.build_hasher();
+        value.hash(&mut hasher);
+        hasher.finish()
+    }
+
+    #[test]
+    fn deterministic() {
+        assert_eq!(hash("config.key"), hash(&String::from("config.key")));
+        assert_eq!(hash(&5u32), hash(&5u32));
+
+        let state = BuildMapHasher::new();
+        assert_eq!(hash_with(&state, "config.key"), hash_with(&state.clone(), "config.key"));
+    }
+
+    #[test]
+    fn seeded_per_builder() {
+        // two builders agreeing on every key would mean the seed isn't used
+        let (a, b) = (BuildMapHasher::new(), BuildMapHasher::new());
+        assert!((0..8).any(|i| hash_with(&a, &i) != hash_with(&b, &i)));
+    }
+
+    #[test]
+    fn distinguishes_tails() {
+        // keys that differ only past the last full word or in their length still hash differently
+        assert_ne!(hash("abcdefghi"), hash("abcdefghj"));
+        assert_ne!(hash("abcdefgh"), hash("abcdefgh\0"));
+        assert_ne!(hash(&[0u8; 3][..]), hash(&[0u8; 4][..]));
+    }
+
+    #[test]
+    fn few_collisions() {
+        let hashes = (0..10_000).map(|i| hash(&format!("key-{}", i))).collect::<std::collections::HashSet<_>>();
+        assert_eq!(hashes.len(), 10_000);
+
+        let mut hasher = MapHasher::default();
+        hasher.write(&[]);
+        assert_eq!(hasher.finish(), 0);
+    }
+}
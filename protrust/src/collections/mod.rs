@@ -1,11 +1,19 @@
 //! Defines collection types used by generated code for repeated and map fields
 
 use crate::{Mergable, internal::Sealed};
-use crate::io::{self, read, write, WireType, FieldNumber, Tag, LengthBuilder, Length, CodedReader, CodedWriter, Input, Output};
-use crate::raw::{self, Value, Packable, Packed};
+use crate::arena::ArenaVec;
+use crate::io::{self, read, write, reverse::ReverseWriter, WireType, FieldNumber, Tag, LengthBuilder, Length, CodedReader, CodedWriter, Input, Output};
+use crate::raw::{self, BorrowedValue, Value, Packable, Packed};
+use self::packed::{PackedRead, PackedWrite};
+use self::parallel::{RepeatedRead, RepeatedWrite, PackedFieldWrite};
+use std::collections::HashMap;
+use std::collections::hash_map::RandomState;
 use std::convert::TryInto;
-use std::hash::Hash;
+use std::hash::{BuildHasher, Hash};
 
+pub mod hash;
+mod packed;
+mod parallel;
 pub mod unknown_fields;
 
 /// A type of value that writes and reads repeated values on the wire, a common trait unifying repeated and map fields.
@@ -19,10 +27,19 @@ pub trait RepeatedValue<T>: Sealed {
     fn calculate_size(&self, builder: LengthBuilder, num: FieldNumber) -> Option<LengthBuilder>;
     /// Writes the value to the coded writer. This takes a field number to build the tag required for each field.
     fn write_to<U: Output>(&self, output: &mut CodedWriter<U>, num: FieldNumber) -> write::Result;
+    /// Writes the value back to front to the reverse writer, starting with the last value in the field.
+    fn write_reverse(&self, output: &mut ReverseWriter, num: FieldNumber) -> write::Result;
     /// Returns a bool indicating whether all the values in the field are initialized
     fn is_initialized(&self) -> bool;
 }
 
+/// A repeated value that can borrow data from the input of a [`CodedReader`](../io/read/struct.CodedReader.html)
+/// reading from a slice, and allocate its values in the reader's arena.
+pub trait BorrowedRepeatedValue<'a, T>: RepeatedValue<T> {
+    /// Adds entries to the repeated field from the coded reader, borrowing from the input slice where the values support it.
+    fn add_borrowed_entries_from<A: read::SliceArena<'a>>(&mut self, input: &mut CodedReader<read::Slice<'a, A>>) -> read::Result<()>;
+}
+
 /// A set of fields. This unifies unknown fields, extension fields, and any other future field set types
 pub trait FieldSet: Sealed {
     /// Checks if the set can read the field from the input and reads it if it can. It returns a state indicating if the field was read.
@@ -31,6 +48,8 @@ pub trait FieldSet: Sealed {
     fn calculate_size(&self, builder: LengthBuilder) -> Option<LengthBuilder>;
     /// Writes the fields in this set to the writer
     fn write_to<T: Output>(&self, output: &mut CodedWriter<T>) -> write::Result;
+    /// Writes the fields in this set back to front to the reverse writer
+    fn write_reverse(&self, output: &mut ReverseWriter) -> write::Result;
     /// Returns if all the fields in this set are initialized
     fn is_initialized(&self) -> bool;
 }
@@ -72,48 +91,19 @@ impl<V: Value> RepeatedValue<V> for RepeatedField<V::Inner> {
 
     #[inline]
     fn add_entries_from<T: Input>(&mut self, input: &mut CodedReader<T>) -> read::Result<()> {
-        input.read_value::<V>().map(|v| self.push(v))
+        <V as RepeatedRead>::read_repeated_into(self, input)
     }
     #[inline]
     fn calculate_size(&self, builder: LengthBuilder, num: FieldNumber) -> Option<LengthBuilder> {
-        if self.is_empty() {
-            return Some(builder);
-        }
-
-        let len: i32 = self.len().try_into().ok()?;
-
-        let tag = Tag::new(num, V::WIRE_TYPE);
-        let tag_len = io::raw_varint32_size(tag.get());
-        let tags_len = unsafe { 
-            Length::new_unchecked(
-                if cfg!(feature = "checked_size") {
-                    tag_len.get().checked_mul(len)?
-                } else {
-                    tag_len.get() * len
-                }
-            )
-        };
-        let builder = builder.add_bytes(tags_len)?;
-        let builder = 
-            // for groups we can add the tags length again for the end tags
-            if V::WIRE_TYPE == WireType::StartGroup {
-                builder.add_bytes(tags_len)?
-            } else {
-                builder
-            };
-        <Self as ValuesSize<V>>::calculate_size(self, builder)
+        repeated_size::<V>(self, builder, num)
     }
     #[inline]
     fn write_to<T: Output>(&self, output: &mut CodedWriter<T>, num: FieldNumber) -> write::Result {
-        if self.is_empty() {
-            return Ok(());
-        }
-
-        for value in self {
-            output.write_field::<V>(num, value)?;
-        }
-
-        Ok(())
+        write_repeated::<V, T>(self, output, num)
+    }
+    #[inline]
+    fn write_reverse(&self, output: &mut ReverseWriter, num: FieldNumber) -> write::Result {
+        write_repeated_reverse::<V>(self, output, num)
     }
     fn is_initialized(&self) -> bool {
         self.iter().all(V::is_initialized)
@@ -124,63 +114,203 @@ impl<V: Value + Packable> RepeatedValue<Packed<V>> for RepeatedField<V::Inner> {
 
     #[inline]
     fn add_entries_from<T: Input>(&mut self, input: &mut CodedReader<T>) -> read::Result<()> {
-        input.read_limit()?.for_all(|input| input.read_value::<V>().map(|v| self.push(v)))
+        <V as PackedRead>::read_packed_into(self, input)
     }
     #[inline]
     fn calculate_size(&self, builder: LengthBuilder, num: FieldNumber) -> Option<LengthBuilder> {
-        if self.is_empty() {
-            return Some(builder);
-        }
+        packed_size::<V>(self, builder, num)
+    }
+    #[inline]
+    fn write_to<T: Output>(&self, output: &mut CodedWriter<T>, num: FieldNumber) -> write::Result {
+        write_packed::<V, T>(self, output, num)
+    }
+    #[inline]
+    fn write_reverse(&self, output: &mut ReverseWriter, num: FieldNumber) -> write::Result {
+        write_packed_reverse::<V>(self, output, num)
+    }
+    fn is_initialized(&self) -> bool {
+        self.iter().all(V::is_initialized)
+    }
+}
+impl<'a, V: BorrowedValue<'a>> BorrowedRepeatedValue<'a, V> for RepeatedField<V::Inner> {
+    #[inline]
+    fn add_borrowed_entries_from<A: read::SliceArena<'a>>(&mut self, input: &mut CodedReader<read::Slice<'a, A>>) -> read::Result<()> {
+        input.read_borrowed_value::<V>().map(|v| self.push(v))
+    }
+}
+impl<'a, V: Value + Packable> BorrowedRepeatedValue<'a, Packed<V>> for RepeatedField<V::Inner> {
+    #[inline]
+    fn add_borrowed_entries_from<A: read::SliceArena<'a>>(&mut self, input: &mut CodedReader<read::Slice<'a, A>>) -> read::Result<()> {
+        <Self as RepeatedValue<Packed<V>>>::add_entries_from(self, input)
+    }
+}
+impl<V: Clone> Mergable for RepeatedField<V> {
+    /// Merges two repeated fields by extending this field with the elements of the other
+    fn merge(&mut self, other: &Self) {
+        self.extend(other.iter().cloned())
+    }
+}
 
-        let len = <Self as ValuesSize<V>>::calculate_size(self, LengthBuilder::new())?.build();
+impl<T> Sealed for ArenaVec<'_, T> { }
+impl<V: Value> RepeatedValue<V> for ArenaVec<'_, V::Inner> {
+    const WIRE_TYPE: WireType = V::WIRE_TYPE;
 
-        builder
-            .add_tag(Tag::new(num, WireType::LengthDelimited))?
-            .add_value::<raw::Uint32>(&(len.get() as u32))?
-            .add_bytes(len)
+    #[inline]
+    fn add_entries_from<T: Input>(&mut self, input: &mut CodedReader<T>) -> read::Result<()> {
+        input.read_value::<V>().map(|v| self.push(v))
+    }
+    #[inline]
+    fn calculate_size(&self, builder: LengthBuilder, num: FieldNumber) -> Option<LengthBuilder> {
+        repeated_size::<V>(self, builder, num)
     }
     #[inline]
     fn write_to<T: Output>(&self, output: &mut CodedWriter<T>, num: FieldNumber) -> write::Result {
-        if self.is_empty() {
-            return Ok(());
-        }
-
-        let len = 
-            <Self as ValuesSize<V>>::calculate_size(self, LengthBuilder::new())
-                .ok_or(write::Error::ValueTooLarge)?
-                .build();
+        write_repeated::<V, T>(self, output, num)
+    }
+    #[inline]
+    fn write_reverse(&self, output: &mut ReverseWriter, num: FieldNumber) -> write::Result {
+        write_repeated_reverse::<V>(self, output, num)
+    }
+    fn is_initialized(&self) -> bool {
+        self.iter().all(V::is_initialized)
+    }
+}
+impl<V: Value + Packable> RepeatedValue<Packed<V>> for ArenaVec<'_, V::Inner> {
+    const WIRE_TYPE: WireType = WireType::LengthDelimited;
 
-        output.write_tag(Tag::new(num, WireType::LengthDelimited))?;
-        output.write_length(len)?;
-        for value in self {
-            output.write_value::<V>(value)?;
-        }
-        Ok(())
+    #[inline]
+    fn add_entries_from<T: Input>(&mut self, input: &mut CodedReader<T>) -> read::Result<()> {
+        input.read_limit()?.for_all(|input| input.read_value::<V>().map(|v| self.push(v)))
+    }
+    #[inline]
+    fn calculate_size(&self, builder: LengthBuilder, num: FieldNumber) -> Option<LengthBuilder> {
+        packed_size::<V>(self, builder, num)
+    }
+    #[inline]
+    fn write_to<T: Output>(&self, output: &mut CodedWriter<T>, num: FieldNumber) -> write::Result {
+        write_packed::<V, T>(self, output, num)
+    }
+    #[inline]
+    fn write_reverse(&self, output: &mut ReverseWriter, num: FieldNumber) -> write::Result {
+        write_packed_reverse::<V>(self, output, num)
     }
     fn is_initialized(&self) -> bool {
         self.iter().all(V::is_initialized)
     }
 }
-impl<V: Clone> Mergable for RepeatedField<V> {
+impl<'a, V: BorrowedValue<'a>> BorrowedRepeatedValue<'a, V> for ArenaVec<'a, V::Inner> {
+    #[inline]
+    fn add_borrowed_entries_from<A: read::SliceArena<'a>>(&mut self, input: &mut CodedReader<read::Slice<'a, A>>) -> read::Result<()> {
+        if let Some(arena) = input.arena() {
+            self.use_arena(arena);
+        }
+        input.read_borrowed_value::<V>().map(|v| self.push(v))
+    }
+}
+impl<'a, V: Value + Packable> BorrowedRepeatedValue<'a, Packed<V>> for ArenaVec<'a, V::Inner> {
+    #[inline]
+    fn add_borrowed_entries_from<A: read::SliceArena<'a>>(&mut self, input: &mut CodedReader<read::Slice<'a, A>>) -> read::Result<()> {
+        if let Some(arena) = input.arena() {
+            self.use_arena(arena);
+        }
+        <Self as RepeatedValue<Packed<V>>>::add_entries_from(self, input)
+    }
+}
+impl<V: Clone> Mergable for ArenaVec<'_, V> {
     /// Merges two repeated fields by extending this field with the elements of the other
     fn merge(&mut self, other: &Self) {
         self.extend(other.iter().cloned())
     }
 }
 
+fn repeated_size<V: Value>(values: &[V::Inner], builder: LengthBuilder, num: FieldNumber) -> Option<LengthBuilder> {
+    if values.is_empty() {
+        return Some(builder);
+    }
+
+    let len: i32 = values.len().try_into().ok()?;
+
+    let tag = Tag::new(num, V::WIRE_TYPE);
+    let tag_len = io::raw_varint32_size(tag.get());
+    let tags_len = unsafe { 
+        Length::new_unchecked(
+            if cfg!(feature = "checked_size") {
+                tag_len.get().checked_mul(len)?
+            } else {
+                tag_len.get() * len
+            }
+        )
+    };
+    let builder = builder.add_bytes(tags_len)?;
+    let builder = 
+        // for groups we can add the tags length again for the end tags
+        if V::WIRE_TYPE == WireType::StartGroup {
+            builder.add_bytes(tags_len)?
+        } else {
+            builder
+        };
+    <[V::Inner] as ValuesSize<V>>::calculate_size(values, builder)
+}
+
+fn write_repeated<V: Value, T: Output>(values: &[V::Inner], output: &mut CodedWriter<T>, num: FieldNumber) -> write::Result {
+    <V as RepeatedWrite>::write_repeated(values, output, num)
+}
+
+fn write_repeated_reverse<V: Value>(values: &[V::Inner], output: &mut ReverseWriter, num: FieldNumber) -> write::Result {
+    for value in values.iter().rev() {
+        output.write_field::<V>(num, value)?;
+    }
+
+    Ok(())
+}
+
+fn packed_size<V: Value + Packable>(values: &[V::Inner], builder: LengthBuilder, num: FieldNumber) -> Option<LengthBuilder> {
+    if values.is_empty() {
+        return Some(builder);
+    }
+
+    let len = <[V::Inner] as ValuesSize<V>>::calculate_size(values, LengthBuilder::new())?.build();
+
+    builder
+        .add_tag(Tag::new(num, WireType::LengthDelimited))?
+        .add_value::<raw::Uint32>(&(len.get() as u32))?
+        .add_bytes(len)
+}
+
+fn write_packed<V: Value + Packable, T: Output>(values: &[V::Inner], output: &mut CodedWriter<T>, num: FieldNumber) -> write::Result {
+    if values.is_empty() {
+        return Ok(());
+    }
+
+    <V as PackedFieldWrite>::write_packed_field(values, output, num)
+}
+
+fn write_packed_reverse<V: Value + Packable>(values: &[V::Inner], output: &mut ReverseWriter, num: FieldNumber) -> write::Result {
+    if values.is_empty() {
+        return Ok(());
+    }
+
+    output.write_length_delimited_with(|output| <V as PackedWrite>::write_packed_reverse(values, output))?;
+    output.write_tag(Tag::new(num, WireType::LengthDelimited))
+}
+
 /// The type used by generated code to represent a map field.
-pub type MapField<K, V> = std::collections::HashMap<K, V>;
+/// 
+/// Map fields hash their keys with the standard library's randomly keyed SipHash by default. Maps that only hold trusted
+/// keys can use the faster [`BuildMapHasher`](hash/struct.BuildMapHasher.html) in its place with the third parameter.
+pub type MapField<K, V, S = RandomState> = HashMap<K, V, S>;
 
 const KEY_FIELD: FieldNumber = unsafe { FieldNumber::new_unchecked(1) };
 const VALUE_FIELD: FieldNumber = unsafe { FieldNumber::new_unchecked(2) };
 
-impl<K, V> Sealed for MapField<K, V> { }
-impl<K, V> RepeatedValue<(K, V)> for MapField<K::Inner, V::Inner>
+impl<K, V, S> Sealed for MapField<K, V, S> { }
+impl<K, V, S> RepeatedValue<(K, V)> for MapField<K::Inner, V::Inner, S>
     where 
         K: Value,
         K::Inner: Default + Eq + Hash,
         V: Value,
-        V::Inner: Default
+        V::Inner: Default,
+        S: BuildHasher
 {
     const WIRE_TYPE: WireType = WireType::LengthDelimited;
     
@@ -188,9 +318,18 @@ impl<K, V> RepeatedValue<(K, V)> for MapField<K::Inner, V::Inner>
         let key_tag = Tag::new(KEY_FIELD, K::WIRE_TYPE);
         let value_tag = Tag::new(VALUE_FIELD, V::WIRE_TYPE);
 
+        if self.is_empty() {
+            // entries come one at a time, so reserve space for the rest of the run in the buffer up front
+            if let Some(tag) = input.last_tag() {
+                let (tag, tag_len) = parallel::encode_tag(tag.get());
+                self.reserve(parallel::scan(input.buffered(), &tag[..tag_len]).count());
+            }
+        }
+
         let mut key = None::<K::Inner>;
         let mut value = None::<V::Inner>;
-        input.read_limit()?.then(|input| {
+        // the entry's key and value fields aren't fields of the projected message, so they're never projected
+        input.read_limit()?.then(|input| input.read_unprojected(|input| {
             while let Some(field) = input.read_field()? {
                 match field.tag() {
                     k if k == key_tag.get() => field.and_then(key_tag, |input| input.read_value::<K>().map(|k| key = Some(k))),
@@ -199,7 +338,7 @@ impl<K, V> RepeatedValue<(K, V)> for MapField<K::Inner, V::Inner>
                 }?
             }
             Ok(())
-        })?;
+        }))?;
         self.insert(key.unwrap_or_default(), value.unwrap_or_default());
 
         Ok(())
@@ -241,8 +380,8 @@ impl<K, V> RepeatedValue<(K, V)> for MapField<K::Inner, V::Inner>
             let length = 
                 LengthBuilder::new()
                     .add_bytes(unsafe { Length::new_unchecked(2) }).ok_or(write::Error::ValueTooLarge)?
-                    .add_value::<K>(key).ok_or(write::Error::ValueTooLarge)?
-                    .add_value::<V>(value).ok_or(write::Error::ValueTooLarge)?
+                    .add_cached_value::<K>(key).ok_or(write::Error::ValueTooLarge)?
+                    .add_cached_value::<V>(value).ok_or(write::Error::ValueTooLarge)?
                     .build();
             output.write_length(length)?;
             output.write_tag(Tag::new(KEY_FIELD, K::WIRE_TYPE))?;
@@ -253,15 +392,28 @@ impl<K, V> RepeatedValue<(K, V)> for MapField<K::Inner, V::Inner>
 
         Ok(())
     }
+    fn write_reverse(&self, output: &mut ReverseWriter, num: FieldNumber) -> write::Result {
+        let tag = Tag::new(num, WireType::LengthDelimited);
+        for (key, value) in self {
+            output.write_length_delimited_with(|output| {
+                output.write_field::<V>(VALUE_FIELD, value)?;
+                output.write_field::<K>(KEY_FIELD, key)
+            })?;
+            output.write_tag(tag)?;
+        }
+
+        Ok(())
+    }
     fn is_initialized(&self) -> bool {
         self.values().all(V::is_initialized)
     }
 }
 
-impl<K, V> Mergable for std::collections::HashMap<K, V>
+impl<K, V, S> Mergable for HashMap<K, V, S>
     where
         K: Clone + Eq + Hash,
-        V: Clone + Mergable
+        V: Clone + Mergable,
+        S: BuildHasher
 {
     fn merge(&mut self, other: &Self) {
         for (k, v) in other {
@@ -277,7 +429,7 @@ trait ValuesSize<T> {
     fn calculate_size(&self, builder: LengthBuilder) -> Option<LengthBuilder>;
 }
 
-impl<V> ValuesSize<V> for RepeatedField<V::Inner>
+impl<V> ValuesSize<V> for [V::Inner]
     where V: Value
 {
     default fn calculate_size(&self, mut builder: LengthBuilder) -> Option<LengthBuilder> {
@@ -288,10 +440,10 @@ impl<V> ValuesSize<V> for RepeatedField<V::Inner>
     }
 }
 
-impl<V> ValuesSize<V> for RepeatedField<V::Inner>
+impl<V> ValuesSize<V> for [V::Inner]
     where V: raw::ConstSized
 {
-    fn calculate_size(&self, builder: LengthBuilder) -> Option<LengthBuilder> {
+    default fn calculate_size(&self, builder: LengthBuilder) -> Option<LengthBuilder> {
         let size = V::SIZE;
         let len: i32 = self.len().try_into().ok()?;
 
@@ -303,4 +455,50 @@ impl<V> ValuesSize<V> for RepeatedField<V::Inner>
             }
         })
     }
-}
\ No newline at end of file
+}
+#[cfg(test)]
+mod test {
+    use crate::io::{CodedReader, CodedWriter, FieldNumber};
+    use crate::raw;
+    use super::{hash::BuildMapHasher, MapField, RepeatedValue};
+
+    const NUM: FieldNumber = unsafe { FieldNumber::new_unchecked(4) };
+
+    fn read<M: RepeatedValue<(raw::String, raw::String)> + Default>(data: &[u8]) -> M {
+        let mut map = M::default();
+        let mut reader = CodedReader::with_slice(data);
+        while let Some(field) = reader.read_field().unwrap() {
+            field.add_entries_to(NUM, &mut map).unwrap();
+        }
+        map
+    }
+
+    #[test]
+    fn map_round_trip() {
+        let map = (0..5000).map(|i| (format!("key-{}", i), format!("value-{}", i))).collect::<MapField<_, _>>();
+        let mut data = Vec::new();
+        CodedWriter::with_vec(&mut data).write_values::<_, (raw::String, raw::String)>(&map, NUM).unwrap();
+
+        let read_map: MapField<String, String> = read(&data);
+        assert_eq!(read_map, map);
+        assert!(read_map.capacity() >= map.len());
+
+        let fast_map: MapField<String, String, BuildMapHasher> = read(&data);
+        assert_eq!(fast_map.len(), map.len());
+        assert!(fast_map.iter().all(|(k, v)| map.get(k) == Some(v)));
+    }
+
+    #[test]
+    fn map_entry_fields() {
+        // a value before its key, a missing key, and a repeated key that replaces the earlier value
+        let data = [
+            34, 6, 18, 1, b'x', 10, 1, b'a',
+            34, 3, 18, 1, b'y',
+            34, 6, 10, 1, b'a', 18, 1, b'z',
+        ];
+        let map: MapField<String, String> = read(&data);
+        assert_eq!(map.len(), 2);
+        assert_eq!(map["a"], "z");
+        assert_eq!(map[""], "y");
+    }
+}
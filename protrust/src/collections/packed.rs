@@ -0,0 +1,429 @@
+//! Bulk readers and writers for packed repeated fields.
+//!
+//! Instead of reading and pushing one element at a time, packed runs of fixed size values are copied
+//! out of the reader's buffer with a single reserve and copy on little endian targets, and packed runs
+//! of varints reserve space for every varint in the buffer before decoding them with the branchless
+//! varint decoder. Elements split across the end of a stream's buffer are read one at a time,
+//! which refills the buffer for the next bulk read.
+//!
+//! Writing goes through the slice writers on [`CodedWriter`](../../io/write/struct.CodedWriter.html),
+//! and varint sizes are summed with the branchless size calculation instead of being added to a builder one by one.
+//! Writing back to front copies runs of fixed size values to the reverse writer the same way.
+
+use crate::io::{read, write, reverse::ReverseWriter, varint, CodedReader, CodedWriter, Input, Output, Length, LengthBuilder};
+use crate::raw::{self, Packable};
+use std::convert::TryFrom;
+use std::{mem, ptr, slice};
+use super::ValuesSize;
+
+/// A packable value that can read a packed run of values into a vector.
+pub trait PackedRead: Packable {
+    /// Reads a length delimited packed run of values, adding them to the end of the vector
+    fn read_packed_into<T: Input>(values: &mut Vec<Self::Inner>, input: &mut CodedReader<T>) -> read::Result<()>;
+}
+
+impl<V: Packable> PackedRead for V {
+    default fn read_packed_into<T: Input>(values: &mut Vec<Self::Inner>, input: &mut CodedReader<T>) -> read::Result<()> {
+        input.read_limit()?.for_all(|input| input.read_value::<V>().map(|v| values.push(v)))
+    }
+}
+
+macro_rules! fixed {
+    ($($t:ty),*) => {
+        $(
+            #[cfg(target_endian = "little")]
+            impl PackedRead for $t {
+                fn read_packed_into<T: Input>(values: &mut Vec<Self::Inner>, input: &mut CodedReader<T>) -> read::Result<()> {
+                    read_fixed::<$t, T>(values, input)
+                }
+            }
+        )*
+    };
+}
+
+fixed!(raw::Fixed32, raw::Fixed64, raw::Sfixed32, raw::Sfixed64);
+
+macro_rules! varints {
+    ($($t:ty => $convert:expr),*) => {
+        $(
+            impl PackedRead for $t {
+                fn read_packed_into<T: Input>(values: &mut Vec<Self::Inner>, input: &mut CodedReader<T>) -> read::Result<()> {
+                    read_varints::<$t, T, _>(values, input, $convert)
+                }
+            }
+        )*
+    };
+}
+
+varints! {
+    raw::Int32 => |v| v as i32,
+    raw::Uint32 => |v| v as u32,
+    raw::Int64 => |v| v as i64,
+    raw::Uint64 => |v| v,
+    raw::Sint32 => |v| { let v = v as u32; (v >> 1) as i32 ^ -((v & 1) as i32) },
+    raw::Sint64 => |v| (v >> 1) as i64 ^ -((v & 1) as i64),
+    raw::Bool => |v| v != 0
+}
+
+impl<E: crate::Enum> PackedRead for raw::Enum<E> {
+    fn read_packed_into<T: Input>(values: &mut Vec<E>, input: &mut CodedReader<T>) -> read::Result<()> {
+        read_varints::<Self, T, _>(values, input, |v| E::from(v as i32))
+    }
+}
+
+/// A packable value that can write a slice of values as a packed run.
+pub trait PackedWrite: Packable {
+    /// Writes the values in the slice without a tag or length
+    fn write_packed_values<T: Output>(values: &[Self::Inner], output: &mut CodedWriter<T>) -> write::Result;
+    /// Writes the values in the slice back to front without a tag or length
+    fn write_packed_reverse(values: &[Self::Inner], output: &mut ReverseWriter) -> write::Result;
+}
+
+impl<V: Packable> PackedWrite for V {
+    default fn write_packed_values<T: Output>(values: &[Self::Inner], output: &mut CodedWriter<T>) -> write::Result {
+        values.iter().try_for_each(|value| output.write_value::<V>(value))
+    }
+    default fn write_packed_reverse(values: &[Self::Inner], output: &mut ReverseWriter) -> write::Result {
+        values.iter().rev().try_for_each(|value| output.write_value::<V>(value))
+    }
+}
+
+impl PackedWrite for raw::Fixed32 {
+    fn write_packed_values<T: Output>(values: &[u32], output: &mut CodedWriter<T>) -> write::Result {
+        output.write_fixed32_slice(values)
+    }
+    fn write_packed_reverse(values: &[u32], output: &mut ReverseWriter) -> write::Result {
+        output.write_fixed32_slice(values)
+    }
+}
+
+impl PackedWrite for raw::Fixed64 {
+    fn write_packed_values<T: Output>(values: &[u64], output: &mut CodedWriter<T>) -> write::Result {
+        output.write_fixed64_slice(values)
+    }
+    fn write_packed_reverse(values: &[u64], output: &mut ReverseWriter) -> write::Result {
+        output.write_fixed64_slice(values)
+    }
+}
+
+impl PackedWrite for raw::Sfixed32 {
+    fn write_packed_values<T: Output>(values: &[i32], output: &mut CodedWriter<T>) -> write::Result {
+        output.write_fixed32_slice(unsafe { slice::from_raw_parts(values.as_ptr() as *const u32, values.len()) })
+    }
+    fn write_packed_reverse(values: &[i32], output: &mut ReverseWriter) -> write::Result {
+        output.write_fixed32_slice(unsafe { slice::from_raw_parts(values.as_ptr() as *const u32, values.len()) })
+    }
+}
+
+impl PackedWrite for raw::Sfixed64 {
+    fn write_packed_values<T: Output>(values: &[i64], output: &mut CodedWriter<T>) -> write::Result {
+        output.write_fixed64_slice(unsafe { slice::from_raw_parts(values.as_ptr() as *const u64, values.len()) })
+    }
+    fn write_packed_reverse(values: &[i64], output: &mut ReverseWriter) -> write::Result {
+        output.write_fixed64_slice(unsafe { slice::from_raw_parts(values.as_ptr() as *const u64, values.len()) })
+    }
+}
+
+impl PackedWrite for raw::Uint32 {
+    fn write_packed_values<T: Output>(values: &[u32], output: &mut CodedWriter<T>) -> write::Result {
+        output.write_varint32_slice(values)
+    }
+    fn write_packed_reverse(values: &[u32], output: &mut ReverseWriter) -> write::Result {
+        output.write_varint32_slice(values)
+    }
+}
+
+impl PackedWrite for raw::Uint64 {
+    fn write_packed_values<T: Output>(values: &[u64], output: &mut CodedWriter<T>) -> write::Result {
+        output.write_varint64_slice(values)
+    }
+    fn write_packed_reverse(values: &[u64], output: &mut ReverseWriter) -> write::Result {
+        output.write_varint64_slice(values)
+    }
+}
+
+impl PackedWrite for raw::Bool {
+    fn write_packed_values<T: Output>(values: &[bool], output: &mut CodedWriter<T>) -> write::Result {
+        // bools are always 0 or 1, which is the same as their one byte varint encoding
+        output.write_raw_bytes(unsafe { slice::from_raw_parts(values.as_ptr() as *const u8, values.len()) })
+    }
+    fn write_packed_reverse(values: &[bool], output: &mut ReverseWriter) -> write::Result {
+        // bools are always 0 or 1, which is the same as their one byte varint encoding
+        output.write_raw_bytes(unsafe { slice::from_raw_parts(values.as_ptr() as *const u8, values.len()) })
+    }
+}
+
+macro_rules! converted_varints {
+    ($($t:ty => $convert:expr),*) => {
+        $(
+            impl PackedWrite for $t {
+                fn write_packed_values<T: Output>(values: &[Self::Inner], output: &mut CodedWriter<T>) -> write::Result {
+                    write_converted_varints(values, output, $convert)
+                }
+                fn write_packed_reverse(values: &[Self::Inner], output: &mut ReverseWriter) -> write::Result {
+                    write_converted_varints_reverse(values, output, $convert)
+                }
+            }
+        )*
+    };
+}
+
+converted_varints! {
+    raw::Int32 => |v| v as i64 as u64,
+    raw::Int64 => |v| v as u64,
+    raw::Sint32 => |v| ((v << 1) ^ (v >> 31)) as u32 as u64,
+    raw::Sint64 => |v| ((v << 1) ^ (v >> 63)) as u64
+}
+
+impl<E: crate::Enum> PackedWrite for raw::Enum<E> {
+    fn write_packed_values<T: Output>(values: &[E], output: &mut CodedWriter<T>) -> write::Result {
+        write_converted_varints(values, output, |v| v.into() as i64 as u64)
+    }
+    fn write_packed_reverse(values: &[E], output: &mut ReverseWriter) -> write::Result {
+        write_converted_varints_reverse(values, output, |v| v.into() as i64 as u64)
+    }
+}
+
+/// Converts the values to their varint values in batches and writes each batch with the slice writer
+fn write_converted_varints<I: Copy, T: Output, F: Fn(I) -> u64>(values: &[I], output: &mut CodedWriter<T>, convert: F) -> write::Result {
+    let mut batch = [0u64; 64];
+    for chunk in values.chunks(batch.len()) {
+        for (converted, &value) in batch.iter_mut().zip(chunk) {
+            *converted = convert(value);
+        }
+        output.write_varint64_slice(&batch[..chunk.len()])?;
+    }
+    Ok(())
+}
+
+/// Converts the values to their varint values in batches like `write_converted_varints`, starting with the last batch
+fn write_converted_varints_reverse<I: Copy, F: Fn(I) -> u64>(values: &[I], output: &mut ReverseWriter, convert: F) -> write::Result {
+    let mut batch = [0u64; 64];
+    for chunk in values.rchunks(batch.len()) {
+        for (converted, &value) in batch.iter_mut().zip(chunk) {
+            *converted = convert(value);
+        }
+        output.write_varint64_slice(&batch[..chunk.len()])?;
+    }
+    Ok(())
+}
+
+macro_rules! varint_sizes {
+    ($($t:ty => $convert:expr),*) => {
+        $(
+            impl ValuesSize<$t> for [<$t as raw::ValueType>::Inner] {
+                fn calculate_size(&self, builder: LengthBuilder) -> Option<LengthBuilder> {
+                    add_varint_sizes(builder, self.iter().map($convert))
+                }
+            }
+        )*
+    };
+}
+
+varint_sizes! {
+    raw::Int32 => |&v| v as i64 as u64,
+    raw::Uint32 => |&v| v as u64,
+    raw::Int64 => |&v| v as u64,
+    raw::Uint64 => |&v| v,
+    raw::Sint32 => |&v| ((v << 1) ^ (v >> 31)) as u32 as u64,
+    raw::Sint64 => |&v| ((v << 1) ^ (v >> 63)) as u64
+}
+
+impl ValuesSize<raw::Bool> for [bool] {
+    fn calculate_size(&self, builder: LengthBuilder) -> Option<LengthBuilder> {
+        builder.add_bytes(Length::new(i32::try_from(self.len()).ok()?)?)
+    }
+}
+
+impl<E: crate::Enum> ValuesSize<raw::Enum<E>> for [E] {
+    fn calculate_size(&self, builder: LengthBuilder) -> Option<LengthBuilder> {
+        add_varint_sizes(builder, self.iter().map(|&v| v.into() as i64 as u64))
+    }
+}
+
+/// Sums the sizes of the varint values and adds them to the builder
+#[inline]
+fn add_varint_sizes<I: Iterator<Item = u64>>(builder: LengthBuilder, values: I) -> Option<LengthBuilder> {
+    builder.add_bytes(Length::new(i32::try_from(varint::encoded_len(values)).ok()?)?)
+}
+
+/// Reads a packed run of fixed size values whose in-memory representation is the same as their little endian encoding
+#[cfg(target_endian = "little")]
+fn read_fixed<V: Packable, T: Input>(values: &mut Vec<V::Inner>, input: &mut CodedReader<T>) -> read::Result<()> {
+    let size = mem::size_of::<V::Inner>();
+    input.read_limit()?.for_all(|input| {
+        let buffered = input.buffered();
+        let count = buffered.len() / size;
+        if count == 0 {
+            return V::read_new(input).map(|v| values.push(v));
+        }
+
+        values.reserve(count);
+        unsafe {
+            let len = values.len();
+            ptr::copy_nonoverlapping(buffered.as_ptr(), values.as_mut_ptr().add(len) as *mut u8, count * size);
+            values.set_len(len + count);
+            input.consume(count * size);
+        }
+        Ok(())
+    })
+}
+
+/// Reads a packed run of varint values, converting each decoded varint with the specified function
+fn read_varints<V: Packable, T: Input, F: Fn(u64) -> V::Inner>(values: &mut Vec<V::Inner>, input: &mut CodedReader<T>, convert: F) -> read::Result<()> {
+    input.read_limit()?.for_all(|input| {
+        let buffered = input.buffered();
+        if buffered.len() < 10 {
+            return V::read_new(input).map(|v| values.push(v));
+        }
+
+        // every varint decoded below ends on a terminator within the buffer,
+        // so this reserves space for at least as many values as we decode
+        values.reserve(varint::count_terminators(buffered));
+        let mut pos = 0;
+        let mut len = values.len();
+        let mut result = Ok(());
+        while let Some(bytes) = buffered.get(pos..pos + 10) {
+            let bytes = unsafe { &*(bytes.as_ptr() as *const [u8; 10]) };
+            match varint::decode(bytes) {
+                Some((value, used)) => {
+                    unsafe { ptr::write(values.as_mut_ptr().add(len), convert(value)); }
+                    len += 1;
+                    pos += used;
+                },
+                None => {
+                    result = Err(read::Error::MalformedVarint);
+                    break;
+                }
+            }
+        }
+        unsafe {
+            values.set_len(len);
+            input.consume(pos);
+        }
+        result
+    })
+}
+
+#[cfg(test)]
+mod test {
+    use crate::collections::{RepeatedField, RepeatedValue};
+    use crate::io::{read, reverse::ReverseWriter, CodedReader, CodedWriter, FieldNumber, Input, Length, LengthBuilder, Tag, WireType};
+    use crate::raw::{self, Packable, Packed};
+    use std::fmt::Debug;
+
+    const NUM: FieldNumber = unsafe { FieldNumber::new_unchecked(1) };
+
+    fn encode<V: Packable>(values: &[V::Inner]) -> Vec<u8>
+        where RepeatedField<V::Inner>: RepeatedValue<Packed<V>>, V::Inner: Clone
+    {
+        let values = values.to_vec();
+        let mut output = CodedWriter::with_stream(Vec::new());
+        RepeatedValue::<Packed<V>>::write_to(&values, &mut output, NUM).unwrap();
+        output.flush().unwrap();
+        output.into_inner()
+    }
+
+    fn encode_naive<V: Packable>(values: &[V::Inner]) -> Vec<u8> {
+        let mut body = CodedWriter::with_stream(Vec::new());
+        for value in values {
+            body.write_value::<V>(value).unwrap();
+        }
+        body.flush().unwrap();
+        let body = body.into_inner();
+
+        let mut output = CodedWriter::with_stream(Vec::new());
+        output.write_tag(Tag::new(NUM, WireType::LengthDelimited)).unwrap();
+        output.write_length(Length::new(body.len() as i32).unwrap()).unwrap();
+        output.write_raw_bytes(&body).unwrap();
+        output.flush().unwrap();
+        output.into_inner()
+    }
+
+    fn decode<V: Packable, T: Input>(input: &mut CodedReader<T>) -> read::Result<RepeatedField<V::Inner>>
+        where RepeatedField<V::Inner>: RepeatedValue<Packed<V>>
+    {
+        let mut values = RepeatedField::new();
+        while input.read_tag()?.is_some() {
+            RepeatedValue::<Packed<V>>::add_entries_from(&mut values, input)?;
+        }
+        Ok(values)
+    }
+
+    fn assert_roundtrip<V: Packable>(values: &[V::Inner])
+        where RepeatedField<V::Inner>: RepeatedValue<Packed<V>>, V::Inner: Clone + Debug + PartialEq
+    {
+        let data = encode::<V>(values);
+        assert_eq!(data, encode_naive::<V>(values));
+        let size = RepeatedValue::<Packed<V>>::calculate_size(&values.to_vec(), LengthBuilder::new(), NUM).unwrap().build();
+        assert_eq!(size.get() as usize, data.len());
+        for &capacity in &[0, 7, 13] {
+            let mut output = CodedWriter::with_capacity(capacity, Vec::new());
+            RepeatedValue::<Packed<V>>::write_to(&values.to_vec(), &mut output, NUM).unwrap();
+            output.flush().unwrap();
+            assert_eq!(output.into_inner(), data, "capacity {}", capacity);
+        }
+        let mut reverse = ReverseWriter::new();
+        RepeatedValue::<Packed<V>>::write_reverse(&values.to_vec(), &mut reverse, NUM).unwrap();
+        assert_eq!(reverse.as_bytes(), data.as_slice());
+
+        assert_eq!(decode::<V, _>(&mut CodedReader::with_slice(&data)).unwrap(), values);
+        assert_eq!(decode::<V, _>(&mut CodedReader::with_slice(&data).as_any()).unwrap(), values);
+        for &capacity in &[1, 7, 13, 64] {
+            assert_eq!(decode::<V, _>(&mut CodedReader::with_capacity(capacity, data.as_slice())).unwrap(), values, "capacity {}", capacity);
+        }
+    }
+
+    fn samples() -> impl Iterator<Item = u64> {
+        let mut state = 0x2545_f491_4f6c_dd1du64;
+        (0..1000u32).map(move |i| {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            state >> (i % 64)
+        })
+    }
+
+    #[test]
+    fn fixed_roundtrip() {
+        assert_roundtrip::<raw::Fixed32>(&samples().map(|v| v as u32).collect::<Vec<_>>());
+        assert_roundtrip::<raw::Fixed64>(&samples().collect::<Vec<_>>());
+        assert_roundtrip::<raw::Sfixed32>(&samples().map(|v| v as i32).collect::<Vec<_>>());
+        assert_roundtrip::<raw::Sfixed64>(&samples().map(|v| v as i64).collect::<Vec<_>>());
+    }
+
+    #[test]
+    fn varint_roundtrip() {
+        assert_roundtrip::<raw::Int32>(&samples().map(|v| v as i32).collect::<Vec<_>>());
+        assert_roundtrip::<raw::Uint32>(&samples().map(|v| v as u32).collect::<Vec<_>>());
+        assert_roundtrip::<raw::Int64>(&samples().map(|v| v as i64).collect::<Vec<_>>());
+        assert_roundtrip::<raw::Uint64>(&samples().collect::<Vec<_>>());
+        assert_roundtrip::<raw::Sint32>(&samples().map(|v| v as i32).collect::<Vec<_>>());
+        assert_roundtrip::<raw::Sint64>(&samples().map(|v| v as i64).collect::<Vec<_>>());
+        assert_roundtrip::<raw::Bool>(&samples().map(|v| v % 3 == 0).collect::<Vec<_>>());
+    }
+
+    #[test]
+    fn appends_to_existing_values() {
+        let data = [10, 3, 1, 2, 3, 10, 2, 4, 5];
+        let values = decode::<raw::Int32, _>(&mut CodedReader::with_slice(&data)).unwrap();
+        assert_eq!(values, [1, 2, 3, 4, 5]);
+    }
+
+    #[test]
+    fn truncated_fixed_fails() {
+        let data = [10, 6, 1, 0, 0, 0, 2, 0];
+        assert!(decode::<raw::Fixed32, _>(&mut CodedReader::with_slice(&data)).is_err());
+        assert!(decode::<raw::Fixed32, _>(&mut CodedReader::with_capacity(3, &data[..])).is_err());
+    }
+
+    #[test]
+    fn malformed_varint_fails() {
+        let mut data = vec![10, 12];
+        data.extend_from_slice(&[0xff; 12]);
+        match decode::<raw::Int64, _>(&mut CodedReader::with_slice(&data)) {
+            Err(read::Error::MalformedVarint) => { },
+            other => panic!("expected a malformed varint, got {:?}", other),
+        }
+    }
+}
@@ -0,0 +1,661 @@
+//! Parallel readers and writers for large repeated fields.
+//!
+//! When a slice reader is built with more than one thread, a run of entries of a repeated message field is first
+//! pre-scanned, skipping over each entry's length and checking the tag before the next to find where every entry
+//! in the slice starts and ends. If the run is large enough to give each thread at least `MIN_CHUNK_BYTES` of it,
+//! the entries are split into contiguous chunks that are decoded on worker threads and appended to the field in order,
+//! so the field is the same as if each entry was read one at a time. The run ends at the first different tag,
+//! malformed length, or entry that isn't completely in the slice, which is then read normally. Stream readers always
+//! read entries one at a time, since only what's in their buffer could be split between threads.
+//!
+//! When a writer is given more than one thread, repeated message fields and packed fields are split into contiguous
+//! chunks, and each chunk's encoded size is summed on its own thread. The prefix sums of those sizes give each chunk
+//! a disjoint region of a single reservation in the output, which the threads encode their chunks into at the same time.
+//! Message sizes come from the sizes cached by the usual sizing pass. Outputs that can't reserve the whole field at once
+//! write it on the writing thread.
+//!
+//! The worker threads are spawned the first time they're needed and shared by every reader and writer in the process,
+//! so reading or writing a field in parallel doesn't spawn threads of its own.
+
+use crate::Message;
+use crate::internal::OnceBox;
+use crate::io::{self, read, write, CodedReader, CodedWriter, Input, Output, FieldNumber, Length, LengthBuilder, Tag, WireType};
+use crate::raw::{self, Packable, Value};
+use std::any::Any;
+use std::convert::TryFrom;
+use std::io::ErrorKind;
+use std::ops::Range;
+use std::sync::{mpsc, Arc, Mutex, PoisonError};
+use std::{mem, panic, thread};
+use super::ValuesSize;
+use super::packed::PackedWrite;
+
+/// The fewest bytes of entries decoded on a thread, so runs are only split when each thread
+/// has enough to decode to make up for handing the chunk to it
+const MIN_CHUNK_BYTES: usize = 64 * 1024;
+/// The fewest entries encoded on a thread, so small fields aren't split into chunks
+/// that cost more to hand off than to process
+const MIN_CHUNK_LEN: usize = 64;
+/// The fewest values of a packed field encoded on a thread
+const MIN_PACKED_CHUNK_LEN: usize = 16 * 1024;
+
+/// A job run on a worker thread
+type Job = Box<dyn FnOnce() + Send + 'static>;
+
+/// The threads that run the chunks of parallel reads and writes. Workers are spawned when a call needs more than
+/// are running, and then wait for jobs for as long as the process runs.
+struct Workers {
+    /// The sender for the job queue and the number of workers spawned
+    state: Mutex<(mpsc::Sender<Job>, usize)>,
+    jobs: Arc<Mutex<mpsc::Receiver<Job>>>,
+}
+
+static WORKERS: OnceBox<Workers> = OnceBox::new();
+
+impl Workers {
+    fn get() -> &'static Workers {
+        WORKERS.get_or_init(|| {
+            let (sender, jobs) = mpsc::channel();
+            Workers { state: Mutex::new((sender, 0)), jobs: Arc::new(Mutex::new(jobs)) }
+        })
+    }
+    /// Queues the jobs, spawning workers until there's at least one for each job
+    fn run(&self, jobs: Vec<Job>) {
+        let mut state = self.state.lock().unwrap_or_else(PoisonError::into_inner);
+        while state.1 < jobs.len() {
+            let queue = self.jobs.clone();
+            thread::spawn(move || Self::work(&queue));
+            state.1 += 1;
+        }
+        for job in jobs {
+            state.0.send(job).expect("the job queue is never closed");
+        }
+    }
+    fn work(queue: &Mutex<mpsc::Receiver<Job>>) {
+        loop {
+            let job = queue.lock().unwrap_or_else(PoisonError::into_inner).recv();
+            match job {
+                Ok(job) => job(),
+                Err(_) => return,
+            }
+        }
+    }
+}
+
+/// Runs the function on each item, running the first on the current thread and the rest on worker threads,
+/// and returns the results in order.
+///
+/// Every job is finished before this returns or unwinds, so the jobs can borrow from the caller.
+fn scoped<I: Send, R: Send, F: Fn(I) -> R + Sync>(items: Vec<I>, f: F) -> Vec<R> {
+    /// Waits for the jobs when dropped, so none of them outlive what they borrow if the current thread panics
+    struct Joined(mpsc::Receiver<thread::Result<()>>);
+
+    impl Joined {
+        /// Waits for every job to finish, returning the first panic
+        fn wait(&mut self) -> Option<Box<dyn Any + Send>> {
+            let mut panicked = None;
+            // every job sends its result, and the channel closes once they're all done or dropped
+            while let Ok(result) = self.0.recv() {
+                if let Err(e) = result {
+                    panicked.get_or_insert(e);
+                }
+            }
+            panicked
+        }
+    }
+
+    impl Drop for Joined {
+        fn drop(&mut self) {
+            self.wait();
+        }
+    }
+
+    let mut items = items.into_iter();
+    let first = match items.next() {
+        Some(first) => first,
+        None => return Vec::new(),
+    };
+    let mut slots = (0..items.len()).map(|_| None).collect::<Vec<Option<R>>>();
+    let f = &f;
+    let first = {
+        let (done, finished) = mpsc::channel();
+        let mut joined = Joined(finished);
+        let jobs = items.zip(slots.iter_mut())
+            .map(|(item, slot)| {
+                let done = done.clone();
+                let job: Box<dyn FnOnce() + Send + '_> = Box::new(move || {
+                    let result = panic::catch_unwind(panic::AssertUnwindSafe(|| *slot = Some(f(item))));
+                    let _ = done.send(result);
+                });
+                // every job is finished before `joined` is dropped, so the job never outlives the borrows in it
+                unsafe { mem::transmute::<_, Job>(job) }
+            })
+            .collect();
+        drop(done);
+        Workers::get().run(jobs);
+
+        let first = f(first);
+        if let Some(e) = joined.wait() {
+            panic::resume_unwind(e);
+        }
+        first
+    };
+
+    let mut results = Vec::with_capacity(slots.len() + 1);
+    results.push(first);
+    results.extend(slots.into_iter().map(|slot| slot.expect("every job finished")));
+    results
+}
+
+/// Splits the values into at most `threads` chunks of at least `min_len` values, returning `None` if that's only one chunk
+fn split<T>(values: &[T], threads: usize, min_len: usize) -> Option<Vec<&[T]>> {
+    let threads = threads.min(values.len() / min_len);
+    if threads <= 1 {
+        return None;
+    }
+    Some(values.chunks((values.len() + threads - 1) / threads).collect())
+}
+
+/// Splits the region into consecutive parts of the specified lengths
+fn split_region<'a>(mut region: &'a mut [u8], lens: &[usize]) -> Vec<&'a mut [u8]> {
+    lens.iter()
+        .map(|&len| {
+            let (part, rest) = std::mem::take(&mut region).split_at_mut(len);
+            region = rest;
+            part
+        })
+        .collect()
+}
+
+/// Writes to the part of a reservation, checking every byte of it was written
+fn write_part<F: FnOnce(&mut CodedWriter<io::write::Slice>) -> write::Result>(part: &mut [u8], f: F) -> write::Result {
+    let mut writer = CodedWriter::with_slice(part);
+    f(&mut writer)?;
+    if writer.into_inner().is_empty() {
+        Ok(())
+    } else {
+        Err(std::io::Error::new(ErrorKind::InvalidData, "a value wrote fewer bytes than its size").into())
+    }
+}
+
+/// Finishes a parallel write, returning the first error in order
+fn collect(results: Vec<write::Result>) -> write::Result {
+    results.into_iter().collect()
+}
+
+/// A value that can read a run of repeated entries into a vector.
+pub trait RepeatedRead: Value {
+    /// Reads the entry at the current position of the input and any entries following it in the same run,
+    /// adding them to the end of the vector
+    fn read_repeated_into<T: Input>(values: &mut Vec<Self::Inner>, input: &mut CodedReader<T>) -> read::Result<()>;
+}
+
+impl<V: Value> RepeatedRead for V {
+    default fn read_repeated_into<T: Input>(values: &mut Vec<Self::Inner>, input: &mut CodedReader<T>) -> read::Result<()> {
+        input.read_value::<V>().map(|v| values.push(v))
+    }
+}
+
+impl<M: Message + Send> RepeatedRead for raw::Message<M> {
+    fn read_repeated_into<T: Input>(values: &mut Vec<M>, input: &mut CodedReader<T>) -> read::Result<()> {
+        // only a slice has the whole run in memory, and a run is only split if at least two threads get enough of it
+        let splittable = input.is_slice() && input.buffered().len() >= 2 * MIN_CHUNK_BYTES;
+        let tag = match input.last_tag() {
+            Some(tag) if input.threads() > 1 && splittable => tag,
+            _ => return input.read_value::<Self>().map(|v| values.push(v)),
+        };
+        let (tag, tag_len) = encode_tag(tag.get());
+        let entries = scan(input.buffered(), &tag[..tag_len]).collect::<Vec<_>>();
+        let end = match entries.last() {
+            Some(last) => last.end,
+            None => return input.read_value::<Self>().map(|v| values.push(v)),
+        };
+
+        let threads = input.threads().min(end / MIN_CHUNK_BYTES);
+        let builder = input.nested_builder();
+        let data = input.buffered();
+        let result = if threads <= 1 {
+            values.reserve(entries.len());
+            decode(&builder, data, &entries, values)
+        } else {
+            decode_parallel(&builder, data, &entries, threads, values)
+        };
+        unsafe { input.consume(end) };
+        result
+    }
+}
+
+/// Encodes a tag as a varint, returning the bytes and the number of bytes used
+#[inline]
+pub(super) fn encode_tag(mut tag: u32) -> ([u8; 5], usize) {
+    let mut bytes = [0; 5];
+    let mut len = 0;
+    while tag >= 0x80 {
+        bytes[len] = tag as u8 | 0x80;
+        tag >>= 7;
+        len += 1;
+    }
+    bytes[len] = tag as u8;
+    (bytes, len + 1)
+}
+
+/// Reads a length prefix, returning the length and the number of bytes it used.
+/// Malformed, negative, and partial lengths return `None` so the reader can report them.
+#[inline]
+fn read_length(data: &[u8]) -> Option<(usize, usize)> {
+    let mut value = 0u64;
+    for (i, &byte) in data.iter().take(10).enumerate() {
+        value |= u64::from(byte & 0x7f) << (7 * i);
+        if byte < 0x80 {
+            let length = value as u32 as i32;
+            return if length < 0 { None } else { Some((length as usize, i + 1)) };
+        }
+    }
+    None
+}
+
+/// Scans the run of entries starting at a length prefix, yielding the range of each entry and its length prefix.
+/// Entries after the first start after a copy of the tag that came before the first.
+pub(super) fn scan<'a>(data: &'a [u8], tag: &'a [u8]) -> Run<'a> {
+    Run { data, tag, start: Some(0) }
+}
+
+/// An iterator over the entries in a run of length delimited fields with the same tag
+pub(super) struct Run<'a> {
+    data: &'a [u8],
+    tag: &'a [u8],
+    start: Option<usize>,
+}
+
+impl Iterator for Run<'_> {
+    type Item = Range<usize>;
+
+    fn next(&mut self) -> Option<Range<usize>> {
+        let start = self.start.take()?;
+        let (len, prefix) = read_length(&self.data[start..])?;
+        let end = start + prefix + len;
+        if end > self.data.len() {
+            return None;
+        }
+        if self.data[end..].starts_with(self.tag) {
+            self.start = Some(end + self.tag.len());
+        }
+        Some(start..end)
+    }
+}
+
+/// Decodes each entry from its own reader made with the builder, adding them to the vector up to the first that fails
+fn decode<M: Message>(builder: &read::Builder, data: &[u8], entries: &[Range<usize>], values: &mut Vec<M>) -> read::Result<()> {
+    entries.iter().try_for_each(|entry| {
+        builder.with_slice(&data[entry.clone()]).read_value::<raw::Message<M>>().map(|v| values.push(v))
+    })
+}
+
+/// Decodes the entries in contiguous chunks across threads, appending them in order up to the first entry that fails,
+/// like reading them one at a time would
+fn decode_parallel<M: Message + Send>(
+    builder: &read::Builder,
+    data: &[u8],
+    entries: &[Range<usize>],
+    threads: usize,
+    values: &mut Vec<M>) -> read::Result<()> {
+    let chunks = entries.chunks((entries.len() + threads - 1) / threads).collect();
+    let chunks = scoped(chunks, |chunk| {
+        let mut decoded = Vec::with_capacity(chunk.len());
+        let result = decode::<M>(builder, data, chunk, &mut decoded);
+        (decoded, result)
+    });
+
+    values.reserve(entries.len());
+    for (mut decoded, result) in chunks {
+        values.append(&mut decoded);
+        result?;
+    }
+    Ok(())
+}
+
+/// A value that can write a repeated field of values.
+pub trait RepeatedWrite: Value {
+    /// Writes each value as a field with the specified number
+    fn write_repeated<T: Output>(values: &[Self::Inner], output: &mut CodedWriter<T>, num: FieldNumber) -> write::Result;
+}
+
+impl<V: Value> RepeatedWrite for V {
+    default fn write_repeated<T: Output>(values: &[Self::Inner], output: &mut CodedWriter<T>, num: FieldNumber) -> write::Result {
+        values.iter().try_for_each(|value| output.write_field::<V>(num, value))
+    }
+}
+
+impl<M: Message + Sync> RepeatedWrite for raw::Message<M> {
+    fn write_repeated<T: Output>(values: &[M], output: &mut CodedWriter<T>, num: FieldNumber) -> write::Result {
+        let chunks = match split(values, output.threads(), MIN_CHUNK_LEN) {
+            Some(chunks) => chunks,
+            None => return values.iter().try_for_each(|value| output.write_field::<Self>(num, value)),
+        };
+
+        let tag_len = io::raw_varint32_size(Tag::new(num, WireType::LengthDelimited).get()).get() as usize;
+        let lens = scoped(chunks.clone(), |chunk| {
+            chunk.iter().try_fold(0usize, |sum, value| {
+                let size = value.cached_size()?;
+                Some(sum + tag_len + io::raw_varint32_size(size.get() as u32).get() as usize + size.get() as usize)
+            })
+        });
+        let lens = lens.into_iter().collect::<Option<Vec<_>>>().ok_or(write::Error::ValueTooLarge)?;
+
+        let total = lens.iter().sum();
+        let written = output.write_reserved(total, |region| {
+            let parts = chunks.iter().copied().zip(split_region(region, &lens)).collect();
+            collect(scoped(parts, |(chunk, part): (&[M], &mut [u8])| {
+                write_part(part, |writer| chunk.iter().try_for_each(|value| writer.write_field::<Self>(num, value)))
+            }))
+        });
+        match written {
+            Some(result) => result,
+            None => values.iter().try_for_each(|value| output.write_field::<Self>(num, value)),
+        }
+    }
+}
+
+/// A packable value that can write a packed field of values.
+pub trait PackedFieldWrite: Packable {
+    /// Writes the values as a packed field with the specified number. The values must not be empty.
+    fn write_packed_field<T: Output>(values: &[Self::Inner], output: &mut CodedWriter<T>, num: FieldNumber) -> write::Result;
+}
+
+/// Calculates the length of a packed run of values
+#[inline]
+fn packed_len<V: Packable>(values: &[V::Inner]) -> Option<Length> {
+    <[V::Inner] as ValuesSize<V>>::calculate_size(values, LengthBuilder::new()).map(LengthBuilder::build)
+}
+
+impl<V: Packable> PackedFieldWrite for V {
+    default fn write_packed_field<T: Output>(values: &[Self::Inner], output: &mut CodedWriter<T>, num: FieldNumber) -> write::Result {
+        let len = packed_len::<V>(values).ok_or(write::Error::ValueTooLarge)?;
+
+        output.write_tag(Tag::new(num, WireType::LengthDelimited))?;
+        output.write_length(len)?;
+        <V as PackedWrite>::write_packed_values(values, output)
+    }
+}
+
+impl<V: Packable> PackedFieldWrite for V where V::Inner: Sync {
+    fn write_packed_field<T: Output>(values: &[Self::Inner], output: &mut CodedWriter<T>, num: FieldNumber) -> write::Result {
+        let chunks = match split(values, output.threads(), MIN_PACKED_CHUNK_LEN) {
+            Some(chunks) => chunks,
+            None => {
+                let len = packed_len::<V>(values).ok_or(write::Error::ValueTooLarge)?;
+                output.write_tag(Tag::new(num, WireType::LengthDelimited))?;
+                output.write_length(len)?;
+                return <V as PackedWrite>::write_packed_values(values, output);
+            },
+        };
+
+        let lens = scoped(chunks.clone(), |chunk| packed_len::<V>(chunk).map(|len| len.get() as usize));
+        let lens = lens.into_iter().collect::<Option<Vec<_>>>().ok_or(write::Error::ValueTooLarge)?;
+        let total = lens.iter().sum::<usize>();
+        let len = i32::try_from(total).ok().and_then(Length::new).ok_or(write::Error::ValueTooLarge)?;
+
+        output.write_tag(Tag::new(num, WireType::LengthDelimited))?;
+        output.write_length(len)?;
+        let written = output.write_reserved(total, |region| {
+            let parts = chunks.iter().copied().zip(split_region(region, &lens)).collect();
+            collect(scoped(parts, |(chunk, part): (&[V::Inner], &mut [u8])| {
+                write_part(part, |writer| <V as PackedWrite>::write_packed_values(chunk, writer))
+            }))
+        });
+        match written {
+            Some(result) => result,
+            None => <V as PackedWrite>::write_packed_values(values, output),
+        }
+    }
+}
+
+#[cfg(test)]
+mod test {
+    use crate::{Message, UnknownFieldSet};
+    use crate::collections::RepeatedField;
+    use crate::io::{read, write, CodedReader, CodedWriter, FieldNumber, Input, Length, LengthBuilder, Output};
+    use crate::raw;
+    use crate::test_support::Record;
+
+    fn record(id: i32) -> Record {
+        Record::new(id, id as usize % 7)
+    }
+
+    #[derive(Default, Clone, Debug, PartialEq)]
+    struct Batch {
+        name: String,
+        records: RepeatedField<Record>,
+        unknown_fields: UnknownFieldSet,
+    }
+
+    impl Batch {
+        const NAME_NUMBER: FieldNumber = unsafe { FieldNumber::new_unchecked(1) };
+        const RECORDS_NUMBER: FieldNumber = unsafe { FieldNumber::new_unchecked(2) };
+
+        fn new(name: &str, ids: std::ops::Range<i32>) -> Self {
+            Batch { name: name.into(), records: ids.map(record).collect(), ..Default::default() }
+        }
+    }
+
+    impl Message for Batch {
+        fn merge_from<T: Input>(&mut self, input: &mut CodedReader<T>) -> read::Result<()> {
+            while let Some(field) = input.read_field()? {
+                match field.tag() {
+                    10 => field.merge_value::<raw::String>(Self::NAME_NUMBER, &mut self.name)?,
+                    18 => field.add_entries_to::<_, raw::Message<Record>>(Self::RECORDS_NUMBER, &mut self.records)?,
+                    _ => field.check_and_try_add_field_to(&mut self.unknown_fields)?.or_skip()?,
+                }
+            }
+            Ok(())
+        }
+        fn calculate_size(&self) -> Option<Length> {
+            let mut builder = LengthBuilder::new();
+            if !self.name.is_empty() {
+                builder = builder.add_field::<raw::String>(Self::NAME_NUMBER, &self.name)?;
+            }
+            builder
+                .add_values::<_, raw::Message<Record>>(&self.records, Self::RECORDS_NUMBER)?
+                .add_fields(&self.unknown_fields)
+                .map(LengthBuilder::build)
+        }
+        fn write_to<T: Output>(&self, output: &mut CodedWriter<T>) -> write::Result {
+            if !self.name.is_empty() {
+                output.write_field::<raw::String>(Self::NAME_NUMBER, &self.name)?;
+            }
+            output.write_values::<_, raw::Message<Record>>(&self.records, Self::RECORDS_NUMBER)?;
+            output.write_fields(&self.unknown_fields)
+        }
+        fn is_initialized(&self) -> bool {
+            true
+        }
+        fn unknown_fields(&self) -> &UnknownFieldSet {
+            &self.unknown_fields
+        }
+        fn unknown_fields_mut(&mut self) -> &mut UnknownFieldSet {
+            &mut self.unknown_fields
+        }
+    }
+
+    /// A batch with enough records to give each of the 4 threads more than `MIN_CHUNK_BYTES` of entries
+    const LARGE: i32 = 40_000;
+
+    fn parallel() -> read::Builder {
+        read::Builder::new().threads(4)
+    }
+
+    fn decode(builder: &read::Builder, data: &[u8]) -> read::Result<Batch> {
+        let mut batch = Batch::default();
+        batch.merge_from(&mut builder.with_slice(data))?;
+        Ok(batch)
+    }
+
+    #[test]
+    fn parallel_matches_sequential() {
+        for &len in &[1, 63, 64, 65, 1000, 5000, LARGE] {
+            let expected = Batch::new("batch", 0..len);
+            let data = expected.to_bytes().unwrap();
+            assert_eq!(decode(&parallel(), &data).unwrap(), expected, "length {}", len);
+        }
+    }
+    #[test]
+    fn runs_keep_field_order() {
+        let mut data = Batch::new("", 0..LARGE / 2).to_bytes().unwrap();
+        data.extend(Batch::new("a", 0..0).to_bytes().unwrap());
+        data.extend(Batch::new("", LARGE / 2..LARGE).to_bytes().unwrap());
+
+        let sequential = decode(&read::Builder::new(), &data).unwrap();
+        assert_eq!(sequential, Batch::new("a", 0..LARGE));
+        assert_eq!(decode(&parallel(), &data).unwrap(), sequential);
+    }
+    #[test]
+    fn stream_decodes_buffered_runs() {
+        let expected = Batch::new("batch", 0..2000);
+        let data = expected.to_bytes().unwrap();
+        let mut batch = Batch::default();
+        batch.merge_from(&mut parallel().with_capacity(1024, data.as_slice())).unwrap();
+        assert_eq!(batch, expected);
+    }
+    #[test]
+    fn invalid_entry_fails() {
+        let mut data = Batch::new("", 0..LARGE / 2).to_bytes().unwrap();
+        data.extend(&[18, 2, 0, 0]);
+        data.extend(Batch::new("", LARGE / 2..LARGE).to_bytes().unwrap());
+        match decode(&parallel(), &data) {
+            Err(read::Error::InvalidTag(0)) => { },
+            r => panic!("unexpected result: {:?}", r),
+        }
+    }
+    #[test]
+    fn failed_chunks_keep_entries_before_the_error() {
+        let mut data = Batch::new("", 0..LARGE / 2).to_bytes().unwrap();
+        data.extend(&[18, 2, 0, 0]);
+        data.extend(Batch::new("", LARGE / 2..LARGE).to_bytes().unwrap());
+
+        let mut sequential = Batch::default();
+        assert!(sequential.merge_from(&mut read::Builder::new().with_slice(&data)).is_err());
+        let mut batch = Batch::default();
+        assert!(batch.merge_from(&mut parallel().with_slice(&data)).is_err());
+        assert_eq!(batch.records.len(), LARGE as usize / 2);
+        assert_eq!(batch, sequential);
+    }
+    #[test]
+    fn truncated_entry_fails() {
+        let data = Batch::new("", 0..LARGE).to_bytes().unwrap();
+        match decode(&parallel(), &data[..data.len() - 1]) {
+            Err(read::Error::IoError(_)) => { },
+            r => panic!("unexpected result: {:?}", r),
+        }
+    }
+    #[test]
+    fn threads_keep_recursion_limit() {
+        let data = Batch::new("", 0..LARGE).to_bytes().unwrap();
+        match decode(&parallel().recursion_limit(0), &data) {
+            Err(read::Error::RecursionLimitExceeded) => { },
+            r => panic!("unexpected result: {:?}", r),
+        }
+        assert!(decode(&parallel().recursion_limit(1), &data).is_ok());
+    }
+
+    fn write_with_threads<T: Output>(batch: &Batch, writer: CodedWriter<T>) -> write::Result {
+        let mut writer = writer.with_threads(4);
+        batch.compute_and_cache_size().unwrap();
+        batch.write_to(&mut writer)
+    }
+
+    #[test]
+    fn parallel_write_matches_sequential() {
+        for &len in &[1, 127, 128, 129, 1000, 5000] {
+            let batch = Batch::new("batch", 0..len);
+            let expected = batch.to_bytes().unwrap();
+
+            let mut output = Vec::new();
+            write_with_threads(&batch, CodedWriter::with_vec(&mut output)).unwrap();
+            assert_eq!(output, expected, "length {}", len);
+
+            let mut output = vec![0; expected.len()];
+            write_with_threads(&batch, CodedWriter::with_slice(&mut output)).unwrap();
+            assert_eq!(output, expected, "length {}", len);
+        }
+    }
+    #[test]
+    fn small_stream_buffer_writes_sequentially() {
+        let batch = Batch::new("batch", 0..1000);
+        let mut output = Vec::new();
+        let mut writer = CodedWriter::with_capacity(256, &mut output);
+        write_with_threads(&batch, writer.as_any()).unwrap();
+        writer.flush().unwrap();
+        drop(writer);
+        assert_eq!(output, batch.to_bytes().unwrap());
+    }
+    #[test]
+    fn small_slice_fails() {
+        let batch = Batch::new("batch", 0..1000);
+        let mut output = vec![0; batch.calculate_size().unwrap().get() as usize - 1];
+        match write_with_threads(&batch, CodedWriter::with_slice(&mut output)) {
+            Err(write::Error::IoError(_)) => { },
+            r => panic!("unexpected result: {:?}", r),
+        }
+    }
+    #[test]
+    fn parallel_packed_write_matches_sequential() {
+        const VALUES: FieldNumber = unsafe { FieldNumber::new_unchecked(3) };
+        let ints: RepeatedField<i32> = (0..100_000).map(|i| i * 7919 - 300_000).collect();
+        let fixed: RepeatedField<u64> = (0..100_000).collect();
+
+        let mut expected = Vec::new();
+        let mut writer = CodedWriter::with_vec(&mut expected);
+        writer.write_values::<_, raw::Packed<raw::Sint32>>(&ints, VALUES).unwrap();
+        writer.write_values::<_, raw::Packed<raw::Fixed64>>(&fixed, VALUES).unwrap();
+        drop(writer);
+
+        let mut output = Vec::new();
+        let mut writer = CodedWriter::with_vec(&mut output).with_threads(3);
+        writer.write_values::<_, raw::Packed<raw::Sint32>>(&ints, VALUES).unwrap();
+        writer.write_values::<_, raw::Packed<raw::Fixed64>>(&fixed, VALUES).unwrap();
+        drop(writer);
+        assert_eq!(output, expected);
+
+        let mut reader = CodedReader::with_slice(&output);
+        let (mut read_ints, mut read_fixed) = (RepeatedField::new(), RepeatedField::new());
+        reader.read_field().unwrap().unwrap().add_entries_to::<_, raw::Packed<raw::Sint32>>(VALUES, &mut read_ints).unwrap();
+        reader.read_field().unwrap().unwrap().add_entries_to::<_, raw::Packed<raw::Fixed64>>(VALUES, &mut read_fixed).unwrap();
+        assert_eq!(read_ints, ints);
+        assert_eq!(read_fixed, fixed);
+    }
+
+    #[test]
+    fn scoped_borrows_and_keeps_order() {
+        let data = (0..64).collect::<Vec<u32>>();
+        let chunks = data.chunks(10).collect::<Vec<_>>();
+        let sums = super::scoped(chunks, |chunk| chunk.iter().sum::<u32>());
+        assert_eq!(sums, data.chunks(10).map(|chunk| chunk.iter().sum::<u32>()).collect::<Vec<_>>());
+    }
+    #[test]
+    fn scoped_joins_before_resuming_panics() {
+        use std::panic;
+        use std::sync::atomic::{AtomicUsize, Ordering};
+
+        let finished = AtomicUsize::new(0);
+        let result = panic::catch_unwind(panic::AssertUnwindSafe(|| {
+            super::scoped((0..4).collect(), |i: usize| {
+                if i == 1 {
+                    panic!("chunk failed");
+                }
+                std::thread::sleep(std::time::Duration::from_millis(10));
+                finished.fetch_add(1, Ordering::SeqCst);
+            })
+        }));
+        assert!(result.is_err());
+        assert_eq!(finished.load(Ordering::SeqCst), 3);
+    }
+    #[test]
+    fn workers_are_reused() {
+        for _ in 0..16 {
+            super::scoped((0..4).collect(), |i: usize| i);
+        }
+        // no test runs more than 3 jobs at once, so no more workers are ever needed
+        let spawned = super::Workers::get().state.lock().unwrap().1;
+        assert!(spawned <= 3, "spawned {} workers", spawned);
+    }
+}
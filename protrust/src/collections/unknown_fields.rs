@@ -5,12 +5,14 @@
 //! 
 //! Unknown fields for unique field numbers can exist for multiple wire types at once to ensure that all data is properly returned.
 
-use crate::{internal::Sealed, Mergable};
-use crate::io::{read, write, FieldNumber, WireType, Tag, LengthBuilder, CodedReader, CodedWriter, Input, Output};
+use crate::{internal::{Sealed, OnceBox}, Mergable};
+use crate::io::{read, write, reverse::ReverseWriter, FieldNumber, WireType, Tag, Length, LengthBuilder, CodedReader, CodedWriter, Input, Output};
 use crate::raw;
 use std::collections::{HashMap, hash_map};
+use std::convert::TryFrom;
 use std::fmt::{self, Formatter, Debug};
 use std::iter::FusedIterator;
+use std::mem;
 use std::ops::RangeBounds;
 use std::vec;
 use super::{FieldSet, TryRead};
@@ -31,26 +33,78 @@ pub enum UnknownField {
 }
 
 /// A set of unknown fields encountered while parsing
-#[derive(PartialEq, Default, Clone, Debug)]
+/// 
+/// Fields read with [`UnknownFieldHandling::StoreRaw`] are kept as their encoded bytes in one buffer
+/// that's written back out with a single copy. The fields are only decoded when they're accessed, and
+/// accessing the set mutably decodes them into the set permanently.
+/// 
+/// [`UnknownFieldHandling::StoreRaw`]: ../../io/read/enum.UnknownFieldHandling.html#variant.StoreRaw
+#[derive(Default)]
 pub struct UnknownFieldSet {
     inner: HashMap<FieldNumber, Vec<UnknownField>>,
+    raw: Vec<u8>,
+    /// A view of the decoded and raw fields combined, decoded when raw fields are accessed
+    decoded: OnceBox<FieldMap>,
+}
+
+type FieldMap = HashMap<FieldNumber, Vec<UnknownField>>;
+
+impl Clone for UnknownFieldSet {
+    fn clone(&self) -> Self {
+        UnknownFieldSet {
+            inner: self.inner.clone(),
+            raw: self.raw.clone(),
+            decoded: OnceBox::new(),
+        }
+    }
+}
+
+impl PartialEq for UnknownFieldSet {
+    fn eq(&self, other: &Self) -> bool {
+        self.view() == other.view()
+    }
+}
+
+impl Debug for UnknownFieldSet {
+    fn fmt(&self, f: &mut Formatter) -> fmt::Result {
+        f.debug_struct("UnknownFieldSet")
+         .field("inner", self.view())
+         .finish()
+    }
 }
 
 impl Sealed for UnknownFieldSet { }
 impl Mergable for UnknownFieldSet {
     fn merge(&mut self, other: &Self) {
-        for (&key, values) in &other.inner {
-            self.inner.entry(key).or_insert_with(Vec::new).extend(values.clone())
+        if !other.inner.is_empty() {
+            // decoded fields are written before raw fields, so decode ours to keep other's fields after them
+            self.expand();
+            for (&key, values) in &other.inner {
+                self.inner.entry(key).or_insert_with(Vec::new).extend(values.clone())
+            }
+        }
+        if !other.raw.is_empty() {
+            self.decoded.take();
+            self.raw.extend_from_slice(&other.raw);
         }
     }
 }
 impl FieldSet for UnknownFieldSet {
     #[inline]
     fn try_add_field_from<'a, T: Input>(&mut self, input: &'a mut CodedReader<T>) -> read::Result<TryRead<'a, T>> {
-        if input.unknown_field_handling().skip() || input.last_tag().map(Tag::wire_type) == Some(WireType::EndGroup) {
+        if input.last_tag().map(Tag::wire_type) == Some(WireType::EndGroup) {
+            return Ok(TryRead::Yielded(input));
+        }
+        record!(input.metrics_mut().unknown_fields += 1);
+        let handling = input.unknown_field_handling();
+        if handling.skip() {
             Ok(TryRead::Yielded(input))
         } else {
-            self.add_field_from(input)?;
+            if handling.raw() {
+                self.add_raw_field_from(input)?;
+            } else {
+                self.add_field_from(input)?;
+            }
             Ok(TryRead::Consumed)
         }
     }
@@ -75,7 +129,7 @@ impl FieldSet for UnknownFieldSet {
                             UnknownField::LengthDelimited(v) => {
                                 builder
                                     .add_tag(Tag::new(key, WireType::LengthDelimited))?
-                                    .add_value::<raw::Bytes<_>>(v)
+                                    .add_value::<raw::Bytes<Box<[u8]>>>(v)
                             },
                             UnknownField::Group(v) => {
                                 builder
@@ -90,7 +144,8 @@ impl FieldSet for UnknownFieldSet {
                             }
                         }
                 })
-            )
+            )?
+            .add_bytes(i32::try_from(self.raw.len()).ok().and_then(Length::new)?)
     }
     fn write_to<T: Output>(&self, output: &mut CodedWriter<T>) -> write::Result {
         for (key, values) in &self.inner {
@@ -120,6 +175,42 @@ impl FieldSet for UnknownFieldSet {
                 }
             }
         }
+        if !self.raw.is_empty() {
+            output.write_raw_bytes(&self.raw)?;
+        }
+        Ok(())
+    }
+    fn write_reverse(&self, output: &mut ReverseWriter) -> write::Result {
+        if !self.raw.is_empty() {
+            output.write_raw_bytes(&self.raw)?;
+        }
+        for (key, values) in &self.inner {
+            for value in values.iter().rev() {
+                match value {
+                    UnknownField::Varint(v) => {
+                        output.write_varint64(*v)?;
+                        output.write_tag(Tag::new(*key, WireType::Varint))?;
+                    },
+                    UnknownField::Bit64(v) => {
+                        output.write_bit64(*v)?;
+                        output.write_tag(Tag::new(*key, WireType::Bit64))?;
+                    },
+                    UnknownField::LengthDelimited(v) => {
+                        output.write_length_delimited(v)?;
+                        output.write_tag(Tag::new(*key, WireType::LengthDelimited))?;
+                    },
+                    UnknownField::Group(v) => {
+                        output.write_tag(Tag::new(*key, WireType::EndGroup))?;
+                        output.write_fields(v)?;
+                        output.write_tag(Tag::new(*key, WireType::StartGroup))?;
+                    },
+                    UnknownField::Bit32(v) => {
+                        output.write_bit32(*v)?;
+                        output.write_tag(Tag::new(*key, WireType::Bit32))?;
+                    },
+                }
+            }
+        }
         Ok(())
     }
     fn is_initialized(&self) -> bool { true }
@@ -149,7 +240,101 @@ impl UnknownFieldSet {
         }
         Ok(())
     }
+    fn add_raw_field_from<T: Input>(&mut self, input: &mut CodedReader<T>) -> read::Result<()> {
+        self.decoded.take();
+        let len = self.raw.len();
+        let result = write_raw_field(&mut self.raw, input);
+        if result.is_err() {
+            // only whole fields are kept so the buffer can always be decoded
+            self.raw.truncate(len);
+        }
+        result
+    }
+    /// Gets the fields in the set, decoding any raw fields
+    fn view(&self) -> &FieldMap {
+        if self.raw.is_empty() {
+            &self.inner
+        } else {
+            self.decoded.get_or_init(|| decode_raw(self.inner.clone(), &self.raw))
+        }
+    }
+    /// Decodes the raw fields in the set into its decoded fields
+    fn expand(&mut self) {
+        if !self.raw.is_empty() {
+            self.inner = match self.decoded.take() {
+                Some(decoded) => decoded,
+                None => decode_raw(mem::take(&mut self.inner), &self.raw),
+            };
+            self.raw.clear();
+        }
+    }
 }
+
+fn push_varint(raw: &mut Vec<u8>, mut value: u64) {
+    while value >= 0x80 {
+        raw.push(value as u8 | 0x80);
+        value >>= 7;
+    }
+    raw.push(value as u8);
+}
+
+/// Writes the field with the last tag read by the input to the buffer as it's encoded
+fn write_raw_field<T: Input>(raw: &mut Vec<u8>, input: &mut CodedReader<T>) -> read::Result<()> {
+    if let Some(last_tag) = input.last_tag() {
+        match last_tag.wire_type() {
+            WireType::Varint => {
+                let value = input.read_varint64()?;
+                push_varint(raw, last_tag.get() as u64);
+                push_varint(raw, value);
+            },
+            WireType::Bit64 => {
+                let value = input.read_bit64()?;
+                push_varint(raw, last_tag.get() as u64);
+                raw.extend_from_slice(&value.to_le_bytes());
+            },
+            WireType::LengthDelimited => {
+                push_varint(raw, last_tag.get() as u64);
+                input.read_length_delimited_with(|len| {
+                    push_varint(raw, len as u64);
+                    let start = raw.len();
+                    raw.resize(start + len, 0);
+                    &mut raw[start..]
+                })?;
+            },
+            WireType::StartGroup => {
+                push_varint(raw, last_tag.get() as u64);
+                let end_tag = Tag::new(last_tag.field(), WireType::EndGroup);
+                while let Some(tag) = input.read_tag()? {
+                    if tag != end_tag {
+                        input.recurse(|input| write_raw_field(raw, input))?;
+                    } else {
+                        break;
+                    }
+                }
+                push_varint(raw, end_tag.get() as u64);
+            },
+            WireType::Bit32 => {
+                let value = input.read_bit32()?;
+                push_varint(raw, last_tag.get() as u64);
+                raw.extend_from_slice(&value.to_le_bytes());
+            },
+            WireType::EndGroup => return Err(read::Error::InvalidTag(last_tag.get()))
+        }
+    }
+    Ok(())
+}
+
+/// Decodes raw fields and adds them after the decoded fields of a set
+fn decode_raw(inner: FieldMap, raw: &[u8]) -> FieldMap {
+    let mut set = UnknownFieldSet { inner, ..UnknownFieldSet::default() };
+    // raw fields were limited by the reader they were read from, so don't limit them again
+    let mut input = read::Builder::new().recursion_limit(usize::max_value()).with_slice(raw);
+    while input.read_tag().expect("raw fields are whole fields").is_some() {
+        set.add_field_from(&mut input).expect("raw fields are whole fields");
+    }
+    set.inner
+}
+
 impl UnknownFieldSet {
     /// Creates a new unknown field set in the specified allocator
     #[inline]
@@ -159,55 +344,64 @@ impl UnknownFieldSet {
     /// Gets the number of fields present in this set
     #[inline]
     pub fn field_len(&self) -> usize {
-        self.inner.len()
+        self.view().len()
     }
     /// Returns whether any fields are present in this set
     #[inline]
     pub fn is_empty(&self) -> bool {
-        self.inner.len() == 0
+        self.inner.is_empty() && self.raw.is_empty()
     }
     /// Returns a slice of values for a field
     pub fn values(&self, num: FieldNumber) -> &[UnknownField] {
-        self.inner.get(&num).map(Vec::as_slice).unwrap_or(&[])
+        self.view().get(&num).map(Vec::as_slice).unwrap_or(&[])
     }
     /// Returns a mutable slice of values for a field
     pub fn values_mut(&mut self, num: FieldNumber) -> &mut [UnknownField] {
+        self.expand();
         self.inner.get_mut(&num).map(Vec::as_mut_slice).unwrap_or(&mut [])
     }
     /// Pushes an new value to the field
     pub fn push_value(&mut self, num: FieldNumber, value: UnknownField) {
+        self.expand();
         self.inner.entry(num).or_insert_with(Vec::new).push(value)
     }
     /// Pops the last value added for the specified field
     pub fn pop_value(&mut self, num: FieldNumber) -> Option<UnknownField> {
+        self.expand();
         self.inner.get_mut(&num).and_then(Vec::pop)
     }
     /// Returns an iterator of all of the fields in the set
     pub fn fields(&self) -> Iter {
-        Iter(self.inner.iter())
+        Iter(self.view().iter())
     }
     /// Returns a mutable iterator of all the fields in the set
     pub fn fields_mut(&mut self) -> IterMut {
+        self.expand();
         IterMut(self.inner.iter_mut())
     }
     /// Clears the set, removing all fields
     pub fn clear(&mut self) {
-        self.inner.clear()
+        self.decoded.take();
+        self.inner.clear();
+        self.raw.clear();
     }
     /// Clears the field, removing all values
     pub fn clear_field(&mut self, num: FieldNumber) {
+        self.expand();
         self.inner.remove(&num);
     }
     /// Gets an iterator of all fields by their field number
     pub fn field_numbers(&self) -> FieldNumbers {
-        FieldNumbers(self.inner.keys())
+        FieldNumbers(self.view().keys())
     }
     /// Clears the set, returning the owned field values
     pub fn drain(&mut self) -> Drain {
+        self.expand();
         Drain(self.inner.drain())
     }
     /// Drains a range of values from a field
     pub fn drain_values<R: RangeBounds<usize>>(&mut self, num: FieldNumber, range: R) -> FieldDrain {
+        self.expand();
         FieldDrain(self.inner.get_mut(&num).map(|v| v.drain(range)))
     }
 }
@@ -374,5 +568,149 @@ impl FusedIterator for FieldDrain<'_> { }
 
 #[cfg(test)]
 mod test {
-    
+    use crate::Mergable;
+    use crate::collections::FieldSet;
+    use crate::io::{read, reverse::ReverseWriter, FieldNumber, Length, LengthBuilder, CodedWriter};
+    use crate::io::read::UnknownFieldHandling;
+    use super::{UnknownField, UnknownFieldSet};
+
+    const INPUT: [u8; 26] = [
+        8, 150, 1,
+        17, 1, 2, 3, 4, 5, 6, 7, 8,
+        26, 3, b'a', b'b', b'c',
+        35, 8, 1, 36,
+        45, 1, 2, 3, 4,
+    ];
+
+    fn num(n: u32) -> FieldNumber {
+        FieldNumber::new(n).unwrap()
+    }
+
+    fn read(data: &[u8], handling: UnknownFieldHandling) -> read::Result<UnknownFieldSet> {
+        let mut set = UnknownFieldSet::new();
+        let mut input = read::Builder::new().unknown_fields(handling).with_slice(data);
+        while input.read_tag()?.is_some() {
+            set.try_add_field_from(&mut input)?.or_skip()?;
+        }
+        Ok(set)
+    }
+
+    fn write(set: &UnknownFieldSet) -> Vec<u8> {
+        let len = set.calculate_size(LengthBuilder::new()).unwrap().build().get() as usize;
+        let mut output = vec![0; len];
+        let mut writer = CodedWriter::with_slice(&mut output);
+        set.write_to(&mut writer).unwrap();
+        assert!(writer.into_inner().is_empty());
+        output
+    }
+
+    #[test]
+    fn raw_fields_write_as_read() {
+        let set = read(&INPUT, UnknownFieldHandling::StoreRaw).unwrap();
+
+        assert!(set.inner.is_empty());
+        assert_eq!(set.raw, INPUT);
+        assert_eq!(set.calculate_size(LengthBuilder::new()).map(LengthBuilder::build), Length::new(INPUT.len() as i32));
+        assert_eq!(write(&set), INPUT);
+    }
+
+    #[test]
+    fn raw_fields_decode_on_access() {
+        let raw = read(&INPUT, UnknownFieldHandling::StoreRaw).unwrap();
+        let decoded = read(&INPUT, UnknownFieldHandling::Store).unwrap();
+
+        assert_eq!(raw.values(num(1)), &[UnknownField::Varint(150)]);
+        assert_eq!(raw.values(num(3)), &[UnknownField::LengthDelimited(b"abc".to_vec().into_boxed_slice())]);
+        assert_eq!(raw.field_len(), 5);
+        assert_eq!(raw, decoded);
+        assert_eq!(raw.clone(), decoded);
+        // shared access doesn't replace the raw fields
+        assert_eq!(raw.raw, INPUT);
+    }
+
+    #[test]
+    fn mutable_access_decodes_raw_fields() {
+        let mut set = read(&INPUT, UnknownFieldHandling::StoreRaw).unwrap();
+        let _ = set.values(num(1));
+        set.push_value(num(1), UnknownField::Varint(2));
+
+        assert!(set.raw.is_empty());
+        assert_eq!(set.values(num(1)), &[UnknownField::Varint(150), UnknownField::Varint(2)]);
+
+        let written = write(&set);
+        assert_eq!(read(&written, UnknownFieldHandling::Store).unwrap(), set);
+    }
+
+    #[test]
+    fn merge_keeps_field_order() {
+        let mut set = read(&[8, 1], UnknownFieldHandling::StoreRaw).unwrap();
+        let mut other = UnknownFieldSet::new();
+        other.push_value(num(1), UnknownField::Varint(2));
+        set.merge(&other);
+        set.merge(&read(&[8, 3], UnknownFieldHandling::StoreRaw).unwrap());
+
+        let expected = [UnknownField::Varint(1), UnknownField::Varint(2), UnknownField::Varint(3)];
+        assert_eq!(set.values(num(1)), &expected);
+        assert_eq!(read(&write(&set), UnknownFieldHandling::Store).unwrap().values(num(1)), &expected);
+    }
+
+    #[test]
+    fn raw_read_extends_existing_fields() {
+        let mut set = read(&INPUT[..3], UnknownFieldHandling::Store).unwrap();
+        let mut input = read::Builder::new().unknown_fields(UnknownFieldHandling::StoreRaw).with_slice(&[8, 2]);
+        input.read_tag().unwrap();
+        set.try_add_field_from(&mut input).unwrap().or_skip().unwrap();
+
+        assert_eq!(set.values(num(1)), &[UnknownField::Varint(150), UnknownField::Varint(2)]);
+        assert_eq!(write(&set), [8, 150, 1, 8, 2]);
+    }
+
+    #[test]
+    fn truncated_raw_field_is_discarded() {
+        let mut set = read(&INPUT[..3], UnknownFieldHandling::StoreRaw).unwrap();
+        let mut input = read::Builder::new().unknown_fields(UnknownFieldHandling::StoreRaw).with_slice(&[26, 3, b'a']);
+        input.read_tag().unwrap();
+
+        assert!(set.try_add_field_from(&mut input).is_err());
+        assert_eq!(set.raw, INPUT[..3]);
+        assert_eq!(set.field_len(), 1);
+    }
+
+    #[test]
+    fn clear_keeps_raw_capacity() {
+        let mut set = read(&INPUT, UnknownFieldHandling::StoreRaw).unwrap();
+        let _ = set.fields().count();
+        set.clear();
+
+        assert!(set.is_empty());
+        assert!(set.raw.capacity() >= INPUT.len());
+        assert_eq!(set.fields().count(), 0);
+    }
+
+    #[test]
+    fn raw_fields_read_from_stream() {
+        let mut set = UnknownFieldSet::new();
+        let mut input = read::Builder::new().unknown_fields(UnknownFieldHandling::StoreRaw).with_capacity(3, INPUT.as_ref());
+        while input.read_tag().unwrap().is_some() {
+            set.try_add_field_from(&mut input).unwrap().or_skip().unwrap();
+        }
+
+        assert_eq!(set.raw, INPUT);
+    }
+
+    #[test]
+    fn reverse_write_matches_fields() {
+        let mut set = read(&INPUT, UnknownFieldHandling::Store).unwrap();
+        set.push_value(num(1), UnknownField::Varint(2));
+        let mut writer = ReverseWriter::new();
+        set.write_reverse(&mut writer).unwrap();
+
+        assert_eq!(writer.len(), write(&set).len());
+        assert_eq!(read(writer.as_bytes(), UnknownFieldHandling::Store).unwrap(), set);
+
+        let raw = read(&INPUT, UnknownFieldHandling::StoreRaw).unwrap();
+        let mut writer = ReverseWriter::new();
+        raw.write_reverse(&mut writer).unwrap();
+        assert_eq!(writer.as_bytes(), INPUT);
+    }
 }
\ No newline at end of file
@@ -1,5 +1,5 @@
 use crate::{UnknownFieldSet, Mergable, Message};
-use crate::io::{read, write, CodedReader, Input, CodedWriter, Output, FieldNumber, Tag, LengthBuilder};
+use crate::io::{read, write, CodedReader, Input, CodedWriter, Output, FieldNumber, Length, LengthBuilder};
 use crate::raw as r;
 
 #[derive(Default, Clone, Debug, PartialEq)]
@@ -43,26 +43,29 @@ impl Message for Timestamp {
     fn merge_from<T: Input>(&mut self, input: &mut CodedReader<T>) -> read::Result<()> {
         while let Some(field) = input.read_field()? {
             match field.tag() {
-                8 => field.read_value(unsafe { Tag::new_unchecked(8) }, |input| input.merge_value::<r::Int64>(&mut self.seconds))?,
-                16 => field.read_value(unsafe { Tag::new_unchecked(16) }, |input| input.merge_value::<r::Int32>(&mut self.nanos))?,
-                _ => field.check_and_read_value(|input| input.try_add_field_to(&mut self.unknown_fields)?.or_skip())?,
+                8 => field.merge_value::<r::Int64>(Self::SECONDS_NUMBER, &mut self.seconds)?,
+                16 => field.merge_value::<r::Int32>(Self::NANOS_NUMBER, &mut self.nanos)?,
+                _ => field.check_and_try_add_field_to(&mut self.unknown_fields)?.or_skip()?,
             }
         }
         Ok(())
     }
-    fn calculate_size(&self, mut builder: LengthBuilder) -> Option<LengthBuilder> {
+    fn clear(&mut self) {
+        self.seconds = 0;
+        self.nanos = 0;
+        self.unknown_fields.clear();
+    }
+    fn calculate_size(&self) -> Option<Length> {
+        let mut builder = LengthBuilder::new();
         if self.seconds != 0 {
-            builder =
-                builder.add_field::<r::Int64>(Self::SECONDS_NUMBER, self.seconds())?;
+            builder = builder.add_field::<r::Int64>(Self::SECONDS_NUMBER, self.seconds())?;
         }
         if self.nanos != 0 {
-            builder =
-                builder.add_field::<r::Int32>(Self::NANOS_NUMBER, self.nanos())?;
+            builder = builder.add_field::<r::Int32>(Self::NANOS_NUMBER, self.nanos())?;
         }
-        builder =
-            builder.add_fields(&self.unknown_fields)?;
-
-        Some(builder)
+        builder
+            .add_fields(&self.unknown_fields)
+            .map(LengthBuilder::build)
     }
     fn write_to<T: Output>(&self, output: &mut CodedWriter<T>) -> write::Result {
         if self.seconds != 0 {
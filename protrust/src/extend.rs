@@ -3,11 +3,11 @@
 use crate::Mergable;
 use crate::collections::{RepeatedField, FieldSet, TryRead};
 use crate::internal::Sealed;
-use crate::io::{read::{self, Input}, write::{self, Output}, FieldNumber, WireType, Tag, LengthBuilder, CodedReader, CodedWriter};
+use crate::io::{read::{self, Input}, write::{self, Output}, reverse::ReverseWriter, FieldNumber, WireType, Tag, LengthBuilder, CodedReader, CodedWriter};
 use crate::raw::{ValueType, Value, Packable, Packed};
-use std::any::TypeId;
+use std::any::{Any, TypeId};
 use std::borrow::{Borrow, Cow, ToOwned};
-use std::collections::{HashMap, hash_map};
+use std::collections::HashMap;
 use std::fmt::{self, Debug};
 use std::marker::PhantomData;
 use std::mem;
@@ -15,7 +15,7 @@ use std::mem;
 mod internal {
     use crate::{Mergable, merge};
     use crate::collections::{RepeatedField, RepeatedValue};
-    use crate::io::{read, write, FieldNumber, WireType, Tag, LengthBuilder, CodedReader, CodedWriter};
+    use crate::io::{read, write, reverse::ReverseWriter, FieldNumber, WireType, Tag, LengthBuilder, CodedReader, CodedWriter};
     use crate::raw::{ValueType, Value, Packable, Packed};
     use std::any::{Any, TypeId};
     use std::fmt::{self, Debug, Formatter};
@@ -51,6 +51,7 @@ mod internal {
         fn try_merge_from(&mut self, input: &mut CodedReader<read::Any>) -> read::Result<TryReadValue<()>>;
         fn calculate_size(&self, builder: LengthBuilder) -> Option<LengthBuilder>;
         fn write_to(&self, output: &mut CodedWriter<write::Any>) -> write::Result;
+        fn write_reverse(&self, output: &mut ReverseWriter) -> write::Result;
         fn is_initialized(&self) -> bool;
     }
 
@@ -111,6 +112,9 @@ mod internal {
         fn write_to(&self, output: &mut CodedWriter<write::Any>) -> write::Result {
             output.write_field::<V>(self.num, &self.value)
         }
+        fn write_reverse(&self, output: &mut ReverseWriter) -> write::Result {
+            output.write_field::<V>(self.num, &self.value)
+        }
         fn is_initialized(&self) -> bool {
             V::is_initialized(&self.value)
         }
@@ -188,6 +192,9 @@ mod internal {
         fn write_to(&self, output: &mut CodedWriter<write::Any>) -> write::Result {
             output.write_values::<_, V>(&self.value, self.num)
         }
+        fn write_reverse(&self, output: &mut ReverseWriter) -> write::Result {
+            output.write_values::<_, V>(&self.value, self.num)
+        }
         fn is_initialized(&self) -> bool {
             RepeatedValue::<V>::is_initialized(&self.value)
         }
@@ -238,6 +245,9 @@ mod internal {
         fn write_to(&self, output: &mut CodedWriter<write::Any>) -> write::Result {
             output.write_values::<_, Packed<V>>(&self.value, self.num)
         }
+        fn write_reverse(&self, output: &mut ReverseWriter) -> write::Result {
+            output.write_values::<_, Packed<V>>(&self.value, self.num)
+        }
         fn is_initialized(&self) -> bool {
             RepeatedValue::<Packed<V>>::is_initialized(&self.value)
         }
@@ -460,24 +470,48 @@ impl<T, V> ExtensionType for RepeatedExtension<T, Packed<V>>
 }
 
 
+/// The extensions of one extended message type, sorted by field number
+type Extensions = [(FieldNumber, &'static dyn ExtensionIdentifier)];
+
+/// Finds an extension in a sorted list of extensions
+#[inline]
+fn find_extension(extensions: &Extensions, num: FieldNumber) -> Option<&'static dyn ExtensionIdentifier> {
+    extensions.binary_search_by_key(&num, |&(num, _)| num).ok().map(|i| extensions[i].1)
+}
+
 /// A registry used to contain all the extensions from a generated code module
+/// 
+/// Registries are frozen when they're built. The extensions of each extended message are kept in their own
+/// sorted array, so reading an extension searches a short slice of field numbers with no hashing, and extension
+/// sets find their message's extensions once when they're given a registry.
 pub struct ExtensionRegistry {
-    by_num: HashMap<(TypeId, FieldNumber), &'static dyn ExtensionIdentifier>
+    /// The extensions of every extended message, sorted by the message's type ID
+    by_type: Box<[(TypeId, Box<Extensions>)]>,
 }
 
 impl ExtensionRegistry {
     /// Returns whether an extension registry contains the extension field
     pub fn contains<T: ?Sized + ExtensionIdentifier>(&self, id: &T) -> bool {
-        self.by_num
-            .get(&(id.message_type(), id.field_number()))
-            .map(|b| *b as *const dyn ExtensionIdentifier as *const u8 == id as *const T as *const u8)
+        find_extension(self.extensions_of(id.message_type()), id.field_number())
+            .map(|b| b as *const dyn ExtensionIdentifier as *const u8 == id as *const T as *const u8)
             .unwrap_or(false)
     }
+    /// Gets the extensions of the specified message type
+    #[inline]
+    fn extensions_of(&self, typ: TypeId) -> &Extensions {
+        match self.by_type.binary_search_by_key(&typ, |&(typ, _)| typ) {
+            Ok(i) => &self.by_type[i].1,
+            Err(_) => &[],
+        }
+    }
+    fn iter(&self) -> impl Iterator<Item = ((TypeId, FieldNumber), &'static dyn ExtensionIdentifier)> + '_ {
+        self.by_type.iter().flat_map(|(typ, extensions)| extensions.iter().map(move |&(num, id)| ((*typ, num), id)))
+    }
 }
 
 impl Debug for ExtensionRegistry {
     fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
-        self.by_num.keys().fmt(f)
+        f.debug_list().entries(self.iter().map(|(key, _)| key)).finish()
     }
 }
 
@@ -496,7 +530,7 @@ impl RegistryBuilder {
     /// Adds the extensions in the specified registry to this registry
     #[inline]
     pub fn add_registry(mut self, registry: &'static ExtensionRegistry) -> Result<Self, ExtensionConflict> {
-        for (&typ_num_pair, &id) in &registry.by_num {
+        for (typ_num_pair, id) in registry.iter() {
             if self.by_num.insert(typ_num_pair, id).is_some() {
                 return Err(ExtensionConflict(typ_num_pair.1));
             }
@@ -515,25 +549,49 @@ impl RegistryBuilder {
         }
     }
     /// Returns the extension registry
-    #[inline]
     pub fn build(self) -> ExtensionRegistry {
-        ExtensionRegistry { by_num: self.by_num }
+        let mut entries = self.by_num.into_iter().collect::<Vec<_>>();
+        entries.sort_unstable_by_key(|&(key, _)| key);
+
+        let mut by_type = Vec::<(TypeId, Vec<_>)>::new();
+        for ((typ, num), id) in entries {
+            match by_type.last_mut() {
+                Some((last, extensions)) if *last == typ => extensions.push((num, id)),
+                _ => by_type.push((typ, vec![(num, id)])),
+            }
+        }
+        ExtensionRegistry {
+            by_type: by_type.into_iter().map(|(typ, extensions)| (typ, extensions.into_boxed_slice())).collect()
+        }
     }
 }
 
 /// An error returned when two extensions are added to a registry builder that use the same field number
 pub struct ExtensionConflict(FieldNumber);
 
+/// The values in an extension set, sorted by field number
+type Values = Vec<(FieldNumber, Box<dyn AnyExtension>)>;
+
 /// A set of extension values that can be accessed by using generated extension identifiers
+/// 
+/// Values are kept in a vector sorted by field number. Messages almost always have only a few extensions set,
+/// so searching the vector is faster than hashing the field number, and an empty set doesn't allocate.
 pub struct ExtensionSet<T: ExtendableMessage> {
     t: PhantomData<fn(T)>,
     registry: Option<&'static ExtensionRegistry>,
-    by_num: HashMap<FieldNumber, Box<dyn AnyExtension>>,
+    /// The extensions of `T` in the registry
+    extensions: &'static Extensions,
+    values: Values,
 }
 
 impl<T: ExtendableMessage + 'static> ExtensionSet<T> {
     fn registry_contains<I: ?Sized + ExtensionIdentifier>(&self, extension: &I) -> bool {
-        self.registry.map_or(false, |r| r.contains(extension))
+        find_extension(self.extensions, extension.field_number())
+            .map_or(false, |b| b as *const dyn ExtensionIdentifier as *const u8 == extension as *const I as *const u8)
+    }
+    #[inline]
+    fn find(&self, num: FieldNumber) -> Result<usize, usize> {
+        self.values.binary_search_by_key(&num, |&(num, _)| num)
     }
 
     /// Returns a new set for this specified message
@@ -557,9 +615,14 @@ impl<T: ExtendableMessage + 'static> ExtensionSet<T> {
     /// 
     /// This clears all set extension values in this set even if you're replacing the registry with the same one.
     pub fn replace_registry(&mut self, new: Option<&'static ExtensionRegistry>) -> Option<&'static ExtensionRegistry> {
-        self.by_num.clear();
+        self.values.clear();
+        self.extensions = new.map_or(&[], |r| r.extensions_of(TypeId::of::<T>()));
         mem::replace(&mut self.registry, new)
     }
+    /// Clears all set extension values in this set, keeping the registry it uses.
+    pub fn clear(&mut self) {
+        self.values.clear();
+    }
 
     /// Returns whether the specified extension is contained in the registry used by this set
     /// and if the field has a set value.
@@ -568,14 +631,14 @@ impl<T: ExtendableMessage + 'static> ExtensionSet<T> {
     }
     /// Returns whether a field in this set has the field number of the specified extension
     pub fn has_extension_unchecked<U: ?Sized + ExtensionIdentifier>(&self, extension: &U) -> bool {
-        self.by_num.contains_key(&extension.field_number())
+        self.find(extension.field_number()).is_ok()
     }
 
     /// Gets the value of the specified extension if it's set. If the extension is not set, this returns None.
     pub fn value<U: ExtensionType<Extended = T>>(&self, extension: &U) -> Option<&U::Value> {
         if self.registry_contains(extension) {
-            self.by_num.get(&extension.field_number()).map(|v| unsafe {
-                (*(v.as_ref() as *const dyn AnyExtension as *const U::Entry)).as_ref()
+            self.find(extension.field_number()).ok().map(|i| unsafe {
+                (*(self.values[i].1.as_ref() as *const dyn AnyExtension as *const U::Entry)).as_ref()
             })
         } else {
             None
@@ -595,9 +658,10 @@ impl<T: ExtendableMessage + 'static> ExtensionSet<T> {
     /// Returns a Field which can be used to modify an extension value
     pub fn field<'a, 'e, U: 'e + ExtensionType<Extended = T>>(&'a mut self, extension: &'e U) -> Option<Field<'a, 'e, U>> {
         if self.registry_contains(extension) {
-            match self.by_num.entry(extension.field_number()) {
-                hash_map::Entry::Occupied(entry) => Some(Field::Occupied(OccupiedField { extension, entry })),
-                hash_map::Entry::Vacant(entry) => Some(Field::Vacant(VacantField { extension, entry })),
+            let values = &mut self.values;
+            match values.binary_search_by_key(&extension.field_number(), |&(num, _)| num) {
+                Ok(index) => Some(Field::Occupied(OccupiedField { extension, values, index })),
+                Err(index) => Some(Field::Vacant(VacantField { extension, values, index })),
             }
         } else {
             None
@@ -610,12 +674,14 @@ impl<T: ExtendableMessage + 'static> FieldSet for ExtensionSet<T> {
     fn try_add_field_from<'a, U: Input>(&mut self, input: &'a mut CodedReader<U>) -> read::Result<TryRead<'a, U>> {
         if let Some(tag) = input.last_tag() {
             let field = tag.field();
-            match self.by_num.entry(field) {
-                hash_map::Entry::Occupied(entry) => {
-                    let entry = entry.into_mut();
+            match self.find(field) {
+                Ok(index) => {
                     let mut any = input.as_any();
-                    match entry.try_merge_from(&mut any)? {
-                        TryReadValue::Consumed(()) => Ok(TryRead::Consumed),
+                    match self.values[index].1.try_merge_from(&mut any)? {
+                        TryReadValue::Consumed(()) => {
+                            record!(any.metrics_mut().extensions += 1);
+                            Ok(TryRead::Consumed)
+                        },
                         TryReadValue::Yielded => {
                             drop(any);
                             Ok(TryRead::Yielded(input))
@@ -623,21 +689,20 @@ impl<T: ExtendableMessage + 'static> FieldSet for ExtensionSet<T> {
                     }
                 },
                 // if the value doesn't already exist, try to find it in our registry
-                hash_map::Entry::Vacant(entry) => {
-                    if let Some(registry) = self.registry {
-                        if let Some(ext) = registry.by_num.get(&(TypeId::of::<T>(), field)) {
-                            let mut any = input.as_any();
-                            return match ext.try_read_value(&mut any)? {
-                                TryReadValue::Consumed(b) => {
-                                    entry.insert(b);
-                                    Ok(TryRead::Consumed)
-                                },
-                                TryReadValue::Yielded => {
-                                    drop(any);
-                                    Ok(TryRead::Yielded(input))
-                                }
-                            };
-                        }
+                Err(index) => {
+                    if let Some(ext) = find_extension(self.extensions, field) {
+                        let mut any = input.as_any();
+                        return match ext.try_read_value(&mut any)? {
+                            TryReadValue::Consumed(b) => {
+                                record!(any.metrics_mut().extensions += 1);
+                                self.values.insert(index, (field, b));
+                                Ok(TryRead::Consumed)
+                            },
+                            TryReadValue::Yielded => {
+                                drop(any);
+                                Ok(TryRead::Yielded(input))
+                            }
+                        };
                     }
 
                     Ok(TryRead::Yielded(input))
@@ -648,21 +713,27 @@ impl<T: ExtendableMessage + 'static> FieldSet for ExtensionSet<T> {
         }
     }
     fn calculate_size(&self, builder: LengthBuilder) -> Option<LengthBuilder> {
-        self.by_num
-            .values()
-            .try_fold(builder, |builder, field| field.calculate_size(builder))
+        self.values
+            .iter()
+            .try_fold(builder, |builder, (_, field)| field.calculate_size(builder))
     }
     fn write_to<U: Output>(&self, output: &mut CodedWriter<U>) -> write::Result {
-        if !self.by_num.is_empty() {
+        if !self.values.is_empty() {
             let mut output = output.as_any();
-            for field in self.by_num.values() {
+            for (_, field) in &self.values {
                 field.write_to(&mut output)?;
             }
         }
         Ok(())
     }
+    fn write_reverse(&self, output: &mut ReverseWriter) -> write::Result {
+        for (_, field) in self.values.iter().rev() {
+            field.write_reverse(output)?;
+        }
+        Ok(())
+    }
     fn is_initialized(&self) -> bool {
-        for field in self.by_num.values() {
+        for (_, field) in &self.values {
             if !field.is_initialized() {
                 return false;
             }
@@ -713,7 +784,8 @@ impl<'a, 'e, T: 'e + ExtensionType> Field<'a, 'e, T> {
 /// Represents an occupied field in an extension set
 pub struct OccupiedField<'a, 'e, T: 'e> {
     extension: &'e T,
-    entry: hash_map::OccupiedEntry<'a, FieldNumber, Box<dyn AnyExtension>>,
+    values: &'a mut Values,
+    index: usize,
 }
 
 impl<'a, 'e, T: 'e + ExtensionType> OccupiedField<'a, 'e, T> {
@@ -724,26 +796,26 @@ impl<'a, 'e, T: 'e + ExtensionType> OccupiedField<'a, 'e, T> {
 
     /// Takes ownership of the value, removing it from the set
     pub fn remove(self) -> T::Value {
-        let raw = Box::into_raw(self.entry.remove());
+        let raw = Box::into_raw(self.values.remove(self.index).1);
         let casted = unsafe { Box::from_raw(raw as *mut T::Entry) };
         T::entry_value(*casted)
     }
 
     /// Gets a reference to the value in the field.
     pub fn get(&self) -> &T::Value {
-        let ptr = self.entry.get().as_ref() as *const dyn AnyExtension as *const T::Entry;
+        let ptr = self.values[self.index].1.as_ref() as *const dyn AnyExtension as *const T::Entry;
         unsafe { (*ptr).as_ref() }
     }
 
     /// Gets a mutable reference to the value in the field.
     pub fn get_mut(&mut self) -> &mut T::Value {
-        let ptr = self.entry.get_mut().as_mut() as *mut dyn AnyExtension as *mut T::Entry;
+        let ptr = self.values[self.index].1.as_mut() as *mut dyn AnyExtension as *mut T::Entry;
         unsafe { (*ptr).as_mut() }
     }
 
     /// Converts the field into a mutable reference to the value in the entry with a lifetime bound to the set.
     pub fn into_mut(self) -> &'a mut T::Value {
-        let ptr = self.entry.into_mut().as_mut() as *mut dyn AnyExtension as *mut T::Entry;
+        let ptr = self.values[self.index].1.as_mut() as *mut dyn AnyExtension as *mut T::Entry;
         unsafe { (*ptr).as_mut() }
     }
 
@@ -756,7 +828,8 @@ impl<'a, 'e, T: 'e + ExtensionType> OccupiedField<'a, 'e, T> {
 /// Represents a field without a value in the set
 pub struct VacantField<'a, 'e, T: 'e> {
     extension: &'e T,
-    entry: hash_map::VacantEntry<'a, FieldNumber, Box<dyn AnyExtension>>,
+    values: &'a mut Values,
+    index: usize,
 }
 
 impl<'a, 'e, T: 'e + ExtensionType> VacantField<'a, 'e, T> {
@@ -766,8 +839,9 @@ impl<'a, 'e, T: 'e + ExtensionType> VacantField<'a, 'e, T> {
     }
     /// Inserts a value for the field, returning a mutable reference to the value
     pub fn insert(self, value: T::Value) -> &'a mut T::Value {
-        let borrow = self.entry.insert(Box::new(self.extension.new_entry(value)));
-        let ptr = borrow.as_mut() as *mut dyn AnyExtension as *mut T::Entry;
+        let num = self.extension.field_number();
+        self.values.insert(self.index, (num, Box::new(self.extension.new_entry(value))));
+        let ptr = self.values[self.index].1.as_mut() as *mut dyn AnyExtension as *mut T::Entry;
         unsafe { (*ptr).as_mut() }
     }
 }
@@ -777,7 +851,216 @@ impl<T: ExtendableMessage> Default for ExtensionSet<T> {
         Self {
             t: PhantomData,
             registry: None,
-            by_num: Default::default()
+            extensions: &[],
+            values: Vec::new(),
+        }
+    }
+}
+
+impl<T: ExtendableMessage> Clone for ExtensionSet<T> {
+    fn clone(&self) -> Self {
+        Self {
+            t: PhantomData,
+            registry: self.registry,
+            extensions: self.extensions,
+            values: self.values.iter().map(|(num, value)| (*num, value.clone_into_box())).collect()
         }
     }
-}
\ No newline at end of file
+}
+
+impl<T: ExtendableMessage> PartialEq for ExtensionSet<T> {
+    /// Returns whether both sets use the same registry and contain equal values for the same extensions
+    fn eq(&self, other: &Self) -> bool {
+        let same_registry = match (self.registry, other.registry) {
+            (Some(r), Some(o)) => std::ptr::eq(r, o),
+            (None, None) => true,
+            _ => false
+        };
+        same_registry &&
+        self.values.len() == other.values.len() &&
+        self.values.iter().zip(&other.values).all(|((num, value), (other_num, other))| {
+            let (value, other) = (value.as_ref(), other.as_ref());
+            num == other_num && Any::type_id(value) == Any::type_id(other) && AnyExtension::eq(value, other)
+        })
+    }
+}
+
+impl<T: ExtendableMessage> Debug for ExtensionSet<T> {
+    fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
+        f.debug_map().entries(self.values.iter().map(|(num, value)| (num, value))).finish()
+    }
+}
+#[cfg(test)]
+mod test {
+    use crate::{Message, UnknownFieldSet};
+    use crate::io::{read, write, CodedReader, CodedWriter, FieldNumber, Input, Length, LengthBuilder, Output};
+    use crate::io::reverse::ReverseWriter;
+    use crate::raw;
+    use std::marker::PhantomData;
+    use super::{ExtendableMessage, ExtensionRegistry, ExtensionSet, RegistryBuilder, RepeatedExtension};
+
+    macro_rules! message {
+        ($name:ident) => {
+            #[derive(Default, Clone, Debug, PartialEq)]
+            struct $name {
+                extensions: ExtensionSet<$name>,
+                unknown_fields: UnknownFieldSet,
+            }
+
+            impl ExtendableMessage for $name {
+                fn extensions(&self) -> &ExtensionSet<Self> {
+                    &self.extensions
+                }
+                fn extensions_mut(&mut self) -> &mut ExtensionSet<Self> {
+                    &mut self.extensions
+                }
+            }
+
+            impl Message for $name {
+                fn merge_from<T: Input>(&mut self, input: &mut CodedReader<T>) -> read::Result<()> {
+                    self.extensions.replace_registry(input.registry());
+                    while let Some(field) = input.read_field()? {
+                        field.check_and_try_add_field_to(&mut self.extensions)?
+                            .or_try(&mut self.unknown_fields)?
+                            .or_skip()?;
+                    }
+                    Ok(())
+                }
+                fn calculate_size(&self) -> Option<Length> {
+                    LengthBuilder::new()
+                        .add_fields(&self.extensions)?
+                        .add_fields(&self.unknown_fields)
+                        .map(LengthBuilder::build)
+                }
+                fn write_to<T: Output>(&self, output: &mut CodedWriter<T>) -> write::Result {
+                    output.write_fields(&self.extensions)?;
+                    output.write_fields(&self.unknown_fields)
+                }
+                fn write_reverse(&self, output: &mut ReverseWriter) -> write::Result {
+                    output.write_fields(&self.unknown_fields)?;
+                    output.write_fields(&self.extensions)
+                }
+                fn is_initialized(&self) -> bool {
+                    true
+                }
+                fn unknown_fields(&self) -> &UnknownFieldSet {
+                    &self.unknown_fields
+                }
+                fn unknown_fields_mut(&mut self) -> &mut UnknownFieldSet {
+                    &mut self.unknown_fields
+                }
+            }
+        };
+    }
+
+    message!(Options);
+    message!(Other);
+
+    const fn num(n: u32) -> FieldNumber {
+        unsafe { FieldNumber::new_unchecked(n) }
+    }
+
+    static FIRST: RepeatedExtension<Options, raw::Int32> = RepeatedExtension { t: PhantomData, num: num(1) };
+    static SECOND: RepeatedExtension<Options, raw::Int32> = RepeatedExtension { t: PhantomData, num: num(2) };
+    static THIRD: RepeatedExtension<Options, raw::Int32> = RepeatedExtension { t: PhantomData, num: num(3) };
+    static OTHER_FIRST: RepeatedExtension<Other, raw::Int32> = RepeatedExtension { t: PhantomData, num: num(1) };
+    static UNREGISTERED: RepeatedExtension<Options, raw::Int32> = RepeatedExtension { t: PhantomData, num: num(3) };
+
+    fn registry() -> &'static ExtensionRegistry {
+        let builder = RegistryBuilder::new()
+            .add_identifier(&THIRD).ok().unwrap()
+            .add_identifier(&OTHER_FIRST).ok().unwrap()
+            .add_identifier(&FIRST).ok().unwrap()
+            .add_identifier(&SECOND).ok().unwrap();
+        Box::leak(Box::new(builder.build()))
+    }
+
+    #[test]
+    fn registry_contains_identifiers() {
+        let registry = registry();
+        assert!(registry.contains(&FIRST));
+        assert!(registry.contains(&SECOND));
+        assert!(registry.contains(&THIRD));
+        assert!(registry.contains(&OTHER_FIRST));
+        assert!(!registry.contains(&UNREGISTERED));
+        assert_eq!(registry.extensions_of(std::any::TypeId::of::<Options>()).len(), 3);
+        assert!(registry.extensions_of(std::any::TypeId::of::<u8>()).is_empty());
+    }
+    #[test]
+    #[cfg(feature = "metrics")]
+    fn count_extensions() {
+        let data = [24, 3, 8, 1, 40, 5, 8, 2];
+        let mut reader = read::Builder::new().registry(Some(registry())).with_slice(&data);
+        Options::default().merge_from(&mut reader).unwrap();
+
+        assert_eq!(reader.metrics().extensions, 3);
+        assert_eq!(reader.metrics().unknown_fields, 1);
+    }
+    #[test]
+    fn registry_conflicts() {
+        let registry = registry();
+        assert!(RegistryBuilder::new().add_registry(registry).ok().unwrap().add_identifier(&UNREGISTERED).is_err());
+        let copy = RegistryBuilder::new().add_registry(registry).ok().unwrap().build();
+        assert_eq!(format!("{:?}", copy), format!("{:?}", registry));
+    }
+    #[test]
+    fn read_registered_extensions() {
+        let data = [24, 3, 8, 1, 40, 5, 8, 2];
+        let mut message = Options::default();
+        message.merge_from(&mut read::Builder::new().registry(Some(registry())).with_slice(&data)).unwrap();
+
+        assert_eq!(message.extensions.value(&FIRST), Some(&vec![1, 2]));
+        assert_eq!(message.extensions.value(&SECOND), None);
+        assert_eq!(message.extensions.value(&THIRD), Some(&vec![3]));
+        assert_eq!(message.extensions.value(&UNREGISTERED), None);
+        assert_eq!(message.unknown_fields.field_len(), 1);
+
+        // extensions are written in field number order
+        assert_eq!(message.to_bytes().unwrap(), [8, 1, 8, 2, 24, 3, 40, 5]);
+        let mut reverse = ReverseWriter::new();
+        message.write_reverse(&mut reverse).unwrap();
+        assert_eq!(reverse.as_bytes(), &[8, 1, 8, 2, 24, 3, 40, 5]);
+    }
+    #[test]
+    fn other_message_extensions_are_unknown() {
+        let data = [8, 1, 16, 2];
+        let mut message = Other::default();
+        message.merge_from(&mut read::Builder::new().registry(Some(registry())).with_slice(&data)).unwrap();
+
+        assert_eq!(message.extensions.value(&OTHER_FIRST), Some(&vec![1]));
+        assert_eq!(message.unknown_fields.field_len(), 1);
+    }
+    #[test]
+    fn fields_keep_values_sorted() {
+        let mut message = Options::default();
+        message.extensions.replace_registry(Some(registry()));
+        message.extensions.field(&THIRD).unwrap().or_insert(vec![3]);
+        message.extensions.field(&FIRST).unwrap().or_insert_with(Vec::new).push(1);
+        message.extensions.field(&SECOND).unwrap().or_insert(vec![2]);
+        assert!(message.extensions.field(&UNREGISTERED).is_none());
+
+        assert_eq!(message.to_bytes().unwrap(), [8, 1, 16, 2, 24, 3]);
+
+        let mut clone = message.clone();
+        assert_eq!(clone, message);
+        match clone.extensions.field(&SECOND).unwrap() {
+            super::Field::Occupied(field) => assert_eq!(field.remove(), vec![2]),
+            super::Field::Vacant(_) => panic!("expected an occupied field"),
+        }
+        assert!(!clone.extensions.has_extension(&SECOND));
+        assert_ne!(clone, message);
+        assert_eq!(clone.to_bytes().unwrap(), [8, 1, 24, 3]);
+    }
+    #[test]
+    fn clear_keeps_registry() {
+        let registry = registry();
+        let mut message = Options::default();
+        message.extensions.replace_registry(Some(registry));
+        message.extensions.field(&FIRST).unwrap().or_insert(vec![1]);
+
+        message.extensions.clear();
+        assert!(!message.extensions.has_extension(&FIRST));
+        assert!(message.extensions.has_registry(Some(registry)));
+        assert!(message.extensions.field(&FIRST).is_some());
+    }
+}
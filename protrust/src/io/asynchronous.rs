@@ -0,0 +1,686 @@
+//! Defines asynchronous readers and writers for sequences of length delimited messages.
+//!
+//! This crate doesn't depend on an async runtime, so [`AsyncRead`] and [`AsyncWrite`] are minimal poll based traits
+//! with the same shape as the traits of `futures` and `tokio`. Sockets from a runtime can be used by implementing them
+//! on a small wrapper that forwards to the runtime's own traits.
+//!
+//! An [`AsyncDecoder`] feeds the bytes of messages to a [`PushDecoder`] as they arrive, waiting on the input instead of
+//! blocking the thread, so each field is merged into the message as soon as it's read and frames are never buffered whole.
+//! An [`AsyncReader`] is a framing helper: it reads each frame's length and then all of its data into one reusable buffer,
+//! and hands out the frame or decodes a message from it once all of it is there.
+//! An [`AsyncWriter`] encodes messages into its buffer and writes them to the output when flushed.
+//!
+//! [`AsyncRead`]: trait.AsyncRead.html
+//! [`AsyncWrite`]: trait.AsyncWrite.html
+//! [`AsyncDecoder`]: struct.AsyncDecoder.html
+//! [`PushDecoder`]: ../push/struct.PushDecoder.html
+//! [`AsyncReader`]: struct.AsyncReader.html
+//! [`AsyncWriter`]: struct.AsyncWriter.html
+
+use crate::Message;
+use crate::io::{read, write, CodedWriter, DEFAULT_BUF_SIZE};
+use crate::io::push::{Feed, PushDecoder};
+use crate::raw::NewFor;
+use std::cmp;
+use std::future::Future;
+use std::io::{self, ErrorKind};
+use std::ops::Range;
+use std::pin::Pin;
+use std::task::{Context, Poll};
+
+/// Reads bytes from a source asynchronously.
+pub trait AsyncRead {
+    /// Attempts to read bytes into the buffer, returning the number of bytes read or 0 at the end of the source.
+    ///
+    /// If no bytes are available, this returns `Poll::Pending` and arranges for the task to be woken
+    /// when the source can be read again.
+    fn poll_read(self: Pin<&mut Self>, cx: &mut Context, buf: &mut [u8]) -> Poll<io::Result<usize>>;
+}
+
+/// Writes bytes to a sink asynchronously.
+pub trait AsyncWrite {
+    /// Attempts to write bytes from the buffer, returning the number of bytes written.
+    ///
+    /// If the sink can't take any bytes, this returns `Poll::Pending` and arranges for the task to be woken
+    /// when the sink can be written to again.
+    fn poll_write(self: Pin<&mut Self>, cx: &mut Context, buf: &[u8]) -> Poll<io::Result<usize>>;
+    /// Attempts to flush any bytes buffered by the sink to their destination.
+    fn poll_flush(self: Pin<&mut Self>, cx: &mut Context) -> Poll<io::Result<()>>;
+}
+
+impl AsyncRead for &[u8] {
+    fn poll_read(mut self: Pin<&mut Self>, _cx: &mut Context, buf: &mut [u8]) -> Poll<io::Result<usize>> {
+        Poll::Ready(io::Read::read(&mut *self, buf))
+    }
+}
+impl<T: ?Sized + AsyncRead + Unpin> AsyncRead for &mut T {
+    fn poll_read(mut self: Pin<&mut Self>, cx: &mut Context, buf: &mut [u8]) -> Poll<io::Result<usize>> {
+        Pin::new(&mut **self).poll_read(cx, buf)
+    }
+}
+impl<T: ?Sized + AsyncRead + Unpin> AsyncRead for Box<T> {
+    fn poll_read(mut self: Pin<&mut Self>, cx: &mut Context, buf: &mut [u8]) -> Poll<io::Result<usize>> {
+        Pin::new(&mut **self).poll_read(cx, buf)
+    }
+}
+
+impl AsyncWrite for Vec<u8> {
+    fn poll_write(self: Pin<&mut Self>, _cx: &mut Context, buf: &[u8]) -> Poll<io::Result<usize>> {
+        self.get_mut().extend_from_slice(buf);
+        Poll::Ready(Ok(buf.len()))
+    }
+    fn poll_flush(self: Pin<&mut Self>, _cx: &mut Context) -> Poll<io::Result<()>> {
+        Poll::Ready(Ok(()))
+    }
+}
+impl<T: ?Sized + AsyncWrite + Unpin> AsyncWrite for &mut T {
+    fn poll_write(mut self: Pin<&mut Self>, cx: &mut Context, buf: &[u8]) -> Poll<io::Result<usize>> {
+        Pin::new(&mut **self).poll_write(cx, buf)
+    }
+    fn poll_flush(mut self: Pin<&mut Self>, cx: &mut Context) -> Poll<io::Result<()>> {
+        Pin::new(&mut **self).poll_flush(cx)
+    }
+}
+impl<T: ?Sized + AsyncWrite + Unpin> AsyncWrite for Box<T> {
+    fn poll_write(mut self: Pin<&mut Self>, cx: &mut Context, buf: &[u8]) -> Poll<io::Result<usize>> {
+        Pin::new(&mut **self).poll_write(cx, buf)
+    }
+    fn poll_flush(mut self: Pin<&mut Self>, cx: &mut Context) -> Poll<io::Result<()>> {
+        Pin::new(&mut **self).poll_flush(cx)
+    }
+}
+
+struct ReadSome<'a, T: ?Sized> {
+    inner: &'a mut T,
+    buf: &'a mut [u8],
+}
+
+impl<T: ?Sized + AsyncRead + Unpin> Future for ReadSome<'_, T> {
+    type Output = io::Result<usize>;
+
+    fn poll(mut self: Pin<&mut Self>, cx: &mut Context) -> Poll<Self::Output> {
+        let this = &mut *self;
+        Pin::new(&mut *this.inner).poll_read(cx, this.buf)
+    }
+}
+
+struct WriteSome<'a, T: ?Sized> {
+    inner: &'a mut T,
+    buf: &'a [u8],
+}
+
+impl<T: ?Sized + AsyncWrite + Unpin> Future for WriteSome<'_, T> {
+    type Output = io::Result<usize>;
+
+    fn poll(mut self: Pin<&mut Self>, cx: &mut Context) -> Poll<Self::Output> {
+        let this = &mut *self;
+        Pin::new(&mut *this.inner).poll_write(cx, this.buf)
+    }
+}
+
+struct Flush<'a, T: ?Sized> {
+    inner: &'a mut T,
+}
+
+impl<T: ?Sized + AsyncWrite + Unpin> Future for Flush<'_, T> {
+    type Output = io::Result<()>;
+
+    fn poll(mut self: Pin<&mut Self>, cx: &mut Context) -> Poll<Self::Output> {
+        Pin::new(&mut *self.inner).poll_flush(cx)
+    }
+}
+
+/// A decoder of length delimited messages from an asynchronous input, the framing written by
+/// [`CodedWriter::write_delimited`](../write/struct.CodedWriter.html#method.write_delimited).
+///
+/// Bytes are read into a fixed size buffer and fed to a [`PushDecoder`](../push/struct.PushDecoder.html) as they arrive,
+/// so a message is decoded while it's being read, and only a field split between two reads is copied.
+///
+/// The decoder keeps all of its progress in itself, including the message decoded so far, so a read future that's dropped
+/// before it completes can be started again without losing any data. If a read returns an error, the decoder shouldn't
+/// be read from again.
+pub struct AsyncDecoder<T, M> {
+    inner: T,
+    buf: Box<[u8]>,
+    /// The range of the buffer holding data that hasn't been fed to the decoder yet
+    data: Range<usize>,
+    decoder: PushDecoder<M>,
+}
+
+impl<T: AsyncRead + Unpin, M: Message> AsyncDecoder<T, M> {
+    /// Creates a new decoder using the default reader options
+    pub fn new(inner: T) -> Self {
+        Self::with_builder(read::Builder::new(), inner)
+    }
+    /// Creates a new decoder that decodes messages with the options of the builder
+    pub fn with_builder(builder: read::Builder, inner: T) -> Self {
+        AsyncDecoder {
+            inner,
+            buf: vec![0; DEFAULT_BUF_SIZE].into_boxed_slice(),
+            data: 0..0,
+            decoder: PushDecoder::with_builder(builder, true),
+        }
+    }
+
+    /// Gets the bytes read from the input that haven't been fed to the decoder yet
+    pub fn buffered(&self) -> &[u8] {
+        &self.buf[self.data.clone()]
+    }
+    /// Returns the underlying input, dropping any buffered data and partially decoded message
+    pub fn into_inner(self) -> T {
+        self.inner
+    }
+
+    /// Reads a new length delimited message, returning None if the input ended before the message.
+    pub async fn read_delimited(&mut self) -> read::Result<Option<M>> {
+        loop {
+            if !self.data.is_empty() {
+                let mut chunk = &self.buf[self.data.clone()];
+                let len = chunk.len();
+                let fed = self.decoder.feed(&mut chunk);
+                self.data.start += len - chunk.len();
+                if let Feed::Done(message) = fed? {
+                    return Ok(Some(message));
+                }
+            }
+
+            let read = ReadSome { inner: &mut self.inner, buf: &mut self.buf }.await;
+            match read {
+                Ok(0) if self.decoder.between_frames() => return Ok(None),
+                Ok(0) => return Err(io::Error::from(ErrorKind::UnexpectedEof).into()),
+                Ok(read) => self.data = 0..read,
+                Err(e) if e.kind() == ErrorKind::Interrupted => { },
+                Err(e) => return Err(e.into()),
+            }
+        }
+    }
+}
+
+/// A framing helper that reads length delimited values from an asynchronous input, the framing written by
+/// [`CodedWriter::write_delimited`](../write/struct.CodedWriter.html#method.write_delimited).
+///
+/// Each frame is read whole into a buffer that's reused between frames before it's returned or decoded, so use an
+/// [`AsyncDecoder`](struct.AsyncDecoder.html) to decode large messages as they arrive. The buffer grows with the data
+/// as it arrives, so a frame's length alone doesn't allocate space for the entire frame. Any bytes read past the end
+/// of a frame are kept for the next one.
+///
+/// The reader keeps all of its progress in itself, so a read future that's dropped before it
+/// completes can be started again without losing any data.
+pub struct AsyncReader<T> {
+    inner: T,
+    buf: Box<[u8]>,
+    /// The range of the buffer holding data that hasn't been read yet
+    data: Range<usize>,
+    builder: read::Builder,
+}
+
+impl<T: AsyncRead + Unpin> AsyncReader<T> {
+    /// Creates a new reader using the default reader options
+    pub fn new(inner: T) -> Self {
+        Self::with_builder(read::Builder::new(), inner)
+    }
+    /// Creates a new reader that reads messages with the options of the builder
+    pub fn with_builder(builder: read::Builder, inner: T) -> Self {
+        AsyncReader {
+            inner,
+            buf: Box::default(),
+            data: 0..0,
+            builder,
+        }
+    }
+
+    /// Gets the bytes read from the input that haven't been read as messages yet
+    pub fn buffered(&self) -> &[u8] {
+        &self.buf[self.data.clone()]
+    }
+    /// Returns the underlying input, dropping any buffered data
+    pub fn into_inner(self) -> T {
+        self.inner
+    }
+
+    /// Reads the next length delimited value, returning its data or None if the input ended before the value.
+    pub async fn read_frame(&mut self) -> read::Result<Option<&[u8]>> {
+        let frame = self.next_frame().await?;
+        Ok(frame.map(move |frame| &self.buf[frame]))
+    }
+    /// Reads a new length delimited message, returning None if the input ended before the message.
+    pub async fn read_delimited<M: Message>(&mut self) -> read::Result<Option<M>> {
+        match self.next_frame().await? {
+            Some(frame) => {
+                let mut input = self.builder.with_slice(&self.buf[frame]);
+                let mut message = M::new_for(&input);
+                input.merge_message(&mut message)?;
+                Ok(Some(message))
+            },
+            None => Ok(None),
+        }
+    }
+    /// Merges the next length delimited message into an existing message, returning false if the input ended before the message.
+    pub async fn merge_delimited<M: Message>(&mut self, message: &mut M) -> read::Result<bool> {
+        match self.next_frame().await? {
+            Some(frame) => {
+                self.builder.with_slice(&self.buf[frame]).merge_message(message)?;
+                Ok(true)
+            },
+            None => Ok(false),
+        }
+    }
+
+    /// Reads the next frame into the buffer, returning the range of its data
+    async fn next_frame(&mut self) -> read::Result<Option<Range<usize>>> {
+        let (prefix, len) = match self.read_length().await? {
+            Some(length) => length,
+            None => return Ok(None),
+        };
+        if !self.fill(prefix + len).await? {
+            return Err(io::Error::from(ErrorKind::UnexpectedEof).into());
+        }
+        let start = self.data.start + prefix;
+        self.data.start = start + len;
+        Ok(Some(start..start + len))
+    }
+    /// Reads a length from the buffer, returning the number of bytes it used and its value
+    async fn read_length(&mut self) -> read::Result<Option<(usize, usize)>> {
+        loop {
+            let buffered = self.buffered();
+            let mut value = 0u64;
+            for (i, &byte) in buffered.iter().take(10).enumerate() {
+                value |= u64::from(byte & 0x7f) << (7 * i);
+                if byte < 0x80 {
+                    let length = value as u32 as i32;
+                    return if length < 0 {
+                        Err(read::Error::NegativeSize)
+                    } else {
+                        Ok(Some((i + 1, length as usize)))
+                    };
+                }
+            }
+            let len = buffered.len();
+            if len >= 10 {
+                return Err(read::Error::MalformedVarint);
+            }
+            if !self.fill(len + 1).await? {
+                return if len == 0 {
+                    Ok(None)
+                } else {
+                    Err(io::Error::from(ErrorKind::UnexpectedEof).into())
+                };
+            }
+        }
+    }
+    /// Reads from the input until at least `len` bytes are buffered, returning false if the input ends first
+    async fn fill(&mut self, len: usize) -> io::Result<bool> {
+        while self.data.len() < len {
+            if self.data.end == self.buf.len() {
+                self.make_room(len);
+            }
+            let read = ReadSome { inner: &mut self.inner, buf: &mut self.buf[self.data.end..] }.await;
+            match read {
+                Ok(0) => return Ok(false),
+                Ok(read) => self.data.end += read,
+                Err(e) if e.kind() == ErrorKind::Interrupted => { },
+                Err(e) => return Err(e),
+            }
+        }
+        Ok(true)
+    }
+    /// Makes space after the buffered data by moving it to the front of the buffer, or by growing the buffer if
+    /// `len` bytes won't fit. The buffer grows with the data that's arrived, so a large length doesn't
+    /// allocate space for the entire value up front.
+    #[cold]
+    fn make_room(&mut self, len: usize) {
+        let buffered = self.data.len();
+        if self.data.start != 0 && self.buf.len() >= len {
+            self.buf.copy_within(self.data.clone(), 0);
+        } else {
+            // the buffer doubles up to the length needed, so a large length alone doesn't allocate space for it all,
+            // but it's never smaller than the default size so small reads like a length's bytes don't each reallocate
+            let grown = cmp::max(self.buf.len() * 2, DEFAULT_BUF_SIZE);
+            let cap = cmp::max(cmp::min(len, grown), DEFAULT_BUF_SIZE);
+            let mut buf = vec![0; cap].into_boxed_slice();
+            buf[..buffered].copy_from_slice(self.buffered());
+            self.buf = buf;
+        }
+        self.data = 0..buffered;
+    }
+}
+
+/// A writer of length delimited messages to an asynchronous output.
+///
+/// Messages are encoded into the writer's buffer when they're written and written
+/// to the output when the writer is flushed. Like the reader, the writer keeps its progress in itself,
+/// so a flush that's dropped before it completes continues from where it stopped when it's started again.
+pub struct AsyncWriter<T> {
+    inner: T,
+    buf: Vec<u8>,
+    /// The number of bytes at the start of the buffer already written to the output
+    written: usize,
+}
+
+impl<T: AsyncWrite + Unpin> AsyncWriter<T> {
+    /// Creates a new writer
+    pub fn new(inner: T) -> Self {
+        Self::with_capacity(DEFAULT_BUF_SIZE, inner)
+    }
+    /// Creates a new writer with the specified buffer capacity
+    pub fn with_capacity(cap: usize, inner: T) -> Self {
+        AsyncWriter {
+            inner,
+            buf: Vec::with_capacity(cap),
+            written: 0,
+        }
+    }
+
+    /// Gets the number of bytes buffered that haven't been written to the output
+    pub fn buffered(&self) -> usize {
+        self.buf.len() - self.written
+    }
+    /// Returns the underlying output, dropping any data that hasn't been flushed
+    pub fn into_inner(self) -> T {
+        self.inner
+    }
+
+    /// Encodes a message preceded by its length into the buffer. If the message can't be written, nothing is buffered.
+    pub fn write_delimited<M: Message>(&mut self, message: &M) -> write::Result {
+        let start = self.buf.len();
+        let result = CodedWriter::with_vec(&mut self.buf).write_delimited(message);
+        if result.is_err() {
+            self.buf.truncate(start);
+        }
+        result
+    }
+    /// Writes everything buffered to the output and flushes the output.
+    pub async fn flush(&mut self) -> io::Result<()> {
+        while self.written != self.buf.len() {
+            let written = WriteSome { inner: &mut self.inner, buf: &self.buf[self.written..] }.await;
+            match written {
+                Ok(0) => return Err(ErrorKind::WriteZero.into()),
+                Ok(written) => self.written += written,
+                Err(e) if e.kind() == ErrorKind::Interrupted => { },
+                Err(e) => return Err(e),
+            }
+        }
+        self.buf.clear();
+        self.written = 0;
+        Flush { inner: &mut self.inner }.await
+    }
+}
+
+#[cfg(test)]
+mod test {
+    use crate::io::{read, CodedWriter, DEFAULT_BUF_SIZE};
+    use crate::test_support::{Record, Required};
+    use std::future::Future;
+    use std::io::{self, ErrorKind};
+    use std::pin::Pin;
+    use std::ptr;
+    use std::task::{Context, Poll, RawWaker, RawWakerVTable, Waker};
+    use super::{AsyncRead, AsyncWrite, AsyncDecoder, AsyncReader, AsyncWriter};
+
+    fn record(id: i32) -> Record {
+        Record::new(id, id as usize * 50)
+    }
+
+    /// Polls the future to completion, returning the result and the number of times it was pending
+    fn block_on<F: Future>(future: F) -> (F::Output, usize) {
+        const VTABLE: RawWakerVTable = RawWakerVTable::new(|_| RawWaker::new(ptr::null(), &VTABLE), |_| { }, |_| { }, |_| { });
+        let waker = unsafe { Waker::from_raw(RawWaker::new(ptr::null(), &VTABLE)) };
+        let mut cx = Context::from_waker(&waker);
+        let mut future = Box::pin(future);
+        let mut pending = 0;
+        loop {
+            match future.as_mut().poll(&mut cx) {
+                Poll::Ready(output) => return (output, pending),
+                Poll::Pending => pending += 1,
+            }
+        }
+    }
+
+    /// An input or output that moves at most `chunk` bytes at a time, and is pending before every move
+    struct Trickle {
+        data: Vec<u8>,
+        pos: usize,
+        chunk: usize,
+        ready: bool,
+    }
+
+    impl Trickle {
+        fn new(data: Vec<u8>, chunk: usize) -> Self {
+            Trickle { data, pos: 0, chunk, ready: false }
+        }
+        fn poll_ready(&mut self, cx: &mut Context) -> Poll<()> {
+            self.ready = !self.ready;
+            if self.ready {
+                cx.waker().wake_by_ref();
+                Poll::Pending
+            } else {
+                Poll::Ready(())
+            }
+        }
+    }
+
+    impl AsyncRead for Trickle {
+        fn poll_read(mut self: Pin<&mut Self>, cx: &mut Context, buf: &mut [u8]) -> Poll<io::Result<usize>> {
+            if self.poll_ready(cx).is_pending() {
+                return Poll::Pending;
+            }
+            let len = buf.len().min(self.chunk).min(self.data.len() - self.pos);
+            buf[..len].copy_from_slice(&self.data[self.pos..self.pos + len]);
+            self.pos += len;
+            Poll::Ready(Ok(len))
+        }
+    }
+
+    impl AsyncWrite for Trickle {
+        fn poll_write(mut self: Pin<&mut Self>, cx: &mut Context, buf: &[u8]) -> Poll<io::Result<usize>> {
+            if self.poll_ready(cx).is_pending() {
+                return Poll::Pending;
+            }
+            let len = buf.len().min(self.chunk);
+            self.data.extend_from_slice(&buf[..len]);
+            Poll::Ready(Ok(len))
+        }
+        fn poll_flush(self: Pin<&mut Self>, _cx: &mut Context) -> Poll<io::Result<()>> {
+            Poll::Ready(Ok(()))
+        }
+    }
+
+    fn records() -> Vec<Record> {
+        (0..20).map(record).collect()
+    }
+
+    fn encode(records: &[Record]) -> Vec<u8> {
+        let mut output = Vec::new();
+        let mut writer = CodedWriter::with_vec(&mut output);
+        for record in records {
+            writer.write_delimited(record).unwrap();
+        }
+        drop(writer);
+        output
+    }
+
+    async fn read_all<T: AsyncRead + Unpin>(reader: &mut AsyncReader<T>) -> read::Result<Vec<Record>> {
+        let mut records = Vec::new();
+        while let Some(record) = reader.read_delimited().await? {
+            records.push(record);
+        }
+        Ok(records)
+    }
+
+    #[test]
+    fn read_from_slice() {
+        let data = encode(&records());
+        let mut reader = AsyncReader::new(data.as_slice());
+        let (read, pending) = block_on(read_all(&mut reader));
+
+        assert_eq!(read.unwrap(), records());
+        assert_eq!(pending, 0);
+    }
+
+    #[test]
+    fn read_as_data_arrives() {
+        let data = encode(&records());
+        for &chunk in &[1, 7, 100, 5000] {
+            let mut reader = AsyncReader::new(Trickle::new(data.clone(), chunk));
+            let (read, pending) = block_on(read_all(&mut reader));
+
+            assert_eq!(read.unwrap(), records());
+            assert!(pending > 0);
+        }
+    }
+
+    #[test]
+    fn large_length_grows_with_data() {
+        // a frame claiming to be 100MB that ends after a few bytes
+        let mut reader = AsyncReader::new(&[128, 128, 128, 50, 8, 1][..]);
+        match block_on(reader.read_frame()).0 {
+            Err(read::Error::IoError(e)) if e.kind() == ErrorKind::UnexpectedEof => { },
+            other => panic!("expected an unexpected eof, got {:?}", other),
+        }
+        assert!(reader.buf.len() < 64 * 1024);
+    }
+
+    #[test]
+    fn small_reads_share_one_buffer() {
+        let data = encode(&records()[..3]);
+        let mut reader = AsyncReader::new(Trickle::new(data, 1));
+        assert_eq!(block_on(reader.read_delimited::<Record>()).0.unwrap(), Some(record(0)));
+        // reading a length and a frame a byte at a time allocates the default buffer once
+        let buf = reader.buf.as_ptr();
+        assert_eq!(reader.buf.len(), DEFAULT_BUF_SIZE);
+
+        assert_eq!(block_on(reader.read_delimited::<Record>()).0.unwrap(), Some(record(1)));
+        assert_eq!(block_on(reader.read_delimited::<Record>()).0.unwrap(), Some(record(2)));
+        assert_eq!(reader.buf.as_ptr(), buf);
+    }
+
+    #[test]
+    fn truncated_length_fails() {
+        let mut reader = AsyncReader::new(&[2, 8, 1, 128][..]);
+        assert_eq!(block_on(reader.read_frame()).0.unwrap(), Some(&[8, 1][..]));
+        assert!(block_on(reader.read_frame()).0.is_err());
+    }
+
+    #[test]
+    fn merge_delimited() {
+        let data = encode(&[record(1), record(2)]);
+        let mut reader = AsyncReader::new(data.as_slice());
+        let mut record = Record::default();
+
+        assert!(block_on(reader.merge_delimited(&mut record)).0.unwrap());
+        assert!(block_on(reader.merge_delimited(&mut record)).0.unwrap());
+        assert!(!block_on(reader.merge_delimited(&mut record)).0.unwrap());
+        assert_eq!(record.id, 2);
+    }
+
+    #[test]
+    fn delimited_messages_are_checked() {
+        // a message with its required id followed by one without it
+        let data = [2, 8, 1, 0];
+        let checked = read::Builder::new().check_initialized(true);
+
+        let mut reader = AsyncReader::with_builder(checked.clone(), &data[..]);
+        assert_eq!(block_on(reader.read_delimited::<Required>()).0.unwrap(), Some(Required::new(Some(1))));
+        assert!(matches!(block_on(reader.read_delimited::<Required>()).0, Err(read::Error::Uninitialized)));
+
+        let mut reader = AsyncReader::with_builder(checked.clone(), &data[..]);
+        let mut message = Required::default();
+        assert!(block_on(reader.merge_delimited(&mut message)).0.unwrap());
+        assert!(matches!(block_on(reader.merge_delimited(&mut Required::default())).0, Err(read::Error::Uninitialized)));
+
+        // merging the empty frame into a message that already has its id is fine
+        let mut reader = AsyncReader::with_builder(checked, &data[..]);
+        assert!(block_on(reader.merge_delimited(&mut message)).0.unwrap());
+        assert!(block_on(reader.merge_delimited(&mut message)).0.unwrap());
+        assert!(!block_on(reader.merge_delimited(&mut message)).0.unwrap());
+
+        // nothing is checked by default
+        let mut reader = AsyncReader::new(&data[2..]);
+        assert_eq!(block_on(reader.read_delimited::<Required>()).0.unwrap(), Some(Required::new(None)));
+    }
+
+    #[test]
+    fn write_partial() {
+        let mut writer = AsyncWriter::new(Trickle::new(Vec::new(), 13));
+        for record in &records() {
+            writer.write_delimited(record).unwrap();
+        }
+        assert_eq!(writer.buffered(), encode(&records()).len());
+
+        let (result, pending) = block_on(writer.flush());
+        result.unwrap();
+        assert!(pending > 0);
+        assert_eq!(writer.buffered(), 0);
+        assert_eq!(writer.into_inner().data, encode(&records()));
+    }
+
+    #[test]
+    fn roundtrip() {
+        let mut writer = AsyncWriter::new(Vec::new());
+        for record in &records() {
+            writer.write_delimited(record).unwrap();
+        }
+        block_on(writer.flush()).0.unwrap();
+        let data = writer.into_inner();
+
+        let mut reader = AsyncReader::new(data.as_slice());
+        assert_eq!(block_on(read_all(&mut reader)).0.unwrap(), records());
+    }
+
+    async fn decode_all<T: AsyncRead + Unpin>(decoder: &mut AsyncDecoder<T, Record>) -> read::Result<Vec<Record>> {
+        let mut records = Vec::new();
+        while let Some(record) = decoder.read_delimited().await? {
+            records.push(record);
+        }
+        Ok(records)
+    }
+
+    #[test]
+    fn decode_as_data_arrives() {
+        let data = encode(&records());
+        for &chunk in &[1, 7, 100, 5000, 100_000] {
+            let mut decoder = AsyncDecoder::new(Trickle::new(data.clone(), chunk));
+            let (read, pending) = block_on(decode_all(&mut decoder));
+
+            assert_eq!(read.unwrap(), records());
+            assert!(pending > 0);
+        }
+    }
+
+    #[test]
+    fn decode_resumes_after_drop() {
+        // a message larger than the decoder's buffer, with each read future dropped after a few polls
+        let records = [record(400), record(3)];
+        let mut decoder = AsyncDecoder::<_, Record>::new(Trickle::new(encode(&records), 100));
+        assert!(decoder.buf.len() < records[0].name.len());
+
+        const VTABLE: RawWakerVTable = RawWakerVTable::new(|_| RawWaker::new(ptr::null(), &VTABLE), |_| { }, |_| { }, |_| { });
+        let waker = unsafe { Waker::from_raw(RawWaker::new(ptr::null(), &VTABLE)) };
+        let mut cx = Context::from_waker(&waker);
+        let mut read = Vec::new();
+        loop {
+            let mut future = Box::pin(decoder.read_delimited());
+            let poll = (0..5).map(|_| future.as_mut().poll(&mut cx)).find(Poll::is_ready);
+            match poll {
+                Some(Poll::Ready(Ok(Some(record)))) => read.push(record),
+                Some(Poll::Ready(Ok(None))) => break,
+                Some(other) => panic!("unexpected result: {:?}", other),
+                None => { },
+            }
+        }
+        assert_eq!(read, records);
+    }
+
+    #[test]
+    fn decode_truncated_fails() {
+        let data = encode(&[record(3)]);
+        let mut decoder = AsyncDecoder::<_, Record>::new(&data[..data.len() - 1]);
+        match block_on(decoder.read_delimited()).0 {
+            Err(read::Error::IoError(e)) if e.kind() == ErrorKind::UnexpectedEof => { },
+            other => panic!("expected an unexpected eof, got {:?}", other),
+        }
+
+        let mut decoder = AsyncDecoder::<_, Record>::new(&[][..]);
+        assert_eq!(block_on(decoder.read_delimited()).0.unwrap(), None);
+    }
+}
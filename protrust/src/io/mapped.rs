@@ -0,0 +1,405 @@
+//! Defines memory mapped file input and an index of the length delimited records in it.
+//!
+//! A [`MappedFile`] exposes the contents of a file as one slice, so it's read with a
+//! [`CodedReader`] over a [`Slice`] without copying anything into a stream buffer, and borrowed
+//! values can point straight into the file. A [`RecordIndex`] is built in one pass that only
+//! skips over each record, and gives constant time access to any record in the file as well as
+//! ranges of records to read on separate threads. The index can be saved next to the file and
+//! loaded again to skip that pass entirely.
+//!
+//! On platforms without `mmap`, the file is read into memory instead.
+//!
+//! [`MappedFile`]: struct.MappedFile.html
+//! [`RecordIndex`]: struct.RecordIndex.html
+//! [`CodedReader`]: ../read/struct.CodedReader.html
+//! [`Slice`]: ../read/struct.Slice.html
+//!
+//! # Examples
+//!
+//! ```ignore
+//! use protrust::io::CodedWriter;
+//! use protrust::io::mapped::{MappedFile, RecordIndex};
+//! # use protrust::doctest::timestamp::Timestamp;
+//! # let path = std::env::temp_dir().join(format!("protrust-mapped-doc-{}", std::process::id()));
+//! # std::fs::write(&path, [2, 8, 1, 0, 2, 16, 2]).unwrap();
+//!
+//! // the file must not be changed by another process while it's mapped
+//! let file = unsafe { MappedFile::open(&path) }.unwrap();
+//! let index = RecordIndex::build(&file)?;
+//!
+//! assert_eq!(index.len(), 3);
+//! assert_eq!(index.record(&file, 2), Some(&[16, 2][..]));
+//!
+//! let last: Timestamp = index.read(&file, 2).unwrap()?;
+//! assert_eq!(last.nanos(), &2);
+//! # drop(file);
+//! # std::fs::remove_file(&path).unwrap();
+//! # Ok::<(), protrust::io::read::Error>(())
+//! ```
+
+use crate::Message;
+use crate::raw::NewFor;
+use std::convert::TryFrom;
+use std::fs::File;
+use std::io::{self, ErrorKind, Read, Write};
+use std::ops::{Deref, Range};
+use std::path::Path;
+use super::read::{self, CodedReader, Slice};
+use super::varint;
+
+#[cfg(unix)]
+mod sys {
+    use std::os::raw::{c_int, c_long, c_void};
+
+    pub const PROT_READ: c_int = 1;
+    pub const MAP_PRIVATE: c_int = 2;
+    pub const MAP_FAILED: *mut c_void = !0 as *mut c_void;
+
+    extern "C" {
+        pub fn mmap(addr: *mut c_void, len: usize, prot: c_int, flags: c_int, fd: c_int, offset: c_long) -> *mut c_void;
+        pub fn munmap(addr: *mut c_void, len: usize) -> c_int;
+    }
+}
+
+/// A read-only view of the contents of a file, mapped into memory where the platform supports it.
+pub struct MappedFile {
+    #[cfg(unix)]
+    ptr: *const u8,
+    #[cfg(unix)]
+    len: usize,
+    #[cfg(not(unix))]
+    data: Vec<u8>,
+}
+
+unsafe impl Send for MappedFile { }
+unsafe impl Sync for MappedFile { }
+
+impl MappedFile {
+    /// Opens the file at the path and maps it into memory.
+    ///
+    /// # Safety
+    ///
+    /// The file must not be modified or truncated while it's mapped, by this process or any other.
+    /// Changes to the file are visible through the mapping, which breaks the guarantees of the slice it's read through.
+    pub unsafe fn open<P: AsRef<Path>>(path: P) -> io::Result<Self> {
+        Self::map(&File::open(path)?)
+    }
+
+    /// Maps the contents of the open file into memory. The file can be closed after it's mapped.
+    ///
+    /// # Safety
+    ///
+    /// The file must not be modified or truncated while it's mapped, the same as [`open`](#method.open).
+    #[cfg(unix)]
+    pub unsafe fn map(file: &File) -> io::Result<Self> {
+        use std::os::unix::io::AsRawFd;
+
+        let len = usize::try_from(file.metadata()?.len()).map_err(|_| io::Error::new(ErrorKind::InvalidInput, "the file is too large to map"))?;
+        if len == 0 {
+            // zero length mappings are invalid, so an empty file maps to nothing
+            return Ok(MappedFile { ptr: std::ptr::NonNull::dangling().as_ptr(), len: 0 });
+        }
+
+        let ptr = sys::mmap(std::ptr::null_mut(), len, sys::PROT_READ, sys::MAP_PRIVATE, file.as_raw_fd(), 0);
+        if ptr == sys::MAP_FAILED {
+            return Err(io::Error::last_os_error());
+        }
+        Ok(MappedFile { ptr: ptr as *const u8, len })
+    }
+
+    /// Reads the contents of the open file into memory.
+    ///
+    /// # Safety
+    ///
+    /// This is always safe on platforms without `mmap`, and is only unsafe to match [`open`](#method.open).
+    #[cfg(not(unix))]
+    pub unsafe fn map(mut file: &File) -> io::Result<Self> {
+        let mut data = Vec::new();
+        file.read_to_end(&mut data)?;
+        Ok(MappedFile { data })
+    }
+
+    /// Gets the contents of the file
+    #[inline]
+    pub fn as_bytes(&self) -> &[u8] {
+        #[cfg(unix)]
+        unsafe { std::slice::from_raw_parts(self.ptr, self.len) }
+        #[cfg(not(unix))]
+        { &self.data }
+    }
+
+    /// Creates a new [`CodedReader`](../read/struct.CodedReader.html) over the contents of the file with the builder
+    pub fn reader(&self, builder: &read::Builder) -> CodedReader<Slice<'_>> {
+        builder.with_slice(self.as_bytes())
+    }
+}
+
+impl Deref for MappedFile {
+    type Target = [u8];
+
+    #[inline]
+    fn deref(&self) -> &[u8] {
+        self.as_bytes()
+    }
+}
+
+impl AsRef<[u8]> for MappedFile {
+    #[inline]
+    fn as_ref(&self) -> &[u8] {
+        self.as_bytes()
+    }
+}
+
+#[cfg(unix)]
+impl Drop for MappedFile {
+    fn drop(&mut self) {
+        if self.len != 0 {
+            unsafe { sys::munmap(self.ptr as *mut _, self.len); }
+        }
+    }
+}
+
+/// Reads the length prefix at the start of the data, returning the length and the number of bytes used by the prefix
+fn read_prefix(data: &[u8]) -> read::Result<(usize, usize)> {
+    let mut bytes = [0u8; 10];
+    let available = data.len().min(10);
+    bytes[..available].copy_from_slice(&data[..available]);
+    let (value, used) = match varint::decode(&bytes) {
+        Some((_, used)) if used > available => return Err(io::Error::from(ErrorKind::UnexpectedEof).into()),
+        Some(result) => result,
+        None => return Err(read::Error::MalformedVarint),
+    };
+    let len = value as u32 as i32;
+    if len < 0 {
+        return Err(read::Error::NegativeSize);
+    }
+    Ok((len as usize, used))
+}
+
+/// An index of the offsets of length delimited records, the same framing read by
+/// [`CodedReader::read_delimited`](../read/struct.CodedReader.html#method.read_delimited).
+#[derive(Clone, Debug, Default, PartialEq, Eq)]
+pub struct RecordIndex {
+    /// The offset of each record's length prefix, followed by the end of the last record
+    offsets: Vec<u64>,
+}
+
+impl RecordIndex {
+    /// Builds an index of the records in the data, skipping over each record without reading it.
+    pub fn build(data: &[u8]) -> read::Result<Self> {
+        let mut offsets = vec![0];
+        let mut start = 0;
+        while start < data.len() {
+            let (len, prefix) = read_prefix(&data[start..])?;
+            let end = start + prefix + len;
+            if end > data.len() {
+                return Err(io::Error::from(ErrorKind::UnexpectedEof).into());
+            }
+            offsets.push(end as u64);
+            start = end;
+        }
+        Ok(RecordIndex { offsets })
+    }
+
+    /// Returns the number of records in the index
+    #[inline]
+    pub fn len(&self) -> usize {
+        self.offsets.len().saturating_sub(1)
+    }
+
+    /// Returns whether the index contains no records
+    #[inline]
+    pub fn is_empty(&self) -> bool {
+        self.len() == 0
+    }
+
+    /// Gets the range of bytes of the record at the index, including its length prefix
+    pub fn range(&self, index: usize) -> Option<Range<usize>> {
+        let start = *self.offsets.get(index)?;
+        let end = *self.offsets.get(index.checked_add(1)?)?;
+        Some(start as usize..end as usize)
+    }
+
+    /// Gets the bytes of the message in the record at the index, without its length prefix.
+    ///
+    /// This returns `None` if the index is out of range or doesn't match the data.
+    pub fn record<'a>(&self, data: &'a [u8], index: usize) -> Option<&'a [u8]> {
+        let record = data.get(self.range(index)?)?;
+        match read_prefix(record) {
+            Ok((len, prefix)) if prefix + len == record.len() => Some(&record[prefix..]),
+            _ => None,
+        }
+    }
+
+    /// Reads the message in the record at the index from the data.
+    pub fn read<M: Message>(&self, data: &[u8], index: usize) -> Option<read::Result<M>> {
+        self.read_with(&read::Builder::new(), data, index)
+    }
+
+    /// Reads the message in the record at the index from the data with the options in the builder.
+    pub fn read_with<M: Message>(&self, builder: &read::Builder, data: &[u8], index: usize) -> Option<read::Result<M>> {
+        let record = self.record(data, index)?;
+        let mut reader = builder.with_slice(record);
+        let mut message = M::new_for(&reader);
+        Some(reader.merge_message(&mut message).map(|_| message))
+    }
+
+    /// Splits the records into at most `parts` contiguous byte ranges of roughly equal size, each
+    /// starting and ending on a record boundary. Each range can be read on its own with
+    /// [`CodedReader::delimited`](../read/struct.CodedReader.html#method.delimited).
+    pub fn split(&self, parts: usize) -> Vec<Range<usize>> {
+        let end = match self.offsets.last() {
+            Some(&end) if self.len() != 0 && parts != 0 => end,
+            _ => return Vec::new(),
+        };
+
+        let mut ranges = Vec::with_capacity(parts);
+        let mut start = 0;
+        for part in 1..=parts as u64 {
+            let target = (u128::from(end) * u128::from(part) / parts as u128) as u64;
+            // the first boundary at or after the target
+            let boundary = match self.offsets.binary_search(&target) {
+                Ok(i) | Err(i) => self.offsets[i.min(self.offsets.len() - 1)],
+            };
+            if boundary > start {
+                ranges.push(start as usize..boundary as usize);
+                start = boundary;
+            }
+        }
+        ranges
+    }
+
+    /// Writes the index to the output, to be saved next to the records it indexes
+    pub fn write_to<W: Write>(&self, output: &mut W) -> io::Result<()> {
+        output.write_all(&(self.len() as u64).to_le_bytes())?;
+        for offset in &self.offsets[1..] {
+            output.write_all(&offset.to_le_bytes())?;
+        }
+        Ok(())
+    }
+
+    /// Reads an index written by [`write_to`](#method.write_to) from the input
+    pub fn read_from<R: Read>(input: &mut R) -> io::Result<Self> {
+        let mut word = [0u8; 8];
+        input.read_exact(&mut word)?;
+        let len = usize::try_from(u64::from_le_bytes(word)).map_err(|_| io::Error::from(ErrorKind::InvalidData))?;
+
+        let mut offsets = Vec::with_capacity(len.min(1 << 20) + 1);
+        offsets.push(0);
+        for _ in 0..len {
+            input.read_exact(&mut word)?;
+            let offset = u64::from_le_bytes(word);
+            if offset < *offsets.last().unwrap() {
+                return Err(io::Error::new(ErrorKind::InvalidData, "record offsets must be in order"));
+            }
+            offsets.push(offset);
+        }
+        Ok(RecordIndex { offsets })
+    }
+}
+
+#[cfg(test)]
+mod test {
+    use crate::io::{read, CodedReader};
+    use crate::test_support::{Record, Required};
+    use std::fs;
+    use std::io::ErrorKind;
+    use super::{MappedFile, RecordIndex};
+
+    /// Frames each record with its length
+    fn records(count: usize) -> Vec<u8> {
+        let mut data = Vec::new();
+        for i in 0..count {
+            let body = vec![8, (i % 100) as u8].repeat(i % 60 + 1);
+            data.push(body.len() as u8);
+            data.extend_from_slice(&body);
+        }
+        data
+    }
+
+    #[test]
+    fn index_records() {
+        let data = records(200);
+        let index = RecordIndex::build(&data).unwrap();
+        assert_eq!(index.len(), 200);
+        assert_eq!(index.record(&data, 0), Some(&[8, 0][..]));
+        assert_eq!(index.record(&data, 199).map(<[u8]>::len), Some(2 * (199 % 60 + 1)));
+        assert_eq!(index.record(&data, 200), None);
+
+        let record: Record = index.read(&data, 5).unwrap().unwrap();
+        assert_eq!(record.id, 5);
+    }
+
+    #[test]
+    fn read_checks_initialized() {
+        // a record with its required id followed by one without it
+        let data = [2, 8, 1, 0];
+        let index = RecordIndex::build(&data).unwrap();
+        let checked = read::Builder::new().check_initialized(true);
+
+        assert_eq!(index.read_with::<Required>(&checked, &data, 0).unwrap().unwrap(), Required::new(Some(1)));
+        assert!(matches!(index.read_with::<Required>(&checked, &data, 1), Some(Err(read::Error::Uninitialized))));
+        assert_eq!(index.read::<Required>(&data, 1).unwrap().unwrap(), Required::new(None));
+    }
+
+    #[test]
+    fn empty_and_invalid_data() {
+        assert!(RecordIndex::build(&[]).unwrap().is_empty());
+        assert!(RecordIndex::default().is_empty());
+        assert!(RecordIndex::default().split(4).is_empty());
+
+        assert!(matches!(RecordIndex::build(&[3, 1, 2]), Err(read::Error::IoError(e)) if e.kind() == ErrorKind::UnexpectedEof));
+        assert!(matches!(RecordIndex::build(&[1, 0, 0x80]), Err(read::Error::IoError(e)) if e.kind() == ErrorKind::UnexpectedEof));
+        assert!(matches!(RecordIndex::build(&[0xff, 0xff, 0xff, 0xff, 0x0f]), Err(read::Error::NegativeSize)));
+        assert!(matches!(RecordIndex::build(&[0xff; 12]), Err(read::Error::MalformedVarint)));
+    }
+
+    #[test]
+    fn split_covers_every_record() {
+        let data = records(1000);
+        let index = RecordIndex::build(&data).unwrap();
+        for &parts in &[1, 3, 8, 5000] {
+            let ranges = index.split(parts);
+            assert!(ranges.len() <= parts);
+            assert_eq!(ranges.first().unwrap().start, 0);
+            assert_eq!(ranges.last().unwrap().end, data.len());
+            assert!(ranges.windows(2).all(|w| w[0].end == w[1].start));
+
+            let count: usize = ranges.iter()
+                .map(|range| CodedReader::with_slice(&data[range.clone()]).delimited::<Record>().map(Result::unwrap).count())
+                .sum();
+            assert_eq!(count, 1000);
+        }
+    }
+
+    #[test]
+    fn save_and_load() {
+        let data = records(50);
+        let index = RecordIndex::build(&data).unwrap();
+        let mut saved = Vec::new();
+        index.write_to(&mut saved).unwrap();
+        assert_eq!(saved.len(), 8 * 51);
+        assert_eq!(RecordIndex::read_from(&mut saved.as_slice()).unwrap(), index);
+
+        assert!(RecordIndex::read_from(&mut &saved[..20]).is_err());
+    }
+
+    #[test]
+    fn map_file() {
+        let path = std::env::temp_dir().join(format!("protrust-mapped-{}", std::process::id()));
+        let data = records(300);
+        fs::write(&path, &data).unwrap();
+
+        let file = unsafe { MappedFile::open(&path) }.unwrap();
+        assert_eq!(&*file, data.as_slice());
+        let count = file.reader(&read::Builder::new()).delimited::<Record>().map(Result::unwrap).count();
+        assert_eq!(count, 300);
+        drop(file);
+
+        fs::write(&path, []).unwrap();
+        let file = unsafe { MappedFile::open(&path) }.unwrap();
+        assert!(file.is_empty());
+        drop(file);
+        fs::remove_file(&path).unwrap();
+    }
+}
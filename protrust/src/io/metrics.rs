@@ -0,0 +1,269 @@
+//! Defines counters readers and writers keep with the `metrics` feature enabled.
+//!
+//! Every [`CodedReader`] and [`CodedWriter`] counts the work it does as it goes, and the counts can be taken from it at
+//! any time with `metrics`. Without the feature, none of the counters exist and nothing is counted.
+//!
+//! [`CodedReader`]: ../read/struct.CodedReader.html
+//! [`CodedWriter`]: ../write/struct.CodedWriter.html
+//!
+//! # Examples
+//!
+//! ```
+//! use protrust::io::{CodedReader, CodedWriter};
+//!
+//! let mut output = Vec::new();
+//! let mut writer = CodedWriter::with_stream(&mut output);
+//! writer.write_varint32(150).unwrap();
+//! writer.flush().unwrap();
+//! assert_eq!(writer.metrics().bytes_written, 2);
+//! assert_eq!(writer.metrics().write_all_calls, 1);
+//! drop(writer);
+//!
+//! let mut reader = CodedReader::with_stream(output.as_slice());
+//! assert_eq!(reader.read_varint32().unwrap(), 150);
+//! assert_eq!(reader.metrics().bytes_read, 2);
+//! assert_eq!(reader.metrics().refills, 1);
+//! ```
+
+use std::io::{self, IoSlice, Write};
+
+/// Counters kept by a [`CodedReader`](../read/struct.CodedReader.html)
+#[derive(Clone, Copy, Debug, Default, PartialEq, Eq)]
+pub struct ReadMetrics {
+    /// The number of bytes consumed from the input, including bytes skipped over
+    pub bytes_read: u64,
+    /// The number of times a stream's buffer was refilled from the input
+    pub refills: u64,
+    /// The number of reads from a stream's input straight into a value, bypassing the buffer
+    pub direct_reads: u64,
+    /// The number of length delimited values the reader allocated, not including values taken from a stream's buffer
+    pub allocations: u64,
+    /// The number of bytes allocated for length delimited values
+    pub allocated_bytes: u64,
+    /// The deepest level of nested messages and groups the reader reached
+    pub max_depth: usize,
+    /// The number of unknown fields read or skipped by unknown field sets
+    pub unknown_fields: u64,
+    /// The number of extension fields read by extension sets
+    pub extensions: u64,
+    /// The number of bytes taken from the input, including bytes that haven't been consumed yet
+    pub(crate) input_bytes: u64,
+}
+
+/// Counters kept by a [`CodedWriter`](../write/struct.CodedWriter.html)
+#[derive(Clone, Copy, Debug, Default, PartialEq, Eq)]
+pub struct WriteMetrics {
+    /// The number of bytes written, including bytes still in a stream's buffer
+    pub bytes_written: u64,
+    /// The number of `write` and `write_vectored` calls made to a stream's output
+    pub writes: u64,
+    /// The number of `write_all` calls made to a stream's output
+    pub write_all_calls: u64,
+    /// The number of `flush` calls made to a stream's output
+    pub flushes: u64,
+}
+
+/// A stream output that counts the calls made to it and the bytes written to it
+pub(crate) struct Counted<T> {
+    pub inner: T,
+    pub metrics: WriteMetrics,
+}
+
+impl<T> Counted<T> {
+    pub fn new(inner: T) -> Self {
+        Counted { inner, metrics: WriteMetrics::default() }
+    }
+}
+
+impl<T: Write> Write for Counted<T> {
+    fn write(&mut self, buf: &[u8]) -> io::Result<usize> {
+        let written = self.inner.write(buf)?;
+        self.metrics.writes += 1;
+        self.metrics.bytes_written += written as u64;
+        Ok(written)
+    }
+    fn write_vectored(&mut self, bufs: &[IoSlice]) -> io::Result<usize> {
+        let written = self.inner.write_vectored(bufs)?;
+        self.metrics.writes += 1;
+        self.metrics.bytes_written += written as u64;
+        Ok(written)
+    }
+    fn write_all(&mut self, buf: &[u8]) -> io::Result<()> {
+        self.inner.write_all(buf)?;
+        self.metrics.write_all_calls += 1;
+        self.metrics.bytes_written += buf.len() as u64;
+        Ok(())
+    }
+    fn flush(&mut self) -> io::Result<()> {
+        self.metrics.flushes += 1;
+        self.inner.flush()
+    }
+}
+
+#[cfg(test)]
+mod test {
+    use crate::{Message, UnknownFieldSet};
+    use crate::collections::RepeatedField;
+    use crate::io::{read, write, CodedReader, CodedWriter, FieldNumber, Input, Length, LengthBuilder, Output};
+    use crate::raw;
+    use super::{ReadMetrics, WriteMetrics};
+
+    const fn num(n: u32) -> FieldNumber {
+        unsafe { FieldNumber::new_unchecked(n) }
+    }
+
+    #[derive(Default, Clone, Debug, PartialEq)]
+    struct Node {
+        data: Vec<u8>,
+        children: RepeatedField<Node>,
+        unknown_fields: UnknownFieldSet,
+    }
+
+    impl Message for Node {
+        fn merge_from<T: Input>(&mut self, input: &mut CodedReader<T>) -> read::Result<()> {
+            while let Some(field) = input.read_field()? {
+                match field.tag() {
+                    10 => field.merge_value::<raw::Bytes<Vec<u8>>>(num(1), &mut self.data)?,
+                    18 => field.add_entries_to::<_, raw::Message<Node>>(num(2), &mut self.children)?,
+                    _ => field.check_and_try_add_field_to(&mut self.unknown_fields)?.or_skip()?,
+                }
+            }
+            Ok(())
+        }
+        fn calculate_size(&self) -> Option<Length> {
+            let mut builder = LengthBuilder::new();
+            if !self.data.is_empty() {
+                builder = builder.add_field::<raw::Bytes<Vec<u8>>>(num(1), &self.data)?;
+            }
+            builder
+                .add_values::<_, raw::Message<Node>>(&self.children, num(2))?
+                .add_fields(&self.unknown_fields)
+                .map(LengthBuilder::build)
+        }
+        fn write_to<T: Output>(&self, output: &mut CodedWriter<T>) -> write::Result {
+            if !self.data.is_empty() {
+                output.write_field::<raw::Bytes<Vec<u8>>>(num(1), &self.data)?;
+            }
+            output.write_values::<_, raw::Message<Node>>(&self.children, num(2))?;
+            output.write_fields(&self.unknown_fields)
+        }
+        fn is_initialized(&self) -> bool {
+            true
+        }
+        fn unknown_fields(&self) -> &UnknownFieldSet {
+            &self.unknown_fields
+        }
+        fn unknown_fields_mut(&mut self) -> &mut UnknownFieldSet {
+            &mut self.unknown_fields
+        }
+    }
+
+    /// A node three messages deep with a large value at the bottom, followed by two unknown fields
+    fn encode() -> Vec<u8> {
+        let leaf = Node { data: vec![7; 300], ..Default::default() };
+        let middle = Node { data: vec![1, 2], children: vec![leaf].into(), ..Default::default() };
+        let root = Node { children: vec![middle].into(), ..Default::default() };
+        let mut data = root.to_bytes().unwrap();
+        data.extend_from_slice(&[24, 5, 32, 6]);
+        data
+    }
+
+    #[test]
+    fn slice_reads() {
+        let data = encode();
+        let mut reader = CodedReader::with_slice(&data);
+        let mut node = Node::default();
+        node.merge_from(&mut reader).unwrap();
+
+        let metrics = reader.metrics();
+        assert_eq!(metrics.bytes_read, data.len() as u64);
+        assert_eq!(metrics.refills, 0);
+        assert_eq!(metrics.direct_reads, 0);
+        assert_eq!(metrics.allocations, 2);
+        assert_eq!(metrics.allocated_bytes, 302);
+        assert_eq!(metrics.max_depth, 2);
+        assert_eq!(metrics.unknown_fields, 2);
+        assert_eq!(node.unknown_fields.fields().count(), 2);
+    }
+
+    #[test]
+    fn stream_reads() {
+        let data = encode();
+        let mut reader = CodedReader::with_capacity(64, data.as_slice());
+        assert_eq!(reader.metrics(), ReadMetrics::default());
+
+        let mut node = Node::default();
+        node.merge_from(&mut reader).unwrap();
+
+        let metrics = reader.metrics();
+        assert_eq!(metrics.bytes_read, data.len() as u64);
+        // the large value is read past the buffer, which is refilled for everything else
+        assert_eq!(metrics.direct_reads, 1);
+        assert!(metrics.refills >= 2);
+        assert_eq!(metrics.allocations, 2);
+        assert_eq!(metrics.allocated_bytes, 302);
+        assert_eq!(metrics.max_depth, 2);
+
+        // a partially read stream only counts the bytes consumed from its buffer
+        let mut reader = CodedReader::with_stream(data.as_slice());
+        reader.read_tag().unwrap();
+        assert_eq!(reader.metrics().bytes_read, 1);
+        assert_eq!(reader.metrics().refills, 1);
+    }
+
+    #[test]
+    fn stream_writes() {
+        let data = encode();
+        let mut node = Node::default();
+        node.merge_from(&mut CodedReader::with_slice(&data)).unwrap();
+
+        let mut output = Vec::new();
+        let mut writer = CodedWriter::with_capacity(64, &mut output);
+        node.write_to(&mut writer).unwrap();
+        let metrics = writer.metrics();
+        assert_eq!(metrics.flushes, 0);
+        // the buffer is written out before the large value, which is written past it
+        assert!(metrics.write_all_calls >= 2);
+
+        writer.flush().unwrap();
+        let flushed = writer.metrics();
+        assert_eq!(flushed.bytes_written, data.len() as u64);
+        assert_eq!(flushed.bytes_written, metrics.bytes_written);
+        assert_eq!(flushed.write_all_calls, metrics.write_all_calls + 1);
+        drop(writer);
+        assert_eq!(output, node.to_bytes().unwrap());
+
+        let mut output = Vec::new();
+        let mut writer = CodedWriter::with_vectored_capacity(64, 128, &mut output);
+        node.write_to(&mut writer).unwrap();
+        assert_eq!(writer.metrics().bytes_written, data.len() as u64);
+        writer.flush().unwrap();
+        assert_eq!(writer.metrics().bytes_written, data.len() as u64);
+        assert!(writer.metrics().writes >= 1);
+        drop(writer);
+        assert_eq!(output, node.to_bytes().unwrap());
+    }
+
+    #[test]
+    fn buffer_writes() {
+        let data = encode();
+        let mut node = Node::default();
+        node.merge_from(&mut CodedReader::with_slice(&data)).unwrap();
+
+        let mut buf = vec![0; data.len() + 10];
+        let mut writer = CodedWriter::with_slice(&mut buf);
+        node.write_to(&mut writer).unwrap();
+        assert_eq!(writer.metrics(), WriteMetrics { bytes_written: data.len() as u64, ..WriteMetrics::default() });
+
+        // only the bytes appended to a vec are counted
+        let mut output = vec![0; 3];
+        let mut writer = CodedWriter::with_vec(&mut output);
+        node.write_to(&mut writer).unwrap();
+        assert_eq!(writer.metrics().bytes_written, data.len() as u64);
+
+        let mut buf = vec![0; data.len()];
+        let mut writer = unsafe { CodedWriter::with_slice_unchecked(&mut buf) };
+        node.write_to(&mut writer).unwrap();
+        assert_eq!(writer.metrics().bytes_written, data.len() as u64);
+    }
+}
@@ -1,17 +1,31 @@
 //! Contains types and traits for reading and writing protobuf coded data.
 
+pub mod asynchronous;
+pub mod mapped;
+#[cfg(feature = "metrics")]
+pub mod metrics;
+pub mod push;
 pub mod read;
+pub mod reverse;
 pub mod write;
 
+pub(crate) mod utf8;
+pub(crate) mod varint;
+
 pub use read::{Input, CodedReader};
 pub use write::{Output, CodedWriter};
 
 use crate::collections::{RepeatedValue, FieldSet};
 use crate::raw::Value;
+use std::borrow::{Borrow, Cow};
 use std::convert::TryFrom;
 use std::error::Error;
 use std::fmt::{self, Display, Formatter};
+use std::hash::{Hash, Hasher};
 use std::num::NonZeroU32;
+use std::ops::{Deref, Range};
+use std::sync::Arc;
+use std::sync::atomic::{AtomicI32, Ordering as AtomicOrdering};
 
 mod internal {
     pub trait Array: AsRef<[u8]> + AsMut<[u8]> {
@@ -462,6 +476,66 @@ impl From<Length> for i32 {
     }
 }
 
+/// A size cached by a message during a call to [`Message::compute_and_cache_size`], used to
+/// avoid recalculating the size of nested messages when they're written to an output.
+///
+/// Cloning a cached size returns an empty cache, and cached sizes are always
+/// considered equal so they don't affect the comparison of the messages they're part of.
+///
+/// # Examples
+///
+/// ```
+/// use protrust::io::{CachedSize, Length};
+///
+/// let size = CachedSize::new();
+/// assert_eq!(size.get(), Length::new(0).unwrap());
+///
+/// size.set(Length::new(5).unwrap());
+/// assert_eq!(size.get(), Length::new(5).unwrap());
+/// ```
+///
+/// [`Message::compute_and_cache_size`]: ../trait.Message.html#method.compute_and_cache_size
+#[derive(Default)]
+pub struct CachedSize(AtomicI32);
+
+impl CachedSize {
+    /// Creates a new empty cached size
+    #[inline]
+    pub const fn new() -> Self {
+        CachedSize(AtomicI32::new(0))
+    }
+    /// Gets the last size stored in the cache
+    #[inline]
+    pub fn get(&self) -> Length {
+        unsafe { Length::new_unchecked(self.0.load(AtomicOrdering::Relaxed)) }
+    }
+    /// Stores a new size in the cache
+    #[inline]
+    pub fn set(&self, value: Length) {
+        self.0.store(value.get(), AtomicOrdering::Relaxed)
+    }
+}
+
+impl Clone for CachedSize {
+    fn clone(&self) -> Self {
+        Self::new()
+    }
+}
+
+impl PartialEq for CachedSize {
+    fn eq(&self, _: &Self) -> bool {
+        true
+    }
+}
+
+impl Eq for CachedSize { }
+
+impl fmt::Debug for CachedSize {
+    fn fmt(&self, fmt: &mut Formatter) -> fmt::Result {
+        fmt.debug_tuple("CachedSize").field(&self.get()).finish()
+    }
+}
+
 /// An opaque type for building a length for writing to an output.
 /// 
 /// This exists to make creating checked lengths easier in generated code.
@@ -506,6 +580,12 @@ impl LengthBuilder {
     pub fn add_value<V: Value>(self, value: &V::Inner) -> Option<Self> {
         V::calculate_size(value, self)
     }
+    /// Adds a value's length to this instance using any sizes cached by a previous size calculation
+    #[inline]
+    #[must_use = "this returns the builder to chain and does not mutate it in place"]
+    pub fn add_cached_value<V: Value>(self, value: &V::Inner) -> Option<Self> {
+        V::cached_size(value, self)
+    }
     /// Adds a field's length to this instance using the specified field number
     #[inline]
     #[must_use = "this returns the builder to chain and does not mutate it in place"]
@@ -521,6 +601,16 @@ impl LengthBuilder {
         }
     }
 
+    /// Adds the length of a length delimited field of bytes that are already encoded
+    #[inline]
+    #[must_use = "this returns the builder to chain and does not mutate it in place"]
+    pub fn add_encoded_field(self, num: FieldNumber, value: &[u8]) -> Option<Self> {
+        let len = Length::new(i32::try_from(value.len()).ok()?)?;
+        self.add_tag(Tag::new(num, WireType::LengthDelimited))?
+            .add_bytes(raw_varint32_size(len.get() as u32))?
+            .add_bytes(len)
+    }
+
     /// Adds a value collection's length to this instance with the specified tag
     #[inline]
     #[must_use = "this returns the builder to chain and does not mutate it in place"]
@@ -546,20 +636,206 @@ impl LengthBuilder {
 /// This is used by [`CodedReader`](read/struct.CodedReader.html) to read length delimited byte values
 /// into various kinds of byte collections.
 pub trait ByteString: AsRef<[u8]> + AsMut<[u8]> {
-    /// Creates a new instance of the byte string. This value does not need to be zeroed.
+    /// Creates a new zeroed instance of the byte string.
     fn new(len: usize) -> Self;
+    /// Creates a new instance of the byte string holding a copy of the value.
+    /// Readers use this for values they copy out of a buffer in one go, so implementations can avoid zeroing
+    /// the string before it's overwritten.
+    fn from_slice(value: &[u8]) -> Self where Self: Sized {
+        let mut string = Self::new(value.len());
+        string.as_mut().copy_from_slice(value);
+        string
+    }
+    /// Creates a new instance of the byte string from a vec holding its value.
+    /// Stream readers use this for values they read into a vec's spare capacity, so the value is never zeroed.
+    fn from_vec(value: Vec<u8>) -> Self where Self: Sized {
+        Self::from_slice(&value)
+    }
 }
 
 impl ByteString for Box<[u8]> {
     fn new(len: usize) -> Self {
         <Vec<u8> as ByteString>::new(len).into_boxed_slice()
     }
+    fn from_slice(value: &[u8]) -> Self {
+        value.into()
+    }
+    fn from_vec(value: Vec<u8>) -> Self {
+        value.into_boxed_slice()
+    }
 }
 
 impl ByteString for Vec<u8> {
     fn new(len: usize) -> Self {
         vec![0; len]
     }
+    fn from_slice(value: &[u8]) -> Self {
+        // copies into the spare capacity of a new vec, which is only given a length once it's written
+        value.to_vec()
+    }
+    fn from_vec(value: Vec<u8>) -> Self {
+        value
+    }
+}
+
+/// A reference counted string of bytes. Cloning the string shares the underlying allocation instead of copying it.
+/// 
+/// When read with a [`CodedReader`](read/struct.CodedReader.html) over a stream, values that fit in the
+/// reader's buffer are returned as slices of the buffer instead of being copied out of it. The reader then
+/// switches to a new buffer on refill if any values still reference the old one.
+/// 
+/// # Examples
+/// 
+/// ```
+/// use protrust::io::{CodedReader, SharedBytes};
+/// 
+/// let data = [3, 1, 2, 3, 2, 4, 5];
+/// let mut reader = CodedReader::with_stream(data.as_ref());
+/// 
+/// let first = reader.read_length_delimited::<SharedBytes>()?;
+/// let mut second = reader.read_length_delimited::<SharedBytes>()?;
+/// assert_eq!(first.as_ref(), &[1, 2, 3]);
+/// assert_eq!(second.as_ref(), &[4, 5]);
+/// 
+/// // modifying a shared value makes a unique copy first
+/// second.as_mut()[0] = 0;
+/// assert_eq!(second.as_ref(), &[0, 5]);
+/// # Ok::<(), protrust::io::read::Error>(())
+/// ```
+#[derive(Clone)]
+pub struct SharedBytes {
+    chunk: Arc<[u8]>,
+    start: usize,
+    end: usize,
+}
+
+impl SharedBytes {
+    /// Creates a new empty string of bytes
+    pub fn new() -> Self {
+        Self::from(Vec::new())
+    }
+    /// Creates a string of bytes sharing the specified range of the chunk
+    pub(crate) fn from_chunk(chunk: &Arc<[u8]>, range: Range<usize>) -> Self {
+        debug_assert!(range.start <= range.end && range.end <= chunk.len());
+        Self { chunk: chunk.clone(), start: range.start, end: range.end }
+    }
+    /// Returns whether this string shares its allocation with another string or a reader
+    pub fn is_shared(&self) -> bool {
+        Arc::strong_count(&self.chunk) != 1
+    }
+}
+
+impl Default for SharedBytes {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+impl From<Vec<u8>> for SharedBytes {
+    fn from(value: Vec<u8>) -> Self {
+        let end = value.len();
+        Self { chunk: value.into(), start: 0, end }
+    }
+}
+
+impl From<&[u8]> for SharedBytes {
+    fn from(value: &[u8]) -> Self {
+        Self { chunk: value.into(), start: 0, end: value.len() }
+    }
+}
+
+impl Deref for SharedBytes {
+    type Target = [u8];
+
+    fn deref(&self) -> &[u8] {
+        &self.chunk[self.start..self.end]
+    }
+}
+
+impl AsRef<[u8]> for SharedBytes {
+    fn as_ref(&self) -> &[u8] {
+        self
+    }
+}
+
+impl AsMut<[u8]> for SharedBytes {
+    /// Gets a unique reference to the bytes, copying them into a new allocation if they're shared
+    fn as_mut(&mut self) -> &mut [u8] {
+        if Arc::get_mut(&mut self.chunk).is_none() {
+            *self = Self::from(self.as_ref());
+        }
+        let (start, end) = (self.start, self.end);
+        &mut Arc::get_mut(&mut self.chunk).expect("chunk was made unique")[start..end]
+    }
+}
+
+impl Borrow<[u8]> for SharedBytes {
+    fn borrow(&self) -> &[u8] {
+        self
+    }
+}
+
+impl PartialEq for SharedBytes {
+    fn eq(&self, other: &Self) -> bool {
+        self.as_ref() == other.as_ref()
+    }
+}
+
+impl Eq for SharedBytes { }
+
+impl PartialOrd for SharedBytes {
+    fn partial_cmp(&self, other: &Self) -> Option<std::cmp::Ordering> {
+        self.as_ref().partial_cmp(other.as_ref())
+    }
+}
+
+impl Ord for SharedBytes {
+    fn cmp(&self, other: &Self) -> std::cmp::Ordering {
+        self.as_ref().cmp(other.as_ref())
+    }
+}
+
+impl Hash for SharedBytes {
+    fn hash<H: Hasher>(&self, state: &mut H) {
+        self.as_ref().hash(state)
+    }
+}
+
+impl fmt::Debug for SharedBytes {
+    fn fmt(&self, f: &mut Formatter) -> fmt::Result {
+        f.debug_list().entries(self.iter()).finish()
+    }
+}
+
+impl ByteString for SharedBytes {
+    fn new(len: usize) -> Self {
+        Self::from(vec![0; len])
+    }
+    fn from_slice(value: &[u8]) -> Self {
+        Self::from(value)
+    }
+    fn from_vec(value: Vec<u8>) -> Self {
+        Self::from(value)
+    }
+}
+
+/// A string of bytes borrowed from the input of a [`CodedReader`](read/struct.CodedReader.html) reading from a slice.
+/// This is used to read length delimited values without copying them out of the input.
+pub trait BorrowedByteString<'a>: AsRef<[u8]> + Sized {
+    /// Creates a new instance of the byte string referencing the specified slice of the input.
+    fn from_borrowed(value: &'a [u8]) -> Self;
+}
+
+impl<'a> BorrowedByteString<'a> for &'a [u8] {
+    fn from_borrowed(value: &'a [u8]) -> Self {
+        value
+    }
+}
+
+impl<'a> BorrowedByteString<'a> for Cow<'a, [u8]> {
+    fn from_borrowed(value: &'a [u8]) -> Self {
+        Cow::Borrowed(value)
+    }
 }
 
 #[inline]
@@ -0,0 +1,550 @@
+//! Defines a push decoder that parses messages from chunks of bytes as they arrive.
+//!
+//! A [`PushDecoder`] never waits on an input. Callers feed it whatever bytes a non-blocking socket has read,
+//! and the decoder keeps everything it needs to pick up where the last chunk stopped: the bytes read so far
+//! of a partial varint, the bytes left in the current value and frame, and the stack of groups the current field is in.
+//!
+//! Each top level field is merged into the message as soon as the last of its bytes is fed. Merging a message's
+//! fields one at a time gives the same message as merging them all at once, so frames are never buffered whole.
+//! Finding where a field ends means scanning its tags and lengths before it's merged, so those bytes are read twice,
+//! though values are only decoded when they're merged. Runs of complete fields in a chunk are merged straight from
+//! the chunk, so only a field split between two chunks is copied.
+//!
+//! A split field is kept whole until its last byte is fed, so the decoder holds as much memory as the largest top
+//! level field split between chunks. That's every byte of a bytes, string, or message field, which can be up to
+//! 2 GiB long, or of a group, which has no length limit. Limit the size of the input fed to the decoder if it isn't
+//! trusted.
+//!
+//! [`PushDecoder`]: struct.PushDecoder.html
+
+use crate::Message;
+use crate::io::{read, FieldNumber, Tag, WireType};
+use crate::raw::NewFor;
+use std::convert::TryFrom;
+use std::io::{self, ErrorKind};
+use std::mem;
+
+/// The result of feeding bytes to a [`PushDecoder`](struct.PushDecoder.html).
+#[derive(Debug, PartialEq)]
+pub enum Feed<M> {
+    /// Every byte was consumed and the message isn't complete yet.
+    NeedMore,
+    /// A length delimited message was completed. The input is left at the first byte after it.
+    Done(M),
+}
+
+/// The bytes of a varint read so far
+#[derive(Clone, Copy, Default)]
+struct Varint {
+    value: u64,
+    len: u32,
+}
+
+impl Varint {
+    /// Adds a byte to the varint, returning the value if it was the last byte
+    #[inline]
+    fn push(&mut self, byte: u8) -> read::Result<Option<u64>> {
+        self.value |= u64::from(byte & 0x7f) << (7 * self.len);
+        self.len += 1;
+        if byte < 0x80 {
+            let value = self.value;
+            *self = Varint::default();
+            Ok(Some(value))
+        } else if self.len == 10 {
+            Err(read::Error::MalformedVarint)
+        } else {
+            Ok(None)
+        }
+    }
+    #[inline]
+    fn is_empty(&self) -> bool {
+        self.len == 0
+    }
+}
+
+#[derive(Clone, Copy)]
+enum Scan {
+    /// Reading a field tag
+    Tag(Varint),
+    /// Reading a varint field value
+    Value(Varint),
+    /// Reading the length of a length delimited value
+    Length(Varint),
+    /// Skipping the remaining bytes of a fixed size or length delimited value
+    Skip(usize),
+}
+
+/// Converts a length varint's value into a length, the same way `CodedReader` does
+#[inline]
+fn length(value: u64) -> read::Result<usize> {
+    let length = value as u32 as i32;
+    if length < 0 {
+        Err(read::Error::NegativeSize)
+    } else {
+        Ok(length as usize)
+    }
+}
+
+/// An incremental decoder that parses a message, or a sequence of length delimited messages,
+/// from chunks of bytes fed to it one at a time.
+///
+/// A top level field split between chunks is buffered until it's complete, so the decoder can hold as many bytes
+/// as the largest such field. See the [module documentation](index.html) for details.
+///
+/// # Examples
+///
+/// ```ignore
+/// use protrust::io::CodedWriter;
+/// use protrust::io::push::{Feed, PushDecoder};
+/// # use protrust::doctest::timestamp::Timestamp;
+///
+/// let mut timestamp = Timestamp::default();
+/// *timestamp.seconds_mut() = 150;
+/// *timestamp.nanos_mut() = 2;
+///
+/// let mut data = Vec::new();
+/// let mut writer = CodedWriter::with_vec(&mut data);
+/// writer.write_delimited(&timestamp)?;
+/// writer.write_delimited(&timestamp)?;
+/// drop(writer);
+///
+/// let mut decoder = PushDecoder::<Timestamp>::delimited();
+/// let mut messages = Vec::new();
+/// for mut chunk in data.chunks(3) {
+///     while !chunk.is_empty() {
+///         if let Feed::Done(message) = decoder.feed(&mut chunk)? {
+///             messages.push(message);
+///         }
+///     }
+/// }
+///
+/// assert_eq!(messages, [timestamp.clone(), timestamp]);
+/// # Ok::<(), Box<dyn std::error::Error>>(())
+/// ```
+pub struct PushDecoder<M> {
+    builder: read::Builder,
+    message: M,
+    /// Whether the input is a sequence of length delimited messages
+    delimited: bool,
+    /// The bytes of the frame length read so far
+    length: Varint,
+    /// The bytes left in the current frame, or `None` if the frame's length hasn't been read
+    frame: Option<usize>,
+    scan: Scan,
+    /// The field numbers of the groups the current top level field is in
+    groups: Vec<FieldNumber>,
+    /// The bytes fed so far of a top level field split between chunks, which can grow to the size of the whole field
+    pending: Vec<u8>,
+    /// Whether a message merged into the current message left checking its required fields to it
+    unchecked: bool,
+}
+
+impl<M: Message> PushDecoder<M> {
+    /// Creates a new decoder for a single message spanning all the bytes fed to it.
+    ///
+    /// All fed bytes are consumed, and the message is returned by [`finish`](#method.finish) at the end of the input.
+    pub fn new() -> Self {
+        Self::with_builder(read::Builder::new(), false)
+    }
+    /// Creates a new decoder for a sequence of length delimited messages.
+    pub fn delimited() -> Self {
+        Self::with_builder(read::Builder::new(), true)
+    }
+    /// Creates a new decoder using the options of the specified builder to decode messages.
+    pub fn with_builder(builder: read::Builder, delimited: bool) -> Self {
+        let message = M::new_for(&builder.with_slice(&[]));
+        PushDecoder {
+            builder,
+            message,
+            delimited,
+            length: Varint::default(),
+            frame: None,
+            scan: Scan::Tag(Varint::default()),
+            groups: Vec::new(),
+            pending: Vec::new(),
+            unchecked: false,
+        }
+    }
+
+    /// Feeds bytes to the decoder, advancing the input past the bytes consumed.
+    ///
+    /// A delimited decoder stops after the end of a message, returning it and leaving the
+    /// rest of the input, so feed the rest again to decode the messages after it.
+    /// If the builder [checks messages are initialized](../read/struct.Builder.html#method.check_initialized),
+    /// a completed message missing its required fields fails with `Uninitialized`, as it does in `finish`.
+    /// If this returns an error, the state of the decoder is unspecified and it shouldn't be fed again.
+    pub fn feed(&mut self, input: &mut &[u8]) -> read::Result<Feed<M>> {
+        if self.delimited && self.frame.is_none() {
+            loop {
+                let (&byte, rest) = match input.split_first() {
+                    Some(split) => split,
+                    None => return Ok(Feed::NeedMore),
+                };
+                *input = rest;
+                if let Some(value) = self.length.push(byte)? {
+                    self.frame = Some(length(value)?);
+                    break;
+                }
+            }
+        }
+
+        let len = match self.frame {
+            Some(remaining) => remaining.min(input.len()),
+            None => input.len(),
+        };
+        let (window, rest) = input.split_at(len);
+        *input = rest;
+        self.merge_chunk(window)?;
+
+        match &mut self.frame {
+            Some(remaining) => {
+                *remaining -= len;
+                if *remaining != 0 {
+                    return Ok(Feed::NeedMore);
+                }
+                if !self.at_field_boundary() {
+                    return Err(io::Error::from(ErrorKind::UnexpectedEof).into());
+                }
+                self.frame = None;
+                let next = M::new_for(&self.builder.with_slice(&[]));
+                let message = mem::replace(&mut self.message, next);
+                let checked = self.check(&message);
+                self.unchecked = false;
+                checked.map(|()| Feed::Done(message))
+            },
+            None => Ok(Feed::NeedMore),
+        }
+    }
+    /// Finishes decoding at the end of the input.
+    ///
+    /// A decoder for a single message returns it. A delimited decoder returns `None`, since
+    /// its messages have already been returned by [`feed`](#method.feed).
+    /// If the input ends in the middle of a field or frame, this returns an unexpected EOF error.
+    pub fn finish(self) -> read::Result<Option<M>> {
+        if !self.at_field_boundary() || self.frame.is_some() || !self.length.is_empty() {
+            return Err(io::Error::from(ErrorKind::UnexpectedEof).into());
+        }
+        if self.delimited {
+            Ok(None)
+        } else {
+            self.check(&self.message)?;
+            Ok(Some(self.message))
+        }
+    }
+
+    /// Fails with `Uninitialized` if the decoder checks messages are initialized and the completed message
+    /// is missing required fields. Fields are merged one at a time, so the message itself is only checked
+    /// once all of them are, like the outermost message of `CodedReader::merge_message`.
+    fn check(&self, message: &M) -> read::Result<()> {
+        if !self.builder.check_initialized_value() {
+            return Ok(());
+        }
+        match message.required_fields_set() {
+            Some(true) if !self.unchecked => Ok(()),
+            Some(false) => Err(read::Error::Uninitialized),
+            _ if message.is_initialized() => Ok(()),
+            _ => Err(read::Error::Uninitialized),
+        }
+    }
+
+    /// Returns whether a delimited decoder is between two messages, with no bytes of the next one fed yet
+    #[inline]
+    pub(crate) fn between_frames(&self) -> bool {
+        self.frame.is_none() && self.length.is_empty()
+    }
+
+    #[inline]
+    fn at_field_boundary(&self) -> bool {
+        self.pending.is_empty() && self.groups.is_empty() && matches!(self.scan, Scan::Tag(tag) if tag.is_empty())
+    }
+
+    /// Merges every top level field completed by the chunk, keeping the bytes of a field left incomplete
+    fn merge_chunk(&mut self, chunk: &[u8]) -> read::Result<()> {
+        let mut start = 0;
+        if !self.pending.is_empty() {
+            match self.scan(chunk)? {
+                Some(end) => {
+                    self.pending.extend_from_slice(&chunk[..end]);
+                    let mut pending = mem::take(&mut self.pending);
+                    let result = self.merge(&pending);
+                    pending.clear();
+                    self.pending = pending;
+                    result?;
+                    start = end;
+                },
+                None => {
+                    self.pending.extend_from_slice(chunk);
+                    return Ok(());
+                }
+            }
+        }
+
+        let mut end = start;
+        while let Some(scanned) = self.scan(&chunk[end..])? {
+            end += scanned;
+        }
+        if end != start {
+            self.merge(&chunk[start..end])?;
+        }
+        self.pending.extend_from_slice(&chunk[end..]);
+        Ok(())
+    }
+
+    #[inline]
+    fn merge(&mut self, fields: &[u8]) -> read::Result<()> {
+        let mut reader = self.builder.with_slice(fields);
+        self.message.merge_from(&mut reader)?;
+        self.unchecked |= reader.take_unchecked_messages();
+        Ok(())
+    }
+
+    /// Scans the bytes, returning the length of the top level field they end or `None` if they're all consumed first
+    fn scan(&mut self, bytes: &[u8]) -> read::Result<Option<usize>> {
+        let mut pos = 0;
+        loop {
+            let value = match &mut self.scan {
+                Scan::Skip(remaining) => {
+                    let len = (*remaining).min(bytes.len() - pos);
+                    *remaining -= len;
+                    pos += len;
+                    if *remaining != 0 {
+                        return Ok(None);
+                    }
+                    None
+                },
+                Scan::Tag(varint) | Scan::Value(varint) | Scan::Length(varint) => {
+                    let byte = match bytes.get(pos) {
+                        Some(&byte) => byte,
+                        None => return Ok(None),
+                    };
+                    pos += 1;
+                    match varint.push(byte)? {
+                        Some(value) => Some(value),
+                        None => continue,
+                    }
+                }
+            };
+
+            let ended = match (self.scan, value) {
+                (Scan::Tag(_), Some(tag)) => self.start_value(tag as u32)?,
+                (Scan::Length(_), Some(len)) => {
+                    self.scan = Scan::Skip(length(len)?);
+                    false
+                },
+                _ => self.end_value(),
+            };
+            if ended {
+                return Ok(Some(pos));
+            }
+        }
+    }
+
+    /// Starts scanning the value of a tag, returning whether it ended a top level field
+    #[inline]
+    fn start_value(&mut self, tag: u32) -> read::Result<bool> {
+        let parsed = Tag::try_from(tag).map_err(|_| read::Error::InvalidTag(tag))?;
+        self.scan = match parsed.wire_type() {
+            WireType::Varint => Scan::Value(Varint::default()),
+            WireType::Bit64 => Scan::Skip(8),
+            WireType::LengthDelimited => Scan::Length(Varint::default()),
+            WireType::Bit32 => Scan::Skip(4),
+            WireType::StartGroup => {
+                if self.groups.len() == self.builder.recursion_limit_value() {
+                    return Err(read::Error::RecursionLimitExceeded);
+                }
+                self.groups.push(parsed.field());
+                Scan::Tag(Varint::default())
+            },
+            WireType::EndGroup => {
+                if self.groups.last() != Some(&parsed.field()) {
+                    return Err(read::Error::InvalidTag(tag));
+                }
+                self.groups.pop();
+                return Ok(self.end_value());
+            }
+        };
+        Ok(false)
+    }
+
+    /// Ends a value, returning whether it was a top level field
+    #[inline]
+    fn end_value(&mut self) -> bool {
+        self.scan = Scan::Tag(Varint::default());
+        self.groups.is_empty()
+    }
+}
+
+impl<M: Message> Default for PushDecoder<M> {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+#[cfg(test)]
+mod test {
+    use crate::Message;
+    use crate::io::{read, CodedReader, CodedWriter};
+    use crate::test_support::{Record, Required};
+    use std::io::ErrorKind;
+    use super::{Feed, PushDecoder};
+
+    fn record(id: i32) -> Record {
+        Record::new(id, id as usize * 30)
+    }
+
+    fn records() -> Vec<Record> {
+        let mut records: Vec<Record> = (0..20).map(record).collect();
+        // a group with a nested group, a fixed value and a length delimited value in it
+        let group = [
+            0x1b, 0x23, 0x2d, 1, 2, 3, 4, 0x24, 0x2a, 2, 5, 6, 0x31, 1, 2, 3, 4, 5, 6, 7, 8, 0x1c,
+        ];
+        records[3].merge_from(&mut CodedReader::with_slice(&group)).unwrap();
+        records
+    }
+
+    fn encode(records: &[Record]) -> Vec<u8> {
+        let mut output = Vec::new();
+        let mut writer = CodedWriter::with_vec(&mut output);
+        for record in records {
+            writer.write_delimited(record).unwrap();
+        }
+        drop(writer);
+        output
+    }
+
+    fn decode_chunks(data: &[u8], chunk: usize) -> Vec<Record> {
+        let mut decoder = PushDecoder::<Record>::delimited();
+        let mut records = Vec::new();
+        for mut chunk in data.chunks(chunk) {
+            while !chunk.is_empty() {
+                if let Feed::Done(record) = decoder.feed(&mut chunk).unwrap() {
+                    records.push(record);
+                }
+            }
+        }
+        assert_eq!(decoder.finish().unwrap(), None);
+        records
+    }
+
+    #[test]
+    fn decode_delimited_in_chunks() {
+        let expected = records();
+        let data = encode(&expected);
+        for &chunk in &[1, 2, 3, 7, 64, data.len()] {
+            assert_eq!(decode_chunks(&data, chunk), expected, "chunk size {}", chunk);
+        }
+    }
+    #[test]
+    fn decode_single_message_in_chunks() {
+        let expected = records().remove(3);
+        let data = expected.to_bytes().unwrap();
+        for &chunk in &[1, 5, data.len()] {
+            let mut decoder = PushDecoder::<Record>::new();
+            for mut chunk in data.chunks(chunk) {
+                assert_eq!(decoder.feed(&mut chunk).unwrap(), Feed::NeedMore);
+                assert!(chunk.is_empty());
+            }
+            assert_eq!(decoder.finish().unwrap(), Some(expected.clone()));
+        }
+    }
+    #[test]
+    fn split_field_is_the_only_pending_data() {
+        let expected = record(10);
+        let data = expected.to_bytes().unwrap();
+        let mut decoder = PushDecoder::<Record>::new();
+        let (mut first, mut second) = data.split_at(4);
+
+        decoder.feed(&mut first).unwrap();
+        assert_eq!(decoder.message.id, 10);
+        assert_eq!(decoder.pending, &data[2..4]);
+
+        decoder.feed(&mut second).unwrap();
+        assert!(decoder.pending.is_empty());
+        assert_eq!(decoder.finish().unwrap(), Some(expected));
+    }
+    #[test]
+    fn completed_messages_are_checked() {
+        let checked = || read::Builder::new().check_initialized(true);
+
+        // a message with its required id followed by one without it
+        let mut decoder = PushDecoder::<Required>::with_builder(checked(), true);
+        let mut input = &[2, 8, 1, 0][..];
+        assert_eq!(decoder.feed(&mut input).unwrap(), Feed::Done(Required::new(Some(1))));
+        assert!(matches!(decoder.feed(&mut input), Err(read::Error::Uninitialized)));
+
+        let mut decoder = PushDecoder::<Required>::with_builder(checked(), false);
+        decoder.feed(&mut &[8][..]).unwrap();
+        decoder.feed(&mut &[1][..]).unwrap();
+        assert_eq!(decoder.finish().unwrap(), Some(Required::new(Some(1))));
+
+        let mut decoder = PushDecoder::<Required>::with_builder(checked(), false);
+        decoder.feed(&mut &[0x10, 1][..]).unwrap();
+        assert!(matches!(decoder.finish(), Err(read::Error::Uninitialized)));
+
+        // nothing is checked by default
+        let mut decoder = PushDecoder::<Required>::new();
+        decoder.feed(&mut &[0x10, 1][..]).unwrap();
+        assert!(decoder.finish().unwrap().is_some());
+    }
+    #[test]
+    fn empty_frame() {
+        let mut decoder = PushDecoder::<Record>::delimited();
+        let mut input = &[0, 0][..];
+        assert_eq!(decoder.feed(&mut input).unwrap(), Feed::Done(Record::default()));
+        assert_eq!(input, &[0]);
+        assert_eq!(decoder.feed(&mut input).unwrap(), Feed::Done(Record::default()));
+        assert_eq!(decoder.feed(&mut input).unwrap(), Feed::NeedMore);
+    }
+    #[test]
+    fn truncated_input() {
+        let data = encode(&records()[..2]);
+        let first = encode(&records()[..1]).len();
+        for end in 1..data.len() {
+            let mut decoder = PushDecoder::<Record>::delimited();
+            let mut input = &data[..end];
+            while !input.is_empty() {
+                decoder.feed(&mut input).unwrap();
+            }
+            match decoder.finish() {
+                Ok(None) if end == first => { },
+                Err(read::Error::IoError(e)) if e.kind() == ErrorKind::UnexpectedEof => { },
+                other => panic!("unexpected result at {}: {:?}", end, other),
+            }
+        }
+    }
+    #[test]
+    fn field_overruns_frame() {
+        // a frame of 2 bytes with a 3 byte field
+        let mut decoder = PushDecoder::<Record>::delimited();
+        assert!(decoder.feed(&mut &[2, 18, 1, 0][..]).is_err());
+    }
+    #[test]
+    fn malformed_varint() {
+        let mut decoder = PushDecoder::<Record>::new();
+        assert!(decoder.feed(&mut &[8; 1][..]).is_ok());
+        match decoder.feed(&mut &[0xff; 10][..]) {
+            Err(read::Error::MalformedVarint) => { },
+            other => panic!("unexpected result: {:?}", other),
+        }
+    }
+    #[test]
+    fn mismatched_end_group() {
+        let mut decoder = PushDecoder::<Record>::new();
+        match decoder.feed(&mut &[0x1b, 0x24][..]) {
+            Err(read::Error::InvalidTag(0x24)) => { },
+            other => panic!("unexpected result: {:?}", other),
+        }
+    }
+    #[test]
+    fn group_recursion_limit() {
+        let builder = read::Builder::new().recursion_limit(2);
+        let mut decoder = PushDecoder::<Record>::with_builder(builder.clone(), false);
+        assert!(decoder.feed(&mut &[0x1b, 0x1b, 0x1c, 0x1c][..]).is_ok());
+
+        let mut decoder = PushDecoder::<Record>::with_builder(builder, false);
+        match decoder.feed(&mut &[0x1b, 0x1b, 0x1b][..]) {
+            Err(read::Error::RecursionLimitExceeded) => { },
+            other => panic!("unexpected result: {:?}", other),
+        }
+    }
+}
@@ -1,19 +1,24 @@
 //! Defines the `CodedReader`, a reader for reading values from a protobuf encoded byte stream.
 
 use crate::Message;
-use crate::collections::{RepeatedValue, FieldSet, TryRead};
+use crate::arena::{Arena, ArenaBytes};
+use crate::collections::{BorrowedRepeatedValue, RepeatedValue, FieldSet, TryRead};
 use crate::extend::ExtensionRegistry;
-use crate::io::{Tag, WireType, FieldNumber, Length, ByteString, DEFAULT_BUF_SIZE};
-use crate::raw::{self, Value};
-use std::boxed::Box;
+use crate::io::{utf8, Tag, WireType, FieldNumber, Length, ByteString, BorrowedByteString, DEFAULT_BUF_SIZE};
+#[cfg(feature = "metrics")]
+use crate::io::metrics::ReadMetrics;
+use crate::raw::{self, Value, BorrowedValue, NewFor};
 use std::cmp::{self, Ordering};
 use std::convert::TryFrom;
 use std::error;
 use std::fmt::{self, Display, Formatter};
 use std::io::{self, Read, ErrorKind};
+use std::iter::FusedIterator;
 use std::marker::PhantomData;
+use std::mem;
 use std::result;
 use std::string::FromUtf8Error;
+use std::sync::Arc;
 
 /// A trait used by `CodedReader`s to efficiently skip bytes in an input.
 pub trait Skip: Read {
@@ -41,13 +46,18 @@ impl<T: ?Sized + Read + io::Seek> Skip for T {
 }
 
 mod internal {
-    use crate::io::{ByteString, Tag, Length, internal::Array, read::{Result, Error}};
+    use crate::io::{ByteString, SharedBytes, Tag, Length, internal::Array, varint, read::{Result, Error}};
+    use crate::pool::ReadBuffer;
     use std::cmp::{self, Ordering};
     use std::convert::TryFrom;
     use std::io::{self, Read as _, ErrorKind};
-    use std::ops::Range;
+    use std::mem::ManuallyDrop;
+    use std::ops::{Deref, DerefMut, Range};
     use std::ptr::{self, NonNull};
+    use std::sync::Arc;
     use super::Skip as Read;
+    #[cfg(feature = "metrics")]
+    use crate::io::metrics::ReadMetrics;
 
     /// State shared between all readers. This is borrowed by Any to manage state of a specialized reader
     #[derive(Default)]
@@ -55,6 +65,12 @@ mod internal {
         pub recursion_depth: usize,
         pub last_tag: Option<Tag>,
         pub next_end_group: Option<Tag>,
+        /// Whether a message is being merged with `merge_message`, so nested messages aren't the outermost one
+        pub checking_message: bool,
+        /// Whether a message that doesn't check its own required fields was read in the outermost message
+        pub unchecked_messages: bool,
+        #[cfg(feature = "metrics")]
+        pub metrics: ReadMetrics,
     }
 
     /// A container for shared buffer manipulation logic.
@@ -180,6 +196,165 @@ mod internal {
                 None
             }
         }
+        /// Tries to read a varint with the branchless decoder, returning None if
+        /// there aren't enough bytes before the limit to use it
+        #[inline]
+        pub fn try_read_varint(&mut self) -> Option<Result<u64>> {
+            let arr = self.try_limited_as_array::<[u8; 10]>()?;
+            Some(match varint::decode(arr) {
+                Some((value, len)) => {
+                    unsafe { self.advance(len); }
+                    Ok(value)
+                },
+                None => Err(Error::MalformedVarint),
+            })
+        }
+    }
+
+    /// A byte string that can share part of a stream's buffer chunk instead of copying it
+    pub trait FromChunk: ByteString + Sized {
+        fn from_chunk(chunk: &Arc<[u8]>, range: Range<usize>) -> Option<Self>;
+    }
+
+    impl<B: ByteString> FromChunk for B {
+        default fn from_chunk(_chunk: &Arc<[u8]>, _range: Range<usize>) -> Option<Self> {
+            None
+        }
+    }
+
+    impl FromChunk for SharedBytes {
+        fn from_chunk(chunk: &Arc<[u8]>, range: Range<usize>) -> Option<Self> {
+            Some(SharedBytes::from_chunk(chunk, range))
+        }
+    }
+
+    /// Tries to take a byte string of the specified length from the buffer by sharing the chunk it points into.
+    /// Assumes that the buffer points into the chunk.
+    #[inline]
+    pub unsafe fn take_from_chunk<B: ByteString>(buffer: &mut Buffer, chunk: &Arc<[u8]>, len: usize) -> Option<B> {
+        if len > buffer.to_limit_len() {
+            return None;
+        }
+
+        let start = usize::wrapping_sub(buffer.start.as_ptr() as _, chunk.as_ptr() as _);
+        let value = B::from_chunk(chunk, start..start + len)?;
+        buffer.advance(len);
+        Some(value)
+    }
+
+    /// Prepares a buffer that may not be initialized to be read into by the input,
+    /// zeroing it unless the input promises never to read from the buffers it's given
+    #[inline]
+    pub fn initialize<R: Read + ?Sized>(input: &R, buf: &mut [u8]) {
+        unsafe { input.initializer() }.initialize(buf)
+    }
+
+    /// Reads exactly `len` bytes from the input onto the end of the vec. The vec's spare capacity is handed to
+    /// the input as it is, and only zeroed first if the input might read from the buffers it's given.
+    pub fn read_to_spare<R: Read + ?Sized>(input: &mut R, vec: &mut Vec<u8>, len: usize) -> io::Result<()> {
+        vec.reserve(len);
+        let start = vec.len();
+        unsafe {
+            let spare = std::slice::from_raw_parts_mut(vec.as_mut_ptr().add(start), len);
+            initialize(input, spare);
+            input.read_exact(spare)?;
+            vec.set_len(start + len);
+        }
+        Ok(())
+    }
+
+    /// The number of reads that bypass a growing stream's buffer before it grows
+    const GROW_AFTER: u32 = 4;
+    /// The largest a growing stream's buffer grows to
+    const MAX_GROWN_LEN: usize = 256 * 1024;
+
+    /// The chunk a stream reads into. A pooled chunk is returned to this thread's buffer pool when the stream
+    /// is dropped, and a growing chunk doubles in size after enough values too large for it are read past it.
+    /// 
+    /// Chunks are allocated uninitialized, and zeroed the first time they're refilled if the input might read
+    /// from the buffers it's given.
+    pub struct StreamBuffer {
+        chunk: ManuallyDrop<Arc<[u8]>>,
+        /// Whether every byte of the chunk has been initialized
+        initialized: bool,
+        pooled: bool,
+        /// The number of reads that bypassed the chunk since it last grew, or None if it doesn't grow
+        direct_reads: Option<u32>,
+    }
+
+    impl StreamBuffer {
+        pub fn new(len: usize, pooled: bool, grow: bool) -> Self {
+            let ReadBuffer { chunk, initialized } = Self::allocate(len, pooled);
+            StreamBuffer {
+                chunk: ManuallyDrop::new(chunk),
+                initialized,
+                pooled,
+                direct_reads: if grow && len != 0 { Some(0) } else { None },
+            }
+        }
+        /// Records a read straight from the input that bypassed the chunk because the value didn't fit in it
+        #[inline]
+        pub fn bypassed(&mut self) {
+            if let Some(reads) = &mut self.direct_reads {
+                *reads += 1;
+            }
+        }
+        fn allocate(len: usize, pooled: bool) -> ReadBuffer {
+            if pooled { crate::pool::take_read_buffer(len) } else { ReadBuffer::new(len) }
+        }
+        /// Replaces the chunk with a new one, returning the old one to the pool if it's pooled
+        fn replace(&mut self, len: usize) {
+            let ReadBuffer { chunk, initialized } = Self::allocate(len, self.pooled);
+            let old = std::mem::replace(&mut *self.chunk, chunk);
+            if self.pooled {
+                crate::pool::put_read_buffer(ReadBuffer { chunk: old, initialized: self.initialized });
+            }
+            self.initialized = initialized;
+        }
+        /// Gets a unique reference to the chunk for the input to refill. The chunk grows first if enough reads
+        /// have bypassed it, and is replaced with a new chunk of the same size if any byte strings still share it.
+        #[inline]
+        pub fn refill<R: Read + ?Sized>(&mut self, input: &R) -> &mut [u8] {
+            match &mut self.direct_reads {
+                Some(reads) if *reads >= GROW_AFTER && self.chunk.len() < MAX_GROWN_LEN => {
+                    *reads = 0;
+                    self.replace(cmp::min(self.chunk.len() * 2, MAX_GROWN_LEN));
+                },
+                _ => { },
+            }
+            if Arc::get_mut(&mut self.chunk).is_none() {
+                self.replace(self.chunk.len());
+            }
+            let chunk = Arc::get_mut(&mut self.chunk).expect("chunk was made unique");
+            if !self.initialized && unsafe { input.initializer() }.should_initialize() {
+                initialize(input, chunk);
+                self.initialized = true;
+            }
+            chunk
+        }
+    }
+
+    impl Deref for StreamBuffer {
+        type Target = Arc<[u8]>;
+
+        fn deref(&self) -> &Arc<[u8]> {
+            &self.chunk
+        }
+    }
+
+    impl DerefMut for StreamBuffer {
+        fn deref_mut(&mut self) -> &mut Arc<[u8]> {
+            &mut self.chunk
+        }
+    }
+
+    impl Drop for StreamBuffer {
+        fn drop(&mut self) {
+            let chunk = unsafe { ManuallyDrop::take(&mut self.chunk) };
+            if self.pooled {
+                crate::pool::put_read_buffer(ReadBuffer { chunk, initialized: self.initialized });
+            }
+        }
     }
 
     pub trait Reader {
@@ -190,26 +365,42 @@ mod internal {
         fn pop_limit(&mut self, old: Option<i32>);
         fn reached_limit(&self) -> bool;
 
-        fn read_tag(&mut self) -> Result<Option<u32>>;
+        fn read_tag(&mut self) -> Result<Option<u32>> {
+            self.try_read_varint32()
+        }
+        /// Reads a 32-bit varint, or returns None if the input is already at its end or limit
+        fn try_read_varint32(&mut self) -> Result<Option<u32>>;
         fn read_varint32(&mut self) -> Result<u32>;
         fn read_varint64(&mut self) -> Result<u64>;
         fn read_bit32(&mut self) -> Result<u32>;
         fn read_bit64(&mut self) -> Result<u64>;
         fn read_length_delimited<B: ByteString>(&mut self) -> Result<B>;
+        fn read_length_delimited_with<B: AsMut<[u8]>, F: FnOnce(usize) -> B>(&mut self, f: F) -> Result<B>;
 
         fn skip_varint(&mut self) -> Result<()>;
         fn skip_bit32(&mut self) -> Result<()>;
         fn skip_bit64(&mut self) -> Result<()>;
         fn skip_length_delimited(&mut self) -> Result<()>;
 
+        /// Gets the bytes already buffered before the current limit. This may not be every byte left in the limit.
+        fn buffered(&self) -> &[u8];
+        /// Consumes bytes returned by `buffered`. The amount must not be more than the length of the buffered slice.
+        unsafe fn consume(&mut self, amnt: usize);
+        /// Returns whether the input is a slice, so every byte left in the limit is buffered
+        fn is_slice(&self) -> bool;
+
         fn as_any(&mut self) -> Any;
 
         fn reached_end(&self) -> bool;
+
+        /// Gets the number of bytes taken from the input that haven't been consumed yet
+        #[cfg(feature = "metrics")]
+        fn unconsumed(&self) -> usize;
     }
 
     pub struct BorrowedStream<'a> {
         pub input: &'a mut dyn Read,
-        pub buf: &'a mut [u8],
+        pub buf: &'a mut StreamBuffer,
         pub remaining_limit: &'a mut i32,
         pub reached_eof: &'a mut bool,
     }
@@ -258,7 +449,8 @@ mod internal {
                 },
             }
         }
-        fn read_direct(BorrowedStream { input: stream, remaining_limit: limit, .. }: &mut BorrowedStream, buf: &mut [u8]) -> Result<()> {
+        fn read_direct(BorrowedStream { input: stream, buf: chunk, remaining_limit: limit, .. }: &mut BorrowedStream, buf: &mut [u8]) -> Result<()> {
+            chunk.bypassed();
             if **limit < 0 {
                 stream.read_exact(buf).map_err(Into::into)
             } else {
@@ -275,13 +467,32 @@ mod internal {
                 }
             }
         }
+        /// Reads `len` bytes straight from the stream onto the end of the vec, bypassing the buffer
+        fn read_direct_to_end(BorrowedStream { input: stream, buf: chunk, remaining_limit: limit, .. }: &mut BorrowedStream, vec: &mut Vec<u8>, len: usize) -> Result<()> {
+            chunk.bypassed();
+            let available = if **limit < 0 { len } else { cmp::min(len, **limit as usize) };
+            if **limit >= 0 {
+                **limit -= available as i32;
+            }
+            read_to_spare(&mut **stream, vec, available)?;
+            if available < len {
+                Err(io::Error::from(ErrorKind::UnexpectedEof).into())
+            } else {
+                Ok(())
+            }
+        }
         /// Attempts to refresh the buffer, returning a bool indicating if the data buffer was filled
         fn try_refresh(&mut self) -> Result<bool> {
             let BorrowedStream { input, buf, remaining_limit, reached_eof } = match &mut self.stream {
                 Some(s) => s,
                 None => return Err(io::Error::from(ErrorKind::UnexpectedEof).into()),
             };
+            let buf = buf.refill(&**input);
             let amnt = input.read(buf)?;
+            record! {
+                self.shared_state.metrics.refills += 1;
+                self.shared_state.metrics.input_bytes += amnt as u64;
+            }
 
             *self.buffer = Buffer::from_slice(&buf[..amnt]);
             if **remaining_limit >= 0 {
@@ -300,6 +511,49 @@ mod internal {
             self.read_exact(&mut buf)?;
             Ok(buf[0])
         }
+        fn read_exact_new<B: AsMut<[u8]>, F: FnOnce(usize) -> B>(&mut self, len: usize, f: F) -> Result<B> {
+            record! {
+                self.shared_state.metrics.allocations += 1;
+                self.shared_state.metrics.allocated_bytes += len as u64;
+            }
+            let mut string = f(len);
+            if len != 0 {
+                self.read_exact(string.as_mut())?;
+            }
+            Ok(string)
+        }
+        /// Reads `len` bytes into a new vec. The buffered bytes are copied into it, and the rest is read
+        /// straight from the stream into its spare capacity if there's too much to go through the buffer,
+        /// so large values are never zeroed before they're read.
+        fn read_exact_vec(&mut self, len: usize) -> Result<Vec<u8>> {
+            record! {
+                self.shared_state.metrics.allocations += 1;
+                self.shared_state.metrics.allocated_bytes += len as u64;
+            }
+            let mut vec = Vec::with_capacity(len);
+            let buffered = cmp::min(len, self.buffer.to_limit_len());
+            unsafe {
+                vec.extend_from_slice(&self.buffer.to_limit_as_slice()[..buffered]);
+                self.buffer.advance(buffered);
+            }
+            let remaining = len - buffered;
+            if remaining != 0 {
+                match &mut self.stream {
+                    Some(stream) if remaining >= stream.buf.len() => {
+                        record! {
+                            self.shared_state.metrics.direct_reads += 1;
+                            self.shared_state.metrics.input_bytes += remaining as u64;
+                        }
+                        Self::read_direct_to_end(stream, &mut vec, remaining)?;
+                    },
+                    _ => {
+                        vec.resize(len, 0);
+                        self.read_exact(&mut vec[buffered..])?;
+                    },
+                }
+            }
+            Ok(vec)
+        }
         fn try_read_byte(&mut self) -> Result<Option<u8>> {
             if self.reached_end() {
                 return Ok(None);
@@ -310,9 +564,10 @@ mod internal {
             } else {
                 match &mut self.stream {
                     Some(BorrowedStream { remaining_limit: &mut 0, .. }) | None => Ok(None),
-                    Some(BorrowedStream { input, buf: [], remaining_limit, reached_eof }) => {
+                    Some(BorrowedStream { input, buf, remaining_limit, reached_eof }) if buf.is_empty() => {
                         let mut buf = [0u8; 1];
                         let result = input.read(&mut buf)?;
+                        record!(self.shared_state.metrics.input_bytes += result as u64);
                         if result != 0 {
                             if **remaining_limit > 0 {
                                 **remaining_limit -= 1;
@@ -343,6 +598,10 @@ mod internal {
                     // the size of the buffer then we read direct from the stream
                     // and adjust our remaining limit accordingly
                     Some(stream) if remaining_slice.len() >= stream.buf.len() => {
+                        record! {
+                            self.shared_state.metrics.direct_reads += 1;
+                            self.shared_state.metrics.input_bytes += remaining_slice.len() as u64;
+                        }
                         Self::read_direct(stream, remaining_slice)
                     },
                     Some(_) => {
@@ -378,12 +637,14 @@ mod internal {
                     Some(BorrowedStream { input, remaining_limit, .. }) => {
                         match (**remaining_limit).cmp(&0) {
                             Ordering::Less => {
+                                record!(self.shared_state.metrics.input_bytes += remaining_amnt as u64);
                                 input.skip_exact(unsafe { Length::new_unchecked(remaining_amnt) }).map_err(Into::into)
                             },
                             Ordering::Equal => Err(io::Error::from(ErrorKind::UnexpectedEof).into()),
                             Ordering::Greater => {
                                 let remaining = **remaining_limit;
                                 let remaining_length = unsafe { Length::new_unchecked(remaining) };
+                                record!(self.shared_state.metrics.input_bytes += remaining as u64);
                                 if remaining > remaining_amnt {
                                     **remaining_limit = 0;
                                     input.skip_exact(remaining_length).map_err(Into::into)
@@ -481,7 +742,11 @@ mod internal {
         }
 
         #[inline]
-        fn read_tag(&mut self) -> Result<Option<u32>> {
+        fn try_read_varint32(&mut self) -> Result<Option<u32>> {
+            if let Some(result) = self.buffer.try_read_varint() {
+                return result.map(|v| Some(v as u32));
+            }
+
             let b = match self.try_read_byte()? {
                 Some(b) if b < 0x80 => return Ok(Some(b as u32)),
                 Some(b) => b,
@@ -505,6 +770,10 @@ mod internal {
             Err(Error::MalformedVarint)
         }
         fn read_varint32(&mut self) -> Result<u32> {
+            if let Some(result) = self.buffer.try_read_varint() {
+                return result.map(|v| v as u32);
+            }
+
             let mut result = 0;
             for i in 0..5 {
                 let b = self.read_byte()?;
@@ -522,6 +791,10 @@ mod internal {
             Err(Error::MalformedVarint)
         }
         fn read_varint64(&mut self) -> Result<u64> {
+            if let Some(result) = self.buffer.try_read_varint() {
+                return result;
+            }
+
             let mut result = 0;
             for i in 0..10 {
                 let b = self.read_byte()?;
@@ -547,11 +820,20 @@ mod internal {
                 self.read_varint32()
                     .and_then(|v| Length::new(v as i32).ok_or(Error::NegativeSize))?
                     .get() as usize;
-            let mut string = B::new(len);
-            if len != 0 {
-                self.read_exact(string.as_mut())?;
+            if let Some(BorrowedStream { buf, .. }) = &self.stream {
+                // the buffer of a stream always points into the stream's chunk
+                if let Some(string) = unsafe { take_from_chunk(self.buffer, buf, len) } {
+                    return Ok(string);
+                }
             }
-            Ok(string)
+            self.read_exact_vec(len).map(B::from_vec)
+        }
+        fn read_length_delimited_with<B: AsMut<[u8]>, F: FnOnce(usize) -> B>(&mut self, f: F) -> Result<B> {
+            let len = 
+                self.read_varint32()
+                    .and_then(|v| Length::new(v as i32).ok_or(Error::NegativeSize))?
+                    .get() as usize;
+            self.read_exact_new(len, f)
         }
 
         fn skip_varint(&mut self) -> Result<()> {
@@ -581,6 +863,15 @@ mod internal {
             }
         }
 
+        fn buffered(&self) -> &[u8] {
+            unsafe { self.buffer.to_limit_as_slice() }
+        }
+        unsafe fn consume(&mut self, amnt: usize) {
+            self.buffer.advance(amnt)
+        }
+        fn is_slice(&self) -> bool {
+            self.stream.is_none()
+        }
         fn as_any(&mut self) -> Any {
             Any {
                 stream: 
@@ -599,6 +890,11 @@ mod internal {
                 None => self.buffer.reached_end()
             }
         }
+
+        #[cfg(feature = "metrics")]
+        fn unconsumed(&self) -> usize {
+            self.buffer.to_end_len()
+        }
     }
 
     unsafe impl Send for Any<'_> { }
@@ -625,6 +921,9 @@ pub enum Error {
     IoError(io::Error),
     /// The input contained an invalid UTF8 string
     InvalidString(FromUtf8Error),
+    /// The input contained a message that was missing required fields, found by a reader that checks
+    /// messages are initialized
+    Uninitialized,
 }
 
 impl From<io::Error> for Error {
@@ -647,7 +946,8 @@ impl Display for Error {
             Error::RecursionLimitExceeded => write!(fmt, "the input contained a nested data structure that exceeded the recursion limit"),
             Error::InvalidTag(val) => write!(fmt, "the input contained an tag that was either invalid or was unexpected at this point in the input: {}", val),
             Error::IoError(err) => write!(fmt, "an error occured in the underlying input: {}", err),
-            Error::InvalidString(_) => write!(fmt, "the input contained an invalid UTF8 string")
+            Error::InvalidString(_) => write!(fmt, "the input contained an invalid UTF8 string"),
+            Error::Uninitialized => write!(fmt, "the input contained a message that was missing required fields"),
         }
     }
 }
@@ -671,26 +971,82 @@ pub type Result<T> = result::Result<T, Error>;
 pub trait Input: internal::Reader { }
 impl<T: internal::Reader> Input for T { }
 
+/// The arena a [`Slice`] input allocates arena-aware containers in. This is `()` for slices without an arena,
+/// and `&Arena` for slices given one with [`with_slice_in`](struct.CodedReader.html#method.with_slice_in).
+/// 
+/// [`Slice`]: struct.Slice.html
+pub trait SliceArena<'a>: Copy + crate::internal::Sealed {
+    /// Gets the arena, if there is one
+    fn get(self) -> Option<&'a Arena>;
+}
+
+impl crate::internal::Sealed for () { }
+impl<'a> SliceArena<'a> for () {
+    #[inline]
+    fn get(self) -> Option<&'a Arena> {
+        None
+    }
+}
+
+impl crate::internal::Sealed for &Arena { }
+impl<'a> SliceArena<'a> for &'a Arena {
+    #[inline]
+    fn get(self) -> Option<&'a Arena> {
+        Some(self)
+    }
+}
+
 /// A type used for a [`CodedReader`] reading from a `slice` input.
 /// 
+/// Slices read with an arena hold a reference to it, so unlike slices read without one they can't be
+/// sent or shared between threads.
+/// 
 /// [`CodedReader`]: struct.CodedReader.html
-pub struct Slice<'a> {
+pub struct Slice<'a, A = ()> {
     a: PhantomData<&'a [u8]>,
     buffer: Buffer,
     state: internal::SharedState,
+    /// The arena arena-aware containers borrowing from the slice are allocated in
+    arena: A,
 }
 
 impl<'a> Slice<'a> {
     fn new(value: &'a [u8]) -> Self {
+        #[allow(unused_mut)]
+        let mut state = SharedState::default();
+        record!(state.metrics.input_bytes = value.len() as u64);
         Self {
             a: PhantomData,
             buffer: Buffer::from_slice(value),
-            state: Default::default(),
+            state,
+            arena: (),
+        }
+    }
+    fn in_arena(self, arena: &'a Arena) -> Slice<'a, &'a Arena> {
+        Slice { a: PhantomData, buffer: self.buffer, state: self.state, arena }
+    }
+}
+
+impl<'a, A> Slice<'a, A> {
+    /// Reads a length delimited value, returning the part of the input slice containing it
+    fn read_length_delimited_slice(&mut self) -> Result<&'a [u8]> {
+        let len = self.read_varint32()? as i32;
+        match len {
+            len if len < 0 => Err(Error::NegativeSize),
+            len if len as usize > self.buffer.to_limit_len() => Err(io::Error::from(ErrorKind::UnexpectedEof).into()),
+            len => {
+                let len = len as usize;
+                unsafe { // we've checked that we have enough data in the branch above, and the buffer borrows the input for 'a
+                    let value = &self.buffer.to_limit_as_slice()[..len];
+                    self.buffer.advance(len);
+                    Ok(value)
+                }
+            }
         }
     }
 }
 
-impl Reader for Slice<'_> {
+impl<A> Reader for Slice<'_, A> {
     fn state(&self) -> &SharedState {
         &self.state
     }
@@ -731,7 +1087,7 @@ impl Reader for Slice<'_> {
         self.buffer.reached_limit()
     }
 
-    fn read_tag(&mut self) -> Result<Option<u32>> {
+    fn try_read_varint32(&mut self) -> Result<Option<u32>> {
         if !self.reached_limit() {
             let next = unsafe { self.buffer.peek_byte() }; // SAFETY: we haven't reached the end so we're fine
             if next < 0x80 {
@@ -746,22 +1102,8 @@ impl Reader for Slice<'_> {
     }
     fn read_varint32(&mut self) -> Result<u32> {
         let mut result = 0u32;
-        if let Some::<&[u8; 10]>(arr) = self.buffer.try_limited_as_array() {
-            let mut iter = arr.as_ref().iter().enumerate();
-            for (i, &b) in iter.by_ref().take(5) {
-                result |= ((b & 0x7f) as u32) << (7 * i);
-                if b < 0x80 {
-                    unsafe { self.buffer.advance(i + 1); }
-                    return Ok(result);
-                }
-            }
-            for (i, &b) in iter {
-                if b < 0x80 {
-                    unsafe { self.buffer.advance(i + 1); }
-                    return Ok(result);
-                }
-            }
-            Err(Error::MalformedVarint)
+        if let Some(result) = self.buffer.try_read_varint() {
+            result.map(|v| v as u32)
         } else if let Some::<&[u8; 5]>(arr) = self.buffer.try_limited_as_array() {
             for (i, &b) in arr.iter().enumerate() {
                 result |= ((b & 0x7f) as u32) << (7 * i);
@@ -791,27 +1133,21 @@ impl Reader for Slice<'_> {
         }
     }
     fn read_varint64(&mut self) -> Result<u64> {
+        if let Some(result) = self.buffer.try_read_varint() {
+            return result;
+        }
+
+        // less than 10 bytes are left before the limit
         let mut result = 0u64;
         let slice = unsafe { self.buffer.to_limit_as_slice() };
-        if slice.len() < 10 {
-            for (i, &b) in slice.iter().enumerate() {
-                result |= ((b & 0x7f) as u64) << (7 * i);
-                if b < 0x80 {
-                    unsafe { self.buffer.advance(i + 1); }
-                    return Ok(result);
-                }
-            }
-            Err(io::Error::from(ErrorKind::UnexpectedEof).into())
-        } else {
-            for (i, &b) in slice.iter().enumerate().take(10) {
-                result |= ((b & 0x7f) as u64) << (7 * i);
-                if b < 0x80 {
-                    unsafe { self.buffer.advance(i + 1); }
-                    return Ok(result);
-                }
+        for (i, &b) in slice.iter().enumerate() {
+            result |= ((b & 0x7f) as u64) << (7 * i);
+            if b < 0x80 {
+                unsafe { self.buffer.advance(i + 1); }
+                return Ok(result);
             }
-            Err(Error::MalformedVarint)
         }
+        Err(io::Error::from(ErrorKind::UnexpectedEof).into())
     }
     fn read_bit32(&mut self) -> Result<u32> {
         self.buffer.try_limited_as_array()
@@ -832,21 +1168,22 @@ impl Reader for Slice<'_> {
             })
     }
     fn read_length_delimited<B: ByteString>(&mut self) -> Result<B> {
-        let len = self.read_varint32()? as i32;
-        match len {
-            len if len < 0 => Err(Error::NegativeSize),
-            0 => Ok(ByteString::new(0)),
-            len if len as usize > self.buffer.to_limit_len() => Err(io::Error::from(ErrorKind::UnexpectedEof).into()),
-            len => {
-                let len = len as usize;
-                let mut bytes = B::new(len);
-                let slice = bytes.as_mut();
-                unsafe { // we've checked that we have enough data to copy in the branch above
-                    self.buffer.copy_nonoverlapping(slice);
-                }
-                Ok(bytes)
-            }
+        let value = self.read_length_delimited_slice()?;
+        record! {
+            self.state.metrics.allocations += 1;
+            self.state.metrics.allocated_bytes += value.len() as u64;
+        }
+        Ok(B::from_slice(value))
+    }
+    fn read_length_delimited_with<B: AsMut<[u8]>, F: FnOnce(usize) -> B>(&mut self, f: F) -> Result<B> {
+        let value = self.read_length_delimited_slice()?;
+        record! {
+            self.state.metrics.allocations += 1;
+            self.state.metrics.allocated_bytes += value.len() as u64;
         }
+        let mut bytes = f(value.len());
+        bytes.as_mut().copy_from_slice(value);
+        Ok(bytes)
     }
 
     fn skip_varint(&mut self) -> Result<()> {
@@ -899,6 +1236,15 @@ impl Reader for Slice<'_> {
         }
     }
 
+    fn buffered(&self) -> &[u8] {
+        unsafe { self.buffer.to_limit_as_slice() }
+    }
+    unsafe fn consume(&mut self, amnt: usize) {
+        self.buffer.advance(amnt)
+    }
+    fn is_slice(&self) -> bool {
+        true
+    }
     fn as_any(&mut self) -> Any {
         Any {
             stream: None,
@@ -910,17 +1256,22 @@ impl Reader for Slice<'_> {
     fn reached_end(&self) -> bool {
         self.buffer.reached_end()
     }
+
+    #[cfg(feature = "metrics")]
+    fn unconsumed(&self) -> usize {
+        self.buffer.to_end_len()
+    }
 }
 
-unsafe impl Send for Slice<'_> { }
-unsafe impl Sync for Slice<'_> { }
+unsafe impl<A: Send> Send for Slice<'_, A> { }
+unsafe impl<A: Sync> Sync for Slice<'_, A> { }
 
 /// A type used for a [`CodedReader`] reading from a `Read` input. This input type buffers the stream's data.
 /// 
 /// [`CodedReader`]: struct.CodedReader.html
 pub struct Stream<T> {
     input: T,
-    buf: Box<[u8]>,
+    buf: internal::StreamBuffer,
     buffer: Buffer,
     remaining_limit: i32,
     reached_eof: bool,
@@ -928,8 +1279,8 @@ pub struct Stream<T> {
 }
 
 impl<T: Read + Skip> Stream<T> {
-    fn new(input: T, cap: usize) -> Self {
-        let buf = vec![0; cap].into_boxed_slice();
+    fn new(input: T, cap: usize, pooled: bool, grow: bool) -> Self {
+        let buf = internal::StreamBuffer::new(cap, pooled, grow);
         let buffer = Buffer::from_slice(&buf[0..0]);
 
         Stream {
@@ -948,9 +1299,14 @@ impl<T: Read + Skip> Stream<T> {
         self.buffer.remaining_limit().map(|i| i + self.remaining_limit)
     }
     fn try_refresh(&mut self) -> Result<bool> {
-        let amnt = self.input.read(&mut self.buf)?;
+        let buf = self.buf.refill(&self.input);
+        let amnt = self.input.read(buf)?;
+        record! {
+            self.state.metrics.refills += 1;
+            self.state.metrics.input_bytes += amnt as u64;
+        }
 
-        self.buffer = Buffer::from_slice(&self.buf[..amnt]);
+        self.buffer = Buffer::from_slice(&buf[..amnt]);
         if self.remaining_limit >= 0 {
             self.remaining_limit = unsafe { self.buffer.apply_partial_limit(self.remaining_limit) };
         }
@@ -994,6 +1350,11 @@ impl<T: Read + Skip> Stream<T> {
         }
     }
     fn read_direct(&mut self, buf: &mut [u8]) -> Result<()> {
+        record! {
+            self.state.metrics.direct_reads += 1;
+            self.state.metrics.input_bytes += buf.len() as u64;
+        }
+        self.buf.bypassed();
         if self.remaining_limit < 0 {
             self.input.read_exact(buf).map_err(Into::into)
         } else {
@@ -1051,12 +1412,14 @@ impl<T: Read + Skip> Stream<T> {
             let remaining_amnt = amnt - limit_buf_len as i32;
             match self.remaining_limit.cmp(&0) {
                 Ordering::Less => {
+                    record!(self.state.metrics.input_bytes += remaining_amnt as u64);
                     self.input.skip_exact(unsafe { Length::new_unchecked(remaining_amnt) }).map_err(Into::into)
                 },
                 Ordering::Equal => Err(io::Error::from(ErrorKind::UnexpectedEof).into()),
                 Ordering::Greater => {
                     let remaining_limit = self.remaining_limit;
                     let remaining_length = unsafe { Length::new_unchecked(remaining_limit) };
+                    record!(self.state.metrics.input_bytes += remaining_limit as u64);
                     if remaining_limit > remaining_amnt {
                         self.remaining_limit = 0;
                         self.input.skip_exact(remaining_length).map_err(Into::into)
@@ -1089,6 +1452,7 @@ impl<T: Read + Skip> Stream<T> {
         } else {
             let mut buf = [0u8; 1];
             let result = self.input.read(&mut buf)?;
+            record!(self.state.metrics.input_bytes += result as u64);
             if result != 0 {
                 if self.remaining_limit > 0 {
                     self.remaining_limit -= 1;
@@ -1104,6 +1468,60 @@ impl<T: Read + Skip> Stream<T> {
         self.read_exact(&mut buf)?;
         Ok(buf[0])
     }
+    fn read_exact_new<B: AsMut<[u8]>, F: FnOnce(usize) -> B>(&mut self, len: usize, f: F) -> Result<B> {
+        record! {
+            self.state.metrics.allocations += 1;
+            self.state.metrics.allocated_bytes += len as u64;
+        }
+        let mut b = f(len);
+        if len != 0 {
+            self.read_exact(b.as_mut())?;
+        }
+        Ok(b)
+    }
+    /// Reads `len` bytes into a new vec. The buffered bytes are copied into it, and the rest is read
+    /// straight from the input into its spare capacity if there's too much to go through the buffer,
+    /// so large values are never zeroed before they're read.
+    fn read_exact_vec(&mut self, len: usize) -> Result<Vec<u8>> {
+        record! {
+            self.state.metrics.allocations += 1;
+            self.state.metrics.allocated_bytes += len as u64;
+        }
+        let mut vec = Vec::with_capacity(len);
+        let buffered = cmp::min(len, self.buffer.to_limit_len());
+        unsafe {
+            vec.extend_from_slice(&self.buffer.to_limit_as_slice()[..buffered]);
+            self.buffer.advance(buffered);
+        }
+        let remaining = len - buffered;
+        if remaining != 0 {
+            if remaining >= self.buf.len() {
+                self.read_direct_to_end(&mut vec, remaining)?;
+            } else {
+                vec.resize(len, 0);
+                self.read_exact(&mut vec[buffered..])?;
+            }
+        }
+        Ok(vec)
+    }
+    /// Reads `len` bytes straight from the input onto the end of the vec, bypassing the buffer
+    fn read_direct_to_end(&mut self, vec: &mut Vec<u8>, len: usize) -> Result<()> {
+        record! {
+            self.state.metrics.direct_reads += 1;
+            self.state.metrics.input_bytes += len as u64;
+        }
+        self.buf.bypassed();
+        let available = if self.remaining_limit < 0 { len } else { cmp::min(len, self.remaining_limit as usize) };
+        if self.remaining_limit >= 0 {
+            self.remaining_limit -= available as i32;
+        }
+        internal::read_to_spare(&mut self.input, vec, available)?;
+        if available < len {
+            Err(io::Error::from(ErrorKind::UnexpectedEof).into())
+        } else {
+            Ok(())
+        }
+    }
 }
 
 impl<T: Read> Reader for Stream<T> {
@@ -1146,7 +1564,11 @@ impl<T: Read> Reader for Stream<T> {
     }
 
     #[inline]
-    fn read_tag(&mut self) -> Result<Option<u32>> {
+    fn try_read_varint32(&mut self) -> Result<Option<u32>> {
+        if let Some(result) = self.buffer.try_read_varint() {
+            return result.map(|v| Some(v as u32));
+        }
+
         let b = match self.try_read_byte()? {
             Some(b) if b < 0x80 => return Ok(Some(b as u32)),
             Some(b) => b,
@@ -1170,6 +1592,10 @@ impl<T: Read> Reader for Stream<T> {
         Err(Error::MalformedVarint)
     }
     fn read_varint32(&mut self) -> Result<u32> {
+        if let Some(result) = self.buffer.try_read_varint() {
+            return result.map(|v| v as u32);
+        }
+
         let mut result = 0;
         for i in 0..5 {
             let b = self.read_byte()?;
@@ -1187,6 +1613,10 @@ impl<T: Read> Reader for Stream<T> {
         Err(Error::MalformedVarint)
     }
     fn read_varint64(&mut self) -> Result<u64> {
+        if let Some(result) = self.buffer.try_read_varint() {
+            return result;
+        }
+
         let mut result = 0;
         for i in 0..10 {
             let b = self.read_byte()?;
@@ -1212,11 +1642,19 @@ impl<T: Read> Reader for Stream<T> {
         if len < 0 {
             Err(Error::NegativeSize)
         } else {
-            let mut b = B::new(len as usize);
-            if len != 0 {
-                self.read_exact(b.as_mut())?;
+            // the buffer always points into the current chunk
+            if let Some(b) = unsafe { internal::take_from_chunk(&mut self.buffer, &self.buf, len as usize) } {
+                return Ok(b);
             }
-            Ok(b)
+            self.read_exact_vec(len as usize).map(B::from_vec)
+        }
+    }
+    fn read_length_delimited_with<B: AsMut<[u8]>, F: FnOnce(usize) -> B>(&mut self, f: F) -> Result<B> {
+        let len = self.read_varint32()? as i32;
+        if len < 0 {
+            Err(Error::NegativeSize)
+        } else {
+            self.read_exact_new(len as usize, f)
         }
     }
 
@@ -1244,6 +1682,15 @@ impl<T: Read> Reader for Stream<T> {
         }
     }
 
+    fn buffered(&self) -> &[u8] {
+        unsafe { self.buffer.to_limit_as_slice() }
+    }
+    unsafe fn consume(&mut self, amnt: usize) {
+        self.buffer.advance(amnt)
+    }
+    fn is_slice(&self) -> bool {
+        false
+    }
     fn as_any(&mut self) -> Any {
         Any {
             stream: Some(internal::BorrowedStream {
@@ -1260,6 +1707,11 @@ impl<T: Read> Reader for Stream<T> {
     fn reached_end(&self) -> bool {
         self.buffer.reached_end() && self.reached_eof
     }
+
+    #[cfg(feature = "metrics")]
+    fn unconsumed(&self) -> usize {
+        self.buffer.to_end_len()
+    }
 }
 
 unsafe impl<T: Send> Send for Stream<T> { }
@@ -1272,6 +1724,11 @@ pub enum UnknownFieldHandling {
     Store,
     /// Skips unknown fields when they're encounted
     Skip,
+    /// Stores unknown fields in a message's `UnknownFieldSet` as they're encoded, appending them to one buffer.
+    /// 
+    /// The fields are written back out with a single copy and are only decoded if they're accessed, making
+    /// this faster for messages that pass unknown fields through without inspecting them.
+    StoreRaw,
 }
 
 impl Default for UnknownFieldHandling {
@@ -1286,6 +1743,88 @@ impl UnknownFieldHandling {
     pub fn skip(self) -> bool {
         self == UnknownFieldHandling::Skip
     }
+    /// Returns whether the handling is set to store unknown fields as they're encoded
+    #[inline]
+    pub fn raw(self) -> bool {
+        self == UnknownFieldHandling::StoreRaw
+    }
+}
+
+/// A set of field numbers to read from a message, along with projections of the messages nested in those fields.
+/// 
+/// Readers with a projection skip every field that isn't in it without decoding or storing it, regardless of
+/// how the reader handles unknown fields. A wanted field without a nested projection is read in full.
+/// 
+/// # Examples
+/// 
+/// ```
+/// use protrust::io::FieldNumber;
+/// use protrust::io::read::{Builder, Projection};
+/// 
+/// let num = |n| FieldNumber::new(n).unwrap();
+/// let projection = Projection::new()
+///     .field(num(1))
+///     .nested(num(4), Projection::new().field(num(2)));
+/// 
+/// assert!(projection.contains(num(1)));
+/// assert!(projection.contains(num(4)));
+/// assert!(!projection.contains(num(2)));
+/// 
+/// let builder = Builder::new().projection(Some(projection));
+/// # drop(builder);
+/// ```
+#[derive(Clone, Debug, Default, PartialEq)]
+pub struct Projection {
+    /// A bit for every wanted field numbered below 128
+    low: u128,
+    /// The wanted fields, sorted by field number
+    fields: Vec<(FieldNumber, Option<Arc<Projection>>)>,
+}
+
+impl Projection {
+    /// Creates a new projection that doesn't contain any fields
+    #[inline]
+    pub fn new() -> Self {
+        Default::default()
+    }
+    /// Adds a field to the projection, reading any message in it in full
+    pub fn field(self, num: FieldNumber) -> Self {
+        self.insert(num, None)
+    }
+    /// Adds a field to the projection, reading any message in it with the nested projection
+    pub fn nested(self, num: FieldNumber, projection: Projection) -> Self {
+        self.insert(num, Some(Arc::new(projection)))
+    }
+    fn insert(mut self, num: FieldNumber, nested: Option<Arc<Projection>>) -> Self {
+        if num.get() < 128 {
+            self.low |= 1 << num.get();
+        }
+        match self.fields.binary_search_by_key(&num, |(n, _)| *n) {
+            Ok(i) => self.fields[i].1 = nested,
+            Err(i) => self.fields.insert(i, (num, nested)),
+        }
+        self
+    }
+    /// Returns whether the projection contains the field
+    #[inline]
+    pub fn contains(&self, num: FieldNumber) -> bool {
+        self.contains_number(num.get())
+    }
+    #[inline]
+    fn contains_number(&self, num: u32) -> bool {
+        if num < 128 {
+            self.low & (1 << num) != 0
+        } else {
+            self.fields.binary_search_by_key(&num, |(n, _)| n.get()).is_ok()
+        }
+    }
+    /// Gets the projection of the message nested in the field, or `None` if the message is read in full
+    pub fn nested_for(&self, num: FieldNumber) -> Option<&Projection> {
+        self.nested_arc(num).map(|p| &**p)
+    }
+    fn nested_arc(&self, num: FieldNumber) -> Option<&Arc<Projection>> {
+        self.fields.binary_search_by_key(&num, |(n, _)| *n).ok().and_then(|i| self.fields[i].1.as_ref())
+    }
 }
 
 #[derive(Clone, Debug)]
@@ -1293,6 +1832,11 @@ struct ReaderOptions {
     unknown_fields: UnknownFieldHandling,
     registry: Option<&'static ExtensionRegistry>,
     recursion_limit: usize,
+    threads: usize,
+    /// The projection of the message currently being read
+    projection: Option<Arc<Projection>>,
+    grow_buffer: bool,
+    check_initialized: bool,
 }
 
 impl Default for ReaderOptions {
@@ -1301,6 +1845,10 @@ impl Default for ReaderOptions {
             unknown_fields: UnknownFieldHandling::Store,
             registry: None,
             recursion_limit: 100,
+            threads: 1,
+            projection: None,
+            grow_buffer: false,
+            check_initialized: false,
         }
     }
 }
@@ -1335,27 +1883,120 @@ impl Builder {
         self.options.recursion_limit = limit;
         self
     }
-    /// Constructs a [`CodedReader`](struct.CodedReader.html) using this builder and 
-    /// the specified slice of bytes
+    /// Sets the number of threads a reader can use to decode runs of repeated message fields. The default is 1,
+    /// which decodes everything on the reading thread.
+    ///
+    /// Only slice readers decode in parallel. Runs of entries in the slice are split into chunks decoded on worker
+    /// threads shared by every reader, and only when each thread gets at least 64 KiB of entries to decode.
     #[inline]
-    pub fn with_slice<'a>(&self, inner: &'a [u8]) -> CodedReader<Slice<'a>> {
-        CodedReader {
-            inner: Slice::new(inner),
-            options: self.options.clone()
-        }
+    pub fn threads(mut self, threads: usize) -> Self {
+        self.options.threads = threads;
+        self
     }
-    /// Constructs a [`CodedReader`](struct.CodedReader.html) using this builder and 
-    /// the specified [`Read`](stream/trait.Read.html) object with the default buffer capacity
+    /// Sets the projection of fields the reader reads from messages. Every other field is skipped.
+    /// No projection is used by default, so every field is read.
+    /// 
+    /// The projection applies to messages read from the reader, and nested projections to the message and group
+    /// fields read from them. Lazy messages keep every byte of their field, and are read with their field's nested
+    /// projection when they're accessed. Map entries are always read in full.
     #[inline]
-    pub fn with_stream<T: Read>(&self, inner: T) -> CodedReader<Stream<T>> {
-        self.with_capacity(DEFAULT_BUF_SIZE, inner)
+    pub fn projection(mut self, projection: Option<Projection>) -> Self {
+        self.options.projection = projection.map(Arc::new);
+        self
+    }
+    /// Sets whether the reader checks the required fields of every message are set as it reads them.
+    /// Messages aren't checked by default.
+    ///
+    /// Each message is checked with [`Message::required_fields_set`] when the reader reaches its end, and reading
+    /// fails with [`Uninitialized`](enum.Error.html#variant.Uninitialized) at the first message missing a required
+    /// field. Messages read with [`CodedReader::merge_message`](struct.CodedReader.html#method.merge_message)
+    /// are checked too, so a message read that way doesn't need to be checked with
+    /// [`Message::is_initialized`] afterwards. Lazy messages are only read in full when they're accessed,
+    /// so they aren't checked.
+    ///
+    /// Messages that don't implement [`Message::required_fields_set`] aren't checked as they're read. Instead,
+    /// the outermost message read with `merge_message` is checked once with [`Message::is_initialized`] after
+    /// it's read in full if any of them were in it, which walks the whole tree again but only once.
+    /// Messages merged with [`Message::merge_from`] directly aren't checked this way.
+    ///
+    /// [`Message::required_fields_set`]: ../../trait.Message.html#method.required_fields_set
+    /// [`Message::is_initialized`]: ../../trait.Message.html#tymethod.is_initialized
+    /// [`Message::merge_from`]: ../../trait.Message.html#tymethod.merge_from
+    #[inline]
+    pub fn check_initialized(mut self, value: bool) -> Self {
+        self.options.check_initialized = value;
+        self
+    }
+    /// Sets whether stream readers grow their buffer when values too large for it keep being read past it.
+    /// Buffers don't grow by default.
+    ///
+    /// A growing buffer doubles in size, up to 256 KiB, after every 4 values that are read straight from the input.
+    #[inline]
+    pub fn grow_buffer(mut self, value: bool) -> Self {
+        self.options.grow_buffer = value;
+        self
+    }
+    /// Gets the recursion limit readers constructed by this builder use
+    #[inline]
+    pub(crate) fn recursion_limit_value(&self) -> usize {
+        self.options.recursion_limit
+    }
+    /// Gets whether readers constructed by this builder check messages are initialized
+    #[inline]
+    pub(crate) fn check_initialized_value(&self) -> bool {
+        self.options.check_initialized
+    }
+    /// Constructs a [`CodedReader`](struct.CodedReader.html) using this builder and 
+    /// the specified slice of bytes
+    #[inline]
+    pub fn with_slice<'a>(&self, inner: &'a [u8]) -> CodedReader<Slice<'a>> {
+        CodedReader {
+            inner: Slice::new(inner),
+            options: self.options.clone()
+        }
+    }
+    /// Constructs a [`CodedReader`](struct.CodedReader.html) using this builder and the specified slice of bytes,
+    /// that allocates arena-aware containers read with [`BorrowedValue`] in the arena
+    ///
+    /// See the [`arena`](../../arena/index.html) module for the containers that use it.
+    ///
+    /// [`BorrowedValue`]: ../../raw/trait.BorrowedValue.html
+    #[inline]
+    pub fn with_slice_in<'a>(&self, inner: &'a [u8], arena: &'a Arena) -> CodedReader<Slice<'a, &'a Arena>> {
+        CodedReader {
+            inner: Slice::new(inner).in_arena(arena),
+            options: self.options.clone()
+        }
+    }
+    /// Constructs a [`CodedReader`](struct.CodedReader.html) using this builder and 
+    /// the specified [`Read`](stream/trait.Read.html) object with the default buffer capacity
+    #[inline]
+    pub fn with_stream<T: Read>(&self, inner: T) -> CodedReader<Stream<T>> {
+        self.with_capacity(DEFAULT_BUF_SIZE, inner)
     }
     /// Constructs a [`CodedReader`](struct.CodedReader.html) using this builder and
     /// the specified [`Read`](stream/trait.Read.html) object with the specified buffer capacity
     #[inline]
     pub fn with_capacity<T: Read>(&self, capacity: usize, inner: T) -> CodedReader<Stream<T>> {
         CodedReader {
-            inner: Stream::new(inner, capacity),
+            inner: Stream::new(inner, capacity, false, self.options.grow_buffer),
+            options: self.options.clone()
+        }
+    }
+    /// Constructs a [`CodedReader`](struct.CodedReader.html) using this builder and
+    /// the specified [`Read`](stream/trait.Read.html) object with a buffer taken from this thread's
+    /// [buffer pool](../../pool/index.html). The buffer is returned to the pool when the reader is dropped.
+    #[inline]
+    pub fn with_pooled_stream<T: Read>(&self, inner: T) -> CodedReader<Stream<T>> {
+        self.with_pooled_capacity(DEFAULT_BUF_SIZE, inner)
+    }
+    /// Constructs a [`CodedReader`](struct.CodedReader.html) using this builder and
+    /// the specified [`Read`](stream/trait.Read.html) object with a buffer of at least the specified capacity taken from
+    /// this thread's [buffer pool](../../pool/index.html). The buffer is returned to the pool when the reader is dropped.
+    #[inline]
+    pub fn with_pooled_capacity<T: Read>(&self, capacity: usize, inner: T) -> CodedReader<Stream<T>> {
+        CodedReader {
+            inner: Stream::new(inner, capacity, true, self.options.grow_buffer),
             options: self.options.clone()
         }
     }
@@ -1423,6 +2064,30 @@ impl<'a, T: Input + 'a> FieldReader<'a, T> {
     }
 }
 
+impl<'a, 'b, A: SliceArena<'b>> FieldReader<'a, Slice<'b, A>> {
+    /// Reads a value from the input, borrowing from the input slice where the value supports it.
+    ///
+    /// This sets the last tag to be a tag made from the specified field number and the value's wire type.
+    #[inline]
+    pub fn read_borrowed_value<V: BorrowedValue<'b>>(self, field: FieldNumber) -> Result<V::Inner> {
+        self.and_then(Tag::new(field, V::WIRE_TYPE), V::read_borrowed)
+    }
+    /// Merges a value from the input with an existing value, borrowing from the input slice where the value supports it.
+    /// 
+    /// This sets the last tag to be a tag made from the specified field number and the value's wire type.
+    #[inline]
+    pub fn merge_borrowed_value<V: BorrowedValue<'b>>(self, field: FieldNumber, inner: &mut V::Inner) -> Result<()> {
+        self.and_then(Tag::new(field, V::WIRE_TYPE), |input| input.merge_borrowed_value::<V>(inner))
+    }
+    /// Adds field entries from the input to the repeated value, borrowing from the input slice where the values support it.
+    ///
+    /// This sets the last tag to be a tag made from the specified field number and the value's wire type.
+    #[inline]
+    pub fn add_borrowed_entries_to<U: BorrowedRepeatedValue<'b, V>, V>(self, field: FieldNumber, value: &mut U) -> Result<()> {
+        self.and_then(Tag::new(field, U::WIRE_TYPE), |input| input.add_borrowed_entries_to::<U, V>(value))
+    }
+}
+
 /// Represents a length delimited value that can be read in a specified format.
 #[must_use]
 pub struct Limit<'a, T: Input + 'a> {
@@ -1453,6 +2118,36 @@ impl<'a, T: Input + 'a> Drop for Limit<'a, T> {
     }
 }
 
+/// An iterator over length delimited messages read one after another from a [`CodedReader`].
+/// This is created with [`CodedReader::delimited`].
+/// 
+/// Every message is read with the same reader, so a stream reader's buffer is reused for the
+/// whole sequence. The iterator ends at the end of the input or after the first error.
+/// 
+/// [`CodedReader`]: struct.CodedReader.html
+/// [`CodedReader::delimited`]: struct.CodedReader.html#method.delimited
+pub struct Delimited<'a, T: Input + 'a, M> {
+    inner: &'a mut CodedReader<T>,
+    failed: bool,
+    _message: PhantomData<fn() -> M>,
+}
+
+impl<'a, T: Input + 'a, M: Message> Iterator for Delimited<'a, T, M> {
+    type Item = Result<M>;
+
+    fn next(&mut self) -> Option<Self::Item> {
+        if self.failed {
+            return None;
+        }
+
+        let result = self.inner.read_delimited().transpose();
+        self.failed = matches!(result, Some(Err(_)));
+        result
+    }
+}
+
+impl<'a, T: Input + 'a, M: Message> FusedIterator for Delimited<'a, T, M> { }
+
 /// A protobuf coded input reader that reads from a specified input.
 pub struct CodedReader<T: Input> {
     inner: T,
@@ -1476,6 +2171,26 @@ impl<T: Read> CodedReader<Stream<T>> {
     pub fn with_capacity(capacity: usize, inner: T) -> Self {
         Builder::new().with_capacity(capacity, inner)
     }
+    /// Creates a new [`CodedReader`] in the default configuration
+    /// over the specified [`Read`] with a buffer taken from this thread's [buffer pool].
+    /// The buffer is returned to the pool when the reader is dropped.
+    /// 
+    /// [`CodedReader`]: struct.CodedReader.html
+    /// [`Read`]: https://doc.rust-lang.org/nightly/std/io/trait.Read.html
+    /// [buffer pool]: ../../pool/index.html
+    pub fn with_pooled_stream(inner: T) -> Self {
+        Builder::new().with_pooled_stream(inner)
+    }
+    /// Creates a new [`CodedReader`] in the default configuration
+    /// over the specified [`Read`] with a buffer of at least the specified capacity taken from this thread's [buffer pool].
+    /// The buffer is returned to the pool when the reader is dropped.
+    /// 
+    /// [`CodedReader`]: struct.CodedReader.html
+    /// [`Read`]: https://doc.rust-lang.org/nightly/std/io/trait.Read.html
+    /// [buffer pool]: ../../pool/index.html
+    pub fn with_pooled_capacity(capacity: usize, inner: T) -> Self {
+        Builder::new().with_pooled_capacity(capacity, inner)
+    }
 
     /// Returns the underlying stream value. This will discard any data that
     /// exists in the buffer.
@@ -1495,11 +2210,89 @@ impl<'a> CodedReader<Slice<'a>> {
     pub fn with_slice(inner: &'a [u8]) -> Self {
         Builder::new().with_slice(inner)
     }
+}
+
+impl<'a> CodedReader<Slice<'a, &'a Arena>> {
+    /// Creates a new [`CodedReader`] over the borrowed slice in the default configuration,
+    /// that allocates arena-aware containers read with [`BorrowedValue`] in the arena.
+    ///
+    /// [`CodedReader`]: struct.CodedReader.html
+    /// [`BorrowedValue`]: ../../raw/trait.BorrowedValue.html
+    pub fn with_slice_in(inner: &'a [u8], arena: &'a Arena) -> Self {
+        Builder::new().with_slice_in(inner, arena)
+    }
+}
+
+impl<'a, A: SliceArena<'a>> CodedReader<Slice<'a, A>> {
+    /// Gets the arena arena-aware containers are allocated in when they're read from this reader
+    pub fn arena(&self) -> Option<&'a Arena> {
+        self.inner.arena.get()
+    }
+    /// Reads a length delimited string of bytes into the reader's arena, or onto the heap if the reader has no arena.
+    pub fn read_arena_bytes(&mut self) -> Result<ArenaBytes<'a>> {
+        let value = self.inner.read_length_delimited_slice()?;
+        record! {
+            self.inner.state.metrics.allocations += 1;
+            self.inner.state.metrics.allocated_bytes += value.len() as u64;
+        }
+        Ok(match self.inner.arena.get() {
+            Some(arena) => ArenaBytes::copy_in(value, arena),
+            None => ArenaBytes::from(value),
+        })
+    }
 
     /// Consumes the reader, returning the remaining slice
     pub fn into_inner(self) -> &'a [u8] {
         unsafe { self.inner.buffer.to_end_as_slice() }
     }
+
+    /// Reads a length delimited string of bytes borrowed directly from the input slice, without copying it.
+    /// 
+    /// # Examples
+    /// 
+    /// ```
+    /// use protrust::io::CodedReader;
+    /// 
+    /// let data = [3, 1, 2, 3];
+    /// let mut reader = CodedReader::with_slice(&data);
+    /// let value: &[u8] = reader.read_length_delimited_borrowed()?;
+    /// 
+    /// assert_eq!(value, &[1, 2, 3]);
+    /// assert_eq!(value.as_ptr(), data[1..].as_ptr());
+    /// # Ok::<(), protrust::io::read::Error>(())
+    /// ```
+    pub fn read_length_delimited_borrowed<B: BorrowedByteString<'a>>(&mut self) -> Result<B> {
+        self.inner.read_length_delimited_slice().map(B::from_borrowed)
+    }
+    /// Reads a length delimited UTF8 string borrowed directly from the input slice, without copying it.
+    pub fn read_str_borrowed(&mut self) -> Result<&'a str> {
+        let value = self.inner.read_length_delimited_slice()?;
+        utf8::as_str(value).map_err(|_| invalid_string(value))
+    }
+    /// Reads a new instance of the value, borrowing from the input slice where the value supports it.
+    pub fn read_borrowed_value<V: BorrowedValue<'a>>(&mut self) -> Result<V::Inner> {
+        V::read_borrowed(self)
+    }
+    /// Merges the input into an existing instance of the value, borrowing from the input slice where the value supports it.
+    pub fn merge_borrowed_value<V: BorrowedValue<'a>>(&mut self, value: &mut V::Inner) -> Result<()> {
+        V::merge_borrowed(value, self)
+    }
+    /// Adds field entries from the reader to the repeated value, borrowing from the input slice where the values support it.
+    /// This is the inverse of `BorrowedRepeatedValue::add_borrowed_entries_from`.
+    #[inline]
+    pub fn add_borrowed_entries_to<U: BorrowedRepeatedValue<'a, V>, V>(&mut self, value: &mut U) -> Result<()> {
+        value.add_borrowed_entries_from(self)
+    }
+}
+
+/// Creates an invalid string error for the specified bytes. This is only used on error paths
+/// where the bytes have been borrowed, so copying them here keeps that cost off the hot path.
+#[cold]
+fn invalid_string(value: &[u8]) -> Error {
+    match String::from_utf8(value.to_vec()) {
+        Err(e) => Error::InvalidString(e),
+        Ok(_) => unreachable!("the string was already found to be invalid"),
+    }
 }
 
 impl<T: Input> CodedReader<T> {
@@ -1509,6 +2302,7 @@ impl<T: Input> CodedReader<T> {
             Err(Error::RecursionLimitExceeded)
         } else {
             state.recursion_depth += 1;
+            record!(state.metrics.max_depth = cmp::max(state.metrics.max_depth, state.recursion_depth));
             Ok(())
         }
     }
@@ -1536,6 +2330,131 @@ impl<T: Input> CodedReader<T> {
     pub fn registry(&self) -> Option<&'static ExtensionRegistry> {
         self.options.registry
     }
+    /// Gets whether the reader checks the required fields of every message are set as it reads them.
+    pub fn checks_initialized(&self) -> bool {
+        self.options.check_initialized
+    }
+    /// Fails with `Uninitialized` if the reader checks messages are initialized and the message just read
+    /// is missing required fields
+    #[inline]
+    pub(crate) fn check_required<M: Message>(&mut self, message: &M) -> Result<()> {
+        if !self.options.check_initialized {
+            return Ok(());
+        }
+        match message.required_fields_set() {
+            Some(true) => Ok(()),
+            Some(false) => Err(Error::Uninitialized),
+            None => {
+                // checked once by the outermost message
+                self.inner.state_mut().unchecked_messages = true;
+                Ok(())
+            }
+        }
+    }
+    /// Returns whether any message read so far left checking its required fields to the outermost message,
+    /// resetting it for the next outermost message
+    pub(crate) fn take_unchecked_messages(&mut self) -> bool {
+        mem::replace(&mut self.inner.state_mut().unchecked_messages, false)
+    }
+    /// Merges the rest of the input into the message.
+    ///
+    /// If the reader [checks messages are initialized](struct.Builder.html#method.check_initialized), this fails
+    /// as soon as any message, including this one, is read without its required fields.
+    pub fn merge_message<M: Message>(&mut self, message: &mut M) -> Result<()> {
+        if !self.options.check_initialized {
+            return message.merge_from(self);
+        }
+        let outermost = !mem::replace(&mut self.inner.state_mut().checking_message, true);
+        let result = message.merge_from(self).and_then(|()| self.check_required(message));
+        if !outermost {
+            return result;
+        }
+        let state = self.inner.state_mut();
+        state.checking_message = false;
+        let unchecked = mem::replace(&mut state.unchecked_messages, false);
+        match result {
+            Ok(()) if unchecked && !message.is_initialized() => Err(Error::Uninitialized),
+            result => result,
+        }
+    }
+    /// Gets the number of threads the reader can use to decode runs of repeated message fields.
+    pub fn threads(&self) -> usize {
+        self.options.threads
+    }
+    /// Gets a builder for readers decoding values nested in the current value on other threads.
+    /// These readers have what's left of this reader's recursion limit and don't spawn threads of their own.
+    pub(crate) fn nested_builder(&self) -> Builder {
+        let mut options = self.options.clone();
+        options.recursion_limit = options.recursion_limit.saturating_sub(self.inner.state().recursion_depth);
+        options.threads = 1;
+        options.projection = self.nested_projection();
+        Builder { options }
+    }
+    /// Gets the projection the reader reads messages with.
+    pub fn projection(&self) -> Option<&Projection> {
+        self.options.projection.as_deref()
+    }
+    /// Gets the counters for everything read so far. Readers made with `as_any` share the counters of the reader
+    /// they were made from.
+    #[cfg(feature = "metrics")]
+    pub fn metrics(&self) -> ReadMetrics {
+        let metrics = self.inner.state().metrics;
+        ReadMetrics { bytes_read: metrics.input_bytes - self.inner.unconsumed() as u64, ..metrics }
+    }
+    #[cfg(feature = "metrics")]
+    pub(crate) fn metrics_mut(&mut self) -> &mut ReadMetrics {
+        &mut self.inner.state_mut().metrics
+    }
+    /// Gets the projection of a message nested in the field of the last tag.
+    /// A message read without a tag before it is read with the current projection.
+    fn nested_projection(&self) -> Option<Arc<Projection>> {
+        let projection = self.options.projection.as_ref()?;
+        match self.last_tag() {
+            Some(tag) => projection.nested_arc(tag.field()).cloned(),
+            None => Some(projection.clone()),
+        }
+    }
+    /// Reads a message nested in the field of the last tag, switching to the field's projection while it's read.
+    #[inline]
+    pub(crate) fn read_nested<R, F: FnOnce(&mut Self) -> Result<R>>(&mut self, f: F) -> Result<R> {
+        if self.options.projection.is_none() {
+            return f(self);
+        }
+
+        let nested = self.nested_projection();
+        let old = std::mem::replace(&mut self.options.projection, nested);
+        let result = f(self);
+        self.options.projection = old;
+        result
+    }
+    /// Reads a value without a projection, such as a map entry, whose fields don't belong to the projected message
+    #[inline]
+    pub(crate) fn read_unprojected<R, F: FnOnce(&mut Self) -> Result<R>>(&mut self, f: F) -> Result<R> {
+        if self.options.projection.is_none() {
+            return f(self);
+        }
+
+        let old = self.options.projection.take();
+        let result = f(self);
+        self.options.projection = old;
+        result
+    }
+    /// Gets the bytes already buffered before the current limit, which bulk readers can decode in place.
+    #[inline]
+    pub(crate) fn buffered(&self) -> &[u8] {
+        self.inner.buffered()
+    }
+    /// Consumes bytes returned by [`buffered`](#method.buffered).
+    #[inline]
+    pub(crate) unsafe fn consume(&mut self, amnt: usize) {
+        self.inner.consume(amnt)
+    }
+    /// Returns whether the reader reads from a slice, so everything left in the current limit is
+    /// [`buffered`](#method.buffered).
+    #[inline]
+    pub(crate) fn is_slice(&self) -> bool {
+        self.inner.is_slice()
+    }
     /// Gets the last tag read by the reader.
     pub fn last_tag(&self) -> Option<Tag> {
         self.inner.state().last_tag
@@ -1570,6 +2489,65 @@ impl<T: Input> CodedReader<T> {
         self.inner.reached_limit()
     }
 
+    /// Reads a message preceded by its length, returning `None` if the input ends before the length.
+    /// 
+    /// This is the framing used to store a sequence of messages in one input, as written by
+    /// [`CodedWriter::write_delimited`](../write/struct.CodedWriter.html#method.write_delimited).
+    /// 
+    /// # Examples
+    /// 
+    /// ```ignore
+    /// # use protrust::doctest::timestamp::Timestamp;
+    /// use protrust::io::CodedReader;
+    /// 
+    /// let input = [2, 8, 5, 2, 8, 6];
+    /// let mut reader = CodedReader::with_stream(input.as_ref());
+    /// 
+    /// assert_eq!(reader.read_delimited::<Timestamp>()?.map(|t| *t.seconds()), Some(5));
+    /// assert_eq!(reader.read_delimited::<Timestamp>()?.map(|t| *t.seconds()), Some(6));
+    /// assert_eq!(reader.read_delimited::<Timestamp>()?, None);
+    /// # Ok::<(), protrust::io::read::Error>(())
+    /// ```
+    pub fn read_delimited<M: Message>(&mut self) -> Result<Option<M>> {
+        let mut message = M::new_for(self);
+        if self.merge_delimited(&mut message)? {
+            Ok(Some(message))
+        } else {
+            Ok(None)
+        }
+    }
+    /// Merges a message preceded by its length into an existing message, returning false if the
+    /// input ends before the length. Clearing the message between calls lets one message be reused
+    /// for every message in the input.
+    pub fn merge_delimited<M: Message>(&mut self, message: &mut M) -> Result<bool> {
+        // the frame length is read like any other length, only a clean end of input before it ends the stream
+        let limit = match self.inner.try_read_varint32()? {
+            Some(limit) => limit as i32,
+            None => return Ok(false),
+        };
+        if limit < 0 {
+            return Err(Error::NegativeSize);
+        }
+
+        let old = self.inner.push_limit(limit)?;
+        let limit = Limit { inner: self, old };
+        limit.inner.recurse(|input| input.merge_message(message))?;
+        // a stream can end before the limit is reached, which is an error for the last message
+        if !limit.inner.reached_limit() {
+            return Err(io::Error::from(ErrorKind::UnexpectedEof).into());
+        }
+        Ok(true)
+    }
+    /// Returns an iterator over the length delimited messages in the rest of the input.
+    /// See [`read_delimited`](#method.read_delimited) for the framing of each message.
+    pub fn delimited<M: Message>(&mut self) -> Delimited<T, M> {
+        Delimited {
+            inner: self,
+            failed: false,
+            _message: PhantomData,
+        }
+    }
+
     #[inline]
     fn read_raw_tag(&mut self) -> Result<Option<u32>> {
         let tag = self.inner.read_tag()?;
@@ -1612,6 +2590,12 @@ impl<T: Input> CodedReader<T> {
     pub fn read_length_delimited<B: ByteString>(&mut self) -> Result<B> {
         self.inner.read_length_delimited()
     }
+    /// Reads a length delimited string of bytes into a container created by the specified function.
+    /// The function is passed the length of the string and must return a container of that length.
+    /// Every byte of the container is overwritten if the read succeeds, so it doesn't need to be initialized.
+    pub fn read_length_delimited_with<B: AsMut<[u8]>, F: FnOnce(usize) -> B>(&mut self, f: F) -> Result<B> {
+        self.inner.read_length_delimited_with(f)
+    }
     /// Reads a group, merging it's fields into the provided message instance.
     pub fn read_group<M: Message>(&mut self, value: &mut M) -> Result<()> {
         struct Guard<'a, T: Input + 'a> {
@@ -1690,8 +2674,28 @@ impl<T: Input> CodedReader<T> {
     /// many fields when the tag's underlying value already exists as a constant.
     #[inline]
     pub fn read_field<'a>(&'a mut self) -> Result<Option<FieldReader<'a, T>>> {
+        if self.options.projection.is_some() {
+            return self.read_projected_field();
+        }
         self.inner.read_tag().map(move |t| t.map(move |t| FieldReader { inner: self, tag: t }))
     }
+    /// Reads the next field in the projection, skipping every field before it
+    fn read_projected_field(&mut self) -> Result<Option<FieldReader<'_, T>>> {
+        loop {
+            let tag = match self.inner.read_tag()? {
+                Some(tag) => tag,
+                None => return Ok(None),
+            };
+            let wanted = self.options.projection.as_ref().map_or(true, |p| p.contains_number(tag >> 3));
+            let checked = Tag::try_from(tag).map_err(|_| Error::InvalidTag(tag))?;
+            // end group tags are left for the message to handle the same as it would without a projection
+            if wanted || checked.wire_type() == WireType::EndGroup {
+                return Ok(Some(FieldReader { inner: self, tag }));
+            }
+            self.set_last_tag(Some(checked));
+            self.skip()?;
+        }
+    }
     /// Reads a new instance of the value from the reader.
     /// This is the inverse of `Value::read_new`.
     #[inline]
@@ -1750,6 +2754,12 @@ mod test {
         }
     }
 
+    #[test]
+    fn slice_readers_are_send_and_sync() {
+        fn assert_send_sync<T: Send + Sync>(_: &T) { }
+        assert_send_sync(&CodedReader::with_slice(&[1, 2, 3]));
+    }
+
     mod actions {
         use std::fmt::Debug;
         use std::marker::PhantomData;
@@ -2184,6 +3194,58 @@ mod test {
             }
 
             run_suite!(SliceInput);
+
+            mod borrowed {
+                use crate::io::read::{CodedReader, Error};
+                use std::borrow::Cow;
+
+                #[test]
+                fn read_bytes_borrows_input() {
+                    let data = [3, 1, 2, 3, 0];
+                    let mut reader = CodedReader::with_slice(&data);
+                    let value: Cow<[u8]> = reader.read_length_delimited_borrowed().unwrap();
+                    match value {
+                        Cow::Borrowed(b) => assert_eq!(b.as_ptr(), data[1..].as_ptr()),
+                        Cow::Owned(_) => panic!("expected borrowed value"),
+                    }
+                    let empty: &[u8] = reader.read_length_delimited_borrowed().unwrap();
+                    assert!(empty.is_empty());
+                    assert!(reader.into_inner().is_empty());
+                }
+                #[test]
+                fn read_truncated_bytes() {
+                    let data = [4, 1, 2, 3];
+                    let mut reader = CodedReader::with_slice(&data);
+                    match reader.read_length_delimited_borrowed::<&[u8]>() {
+                        Err(Error::IoError(_)) => { },
+                        r => panic!("unexpected result: {:?}", r),
+                    }
+                }
+                #[test]
+                fn read_negative_bytes() {
+                    let data = [255, 255, 255, 255, 15];
+                    let mut reader = CodedReader::with_slice(&data);
+                    match reader.read_length_delimited_borrowed::<&[u8]>() {
+                        Err(Error::NegativeSize) => { },
+                        r => panic!("unexpected result: {:?}", r),
+                    }
+                }
+                #[test]
+                fn read_str() {
+                    let data = [2, b'h', b'i'];
+                    let mut reader = CodedReader::with_slice(&data);
+                    assert_eq!(reader.read_str_borrowed().unwrap(), "hi");
+                }
+                #[test]
+                fn read_invalid_str() {
+                    let data = [2, 0xC3, 0x28];
+                    let mut reader = CodedReader::with_slice(&data);
+                    match reader.read_str_borrowed() {
+                        Err(Error::InvalidString(e)) => assert_eq!(e.as_bytes(), &[0xC3, 0x28]),
+                        r => panic!("unexpected result: {:?}", r),
+                    }
+                }
+            }
         }
 
         mod stream {
@@ -2227,6 +3289,762 @@ mod test {
                 stream_case!(StreamTinyBuffer(10));
                 run_suite!(StreamTinyBuffer);
             }
+
+            mod shared {
+                use crate::io::{CodedReader, SharedBytes};
+                use std::sync::Arc;
+
+                #[test]
+                fn read_shares_buffer() {
+                    let data = [3, 1, 2, 3, 2, 4, 5];
+                    let mut reader = CodedReader::with_stream(data.as_ref());
+                    let first = reader.read_length_delimited::<SharedBytes>().unwrap();
+                    let second = reader.read_length_delimited::<SharedBytes>().unwrap();
+
+                    assert_eq!(first.as_ref(), &[1, 2, 3]);
+                    assert_eq!(second.as_ref(), &[4, 5]);
+                    assert!(Arc::ptr_eq(&first.chunk, &second.chunk));
+                    assert!(Arc::ptr_eq(&first.chunk, &reader.inner.buf));
+                }
+                #[test]
+                fn refill_keeps_shared_values() {
+                    let data = [3, 1, 2, 3, 3, 4, 5, 6];
+                    let mut reader = CodedReader::with_capacity(4, data.as_ref());
+                    let first = reader.read_length_delimited::<SharedBytes>().unwrap();
+                    let second = reader.read_length_delimited::<SharedBytes>().unwrap();
+
+                    assert_eq!(first.as_ref(), &[1, 2, 3]);
+                    assert_eq!(second.as_ref(), &[4, 5, 6]);
+                    assert!(!Arc::ptr_eq(&first.chunk, &second.chunk));
+                }
+                #[test]
+                fn refill_reuses_unshared_buffer() {
+                    let data = [3, 1, 2, 3, 3, 4, 5, 6];
+                    let mut reader = CodedReader::with_capacity(4, data.as_ref());
+                    let first = reader.read_length_delimited::<Vec<u8>>().unwrap();
+                    let chunk = reader.inner.buf.as_ptr();
+                    let second = reader.read_length_delimited::<Vec<u8>>().unwrap();
+
+                    assert_eq!(first, [1, 2, 3]);
+                    assert_eq!(second, [4, 5, 6]);
+                    assert_eq!(chunk, reader.inner.buf.as_ptr());
+                }
+                #[test]
+                fn read_larger_than_buffer_copies() {
+                    let data = [5, 1, 2, 3, 4, 5];
+                    let mut reader = CodedReader::with_capacity(2, data.as_ref());
+                    let value = reader.read_length_delimited::<SharedBytes>().unwrap();
+
+                    assert_eq!(value.as_ref(), &[1, 2, 3, 4, 5]);
+                    assert!(!value.is_shared());
+                }
+                #[test]
+                fn any_read_shares_buffer() {
+                    let data = [3, 1, 2, 3];
+                    let mut reader = CodedReader::with_stream(data.as_ref());
+                    let value = reader.as_any().read_length_delimited::<SharedBytes>().unwrap();
+
+                    assert_eq!(value.as_ref(), &[1, 2, 3]);
+                    assert!(Arc::ptr_eq(&value.chunk, &reader.inner.buf));
+                }
+            }
+        }
+    }
+
+    mod delimited {
+        use crate::Message;
+        use crate::io::{read, CodedReader, CodedWriter};
+        use crate::test_support::Record;
+        use std::io::{self, Write};
+
+        fn record(id: i32) -> Record {
+            Record::new(id, id as usize % 7)
+        }
+
+        /// A writer counting the writes made to it
+        #[derive(Default)]
+        struct Counted {
+            data: Vec<u8>,
+            writes: usize,
+        }
+
+        impl Write for &mut Counted {
+            fn write(&mut self, buf: &[u8]) -> io::Result<usize> {
+                self.writes += 1;
+                self.data.extend_from_slice(buf);
+                Ok(buf.len())
+            }
+            fn flush(&mut self) -> io::Result<()> {
+                Ok(())
+            }
+        }
+
+        fn records() -> Vec<Record> {
+            (0..200).map(record).collect()
+        }
+
+        fn encode(records: &[Record], cap: usize) -> Counted {
+            let mut output = Counted::default();
+            let mut writer = CodedWriter::with_capacity(cap, &mut output);
+            for record in records {
+                writer.write_delimited(record).unwrap();
+            }
+            writer.flush().unwrap();
+            drop(writer);
+            output
+        }
+
+        #[test]
+        fn roundtrip_slice() {
+            let records = records();
+            let data = encode(&records, 8192).data;
+            let mut reader = CodedReader::with_slice(&data);
+            let read = reader.delimited::<Record>().collect::<read::Result<Vec<_>>>().unwrap();
+
+            assert_eq!(read, records);
+        }
+        #[test]
+        fn roundtrip_stream() {
+            let records = records();
+            let data = encode(&records, 8192).data;
+            for &cap in &[1, 3, 16, 8192] {
+                let mut reader = CodedReader::with_capacity(cap, data.as_slice());
+                let read = reader.delimited::<Record>().collect::<read::Result<Vec<_>>>().unwrap();
+
+                assert_eq!(read, records, "capacity {}", cap);
+            }
+        }
+        #[test]
+        fn roundtrip_any() {
+            let records = records();
+            let data = encode(&records, 8192).data;
+            let mut reader = CodedReader::with_capacity(7, data.as_slice());
+            let mut reader = reader.as_any();
+            let read = reader.delimited::<Record>().collect::<read::Result<Vec<_>>>().unwrap();
+
+            assert_eq!(read, records);
+        }
+        #[test]
+        fn merge_reuses_message() {
+            let records = records();
+            let data = encode(&records, 8192).data;
+            let mut reader = CodedReader::with_stream(data.as_slice());
+            let mut record = Record::default();
+            let mut count = 0;
+            while reader.merge_delimited(&mut record).unwrap() {
+                assert_eq!(record, records[count]);
+                record.clear();
+                count += 1;
+            }
+            assert_eq!(count, records.len());
+        }
+        #[test]
+        fn empty_messages() {
+            let data = [0, 0, 0];
+            let mut reader = CodedReader::with_stream(data.as_ref());
+
+            assert_eq!(reader.delimited::<Record>().count(), 3);
+        }
+        #[test]
+        fn truncated_message_fails_once() {
+            let data = [2, 8, 1, 4, 8, 2];
+            let mut reader = CodedReader::with_stream(data.as_ref());
+            let mut iter = reader.delimited::<Record>();
+
+            assert_eq!(iter.next().unwrap().unwrap().id, 1);
+            assert!(iter.next().unwrap().is_err());
+            assert!(iter.next().is_none());
+        }
+        #[test]
+        fn truncated_length_fails() {
+            let data = [0x80];
+            let mut reader = CodedReader::with_slice(&data);
+
+            assert!(reader.read_delimited::<Record>().is_err());
+        }
+        #[test]
+        fn stream_writes_are_batched() {
+            let records = records();
+            let batched = encode(&records, 256);
+
+            assert_eq!(batched.data, encode(&records, 8192).data);
+            assert!(batched.writes * 16 < records.len(), "{} writes for {} messages", batched.writes, records.len());
+        }
+    }
+
+    mod uninit {
+        use crate::arena::{Arena, ArenaBytes};
+        use crate::io::{CodedReader, SharedBytes};
+        use crate::io::read::Builder;
+        use crate::raw::{self, Value};
+        use std::io::{self, Read};
+
+        /// An input that checks the large buffers it's given were zeroed, since it could read from them
+        struct Inspecting<'a> {
+            data: &'a [u8],
+            zeroed: bool,
+        }
+
+        impl Read for Inspecting<'_> {
+            fn read(&mut self, buf: &mut [u8]) -> io::Result<usize> {
+                if buf.len() >= 64 {
+                    self.zeroed &= buf.iter().all(|&b| b == 0);
+                }
+                self.data.read(buf)
+            }
+        }
+
+        fn value(len: usize) -> Vec<u8> {
+            let mut data = vec![(len as u8) | 0x80, (len >> 7) as u8];
+            data.extend((0..len).map(|i| i as u8 | 1));
+            data
+        }
+
+        #[test]
+        fn values_are_filled() {
+            let data = value(300);
+            let expected = &data[2..];
+            assert_eq!(CodedReader::with_slice(&data).read_length_delimited::<Vec<u8>>().unwrap(), expected);
+            assert_eq!(CodedReader::with_capacity(16, data.as_slice()).read_length_delimited::<Box<[u8]>>().unwrap().as_ref(), expected);
+            assert_eq!(CodedReader::with_capacity(16, data.as_slice()).read_length_delimited::<SharedBytes>().unwrap().as_ref(), expected);
+
+            let arena = Arena::new();
+            let bytes: ArenaBytes = Builder::new().with_slice_in(&data, &arena).read_arena_bytes().unwrap();
+            assert_eq!(bytes.as_ref(), expected);
+
+            // merging reuses the existing vec and still overwrites all of it
+            let mut merged = vec![0xff; 400];
+            raw::Bytes::<Vec<u8>>::merge_from(&mut merged, &mut CodedReader::with_capacity(16, data.as_slice())).unwrap();
+            assert_eq!(merged, expected);
+        }
+
+        #[test]
+        fn direct_reads_are_zeroed() {
+            let data = value(300);
+            let mut input = Inspecting { data: &data, zeroed: true };
+            let value = CodedReader::with_capacity(16, &mut input).read_length_delimited::<Vec<u8>>().unwrap();
+            assert_eq!(value, &data[2..]);
+            assert!(input.zeroed);
+        }
+
+        #[test]
+        fn new_chunks_are_zeroed() {
+            let data = value(100);
+            let mut input = Inspecting { data: &data, zeroed: true };
+            let value = CodedReader::with_capacity(128, &mut input).read_length_delimited::<Vec<u8>>().unwrap();
+            assert_eq!(value, &data[2..]);
+            assert!(input.zeroed);
+        }
+
+        #[test]
+        fn direct_reads_fill_spare_capacity() {
+            let data = value(300);
+            let value = CodedReader::with_capacity(16, data.as_slice()).read_length_delimited::<Vec<u8>>().unwrap();
+            assert_eq!(value, &data[2..]);
+            // read straight into the capacity it was created with rather than a zeroed length
+            assert_eq!(value.capacity(), 300);
+        }
+
+        #[test]
+        fn failed_reads_leave_nothing() {
+            let data = value(300);
+            let mut merged = vec![1, 2, 3];
+            assert!(raw::Bytes::<Vec<u8>>::merge_from(&mut merged, &mut CodedReader::with_capacity(16, &data[..200])).is_err());
+            assert!(merged.is_empty());
+        }
+
+        #[test]
+        fn failed_string_merges_keep_the_old_value() {
+            let data = value(300);
+            let mut merged = "old".to_string();
+            assert!(raw::String::merge_from(&mut merged, &mut CodedReader::with_capacity(16, &data[..200])).is_err());
+            assert_eq!(merged, "old");
+
+            let invalid = [2, 0xc3, 0x28];
+            assert!(raw::String::merge_from(&mut merged, &mut CodedReader::with_slice(&invalid)).is_err());
+            assert_eq!(merged, "old");
+
+            let valid = [3, b'n', b'e', b'w'];
+            raw::String::merge_from(&mut merged, &mut CodedReader::with_slice(&valid)).unwrap();
+            assert_eq!(merged, "new");
+        }
+    }
+
+    mod buffers {
+        use crate::io::read::Builder;
+
+        /// Values too large for a 16 byte buffer, so each one is read past it
+        fn values() -> Vec<u8> {
+            let mut data = Vec::new();
+            for i in 0..12u8 {
+                data.push(40);
+                data.extend_from_slice(&[i; 40]);
+            }
+            data
+        }
+
+        fn read_all(builder: Builder, data: &[u8]) -> usize {
+            let mut reader = builder.with_capacity(16, data);
+            for i in 0..12u8 {
+                assert_eq!(reader.read_length_delimited::<Vec<u8>>().unwrap(), [i; 40]);
+            }
+            assert_eq!(reader.read_tag().unwrap(), None);
+            reader.inner.buf.len()
+        }
+
+        #[test]
+        fn buffers_grow_after_direct_reads() {
+            let data = values();
+            assert_eq!(read_all(Builder::new(), &data), 16);
+
+            let len = read_all(Builder::new().grow_buffer(true), &data);
+            assert!(len > 16);
+            assert!(len.is_power_of_two());
+        }
+
+        #[test]
+        fn pooled_buffers_grow() {
+            crate::pool::clear_buffers();
+            let data = values();
+            let mut reader = Builder::new().grow_buffer(true).with_pooled_capacity(16, &data[..]);
+            for i in 0..12u8 {
+                assert_eq!(reader.read_length_delimited::<Vec<u8>>().unwrap(), [i; 40]);
+            }
+            let grown = reader.inner.buf.len();
+            assert!(grown > 16);
+            // each buffer the reader grew out of went back to the pool as soon as it was replaced
+            assert!(crate::pool::read_buffer_lens().contains(&16));
+            assert!(!crate::pool::read_buffer_lens().contains(&grown));
+
+            drop(reader);
+            let mut lens = crate::pool::read_buffer_lens();
+            lens.sort();
+            assert_eq!(lens.first(), Some(&16));
+            assert_eq!(lens.last(), Some(&grown));
+        }
+    }
+
+    mod required {
+        use crate::{Message, UnknownFieldSet};
+        use crate::collections::RepeatedField;
+        use crate::io::{read, write, CodedReader, CodedWriter, FieldNumber, Input, Length, LengthBuilder, Output};
+        use crate::io::read::{Builder, Error};
+        use crate::raw;
+        use std::cell::Cell;
+
+        const fn num(n: u32) -> FieldNumber {
+            unsafe { FieldNumber::new_unchecked(n) }
+        }
+
+        thread_local! {
+            static CHECKS: Cell<usize> = Cell::new(0);
+            static INIT_CHECKS: Cell<usize> = Cell::new(0);
+        }
+
+        /// A message with a required value and nested messages
+        #[derive(Default, Clone, Debug, PartialEq)]
+        struct Node {
+            value: Option<i32>,
+            children: RepeatedField<Node>,
+            unknown_fields: UnknownFieldSet,
+        }
+
+        impl Message for Node {
+            fn merge_from<T: Input>(&mut self, input: &mut CodedReader<T>) -> read::Result<()> {
+                while let Some(field) = input.read_field()? {
+                    match field.tag() {
+                        8 => self.value = Some(field.read_value::<raw::Int32>(num(1))?),
+                        18 => field.add_entries_to::<_, raw::Message<Node>>(num(2), &mut self.children)?,
+                        _ => field.check_and_try_add_field_to(&mut self.unknown_fields)?.or_skip()?,
+                    }
+                }
+                Ok(())
+            }
+            fn calculate_size(&self) -> Option<Length> {
+                let mut builder = LengthBuilder::new();
+                if let Some(value) = &self.value {
+                    builder = builder.add_field::<raw::Int32>(num(1), value)?;
+                }
+                builder
+                    .add_values::<_, raw::Message<Node>>(&self.children, num(2))?
+                    .add_fields(&self.unknown_fields)
+                    .map(LengthBuilder::build)
+            }
+            fn write_to<T: Output>(&self, output: &mut CodedWriter<T>) -> write::Result {
+                if let Some(value) = &self.value {
+                    output.write_field::<raw::Int32>(num(1), value)?;
+                }
+                output.write_values::<_, raw::Message<Node>>(&self.children, num(2))?;
+                output.write_fields(&self.unknown_fields)
+            }
+            fn is_initialized(&self) -> bool {
+                self.value.is_some() && self.children.iter().all(Node::is_initialized)
+            }
+            fn required_fields_set(&self) -> Option<bool> {
+                CHECKS.with(|c| c.set(c.get() + 1));
+                Some(self.value.is_some())
+            }
+            fn unknown_fields(&self) -> &UnknownFieldSet {
+                &self.unknown_fields
+            }
+            fn unknown_fields_mut(&mut self) -> &mut UnknownFieldSet {
+                &mut self.unknown_fields
+            }
+        }
+
+        /// A message like `Node` that leaves checking its required value to `is_initialized`
+        #[derive(Default, Clone, Debug, PartialEq)]
+        struct Chain {
+            value: Option<i32>,
+            next: RepeatedField<Chain>,
+            unknown_fields: UnknownFieldSet,
+        }
+
+        impl Message for Chain {
+            fn merge_from<T: Input>(&mut self, input: &mut CodedReader<T>) -> read::Result<()> {
+                while let Some(field) = input.read_field()? {
+                    match field.tag() {
+                        8 => self.value = Some(field.read_value::<raw::Int32>(num(1))?),
+                        18 => field.add_entries_to::<_, raw::Message<Chain>>(num(2), &mut self.next)?,
+                        _ => field.check_and_try_add_field_to(&mut self.unknown_fields)?.or_skip()?,
+                    }
+                }
+                Ok(())
+            }
+            fn calculate_size(&self) -> Option<Length> {
+                let mut builder = LengthBuilder::new();
+                if let Some(value) = &self.value {
+                    builder = builder.add_field::<raw::Int32>(num(1), value)?;
+                }
+                builder
+                    .add_values::<_, raw::Message<Chain>>(&self.next, num(2))?
+                    .add_fields(&self.unknown_fields)
+                    .map(LengthBuilder::build)
+            }
+            fn write_to<T: Output>(&self, output: &mut CodedWriter<T>) -> write::Result {
+                if let Some(value) = &self.value {
+                    output.write_field::<raw::Int32>(num(1), value)?;
+                }
+                output.write_values::<_, raw::Message<Chain>>(&self.next, num(2))?;
+                output.write_fields(&self.unknown_fields)
+            }
+            fn is_initialized(&self) -> bool {
+                INIT_CHECKS.with(|c| c.set(c.get() + 1));
+                self.value.is_some() && self.next.iter().all(Chain::is_initialized)
+            }
+            fn unknown_fields(&self) -> &UnknownFieldSet {
+                &self.unknown_fields
+            }
+            fn unknown_fields_mut(&mut self) -> &mut UnknownFieldSet {
+                &mut self.unknown_fields
+            }
+        }
+
+        fn chain(depth: usize, missing: Option<usize>) -> Chain {
+            (0..depth).rev().fold(None, |next: Option<Chain>, i| Some(Chain {
+                value: if missing == Some(i) { None } else { Some(i as i32) },
+                next: next.into_iter().collect::<Vec<_>>().into(),
+                ..Chain::default()
+            })).unwrap_or_default()
+        }
+
+        fn node(value: Option<i32>, children: Vec<Node>) -> Node {
+            Node { value, children: children.into(), ..Node::default() }
+        }
+
+        fn checked() -> Builder {
+            Builder::new().check_initialized(true)
+        }
+
+        #[test]
+        fn every_message_is_checked_once() {
+            let tree = node(Some(1), vec![node(Some(2), vec![node(Some(3), vec![])]), node(Some(4), vec![])]);
+            let data = tree.to_bytes().unwrap();
+
+            CHECKS.with(|c| c.set(0));
+            let mut read = Node::default();
+            checked().with_slice(&data).merge_message(&mut read).unwrap();
+            assert_eq!(read, tree);
+            assert_eq!(CHECKS.with(Cell::get), 4);
+
+            // nothing is checked by default
+            CHECKS.with(|c| c.set(0));
+            Builder::new().with_slice(&data).merge_message(&mut Node::default()).unwrap();
+            assert_eq!(CHECKS.with(Cell::get), 0);
+        }
+
+        #[test]
+        fn missing_fields_fail_the_read() {
+            let nested = node(Some(1), vec![node(Some(2), vec![node(None, vec![])]), node(Some(4), vec![])]).to_bytes().unwrap();
+            let mut read = Node::default();
+            read.merge_from(&mut CodedReader::with_slice(&nested)).unwrap();
+            assert!(!read.is_initialized());
+
+            CHECKS.with(|c| c.set(0));
+            assert!(matches!(checked().with_slice(&nested).merge_message(&mut Node::default()), Err(Error::Uninitialized)));
+            // the read stops at the first message missing its value
+            assert_eq!(CHECKS.with(Cell::get), 1);
+
+            let root = node(None, vec![node(Some(2), vec![])]).to_bytes().unwrap();
+            assert!(checked().with_slice(&root).merge_message(&mut Node::default()).is_err());
+            assert!(checked().with_slice(&root).read_value::<raw::FrozenMessage<Node>>().is_err());
+            Builder::new().with_slice(&root).merge_message(&mut Node::default()).unwrap();
+        }
+
+        #[test]
+        fn unchecked_messages_are_checked_once_at_the_top() {
+            let data = chain(8, None).to_bytes().unwrap();
+            INIT_CHECKS.with(|c| c.set(0));
+            let mut read = Chain::default();
+            checked().with_slice(&data).merge_message(&mut read).unwrap();
+            assert_eq!(read, chain(8, None));
+            // one walk over the tree, not one per level
+            assert_eq!(INIT_CHECKS.with(Cell::get), 8);
+
+            let missing = chain(8, Some(6)).to_bytes().unwrap();
+            assert!(matches!(checked().with_slice(&missing).merge_message(&mut Chain::default()), Err(Error::Uninitialized)));
+            Builder::new().with_slice(&missing).merge_message(&mut Chain::default()).unwrap();
+
+            // the reader can be used for the next message after a failed check
+            let mut data = Vec::new();
+            let mut writer = CodedWriter::with_vec(&mut data);
+            writer.write_delimited(&chain(3, Some(2))).unwrap();
+            writer.write_delimited(&chain(3, None)).unwrap();
+            drop(writer);
+            let mut reader = checked().with_slice(&data);
+            assert!(matches!(reader.read_delimited::<Chain>(), Err(Error::Uninitialized)));
+            assert_eq!(reader.read_delimited::<Chain>().unwrap(), Some(chain(3, None)));
+        }
+
+        #[test]
+        fn delimited_messages_are_checked() {
+            let mut data = Vec::new();
+            let mut writer = CodedWriter::with_vec(&mut data);
+            writer.write_delimited(&node(Some(1), vec![])).unwrap();
+            writer.write_delimited(&node(None, vec![])).unwrap();
+            drop(writer);
+
+            let mut reader = checked().with_slice(&data);
+            assert_eq!(reader.read_delimited::<Node>().unwrap(), Some(node(Some(1), vec![])));
+            assert!(matches!(reader.read_delimited::<Node>(), Err(Error::Uninitialized)));
         }
     }
-}
\ No newline at end of file
+
+    mod projection {
+        use crate::{Message, UnknownFieldSet};
+        use crate::collections::{MapField, RepeatedField};
+        use crate::io::{read, write, CodedReader, CodedWriter, FieldNumber, Input, Length, LengthBuilder, Output};
+        use crate::io::read::{Builder, Projection, UnknownFieldHandling};
+        use crate::raw;
+
+        const fn num(n: u32) -> FieldNumber {
+            unsafe { FieldNumber::new_unchecked(n) }
+        }
+
+        #[derive(Default, Clone, Debug, PartialEq)]
+        struct Event {
+            id: i32,
+            name: String,
+            children: RepeatedField<Event>,
+            unknown_fields: UnknownFieldSet,
+        }
+
+        impl Message for Event {
+            fn merge_from<T: Input>(&mut self, input: &mut CodedReader<T>) -> read::Result<()> {
+                while let Some(field) = input.read_field()? {
+                    match field.tag() {
+                        8 => field.merge_value::<raw::Int32>(num(1), &mut self.id)?,
+                        18 => field.merge_value::<raw::String>(num(2), &mut self.name)?,
+                        26 => field.add_entries_to::<_, raw::Message<Event>>(num(3), &mut self.children)?,
+                        _ => field.check_and_try_add_field_to(&mut self.unknown_fields)?.or_skip()?,
+                    }
+                }
+                Ok(())
+            }
+            fn calculate_size(&self) -> Option<Length> {
+                let mut builder = LengthBuilder::new();
+                if self.id != 0 {
+                    builder = builder.add_field::<raw::Int32>(num(1), &self.id)?;
+                }
+                if !self.name.is_empty() {
+                    builder = builder.add_field::<raw::String>(num(2), &self.name)?;
+                }
+                builder
+                    .add_values::<_, raw::Message<Event>>(&self.children, num(3))?
+                    .add_fields(&self.unknown_fields)
+                    .map(LengthBuilder::build)
+            }
+            fn write_to<T: Output>(&self, output: &mut CodedWriter<T>) -> write::Result {
+                if self.id != 0 {
+                    output.write_field::<raw::Int32>(num(1), &self.id)?;
+                }
+                if !self.name.is_empty() {
+                    output.write_field::<raw::String>(num(2), &self.name)?;
+                }
+                output.write_values::<_, raw::Message<Event>>(&self.children, num(3))?;
+                output.write_fields(&self.unknown_fields)
+            }
+            fn is_initialized(&self) -> bool {
+                true
+            }
+            fn unknown_fields(&self) -> &UnknownFieldSet {
+                &self.unknown_fields
+            }
+            fn unknown_fields_mut(&mut self) -> &mut UnknownFieldSet {
+                &mut self.unknown_fields
+            }
+        }
+
+        fn event(id: i32, children: usize) -> Event {
+            Event {
+                id,
+                name: format!("event-{}", id),
+                children: (0..children).map(|i| event(id * 10 + i as i32, 0)).collect(),
+                ..Default::default()
+            }
+        }
+
+        /// An event followed by an unknown varint field and an unknown group
+        fn encode(event: &Event) -> Vec<u8> {
+            let mut data = event.to_bytes().unwrap();
+            data.extend_from_slice(&[72, 5, 83, 8, 1, 84]);
+            data
+        }
+
+        fn decode(builder: Builder, data: &[u8]) -> Event {
+            let mut event = Event::default();
+            event.merge_from(&mut builder.with_slice(data)).unwrap();
+            event
+        }
+
+        #[test]
+        fn skips_fields_outside_projection() {
+            let data = encode(&event(1, 3));
+            let read = decode(Builder::new().projection(Some(Projection::new().field(num(1)))), &data);
+
+            assert_eq!(read, Event { id: 1, ..Default::default() });
+        }
+        #[test]
+        fn skipped_fields_are_never_stored() {
+            let data = encode(&event(1, 0));
+            for &handling in &[UnknownFieldHandling::Store, UnknownFieldHandling::StoreRaw] {
+                let builder = Builder::new().unknown_fields(handling).projection(Some(Projection::new().field(num(2))));
+                let read = decode(builder, &data);
+                assert_eq!(read.name, "event-1");
+                assert!(read.unknown_fields.is_empty());
+            }
+
+            let all = Projection::new().field(num(2)).field(num(9)).field(num(10));
+            assert_eq!(decode(Builder::new().projection(Some(all)), &data).unknown_fields.field_len(), 2);
+        }
+        #[test]
+        fn nested_projection() {
+            let data = encode(&event(1, 3));
+            let projection = Projection::new().field(num(1)).nested(num(3), Projection::new().field(num(2)));
+            let read = decode(Builder::new().projection(Some(projection)), &data);
+
+            assert_eq!(read.id, 1);
+            assert!(read.name.is_empty());
+            assert_eq!(read.children.iter().map(|c| (c.id, c.name.as_str())).collect::<Vec<_>>(),
+                [(0, "event-10"), (0, "event-11"), (0, "event-12")]);
+
+            // a wanted field without a nested projection is read in full
+            let read = decode(Builder::new().projection(Some(Projection::new().field(num(3)))), &data);
+            assert_eq!(read.children, event(1, 3).children);
+        }
+        /// A message of maps, whose entries have fields 1 and 2 like the projected message
+        #[derive(Default, Clone, Debug, PartialEq)]
+        struct Catalog {
+            events: MapField<i32, Event>,
+            labels: MapField<String, String>,
+            unknown_fields: UnknownFieldSet,
+        }
+
+        impl Message for Catalog {
+            fn merge_from<T: Input>(&mut self, input: &mut CodedReader<T>) -> read::Result<()> {
+                while let Some(field) = input.read_field()? {
+                    match field.tag() {
+                        10 => field.add_entries_to::<_, (raw::Int32, raw::Message<Event>)>(num(1), &mut self.events)?,
+                        18 => field.add_entries_to::<_, (raw::String, raw::String)>(num(2), &mut self.labels)?,
+                        _ => field.check_and_try_add_field_to(&mut self.unknown_fields)?.or_skip()?,
+                    }
+                }
+                Ok(())
+            }
+            fn calculate_size(&self) -> Option<Length> {
+                LengthBuilder::new()
+                    .add_values::<_, (raw::Int32, raw::Message<Event>)>(&self.events, num(1))?
+                    .add_values::<_, (raw::String, raw::String)>(&self.labels, num(2))?
+                    .add_fields(&self.unknown_fields)
+                    .map(LengthBuilder::build)
+            }
+            fn write_to<T: Output>(&self, output: &mut CodedWriter<T>) -> write::Result {
+                output.write_values::<_, (raw::Int32, raw::Message<Event>)>(&self.events, num(1))?;
+                output.write_values::<_, (raw::String, raw::String)>(&self.labels, num(2))?;
+                output.write_fields(&self.unknown_fields)
+            }
+            fn is_initialized(&self) -> bool {
+                true
+            }
+            fn unknown_fields(&self) -> &UnknownFieldSet {
+                &self.unknown_fields
+            }
+            fn unknown_fields_mut(&mut self) -> &mut UnknownFieldSet {
+                &mut self.unknown_fields
+            }
+        }
+
+        #[test]
+        fn map_entries_are_read_in_full() {
+            let mut catalog = Catalog::default();
+            catalog.events.insert(1, event(1, 2));
+            catalog.events.insert(2, event(2, 0));
+            catalog.labels.insert("a".to_string(), "b".to_string());
+            let data = catalog.to_bytes().unwrap();
+
+            let mut read = Catalog::default();
+            read.merge_from(&mut Builder::new().projection(Some(Projection::new().field(num(1)))).with_slice(&data)).unwrap();
+            assert_eq!(read.events, catalog.events);
+            assert!(read.labels.is_empty());
+
+            let projection = Projection::new().nested(num(1), Projection::new().field(num(1))).field(num(2));
+            let mut read = Catalog::default();
+            read.merge_from(&mut Builder::new().projection(Some(projection)).with_slice(&data)).unwrap();
+            assert_eq!(read, catalog);
+        }
+        #[test]
+        fn nested_projection_on_threads() {
+            // enough children to split between threads
+            let data = encode(&event(1, 20_000));
+            let projection = Projection::new().nested(num(3), Projection::new().field(num(1)));
+            let sequential = decode(Builder::new().projection(Some(projection.clone())), &data);
+            assert_eq!(sequential.children.len(), 20_000);
+            assert!(sequential.children.iter().all(|c| c.name.is_empty()));
+
+            assert_eq!(decode(Builder::new().threads(4).projection(Some(projection)), &data), sequential);
+        }
+        #[test]
+        fn stream_and_any_readers() {
+            let data = encode(&event(2, 2));
+            let projection = Projection::new().field(num(1)).nested(num(3), Projection::new().field(num(1)));
+            let expected = decode(Builder::new().projection(Some(projection.clone())), &data);
+            let builder = Builder::new().projection(Some(projection));
+
+            let mut event = Event::default();
+            event.merge_from(&mut builder.with_capacity(3, data.as_slice())).unwrap();
+            assert_eq!(event, expected);
+
+            let mut event = Event::default();
+            event.merge_from(&mut builder.with_capacity(3, data.as_slice()).as_any()).unwrap();
+            assert_eq!(event, expected);
+        }
+        #[test]
+        fn large_field_numbers() {
+            let projection = Projection::new().field(num(1000)).field(num(5));
+            assert!(projection.contains(num(1000)));
+            assert!(projection.contains(num(5)));
+            assert!(!projection.contains(num(999)));
+            assert!(!projection.contains(num(6)));
+        }
+    }
+}
@@ -0,0 +1,428 @@
+//! Defines the `ReverseWriter`, a writer that encodes values from the end of its buffer toward the front.
+//!
+//! On the wire a length delimited value comes after its length, so a [`CodedWriter`] has to know the size of
+//! every nested message before writing its first byte, which is what [`Message::compute_and_cache_size`] is for.
+//! A `ReverseWriter` writes a value's body first, then its length and tag in front of it, when the length is simply
+//! the number of bytes written since the body started. Messages written in reverse are never sized at all.
+//!
+//! Since everything is written back to front, fields have to be written in the opposite of the order they should
+//! appear in the output: a message writes its unknown fields first and its first field last, and repeated values
+//! are written from the last value to the first.
+//!
+//! [`CodedWriter`]: ../write/struct.CodedWriter.html
+//! [`Message::compute_and_cache_size`]: ../../trait.Message.html#method.compute_and_cache_size
+
+use crate::Message;
+use crate::collections::{RepeatedValue, FieldSet};
+use crate::io::{varint, FieldNumber, WireType, Tag, Length, CodedWriter};
+use crate::io::write::{Result, Error};
+use crate::raw::Value;
+use std::cmp;
+use std::convert::TryFrom;
+use std::io::{self as stdio, ErrorKind};
+use std::slice;
+
+const MIN_CAPACITY: usize = 64;
+
+/// A writer that encodes values back to front into a growable buffer.
+///
+/// # Examples
+///
+/// ```
+/// use protrust::io::{FieldNumber, reverse::ReverseWriter};
+/// use protrust::raw;
+///
+/// let num = FieldNumber::new(1).unwrap();
+/// let mut writer = ReverseWriter::new();
+/// // write the second value first so it comes last
+/// writer.write_field::<raw::String>(num, &"bar".to_string())?;
+/// writer.write_field::<raw::Int32>(num, &150)?;
+///
+/// assert_eq!(writer.as_bytes(), &[8, 150, 1, 10, 3, b'b', b'a', b'r']);
+/// # Ok::<(), protrust::io::write::Error>(())
+/// ```
+#[derive(Default)]
+pub struct ReverseWriter {
+    /// The buffer being written, with the written data at the end
+    buf: Vec<u8>,
+    /// The index of the first written byte in the buffer
+    start: usize,
+}
+
+impl ReverseWriter {
+    /// Creates a new empty writer. The writer doesn't allocate until something is written.
+    pub fn new() -> Self {
+        Self::default()
+    }
+    /// Creates a new empty writer that can write the specified number of bytes without reallocating.
+    pub fn with_capacity(cap: usize) -> Self {
+        ReverseWriter {
+            buf: vec![0; cap],
+            start: cap,
+        }
+    }
+
+    /// Returns the number of bytes written
+    #[inline]
+    pub fn len(&self) -> usize {
+        self.buf.len() - self.start
+    }
+    /// Returns whether nothing has been written
+    #[inline]
+    pub fn is_empty(&self) -> bool {
+        self.len() == 0
+    }
+    /// Returns the bytes written so far
+    #[inline]
+    pub fn as_bytes(&self) -> &[u8] {
+        &self.buf[self.start..]
+    }
+    /// Removes everything written, keeping the buffer's capacity
+    pub fn clear(&mut self) {
+        self.start = self.buf.len();
+    }
+    /// Returns the bytes written, moving them to the front of the buffer if there's space left before them
+    pub fn into_vec(mut self) -> Vec<u8> {
+        if self.start != 0 {
+            let len = self.len();
+            self.buf.copy_within(self.start.., 0);
+            self.buf.truncate(len);
+        }
+        self.buf
+    }
+
+    /// Takes the next `len` bytes in front of the written data, growing the buffer if there aren't enough
+    #[inline]
+    fn claim(&mut self, len: usize) -> &mut [u8] {
+        if self.start < len {
+            self.grow(len);
+        }
+        self.start -= len;
+        unsafe { self.buf.get_unchecked_mut(self.start..self.start + len) }
+    }
+    #[cold]
+    fn grow(&mut self, additional: usize) {
+        let len = self.len();
+        let cap = cmp::max(cmp::max(self.buf.len() * 2, len + additional), MIN_CAPACITY);
+        let mut buf = vec![0; cap];
+        buf[cap - len..].copy_from_slice(self.as_bytes());
+        self.buf = buf;
+        self.start = cap - len;
+    }
+
+    /// Writes a 32-bit varint value to the output
+    #[inline]
+    pub fn write_varint32(&mut self, value: u32) -> Result {
+        self.write_varint64(u64::from(value))
+    }
+    /// Writes a 64-bit varint value to the output
+    #[inline]
+    pub fn write_varint64(&mut self, value: u64) -> Result {
+        let len = super::raw_varint64_size(value).get() as usize;
+        encode_varint(value, self.claim(len));
+        Ok(())
+    }
+    /// Writes a little-endian 4-byte integer to the output
+    #[inline]
+    pub fn write_bit32(&mut self, value: u32) -> Result {
+        self.claim(4).copy_from_slice(&value.to_le_bytes());
+        Ok(())
+    }
+    /// Writes an little-endian 8-byte integer to the output
+    #[inline]
+    pub fn write_bit64(&mut self, value: u64) -> Result {
+        self.claim(8).copy_from_slice(&value.to_le_bytes());
+        Ok(())
+    }
+    /// Writes a length delimited string of bytes to the output
+    #[inline]
+    pub fn write_length_delimited(&mut self, value: &[u8]) -> Result {
+        let len = i32::try_from(value.len()).map_err(|_| Error::ValueTooLarge)?;
+        self.write_raw_bytes(value)?;
+        self.write_length(unsafe { Length::new_unchecked(len) })
+    }
+    /// Writes a string of bytes to the output as is, without a length delimiter
+    #[inline]
+    pub fn write_raw_bytes(&mut self, value: &[u8]) -> Result {
+        self.claim(value.len()).copy_from_slice(value);
+        Ok(())
+    }
+    /// Writes the output of the function followed by its length, making it a length delimited value.
+    ///
+    /// This fails with [`ValueTooLarge`](../write/enum.Error.html#variant.ValueTooLarge) if the function writes
+    /// more bytes than a length can represent.
+    #[inline]
+    pub fn write_length_delimited_with<F: FnOnce(&mut Self) -> Result>(&mut self, f: F) -> Result {
+        let end = self.len();
+        f(self)?;
+        let len = i32::try_from(self.len() - end).map_err(|_| Error::ValueTooLarge)?;
+        self.write_length(unsafe { Length::new_unchecked(len) })
+    }
+    /// Writes a slice of 32-bit varint values to the output, keeping them in the same order.
+    pub fn write_varint32_slice(&mut self, values: &[u32]) -> Result {
+        self.write_varints(values.iter().map(|&v| u64::from(v)))
+    }
+    /// Writes a slice of 64-bit varint values to the output, keeping them in the same order.
+    pub fn write_varint64_slice(&mut self, values: &[u64]) -> Result {
+        self.write_varints(values.iter().copied())
+    }
+    /// Sizes the values first so space for all of them is taken at once, then encodes them front to back
+    #[inline]
+    fn write_varints<I: Iterator<Item = u64> + Clone>(&mut self, values: I) -> Result {
+        let len = varint::encoded_len(values.clone());
+        let bytes = self.claim(len);
+        let mut values = values;
+        let mut ptr = bytes.as_mut_ptr();
+        unsafe {
+            let end = ptr.add(len);
+            // encode without checks while there's room for the longest varint
+            while end as usize - ptr as usize >= 10 {
+                match values.next() {
+                    Some(value) => varint::encode_unchecked(value, &mut ptr),
+                    None => return Ok(()),
+                }
+            }
+            let mut rest = slice::from_raw_parts_mut(ptr, end as usize - ptr as usize);
+            for value in values {
+                let (bytes, remaining) = rest.split_at_mut(super::raw_varint64_size(value).get() as usize);
+                encode_varint(value, bytes);
+                rest = remaining;
+            }
+        }
+        Ok(())
+    }
+    /// Writes a slice of little-endian 4-byte integers to the output, keeping them in the same order.
+    /// On little endian targets this is a single copy.
+    pub fn write_fixed32_slice(&mut self, values: &[u32]) -> Result {
+        if cfg!(target_endian = "little") {
+            self.write_raw_bytes(unsafe { slice::from_raw_parts(values.as_ptr() as *const u8, values.len() * 4) })
+        } else {
+            values.iter().rev().try_for_each(|&v| self.write_bit32(v))
+        }
+    }
+    /// Writes a slice of little-endian 8-byte integers to the output, keeping them in the same order.
+    /// On little endian targets this is a single copy.
+    pub fn write_fixed64_slice(&mut self, values: &[u64]) -> Result {
+        if cfg!(target_endian = "little") {
+            self.write_raw_bytes(unsafe { slice::from_raw_parts(values.as_ptr() as *const u8, values.len() * 8) })
+        } else {
+            values.iter().rev().try_for_each(|&v| self.write_bit64(v))
+        }
+    }
+
+    /// Writes a length to the output
+    #[inline]
+    pub fn write_length(&mut self, length: Length) -> Result {
+        self.write_varint32(length.get() as u32)
+    }
+    /// Writes a tag to the output
+    #[inline]
+    pub fn write_tag(&mut self, tag: Tag) -> Result {
+        self.write_varint32(tag.get())
+    }
+
+    /// Writes `len` bytes in front of the written data with a forward [`CodedWriter`](../write/struct.CodedWriter.html).
+    ///
+    /// This lets values that can only be written forward be used with a reverse writer, as long as their size is known.
+    /// If the function fails or doesn't write exactly `len` bytes, nothing is written.
+    pub fn write_forward<F>(&mut self, len: Length, f: F) -> Result
+        where F: FnOnce(&mut CodedWriter<super::write::Slice>) -> Result
+    {
+        let start = self.start;
+        let mut writer = CodedWriter::with_slice(self.claim(len.get() as usize));
+        let result = f(&mut writer).and_then(|()| {
+            if writer.into_inner().is_empty() {
+                Ok(())
+            } else {
+                Err(Error::IoError(stdio::Error::new(ErrorKind::InvalidData, "the value wrote fewer bytes than its length")))
+            }
+        });
+        if result.is_err() {
+            self.start = start;
+        }
+        result
+    }
+
+    /// Writes a message's fields to the output, without a length. This uses an alias to `Message::write_reverse`.
+    #[inline]
+    pub fn write_message<M: Message>(&mut self, message: &M) -> Result {
+        message.write_reverse(self)
+    }
+    /// Writes the value to the output. This uses an alias to `Value::write_reverse`.
+    #[inline]
+    pub fn write_value<V: Value>(&mut self, value: &V::Inner) -> Result {
+        V::write_reverse(value, self)
+    }
+    /// Writes the value to the output using the field number and the wire type of the value.
+    #[inline]
+    pub fn write_field<V: Value>(&mut self, num: FieldNumber, value: &V::Inner) -> Result {
+        if V::WIRE_TYPE == WireType::StartGroup {
+            self.write_tag(Tag::new(num, WireType::EndGroup))?;
+        }
+        self.write_value::<V>(value)?;
+        self.write_tag(Tag::new(num, V::WIRE_TYPE))
+    }
+    /// Writes a length delimited field of bytes that are already encoded, such as a message encoded ahead of time.
+    #[inline]
+    pub fn write_encoded_field(&mut self, num: FieldNumber, value: &[u8]) -> Result {
+        self.write_length_delimited(value)?;
+        self.write_tag(Tag::new(num, WireType::LengthDelimited))
+    }
+    /// Writes the values in the repeated field to the output. This uses an alias to `RepeatedValue::write_reverse`.
+    #[inline]
+    pub fn write_values<U: RepeatedValue<V>, V>(&mut self, value: &U, num: FieldNumber) -> Result {
+        value.write_reverse(self, num)
+    }
+    /// Writes the fields in the set to the output. This uses an alias to `FieldSet::write_reverse`.
+    #[inline]
+    pub fn write_fields<U: FieldSet>(&mut self, value: &U) -> Result {
+        value.write_reverse(self)
+    }
+}
+
+/// Encodes the varint into the bytes, which must be exactly the length of the varint
+#[inline]
+fn encode_varint(mut value: u64, bytes: &mut [u8]) {
+    let (last, rest) = bytes.split_last_mut().expect("varints are at least one byte");
+    for byte in rest {
+        *byte = value as u8 | 0x80;
+        value >>= 7;
+    }
+    *last = value as u8;
+}
+
+#[cfg(test)]
+mod test {
+    use crate::collections::{RepeatedField, MapField};
+    use crate::io::{FieldNumber, Length, CodedWriter};
+    use crate::raw;
+    use super::ReverseWriter;
+
+    fn forward<V: raw::Value>(num: FieldNumber, value: &V::Inner) -> Vec<u8> {
+        let mut output = Vec::new();
+        CodedWriter::with_vec(&mut output).write_field::<V>(num, value).unwrap();
+        output
+    }
+
+    #[test]
+    fn values_match_forward_writer() {
+        let num = FieldNumber::new(100).unwrap();
+        macro_rules! check {
+            ($($t:ty => $v:expr),* $(,)?) => {
+                $({
+                    let mut writer = ReverseWriter::new();
+                    writer.write_field::<$t>(num, &$v).unwrap();
+                    assert_eq!(writer.as_bytes(), &forward::<$t>(num, &$v)[..], stringify!($t));
+                })*
+            };
+        }
+        check! {
+            raw::Int32 => -1,
+            raw::Uint32 => u32::max_value(),
+            raw::Int64 => i64::min_value(),
+            raw::Uint64 => 0,
+            raw::Sint32 => -300,
+            raw::Sint64 => 300,
+            raw::Fixed32 => 5,
+            raw::Fixed64 => 6,
+            raw::Sfixed32 => -7,
+            raw::Sfixed64 => -8,
+            raw::Bool => true,
+            raw::String => "abc".to_string(),
+            raw::Bytes<Vec<u8>> => vec![1; 200],
+        }
+    }
+
+    #[test]
+    fn repeated_values_keep_order() {
+        let num = FieldNumber::new(2).unwrap();
+        let values: RepeatedField<std::string::String> = vec!["a".to_string(), "bc".to_string()];
+        let mut writer = ReverseWriter::new();
+        writer.write_values::<_, raw::String>(&values, num).unwrap();
+
+        let mut expected = Vec::new();
+        CodedWriter::with_vec(&mut expected).write_values::<_, raw::String>(&values, num).unwrap();
+        assert_eq!(writer.as_bytes(), expected.as_slice());
+    }
+
+    #[test]
+    fn map_entries() {
+        let num = FieldNumber::new(3).unwrap();
+        let mut map = MapField::new();
+        map.insert(1u32, "a".to_string());
+        let mut writer = ReverseWriter::new();
+        writer.write_values::<_, (raw::Uint32, raw::String)>(&map, num).unwrap();
+
+        assert_eq!(writer.as_bytes(), &[26, 5, 8, 1, 18, 1, b'a']);
+    }
+
+    #[test]
+    fn grows_keeping_written_data() {
+        let mut writer = ReverseWriter::with_capacity(1);
+        for i in 0..1000u32 {
+            writer.write_varint32(i).unwrap();
+        }
+        let mut expected = Vec::new();
+        let mut forward = CodedWriter::with_vec(&mut expected);
+        for i in (0..1000).rev() {
+            forward.write_varint32(i).unwrap();
+        }
+        drop(forward);
+
+        assert_eq!(writer.len(), expected.len());
+        assert_eq!(writer.into_vec(), expected);
+    }
+
+    #[test]
+    fn length_delimited_with() {
+        let mut writer = ReverseWriter::new();
+        writer.write_length_delimited_with(|w| {
+            w.write_raw_bytes(&[3; 200])?;
+            w.write_varint32(1)
+        }).unwrap();
+
+        let bytes = writer.into_vec();
+        assert_eq!(&bytes[..3], &[201, 1, 1]);
+        assert_eq!(&bytes[3..], &[3; 200][..]);
+    }
+
+    #[test]
+    fn slices_keep_order() {
+        let mut writer = ReverseWriter::new();
+        writer.write_fixed32_slice(&[1, 2]).unwrap();
+        writer.write_varint64_slice(&[300, 1]).unwrap();
+
+        assert_eq!(writer.as_bytes(), &[172, 2, 1, 1, 0, 0, 0, 2, 0, 0, 0]);
+
+        let values: Vec<u64> = (0..64).map(|i| 1 << i).chain(0..20).collect();
+        let mut writer = ReverseWriter::new();
+        writer.write_varint64_slice(&values).unwrap();
+        let mut expected = Vec::new();
+        CodedWriter::with_vec(&mut expected).write_varint64_slice(&values).unwrap();
+        assert_eq!(writer.as_bytes(), expected.as_slice());
+    }
+
+    #[test]
+    fn write_forward() {
+        let mut writer = ReverseWriter::new();
+        writer.write_varint32(1).unwrap();
+        writer.write_forward(Length::new(2).unwrap(), |w| w.write_varint32(300)).unwrap();
+        assert_eq!(writer.as_bytes(), &[172, 2, 1]);
+
+        // too few or too many bytes leaves the output as it was
+        assert!(writer.write_forward(Length::new(2).unwrap(), |w| w.write_varint32(1)).is_err());
+        assert!(writer.write_forward(Length::new(1).unwrap(), |w| w.write_varint32(300)).is_err());
+        assert_eq!(writer.as_bytes(), &[172, 2, 1]);
+    }
+
+    #[test]
+    fn clear_keeps_capacity() {
+        let mut writer = ReverseWriter::with_capacity(16);
+        writer.write_bit64(1).unwrap();
+        writer.clear();
+
+        assert!(writer.is_empty());
+        writer.write_bit32(2).unwrap();
+        assert_eq!(writer.into_vec().capacity(), 16);
+    }
+}
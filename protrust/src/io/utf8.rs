@@ -0,0 +1,329 @@
+//! UTF-8 validation used by readers decoding strings.
+//!
+//! On CPUs with AVX2, strings are validated 32 bytes at a time with the lookup algorithm described by Keiser and
+//! Lemire in "Validating UTF-8 In Less Than One Instruction Per Byte": each byte is classified by its high nibble,
+//! the previous byte's high and low nibbles are looked up in three small tables, and the tables' error bits are
+//! combined so any invalid sequence leaves a bit set. Blocks of ASCII are checked with a single test.
+//!
+//! Otherwise, and for strings too short to fill a block, any ASCII prefix is skipped 8 bytes at a time and the rest
+//! of the string is checked with the standard library's validator.
+
+use std::str::{self, Utf8Error};
+use std::string::FromUtf8Error;
+
+const HIGH_BITS: u64 = 0x8080_8080_8080_8080;
+
+/// Returns whether the bytes are valid UTF-8
+#[inline]
+pub fn validate(bytes: &[u8]) -> bool {
+    #[cfg(target_arch = "x86_64")]
+    {
+        if bytes.len() >= 32 && is_x86_feature_detected!("avx2") {
+            return unsafe { avx2::validate(bytes) };
+        }
+    }
+    validate_fallback(bytes)
+}
+
+fn validate_fallback(bytes: &[u8]) -> bool {
+    let ascii = ascii_len(bytes);
+    ascii == bytes.len() || str::from_utf8(&bytes[ascii..]).is_ok()
+}
+
+/// Converts the bytes to a `str` if they're valid UTF-8
+#[inline]
+pub fn as_str(bytes: &[u8]) -> Result<&str, Utf8Error> {
+    if validate(bytes) {
+        Ok(unsafe { str::from_utf8_unchecked(bytes) })
+    } else {
+        Err(invalid_str(bytes))
+    }
+}
+
+/// Converts the bytes to a `String` if they're valid UTF-8
+#[inline]
+pub fn into_string(bytes: Vec<u8>) -> Result<String, FromUtf8Error> {
+    if validate(&bytes) {
+        Ok(unsafe { String::from_utf8_unchecked(bytes) })
+    } else {
+        Err(invalid_string(bytes))
+    }
+}
+
+#[cold]
+fn invalid_str(bytes: &[u8]) -> Utf8Error {
+    match str::from_utf8(bytes) {
+        Err(e) => e,
+        Ok(_) => unreachable!("the string was already found to be invalid"),
+    }
+}
+
+#[cold]
+fn invalid_string(bytes: Vec<u8>) -> FromUtf8Error {
+    match String::from_utf8(bytes) {
+        Err(e) => e,
+        Ok(_) => unreachable!("the string was already found to be invalid"),
+    }
+}
+
+/// Gets the number of ASCII bytes at the start of the slice
+fn ascii_len(bytes: &[u8]) -> usize {
+    let mut chunks = bytes.chunks_exact(8);
+    let mut len = 0;
+    for chunk in &mut chunks {
+        let mut word = [0u8; 8];
+        word.copy_from_slice(chunk);
+        let high = u64::from_le_bytes(word) & HIGH_BITS;
+        if high != 0 {
+            return len + (high.trailing_zeros() / 8) as usize;
+        }
+        len += 8;
+    }
+    len + chunks.remainder().iter().take_while(|&&b| b < 0x80).count()
+}
+
+#[cfg(target_arch = "x86_64")]
+mod avx2 {
+    use std::arch::x86_64::*;
+
+    // error bits set by the tables. a sequence is invalid where all three tables share a bit,
+    // except for the continuation bytes of three and four byte characters, which share only TWO_CONTS.
+
+    /// A lead byte followed by ASCII or another lead byte
+    const TOO_SHORT: u8 = 1 << 0;
+    /// ASCII followed by a continuation byte
+    const TOO_LONG: u8 = 1 << 1;
+    const OVERLONG_3: u8 = 1 << 2;
+    /// A four byte character above U+10FFFF
+    const TOO_LARGE: u8 = 1 << 3;
+    const SURROGATE: u8 = 1 << 4;
+    const OVERLONG_2: u8 = 1 << 5;
+    const TOO_LARGE_1000: u8 = 1 << 6;
+    const OVERLONG_4: u8 = 1 << 6;
+    /// Two continuation bytes in a row
+    const TWO_CONTS: u8 = 1 << 7;
+    const CARRY: u8 = TOO_SHORT | TOO_LONG | TWO_CONTS;
+
+    /// Errors by the high nibble of the previous byte
+    const BYTE_1_HIGH: [u8; 16] = [
+        TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+        TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+        TOO_SHORT | OVERLONG_2,
+        TOO_SHORT,
+        TOO_SHORT | OVERLONG_3 | SURROGATE,
+        TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4,
+    ];
+    /// Errors by the low nibble of the previous byte
+    const BYTE_1_LOW: [u8; 16] = [
+        CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+        CARRY | OVERLONG_2,
+        CARRY,
+        CARRY,
+        CARRY | TOO_LARGE,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+    ];
+    /// Errors by the high nibble of the current byte
+    const BYTE_2_HIGH: [u8; 16] = [
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+    ];
+
+    /// The largest bytes that can end a block without starting a character that continues past it
+    const MAX_LAST: [u8; 32] = [
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xef, 0xdf, 0xbf,
+    ];
+
+    struct Validator {
+        byte_1_high: __m256i,
+        byte_1_low: __m256i,
+        byte_2_high: __m256i,
+        max_last: __m256i,
+        /// The previous block, or zero if it was ASCII
+        prev: __m256i,
+        /// The bytes of the previous block that start a character continuing into this one
+        prev_incomplete: __m256i,
+        error: __m256i,
+    }
+
+    impl Validator {
+        #[inline]
+        #[target_feature(enable = "avx2")]
+        unsafe fn new() -> Self {
+            let table = |t: &[u8; 16]| _mm256_broadcastsi128_si256(_mm_loadu_si128(t.as_ptr() as *const __m128i));
+            Validator {
+                byte_1_high: table(&BYTE_1_HIGH),
+                byte_1_low: table(&BYTE_1_LOW),
+                byte_2_high: table(&BYTE_2_HIGH),
+                max_last: _mm256_loadu_si256(MAX_LAST.as_ptr() as *const __m256i),
+                prev: _mm256_setzero_si256(),
+                prev_incomplete: _mm256_setzero_si256(),
+                error: _mm256_setzero_si256(),
+            }
+        }
+
+        #[inline]
+        #[target_feature(enable = "avx2")]
+        unsafe fn check(&mut self, input: __m256i) {
+            if _mm256_movemask_epi8(input) == 0 {
+                // an ASCII block is only invalid if the last block ended in the middle of a character
+                self.error = _mm256_or_si256(self.error, self.prev_incomplete);
+                self.prev = _mm256_setzero_si256();
+                self.prev_incomplete = _mm256_setzero_si256();
+                return;
+            }
+
+            let nibble = _mm256_set1_epi8(0x0f);
+            // the input shifted forward by 1, 2 and 3 bytes, with the end of the previous block shifted in
+            let carried = _mm256_permute2x128_si256(self.prev, input, 0x21);
+            let prev1 = _mm256_alignr_epi8(input, carried, 15);
+            let prev2 = _mm256_alignr_epi8(input, carried, 14);
+            let prev3 = _mm256_alignr_epi8(input, carried, 13);
+
+            let byte_1_high = _mm256_shuffle_epi8(self.byte_1_high, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble));
+            let byte_1_low = _mm256_shuffle_epi8(self.byte_1_low, _mm256_and_si256(prev1, nibble));
+            let byte_2_high = _mm256_shuffle_epi8(self.byte_2_high, _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble));
+            let special = _mm256_and_si256(_mm256_and_si256(byte_1_high, byte_1_low), byte_2_high);
+
+            // bytes two after a three or four byte lead, or three after a four byte lead, must be continuations,
+            // which the tables only mark with TWO_CONTS
+            let third = _mm256_subs_epu8(prev2, _mm256_set1_epi8((0xe0u8 - 0x80) as i8));
+            let fourth = _mm256_subs_epu8(prev3, _mm256_set1_epi8((0xf0u8 - 0x80) as i8));
+            let must_continue = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8(0x80u8 as i8));
+
+            self.error = _mm256_or_si256(self.error, _mm256_xor_si256(must_continue, special));
+            self.prev_incomplete = _mm256_subs_epu8(input, self.max_last);
+            self.prev = input;
+        }
+    }
+
+    /// Returns whether the bytes are valid UTF-8
+    #[target_feature(enable = "avx2")]
+    pub unsafe fn validate(bytes: &[u8]) -> bool {
+        let mut validator = Validator::new();
+        let mut chunks = bytes.chunks_exact(32);
+        for chunk in &mut chunks {
+            validator.check(_mm256_loadu_si256(chunk.as_ptr() as *const __m256i));
+        }
+        let remainder = chunks.remainder();
+        if !remainder.is_empty() {
+            // padding the end with ASCII catches a character cut off by the end of the string
+            let mut block = [0u8; 32];
+            block[..remainder.len()].copy_from_slice(remainder);
+            validator.check(_mm256_loadu_si256(block.as_ptr() as *const __m256i));
+        }
+        let error = _mm256_or_si256(validator.error, validator.prev_incomplete);
+        _mm256_testz_si256(error, error) == 1
+    }
+}
+
+#[cfg(test)]
+mod test {
+    use super::{ascii_len, as_str, into_string, validate, validate_fallback};
+
+    fn check(bytes: &[u8]) {
+        let expected = std::str::from_utf8(bytes);
+        assert_eq!(validate(bytes), expected.is_ok(), "{:x?}", bytes);
+        assert_eq!(validate_fallback(bytes), expected.is_ok(), "{:x?}", bytes);
+        #[cfg(target_arch = "x86_64")]
+        {
+            if is_x86_feature_detected!("avx2") {
+                assert_eq!(unsafe { super::avx2::validate(bytes) }, expected.is_ok(), "{:x?}", bytes);
+            }
+        }
+        assert_eq!(as_str(bytes), expected);
+        assert_eq!(into_string(bytes.to_vec()).map_err(|e| e.utf8_error()), expected.map(str::to_owned));
+    }
+
+    /// Checks the sequence at every offset around the lanes and ends of two blocks, between ASCII and between text
+    fn check_everywhere(sequence: &[u8]) {
+        for &fill in &["a", "\u{e9}", "\u{65e5}", "\u{1f600}"] {
+            let padding = fill.repeat(32);
+            for offset in 0..70 {
+                let mut bytes = format!("{}{}", "a".repeat(offset % 4), fill.repeat(offset / 4)).into_bytes();
+                bytes.extend_from_slice(sequence);
+                bytes.extend_from_slice(padding.as_bytes());
+                let end = bytes.len();
+                check(&bytes);
+                check(&bytes[..end - padding.len()]);
+            }
+        }
+    }
+
+    #[test]
+    fn ascii_prefix() {
+        let mut bytes = vec![b'a'; 100];
+        assert_eq!(ascii_len(&bytes), 100);
+        for i in 0..100 {
+            bytes[i] = 0xc3;
+            assert_eq!(ascii_len(&bytes), i);
+            bytes[i] = b'a';
+        }
+    }
+
+    #[test]
+    fn valid_strings() {
+        check(b"");
+        check(b"hello");
+        check("h\u{e9}llo w\u{f6}rld".as_bytes());
+        check("\u{65e5}\u{672c}\u{8a9e}\u{1f600}".repeat(100).as_bytes());
+        for &c in &['\u{7f}', '\u{80}', '\u{7ff}', '\u{800}', '\u{d7ff}', '\u{e000}', '\u{fffd}', '\u{ffff}', '\u{10000}', '\u{10ffff}'] {
+            let mut buf = [0; 4];
+            check_everywhere(c.encode_utf8(&mut buf).as_bytes());
+        }
+    }
+
+    #[test]
+    fn invalid_strings() {
+        let sequences: &[&[u8]] = &[
+            &[0x80], &[0xbf], &[0xc0, 0x80], &[0xc1, 0xbf], &[0xc3], &[0xc3, 0x28], &[0xc3, 0xa9, 0xa9],
+            &[0xe0, 0x80, 0x80], &[0xe0, 0x9f, 0xbf], &[0xe2, 0x82], &[0xe2, 0x28, 0xa1], &[0xed, 0xa0, 0x80],
+            &[0xed, 0xbf, 0xbf], &[0xf0, 0x80, 0x80, 0x80], &[0xf0, 0x8f, 0xbf, 0xbf], &[0xf0, 0x9f, 0x98],
+            &[0xf4, 0x90, 0x80, 0x80], &[0xf5, 0x80, 0x80, 0x80], &[0xff], &[0xfe], &[0xf0, 0x9f, 0x98, 0x80, 0x80],
+        ];
+        for sequence in sequences {
+            check_everywhere(sequence);
+        }
+    }
+
+    #[test]
+    fn every_pair() {
+        // every two byte sequence, with a valid character before and after it, catches errors in the tables
+        for a in 0..=255u8 {
+            for b in 0..=255u8 {
+                let mut bytes = "\u{e9}".repeat(15).into_bytes();
+                bytes.extend_from_slice(&[a, b]);
+                bytes.extend_from_slice("\u{65e5}".repeat(10).as_bytes());
+                check(&bytes);
+            }
+        }
+    }
+
+    #[test]
+    fn every_triple_prefix() {
+        for a in 0xe0..=0xf4u8 {
+            for b in 0x80..=0xbfu8 {
+                for c in 0..=255u8 {
+                    let mut bytes = vec![b'x'; 30];
+                    bytes.extend_from_slice(&[a, b, c, 0x80, b'y']);
+                    bytes.extend_from_slice(&[b'z'; 30]);
+                    check(&bytes);
+                }
+            }
+        }
+    }
+}
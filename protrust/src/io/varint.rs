@@ -0,0 +1,259 @@
+//! Branchless varint decoding kernels used by readers when enough bytes are buffered.
+//!
+//! Instead of checking each byte for a terminator, these load the first 8 bytes as a little endian
+//! `u64`, find the terminating byte from the inverted continuation bits, mask off any bytes after it,
+//! and then compact the 7-bit groups into the value. On targets compiled with BMI2 the compaction is a
+//! single `pext`, otherwise it's done with three shift and mask steps.
+//!
+//! Encoding runs the same steps in reverse: the 7-bit groups are spread out into bytes (a `pdep` with BMI2),
+//! the continuation bits are set for every byte before the last, and all 8 bytes are stored at once.
+//!
+//! To reserve space ahead of decoding a packed field, [`count_terminators`] counts the varints in a buffer by
+//! counting the bytes without a continuation bit, 32 bytes at a time with AVX2 when the CPU supports it.
+
+const CONTINUATION_BITS: u64 = 0x8080_8080_8080_8080;
+const PAYLOAD_BITS: u64 = 0x7f7f_7f7f_7f7f_7f7f;
+
+/// Compacts the low 7 bits of each byte of the value into a 56-bit value
+#[inline(always)]
+fn compact(value: u64) -> u64 {
+    #[cfg(all(target_arch = "x86_64", target_feature = "bmi2"))]
+    unsafe {
+        std::arch::x86_64::_pext_u64(value, PAYLOAD_BITS)
+    }
+    #[cfg(not(all(target_arch = "x86_64", target_feature = "bmi2")))]
+    {
+        let x = value & PAYLOAD_BITS;
+        let x = ((x & 0x7f00_7f00_7f00_7f00) >> 1) | (x & 0x007f_007f_007f_007f);
+        let x = ((x & 0x3fff_0000_3fff_0000) >> 2) | (x & 0x0000_3fff_0000_3fff);
+        ((x & 0x0fff_ffff_0000_0000) >> 4) | (x & 0x0000_0000_0fff_ffff)
+    }
+}
+
+/// Spreads the low 56 bits of the value into the low 7 bits of each byte
+#[inline(always)]
+fn spread(value: u64) -> u64 {
+    #[cfg(all(target_arch = "x86_64", target_feature = "bmi2"))]
+    unsafe {
+        std::arch::x86_64::_pdep_u64(value, PAYLOAD_BITS)
+    }
+    #[cfg(not(all(target_arch = "x86_64", target_feature = "bmi2")))]
+    {
+        let x = ((value & 0x00ff_ffff_f000_0000) << 4) | (value & 0x0000_0000_0fff_ffff);
+        let x = ((x & 0x0fff_c000_0fff_c000) << 2) | (x & 0x0000_3fff_0000_3fff);
+        ((x & 0x3f80_3f80_3f80_3f80) << 1) | (x & 0x007f_007f_007f_007f)
+    }
+}
+
+/// Encodes a varint at the pointer, advancing it past the encoded value.
+///
+/// # Safety
+///
+/// At least 10 bytes must be writable at the pointer. Values shorter than 9 bytes still write 8 bytes,
+/// leaving anything after the varint overwritten with unspecified data.
+#[inline]
+pub unsafe fn encode_unchecked(value: u64, ptr: &mut *mut u8) {
+    if value < 1 << 56 {
+        let len = super::raw_varint64_size(value).get() as usize;
+        let continuations = CONTINUATION_BITS & ((1u64 << (8 * (len - 1))) - 1);
+        std::ptr::write_unaligned(*ptr as *mut [u8; 8], (spread(value) | continuations).to_le_bytes());
+        *ptr = ptr.add(len);
+    } else {
+        encode_long(value, ptr);
+    }
+}
+
+#[cold]
+unsafe fn encode_long(value: u64, ptr: &mut *mut u8) {
+    std::ptr::write_unaligned(*ptr as *mut [u8; 8], (spread(value) | CONTINUATION_BITS).to_le_bytes());
+    let high = value >> 56;
+    if high < 0x80 {
+        *ptr.add(8) = high as u8;
+        *ptr = ptr.add(9);
+    } else {
+        *ptr.add(8) = high as u8 | 0x80;
+        *ptr.add(9) = (high >> 7) as u8;
+        *ptr = ptr.add(10);
+    }
+}
+
+/// Calculates the total number of bytes the values take when encoded as varints
+#[inline]
+pub fn encoded_len<I: IntoIterator<Item = u64>>(values: I) -> usize {
+    values.into_iter().map(|v| super::raw_varint64_size(v).get() as usize).sum()
+}
+
+/// Decodes a varint from the start of the bytes, returning the value and the number of bytes it used,
+/// or None if none of the 10 bytes terminate the varint.
+///
+/// Like the byte by byte decoders, any bits past the 64th bit are discarded.
+#[inline]
+pub fn decode(bytes: &[u8; 10]) -> Option<(u64, usize)> {
+    let mut word = [0u8; 8];
+    word.copy_from_slice(&bytes[..8]);
+    let word = u64::from_le_bytes(word);
+
+    let terminators = !word & CONTINUATION_BITS;
+    if terminators != 0 {
+        // keep every bit up to and including the first terminator's high bit
+        let masked = word & (terminators ^ (terminators - 1));
+        let len = (terminators.trailing_zeros() as usize + 1) / 8;
+        Some((compact(masked), len))
+    } else {
+        decode_long(compact(word), bytes[8], bytes[9])
+    }
+}
+
+#[cold]
+fn decode_long(low: u64, b8: u8, b9: u8) -> Option<(u64, usize)> {
+    let value = low | ((b8 & 0x7f) as u64) << 56;
+    if b8 < 0x80 {
+        Some((value, 9))
+    } else if b9 < 0x80 {
+        Some((value | ((b9 & 0x7f) as u64) << 63, 10))
+    } else {
+        None
+    }
+}
+
+/// Counts the bytes in the slice that terminate a varint, which is the number of complete varints it contains.
+#[inline]
+pub fn count_terminators(bytes: &[u8]) -> usize {
+    #[cfg(target_arch = "x86_64")]
+    {
+        if bytes.len() >= 32 && is_x86_feature_detected!("avx2") {
+            return unsafe { count_terminators_avx2(bytes) };
+        }
+    }
+    count_terminators_swar(bytes)
+}
+
+fn count_terminators_swar(bytes: &[u8]) -> usize {
+    let mut chunks = bytes.chunks_exact(8);
+    let mut count = 0;
+    for chunk in &mut chunks {
+        let mut word = [0u8; 8];
+        word.copy_from_slice(chunk);
+        count += (!u64::from_le_bytes(word) & CONTINUATION_BITS).count_ones() as usize;
+    }
+    count + chunks.remainder().iter().filter(|&&b| b < 0x80).count()
+}
+
+#[cfg(target_arch = "x86_64")]
+#[target_feature(enable = "avx2")]
+unsafe fn count_terminators_avx2(bytes: &[u8]) -> usize {
+    use std::arch::x86_64::{__m256i, _mm256_loadu_si256, _mm256_movemask_epi8};
+
+    let mut chunks = bytes.chunks_exact(32);
+    let mut count = 0;
+    for chunk in &mut chunks {
+        let continuations = _mm256_movemask_epi8(_mm256_loadu_si256(chunk.as_ptr() as *const __m256i));
+        count += 32 - (continuations as u32).count_ones() as usize;
+    }
+    count + count_terminators_swar(chunks.remainder())
+}
+
+#[cfg(test)]
+mod test {
+    use super::{count_terminators, count_terminators_swar, decode, encode_unchecked, encoded_len};
+
+    fn decode_naive(bytes: &[u8; 10]) -> Option<(u64, usize)> {
+        let mut result = 0u64;
+        for (i, &b) in bytes.iter().enumerate() {
+            result |= ((b & 0x7f) as u64) << (7 * i);
+            if b < 0x80 {
+                return Some((result, i + 1));
+            }
+        }
+        None
+    }
+
+    fn encode(mut value: u64, bytes: &mut [u8; 10]) {
+        let mut i = 0;
+        while value >= 0x80 {
+            bytes[i] = value as u8 | 0x80;
+            value >>= 7;
+            i += 1;
+        }
+        bytes[i] = value as u8;
+    }
+
+    #[test]
+    fn decodes_every_length() {
+        for shift in 0..64 {
+            for &value in &[1u64 << shift, (1u64 << shift) - 1, (1u64 << shift) | 1] {
+                let mut bytes = [0xffu8; 10];
+                encode(value, &mut bytes);
+                assert_eq!(decode(&bytes), decode_naive(&bytes), "value {}", value);
+                assert_eq!(decode(&bytes).map(|(v, _)| v), Some(value));
+            }
+        }
+        let mut bytes = [0xffu8; 10];
+        encode(u64::max_value(), &mut bytes);
+        assert_eq!(decode(&bytes), Some((u64::max_value(), 10)));
+    }
+
+    #[test]
+    fn ignores_trailing_bytes() {
+        let bytes = [0x96, 0x01, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff];
+        assert_eq!(decode(&bytes), Some((150, 2)));
+    }
+
+    #[test]
+    fn matches_naive_decoder() {
+        let mut state = 0x2545_f491_4f6c_dd1du64;
+        for _ in 0..10_000 {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            let mut bytes = state.to_le_bytes();
+            // bias the generated bytes towards terminating at random points
+            bytes[(state >> 60) as usize % 8] &= 0x7f;
+            let mut input = [0u8; 10];
+            input[..8].copy_from_slice(&bytes);
+            input[8] = (state >> 3) as u8;
+            input[9] = (state >> 11) as u8;
+            assert_eq!(decode(&input), decode_naive(&input), "input {:?}", input);
+        }
+    }
+
+    #[test]
+    fn rejects_malformed() {
+        assert_eq!(decode(&[0xff; 10]), None);
+    }
+
+    #[test]
+    fn keeps_tenth_byte_low_bit() {
+        let bytes = [0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x7f];
+        assert_eq!(decode(&bytes), decode_naive(&bytes));
+    }
+
+    #[test]
+    fn counts_terminators() {
+        let bytes: Vec<u8> = (0..200u32).map(|i| (i * 37) as u8).collect();
+        let expected = bytes.iter().filter(|&&b| b < 0x80).count();
+        for start in 0..40 {
+            assert_eq!(count_terminators(&bytes[start..]), expected - bytes[..start].iter().filter(|&&b| b < 0x80).count());
+            assert_eq!(count_terminators_swar(&bytes[start..]), count_terminators(&bytes[start..]));
+        }
+        assert_eq!(count_terminators(&[]), 0);
+    }
+
+    #[test]
+    fn encodes_like_naive_encoder() {
+        for shift in 0..64 {
+            for &value in &[1u64 << shift, (1u64 << shift) - 1, (1u64 << shift) | 1, u64::max_value() >> shift] {
+                let mut expected = [0u8; 10];
+                encode(value, &mut expected);
+                let len = encoded_len(Some(value));
+
+                let mut output = [0xaau8; 10];
+                let mut ptr = output.as_mut_ptr();
+                unsafe { encode_unchecked(value, &mut ptr); }
+                assert_eq!(ptr as usize - output.as_ptr() as usize, len, "value {}", value);
+                assert_eq!(output[..len], expected[..len], "value {}", value);
+                assert_eq!(decode(&output), Some((value, len)));
+            }
+        }
+    }
+}
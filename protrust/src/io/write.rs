@@ -1,14 +1,18 @@
 //! Defines the `CodedWriter`, a writer for writing protobuf encoded values to streams.
 
+use crate::Message;
 use crate::collections::{RepeatedValue, FieldSet};
-use crate::io::{FieldNumber, WireType, Tag, Length, DEFAULT_BUF_SIZE};
+use crate::io::{varint, FieldNumber, WireType, Tag, Length, DEFAULT_BUF_SIZE};
+#[cfg(feature = "metrics")]
+use crate::io::metrics::{Counted, WriteMetrics};
 use crate::raw::Value;
+use std::cmp;
 use std::convert::TryFrom;
 use std::error;
 use std::fmt::{self, Display, Formatter};
 use std::marker::PhantomData;
-use std::io::{self, Write, ErrorKind};
-use std::mem::ManuallyDrop;
+use std::io::{self, Write, ErrorKind, IoSlice};
+use std::mem::{ManuallyDrop, MaybeUninit};
 use std::ops::Range;
 use std::ptr::{self, NonNull};
 use std::slice;
@@ -21,7 +25,9 @@ mod internal {
     use std::io::{self, Write, ErrorKind};
     use std::ptr::{self, NonNull};
     use std::slice;
-    use super::{Result, Error, write_varint32_unchecked, write_varint64_unchecked, write_bytes_unchecked};
+    #[cfg(feature = "metrics")]
+    use crate::io::metrics::WriteMetrics;
+    use super::{Result, Error, write_varint32_unchecked, write_varint64_unchecked, write_bytes_unchecked, write_varints_unchecked};
 
     pub trait Writer {
         fn write_varint32(&mut self, value: u32) -> Result;
@@ -29,8 +35,52 @@ mod internal {
         fn write_bit32(&mut self, value: u32) -> Result;
         fn write_bit64(&mut self, value: u64) -> Result;
         fn write_length_delimited(&mut self, value: &[u8]) -> Result;
+        fn write_bytes(&mut self, value: &[u8]) -> Result;
+
+        /// Gets the number of bytes that can be written at the current position without any checks
+        fn unchecked_len(&self) -> usize;
+        /// Gets the current position of the write pointer
+        fn position(&mut self) -> &mut *mut u8;
+        /// Makes sure at least `len` bytes can be written at the current position without any checks,
+        /// returning false if the output can't provide them
+        fn reserve(&mut self, len: usize) -> bool {
+            self.unchecked_len() >= len
+        }
+
+        fn write_varint32_slice(&mut self, values: &[u32]) -> Result {
+            let mut values = values;
+            while let Some((&first, rest)) = values.split_first() {
+                let count = unsafe { write_varints_unchecked(values, 5, self.unchecked_len(), self.position()) };
+                if count == 0 {
+                    self.write_varint32(first)?;
+                    values = rest;
+                } else {
+                    values = &values[count..];
+                }
+            }
+            Ok(())
+        }
+        fn write_varint64_slice(&mut self, values: &[u64]) -> Result {
+            let mut values = values;
+            while let Some((&first, rest)) = values.split_first() {
+                let count = unsafe { write_varints_unchecked(values, 10, self.unchecked_len(), self.position()) };
+                if count == 0 {
+                    self.write_varint64(first)?;
+                    values = rest;
+                } else {
+                    values = &values[count..];
+                }
+            }
+            Ok(())
+        }
 
         fn as_any(&mut self) -> Any;
+
+        /// Gets the counters for everything written so far. Any writers don't keep their own.
+        #[cfg(feature = "metrics")]
+        fn metrics(&self) -> WriteMetrics {
+            WriteMetrics::default()
+        }
     }
 
     struct BorrowedStream<'a> {
@@ -207,10 +257,12 @@ mod internal {
             }
         }
         fn write_length_delimited(&mut self, value: &[u8]) -> Result {
-            let len = value.len();
-            let delimiter = i32::try_from(len).map_err(|_| Error::ValueTooLarge)? as u32;
+            let delimiter = i32::try_from(value.len()).map_err(|_| Error::ValueTooLarge)? as u32;
             self.write_varint32(delimiter)?;
-            if self.can_write(len) {
+            self.write_bytes(value)
+        }
+        fn write_bytes(&mut self, value: &[u8]) -> Result {
+            if self.can_write(value.len()) {
                 unsafe { write_bytes_unchecked(value, self.current); }
                 Ok(())
             } else if let Some(mut buffer) = self.as_borrowed_stream() {
@@ -219,6 +271,16 @@ mod internal {
                 Err(io::Error::from(ErrorKind::WriteZero).into())
             }
         }
+        fn unchecked_len(&self) -> usize {
+            // without an end we can't know how much space is left in an unchecked slice
+            match self.end {
+                Some(end) => usize::wrapping_sub(end.as_ptr() as _, *self.current as _),
+                None => 0
+            }
+        }
+        fn position(&mut self) -> &mut *mut u8 {
+            self.current
+        }
         #[allow(clippy::map_clone)]
         fn as_any<'a>(&'a mut self) -> Any<'a> {
             Any {
@@ -309,6 +371,25 @@ unsafe fn write_varint64_unchecked(mut value: u64, ptr: &mut *mut u8) {
     }
 }
 
+/// Encodes as many of the values as are guaranteed to fit in `remaining` bytes
+/// if every value takes `max_len` bytes, returning the number of values written.
+///
+/// Values are stored 8 bytes at a time, which writes past the end of a short value. Each value's extra bytes are
+/// overwritten by the value after it, so only values with another after them are stored this way, where at least
+/// `2 * max_len` bytes remain. The last value is written a byte at a time, leaving every byte after it untouched.
+#[inline]
+unsafe fn write_varints_unchecked<V: Copy + Into<u64>>(values: &[V], max_len: usize, remaining: usize, ptr: &mut *mut u8) -> usize {
+    debug_assert!(max_len >= 5, "an 8 byte store needs at least 8 bytes left");
+    let count = cmp::min(values.len(), remaining / max_len);
+    if let Some((&last, rest)) = values.get_unchecked(..count).split_last() {
+        for &value in rest {
+            varint::encode_unchecked(value.into(), ptr);
+        }
+        write_varint64_unchecked(last.into(), ptr);
+    }
+    count
+}
+
 #[inline]
 unsafe fn write_bytes_unchecked(slice: &[u8], ptr: &mut *mut u8) {
     match slice.len() {
@@ -329,11 +410,19 @@ pub struct SliceUnchecked<'a> {
     a: PhantomData<&'a mut [u8]>,
     ptr: *mut u8,
     end: *mut u8,
+    #[cfg(feature = "metrics")]
+    origin: *mut u8,
 }
 impl<'a> SliceUnchecked<'a> {
     fn new(s: &'a mut [u8]) -> Self {
         let Range { start, end } = s.as_mut_ptr_range();
-        Self { a: PhantomData, ptr: start, end }
+        Self {
+            a: PhantomData,
+            ptr: start,
+            end,
+            #[cfg(feature = "metrics")]
+            origin: start,
+        }
     }
     fn into_inner(self) -> &'a mut [u8] {
         let len = usize::wrapping_sub(self.end as _, self.ptr as _);
@@ -367,6 +456,16 @@ impl Writer for SliceUnchecked<'_> {
         }
         Ok(())
     }
+    fn write_bytes(&mut self, value: &[u8]) -> Result {
+        unsafe { write_bytes_unchecked(value, &mut self.ptr); }
+        Ok(())
+    }
+    fn unchecked_len(&self) -> usize {
+        usize::wrapping_sub(self.end as _, self.ptr as _)
+    }
+    fn position(&mut self) -> &mut *mut u8 {
+        &mut self.ptr
+    }
 
     fn as_any(&mut self) -> Any {
         Any {
@@ -376,6 +475,11 @@ impl Writer for SliceUnchecked<'_> {
             end: None
         }
     }
+
+    #[cfg(feature = "metrics")]
+    fn metrics(&self) -> WriteMetrics {
+        WriteMetrics { bytes_written: usize::wrapping_sub(self.ptr as _, self.origin as _) as u64, ..WriteMetrics::default() }
+    }
 }
 
 /// A slice output. This elides many checks associated with a standard stream output.
@@ -383,6 +487,8 @@ pub struct Slice<'a> {
     a: PhantomData<&'a mut [u8]>,
     start: *mut u8,
     end: *mut u8,
+    #[cfg(feature = "metrics")]
+    origin: *mut u8,
 }
 impl<'a> Slice<'a> {
     fn new(s: &'a mut [u8]) -> Self {
@@ -390,7 +496,9 @@ impl<'a> Slice<'a> {
         Self {
             a: PhantomData,
             start,
-            end
+            end,
+            #[cfg(feature = "metrics")]
+            origin: start,
         }
     }
     fn len(&self) -> usize {
@@ -467,6 +575,23 @@ impl Writer for Slice<'_> {
             Err(io::Error::from(ErrorKind::WriteZero).into())
         }
     }
+    fn write_bytes(&mut self, value: &[u8]) -> Result {
+        if self.len() >= value.len() {
+            unsafe {
+                write_bytes_unchecked(value, &mut self.start);
+            }
+            debug_assert!(self.start <= self.end);
+            Ok(())
+        } else {
+            Err(io::Error::from(ErrorKind::WriteZero).into())
+        }
+    }
+    fn unchecked_len(&self) -> usize {
+        self.len()
+    }
+    fn position(&mut self) -> &mut *mut u8 {
+        &mut self.start
+    }
 
     fn as_any(&mut self) -> Any {
         Any {
@@ -476,6 +601,182 @@ impl Writer for Slice<'_> {
             end: Some(unsafe { NonNull::new_unchecked(self.end) }),
         }
     }
+
+    #[cfg(feature = "metrics")]
+    fn metrics(&self) -> WriteMetrics {
+        WriteMetrics { bytes_written: usize::wrapping_sub(self.start as _, self.origin as _) as u64, ..WriteMetrics::default() }
+    }
+}
+
+/// The end of a `Vec` that a [`VecOutput`](struct.VecOutput.html) appends to
+struct VecSink<'a> {
+    vec: &'a mut Vec<u8>,
+    current: *mut u8,
+    end: *mut u8,
+}
+
+impl VecSink<'_> {
+    fn new(vec: &mut Vec<u8>) -> VecSink {
+        let mut sink = VecSink { vec, current: ptr::null_mut(), end: ptr::null_mut() };
+        sink.reset();
+        sink
+    }
+    /// Points the sink at the spare capacity of the `Vec`
+    fn reset(&mut self) {
+        let (len, cap) = (self.vec.len(), self.vec.capacity());
+        let start = self.vec.as_mut_ptr();
+        unsafe {
+            self.current = start.add(len);
+            self.end = start.add(cap);
+        }
+    }
+    #[inline]
+    fn remaining(&self) -> usize {
+        usize::wrapping_sub(self.end as _, self.current as _)
+    }
+    /// Sets the length of the `Vec` to include everything written to it
+    #[inline]
+    fn commit(&mut self) {
+        let len = usize::wrapping_sub(self.current as _, self.vec.as_ptr() as _);
+        unsafe { self.vec.set_len(len); }
+    }
+    /// Makes sure `len` bytes can be written at the current position, growing the `Vec` if they can't
+    #[inline]
+    fn reserve(&mut self, len: usize) {
+        if self.remaining() < len {
+            self.grow(len);
+        }
+    }
+    #[cold]
+    fn grow(&mut self, len: usize) {
+        self.commit();
+        self.vec.reserve(len);
+        self.reset();
+    }
+    #[inline]
+    fn write_bytes(&mut self, value: &[u8]) {
+        self.reserve(value.len());
+        unsafe { write_bytes_unchecked(value, &mut self.current); }
+    }
+}
+
+impl Write for VecSink<'_> {
+    fn write(&mut self, buf: &[u8]) -> io::Result<usize> {
+        self.write_bytes(buf);
+        Ok(buf.len())
+    }
+    fn flush(&mut self) -> io::Result<()> {
+        Ok(())
+    }
+}
+
+/// An output that appends to a `Vec`, growing it as needed.
+/// 
+/// Values are written directly into the `Vec`'s spare capacity, so reserving the size of a message
+/// ahead of time writes it with no further allocations or copies.
+pub struct VecOutput<'a> {
+    sink: VecSink<'a>,
+    /// An empty buffer for any writers, which write through the sink instead
+    any_position: *mut u8,
+    /// The length of the `Vec` before anything was written to it
+    #[cfg(feature = "metrics")]
+    origin: usize,
+}
+
+impl<'a> VecOutput<'a> {
+    fn new(vec: &'a mut Vec<u8>) -> Self {
+        VecOutput {
+            #[cfg(feature = "metrics")]
+            origin: vec.len(),
+            sink: VecSink::new(vec),
+            any_position: NonNull::dangling().as_ptr(),
+        }
+    }
+    fn into_inner(mut self) -> &'a mut Vec<u8> {
+        self.sink.commit();
+        let vec = unsafe { ptr::read(&self.sink.vec) };
+        std::mem::forget(self);
+        vec
+    }
+}
+
+impl Writer for VecOutput<'_> {
+    fn write_varint32(&mut self, value: u32) -> Result {
+        self.sink.reserve(raw_varint32_size(value).get() as usize);
+        unsafe { write_varint32_unchecked(value, &mut self.sink.current); }
+        Ok(())
+    }
+    fn write_varint64(&mut self, value: u64) -> Result {
+        self.sink.reserve(raw_varint64_size(value).get() as usize);
+        unsafe { write_varint64_unchecked(value, &mut self.sink.current); }
+        Ok(())
+    }
+    fn write_bit32(&mut self, value: u32) -> Result {
+        self.sink.write_bytes(&u32::to_le_bytes(value));
+        Ok(())
+    }
+    fn write_bit64(&mut self, value: u64) -> Result {
+        self.sink.write_bytes(&u64::to_le_bytes(value));
+        Ok(())
+    }
+    fn write_length_delimited(&mut self, value: &[u8]) -> Result {
+        let delimiter = i32::try_from(value.len()).map_err(|_| Error::ValueTooLarge)? as u32;
+        self.sink.reserve(5 + value.len());
+        self.write_varint32(delimiter)?;
+        self.sink.write_bytes(value);
+        Ok(())
+    }
+    fn write_bytes(&mut self, value: &[u8]) -> Result {
+        self.sink.write_bytes(value);
+        Ok(())
+    }
+    fn unchecked_len(&self) -> usize {
+        self.sink.remaining()
+    }
+    fn position(&mut self) -> &mut *mut u8 {
+        &mut self.sink.current
+    }
+    fn reserve(&mut self, len: usize) -> bool {
+        self.sink.reserve(len);
+        true
+    }
+    fn write_varint32_slice(&mut self, values: &[u32]) -> Result {
+        // values take at most 5 bytes, and the last one is written a byte at a time so nothing is stored past it
+        self.sink.reserve(values.len() * 5);
+        let count = unsafe { write_varints_unchecked(values, 5, self.sink.remaining(), &mut self.sink.current) };
+        assert_eq!(count, values.len(), "space was reserved for every value");
+        Ok(())
+    }
+    fn write_varint64_slice(&mut self, values: &[u64]) -> Result {
+        // values never store more than the 10 bytes the longest one takes
+        self.sink.reserve(values.len() * 10);
+        let count = unsafe { write_varints_unchecked(values, 10, self.sink.remaining(), &mut self.sink.current) };
+        assert_eq!(count, values.len(), "space was reserved for every value");
+        Ok(())
+    }
+
+    fn as_any(&mut self) -> Any {
+        // the any writer gets an empty buffer, so it writes everything to the sink, growing the vec as it needs
+        let position = unsafe { NonNull::new_unchecked(self.any_position) };
+        Any {
+            stream: Some(&mut self.sink),
+            start: Some(position),
+            current: &mut self.any_position,
+            end: Some(position),
+        }
+    }
+
+    #[cfg(feature = "metrics")]
+    fn metrics(&self) -> WriteMetrics {
+        let len = usize::wrapping_sub(self.sink.current as _, self.sink.vec.as_ptr() as _);
+        WriteMetrics { bytes_written: (len - self.origin) as u64, ..WriteMetrics::default() }
+    }
+}
+
+impl Drop for VecOutput<'_> {
+    fn drop(&mut self) {
+        self.sink.commit();
+    }
 }
 
 #[derive(PartialEq, Eq)]
@@ -484,21 +785,51 @@ enum DropFlag {
     Owned,
 }
 
-/// A buffered stream output
+/// The output of a buffered stream, which counts the calls made to it with the `metrics` feature
+#[cfg(feature = "metrics")]
+type Sink<T> = Counted<T>;
+#[cfg(not(feature = "metrics"))]
+type Sink<T> = T;
+
+#[inline]
+fn sink<T>(output: T) -> Sink<T> {
+    #[cfg(feature = "metrics")]
+    let output = Counted::new(output);
+    output
+}
+
+#[inline]
+fn unsink<T>(output: Sink<T>) -> T {
+    #[cfg(feature = "metrics")]
+    let output = output.inner;
+    output
+}
+
+/// A buffered stream output. The buffer is allocated uninitialized, and only the part of it that's been written is ever read.
 pub struct Stream<T: Write> {
-    output: ManuallyDrop<T>,
+    output: ManuallyDrop<Sink<T>>,
     start: NonNull<u8>,
     current: *mut u8,
     end: NonNull<u8>,
+    /// Whether the buffer is returned to this thread's buffer pool when the stream is dropped
+    pooled: bool,
 }
 impl<T: Write> Stream<T> {
     fn with_capacity(cap: usize, output: T) -> Self {
-        let Range { start, end } = Box::leak(vec![0; cap].into_boxed_slice()).as_mut_ptr_range();
+        Self::with_buffer(crate::pool::new_write_buffer(cap), false, output)
+    }
+    fn with_pooled(output: T) -> Self {
+        Self::with_buffer(crate::pool::take_write_buffer(DEFAULT_BUF_SIZE), true, output)
+    }
+    fn with_buffer(buf: Box<[MaybeUninit<u8>]>, pooled: bool, output: T) -> Self {
+        let Range { start, end } = Box::leak(buf).as_mut_ptr_range();
+        let (start, end) = (start as *mut u8, end as *mut u8);
         Self {
-            output: ManuallyDrop::new(output),
+            output: ManuallyDrop::new(sink(output)),
             start: unsafe { NonNull::new_unchecked(start) },
             current: start,
             end: unsafe { NonNull::new_unchecked(end) },
+            pooled,
         }
     }
     #[inline]
@@ -527,12 +858,15 @@ impl<T: Write> Stream<T> {
         let output = unsafe { ManuallyDrop::take(&mut self.output) };
         unsafe { self.drop_inner(DropFlag::Moved) };
         std::mem::forget(self);
-        output
+        unsink(output)
     }
     #[inline]
     unsafe fn drop_inner(&mut self, flag: DropFlag) {
-        let raw_slice = slice::from_raw_parts_mut(self.start.as_ptr(), self.capacity());
-        drop(Box::from_raw(raw_slice));
+        let raw_slice = slice::from_raw_parts_mut(self.start.as_ptr() as *mut MaybeUninit<u8>, self.capacity());
+        let buf = Box::from_raw(raw_slice);
+        if self.pooled {
+            crate::pool::put_write_buffer(buf);
+        }
         if flag == DropFlag::Owned {
             ManuallyDrop::drop(&mut self.output);
         }
@@ -592,9 +926,12 @@ impl<T: Write> Writer for Stream<T> {
         Ok(())
     }
     fn write_length_delimited(&mut self, value: &[u8]) -> Result {
-        let len = value.len();
-        let delimiter = i32::try_from(len).map_err(|_| Error::ValueTooLarge)? as u32;
+        let delimiter = i32::try_from(value.len()).map_err(|_| Error::ValueTooLarge)? as u32;
         self.write_varint32(delimiter)?;
+        self.write_bytes(value)
+    }
+    fn write_bytes(&mut self, value: &[u8]) -> Result {
+        let len = value.len();
         if self.remaining() < len {
             self.flush()?;
         }
@@ -605,6 +942,12 @@ impl<T: Write> Writer for Stream<T> {
         }
         Ok(())
     }
+    fn unchecked_len(&self) -> usize {
+        self.remaining()
+    }
+    fn position(&mut self) -> &mut *mut u8 {
+        &mut self.current
+    }
 
     fn as_any(&mut self) -> Any {
         Any {
@@ -614,6 +957,12 @@ impl<T: Write> Writer for Stream<T> {
             end: Some(self.end),
         }
     }
+
+    #[cfg(feature = "metrics")]
+    fn metrics(&self) -> WriteMetrics {
+        let metrics = self.output.metrics;
+        WriteMetrics { bytes_written: metrics.bytes_written + self.buffered() as u64, ..metrics }
+    }
 }
 impl<T: Write> Drop for Stream<T> {
     fn drop(&mut self) {
@@ -621,15 +970,270 @@ impl<T: Write> Drop for Stream<T> {
     }
 }
 
+/// The default length at which a [`Vectored`](struct.Vectored.html) output references byte strings instead of copying them
+pub const DEFAULT_VECTORED_THRESHOLD: usize = 512;
+
+/// The most pieces a vectored output holds before flushing, matching the usual limit on the slices one vectored write takes
+const MAX_PIECES: usize = 1024;
+
+/// A piece of vectored output waiting to be written
+enum Piece<'a> {
+    /// A range of the output's buffer
+    Buffered(Range<usize>),
+    /// A byte string referenced in place
+    Borrowed(&'a [u8]),
+}
+
+impl Piece<'_> {
+    fn len(&self) -> usize {
+        match self {
+            Piece::Buffered(range) => range.len(),
+            Piece::Borrowed(value) => value.len(),
+        }
+    }
+}
+
+/// A stream, its buffer and the pieces of output that need to be written to it before anything else.
+/// The buffer is allocated uninitialized, and only the ranges of it that have been written are read.
+struct Pending<'a, T> {
+    output: Sink<T>,
+    buf: Box<[MaybeUninit<u8>]>,
+    pieces: Vec<Piece<'a>>,
+}
+
+impl<T: Write> Pending<'_, T> {
+    /// Gets a range of the buffer that's been written to
+    #[inline]
+    unsafe fn written(buf: &[MaybeUninit<u8>], range: Range<usize>) -> &[u8] {
+        let written = &buf[range];
+        slice::from_raw_parts(written.as_ptr() as *const u8, written.len())
+    }
+    /// Writes the pending pieces followed by the tail of the buffer with as few vectored writes as possible
+    fn write_pieces(&mut self, tail: Range<usize>) -> io::Result<()> {
+        let buf = &self.buf;
+        let mut slices: Vec<&[u8]> =
+            self.pieces
+                .iter()
+                .map(|piece| match piece {
+                    Piece::Buffered(range) => unsafe { Self::written(buf, range.clone()) },
+                    Piece::Borrowed(value) => *value,
+                })
+                .chain(Some(unsafe { Self::written(buf, tail) }))
+                .filter(|s| !s.is_empty())
+                .collect();
+        let mut slices = slices.as_mut_slice();
+        while !slices.is_empty() {
+            let io_slices: Vec<IoSlice> = slices.iter().map(|s| IoSlice::new(s)).collect();
+            let mut written = match self.output.write_vectored(&io_slices) {
+                Ok(0) => return Err(ErrorKind::WriteZero.into()),
+                Ok(written) => written,
+                Err(ref e) if e.kind() == ErrorKind::Interrupted => continue,
+                Err(e) => return Err(e),
+            };
+            while written != 0 {
+                let first = slices[0];
+                if written >= first.len() {
+                    written -= first.len();
+                    slices = &mut slices[1..];
+                } else {
+                    slices[0] = &first[written..];
+                    written = 0;
+                }
+            }
+        }
+        self.pieces.clear();
+        Ok(())
+    }
+}
+
+impl<T: Write> Write for Pending<'_, T> {
+    fn write(&mut self, buf: &[u8]) -> io::Result<usize> {
+        if !self.pieces.is_empty() {
+            self.write_pieces(0..0)?;
+        }
+        self.output.write(buf)
+    }
+    fn flush(&mut self) -> io::Result<()> {
+        self.output.flush()
+    }
+}
+
+/// A buffered stream output that can reference large byte strings in place instead of copying them into its buffer.
+/// 
+/// Encoded values are written to the buffer. Byte strings at least as long as the output's threshold are
+/// referenced instead, and written together with the buffer in order with `write_vectored`, so large byte
+/// and string fields are written without copying them.
+/// 
+/// Byte strings written with
+/// [`write_borrowed_length_delimited`](struct.CodedWriter.html#method.write_borrowed_length_delimited)
+/// stay borrowed for as long as the writer, so they're kept until the next flush and written with as few writes
+/// as the buffer size allows. Byte strings written any other way, like the bytes fields of a message, only live
+/// for the call that writes them, so they're written with everything pending before that call returns.
+pub struct Vectored<'a, T: Write> {
+    output: Pending<'a, T>,
+    /// The start of the part of the buffer that hasn't been added to the pending pieces
+    segment: *mut u8,
+    current: *mut u8,
+    end: *mut u8,
+    threshold: usize,
+}
+impl<'a, T: Write> Vectored<'a, T> {
+    fn with_capacity(cap: usize, threshold: usize, output: T) -> Self {
+        let mut buf = crate::pool::new_write_buffer(cap);
+        let Range { start, end } = buf.as_mut_ptr_range();
+        let (start, end) = (start as *mut u8, end as *mut u8);
+        Self {
+            output: Pending { output: sink(output), buf, pieces: Vec::new() },
+            segment: start,
+            current: start,
+            end,
+            threshold,
+        }
+    }
+    #[inline]
+    fn remaining(&self) -> usize {
+        usize::wrapping_sub(self.end as _, self.current as _)
+    }
+    #[inline]
+    fn capacity(&self) -> usize {
+        self.output.buf.len()
+    }
+    /// Returns the offset of a pointer into the buffer
+    #[inline]
+    fn offset(&self, ptr: *mut u8) -> usize {
+        usize::wrapping_sub(ptr as _, self.output.buf.as_ptr() as _)
+    }
+    fn flush(&mut self) -> Result {
+        let tail = self.offset(self.segment)..self.offset(self.current);
+        self.output.write_pieces(tail)?;
+        self.segment = self.output.buf.as_mut_ptr() as *mut u8;
+        self.current = self.segment;
+        Ok(())
+    }
+    fn into_inner(self) -> T {
+        unsink(self.output.output)
+    }
+    /// Writes bytes that must be copied to the output, flushing when they don't fit in the buffer
+    fn write_copied(&mut self, value: &[u8]) -> Result {
+        let len = value.len();
+        // bytes written straight to the stream must come after the pending pieces, so flush those too
+        if self.remaining() < len || len >= self.capacity() {
+            self.flush()?;
+        }
+        if len >= self.capacity() {
+            self.output.output.write_all(value)?;
+        } else {
+            unsafe { write_bytes_unchecked(value, &mut self.current); }
+        }
+        Ok(())
+    }
+    /// Writes bytes that live as long as the output, referencing them if they're at least as long as the threshold
+    fn write_borrowed(&mut self, value: &'a [u8]) -> Result {
+        if value.len() < self.threshold || value.is_empty() {
+            return self.write_copied(value);
+        }
+
+        // end the buffered segment here so the reference is written after it
+        let buffered = self.offset(self.segment)..self.offset(self.current);
+        if !buffered.is_empty() {
+            self.output.pieces.push(Piece::Buffered(buffered));
+            self.segment = self.current;
+        }
+        self.output.pieces.push(Piece::Borrowed(value));
+        if self.output.pieces.len() >= MAX_PIECES {
+            self.flush()?;
+        }
+        Ok(())
+    }
+    /// Writes bytes that only live for this call. Ones at least as long as the threshold are referenced like
+    /// borrowed bytes and flushed with everything pending before this returns, so they're still never copied.
+    fn write_referenced(&mut self, value: &[u8]) -> Result {
+        if value.len() < self.threshold || value.is_empty() {
+            return self.write_copied(value);
+        }
+
+        // SAFETY: the piece is written or dropped before this returns, so it never outlives `value`
+        let value: &'a [u8] = unsafe { &*(value as *const [u8]) };
+        let result = self.write_borrowed(value).and_then(|()| self.flush());
+        if result.is_err() {
+            self.output.pieces.clear();
+        }
+        result
+    }
+}
+impl<T: Write> Writer for Vectored<'_, T> {
+    fn write_varint32(&mut self, value: u32) -> Result {
+        let len = raw_varint32_size(value).get() as usize;
+        if self.remaining() < len || len >= self.capacity() {
+            let mut buf = [0; 5];
+            unsafe { write_varint32_unchecked(value, &mut buf.as_mut_ptr()); }
+            self.write_copied(&buf[..len])
+        } else {
+            unsafe { write_varint32_unchecked(value, &mut self.current); }
+            Ok(())
+        }
+    }
+    fn write_varint64(&mut self, value: u64) -> Result {
+        let len = raw_varint64_size(value).get() as usize;
+        if self.remaining() < len || len >= self.capacity() {
+            let mut buf = [0; 10];
+            unsafe { write_varint64_unchecked(value, &mut buf.as_mut_ptr()); }
+            self.write_copied(&buf[..len])
+        } else {
+            unsafe { write_varint64_unchecked(value, &mut self.current); }
+            Ok(())
+        }
+    }
+    fn write_bit32(&mut self, value: u32) -> Result {
+        self.write_copied(&u32::to_le_bytes(value))
+    }
+    fn write_bit64(&mut self, value: u64) -> Result {
+        self.write_copied(&u64::to_le_bytes(value))
+    }
+    fn write_length_delimited(&mut self, value: &[u8]) -> Result {
+        let delimiter = i32::try_from(value.len()).map_err(|_| Error::ValueTooLarge)? as u32;
+        self.write_varint32(delimiter)?;
+        self.write_referenced(value)
+    }
+    fn write_bytes(&mut self, value: &[u8]) -> Result {
+        self.write_referenced(value)
+    }
+    fn unchecked_len(&self) -> usize {
+        self.remaining()
+    }
+    fn position(&mut self) -> &mut *mut u8 {
+        &mut self.current
+    }
+
+    fn as_any(&mut self) -> Any {
+        // the any writer writes its buffer through the pending output, which writes the pending pieces first
+        Any {
+            stream: Some(&mut self.output),
+            start: NonNull::new(self.segment),
+            current: &mut self.current,
+            end: NonNull::new(self.end),
+        }
+    }
+
+    #[cfg(feature = "metrics")]
+    fn metrics(&self) -> WriteMetrics {
+        let metrics = self.output.output.metrics;
+        let pending = self.output.pieces.iter().map(Piece::len).sum::<usize>();
+        let buffered = usize::wrapping_sub(self.current as _, self.segment as _);
+        WriteMetrics { bytes_written: metrics.bytes_written + (pending + buffered) as u64, ..metrics }
+    }
+}
+
 /// A protobuf coded output writer that writes to the specified output
 pub struct CodedWriter<T: Output> {
     inner: T,
+    threads: usize,
 }
 
 impl<'a> CodedWriter<Slice<'a>> {
     /// Creates a coded writer that writes to the specified slice
     pub fn with_slice(s: &'a mut [u8]) -> Self {
-        Self { inner: Slice::new(s), }
+        Self { inner: Slice::new(s), threads: 1 }
     }
     /// Returns ownership of the buffer at the current point in the slice
     pub fn into_inner(self) -> &'a mut [u8] {
@@ -637,6 +1241,18 @@ impl<'a> CodedWriter<Slice<'a>> {
     }
 }
 
+impl<'a> CodedWriter<VecOutput<'a>> {
+    /// Creates a coded writer that appends to the specified `Vec`, growing it as needed.
+    /// Reserving space in the `Vec` ahead of time lets the writer write without growing it.
+    pub fn with_vec(vec: &'a mut Vec<u8>) -> Self {
+        Self { inner: VecOutput::new(vec), threads: 1 }
+    }
+    /// Returns the `Vec`, including everything written to it
+    pub fn into_inner(self) -> &'a mut Vec<u8> {
+        self.inner.into_inner()
+    }
+}
+
 impl<'a> CodedWriter<SliceUnchecked<'a>> {
     /// Creates a coded writer that writes to the specified slice without performing any length checks
     /// 
@@ -645,7 +1261,7 @@ impl<'a> CodedWriter<SliceUnchecked<'a>> {
     /// Caution must be used when using the resulting writer as any writes outside of the slice are
     /// undefined behavior.
     pub unsafe fn with_slice_unchecked(s: &'a mut [u8]) -> Self {
-        Self { inner: SliceUnchecked::new(s) }
+        Self { inner: SliceUnchecked::new(s), threads: 1 }
     }
     /// Returns ownership of the buffer at the current point in the slice. This result of this is
     /// undefined if the writer has written past the end of the slice.
@@ -661,7 +1277,12 @@ impl<T: Write> CodedWriter<Stream<T>> {
     }
     /// Creates a coded writer that writes to the specified stream with the specified buffer capacity
     pub fn with_capacity(cap: usize, inner: T) -> Self {
-        Self { inner: Stream::with_capacity(cap, inner) }
+        Self { inner: Stream::with_capacity(cap, inner), threads: 1 }
+    }
+    /// Creates a coded writer that writes to the specified stream with a buffer taken from this thread's
+    /// [buffer pool](../../pool/index.html). The buffer is returned to the pool when the writer is dropped.
+    pub fn with_pooled_stream(inner: T) -> Self {
+        Self { inner: Stream::with_pooled(inner), threads: 1 }
     }
 
     /// Flushes the stream buffer
@@ -674,13 +1295,82 @@ impl<T: Write> CodedWriter<Stream<T>> {
     }
 }
 
+impl<'a, T: Write> CodedWriter<Vectored<'a, T>> {
+    /// Creates a coded writer that writes to the specified stream with the default buffer capacity,
+    /// referencing borrowed byte strings at least [`DEFAULT_VECTORED_THRESHOLD`](constant.DEFAULT_VECTORED_THRESHOLD.html)
+    /// bytes long instead of copying them.
+    pub fn with_vectored(inner: T) -> Self {
+        Self::with_vectored_capacity(DEFAULT_BUF_SIZE, DEFAULT_VECTORED_THRESHOLD, inner)
+    }
+    /// Creates a coded writer that writes to the specified stream with the specified buffer capacity,
+    /// referencing borrowed byte strings at least `threshold` bytes long instead of copying them.
+    pub fn with_vectored_capacity(cap: usize, threshold: usize, inner: T) -> Self {
+        Self { inner: Vectored::with_capacity(cap, threshold, inner), threads: 1 }
+    }
+
+    /// Writes a length delimited string of bytes to the output, referencing it in place until the writer is
+    /// next flushed if it's at least as long as the writer's threshold
+    pub fn write_borrowed_length_delimited(&mut self, value: &'a [u8]) -> Result {
+        let delimiter = i32::try_from(value.len()).map_err(|_| Error::ValueTooLarge)? as u32;
+        self.inner.write_varint32(delimiter)?;
+        self.inner.write_borrowed(value)
+    }
+    /// Writes a string of bytes to the output as is, without a length delimiter, referencing it in place
+    /// until the writer is next flushed if it's at least as long as the writer's threshold
+    pub fn write_borrowed_raw_bytes(&mut self, value: &'a [u8]) -> Result {
+        self.inner.write_borrowed(value)
+    }
+    /// Writes the buffer and any referenced byte strings to the stream
+    pub fn flush(&mut self) -> Result {
+        self.inner.flush()
+    }
+    /// Returns ownership of the inner stream, discarding any data that hasn't been flushed
+    pub fn into_inner(self) -> T {
+        self.inner.into_inner()
+    }
+}
+
 impl<T: Output> CodedWriter<T> {
     /// Converts the generic writer into a writer over Any input
     pub fn as_any(&mut self) -> CodedWriter<Any> {
         CodedWriter {
-            inner: self.inner.as_any()
+            inner: self.inner.as_any(),
+            threads: self.threads,
         }
     }
+    /// Sets the number of threads the writer can use to write large repeated message and packed fields.
+    /// The default is 1, which writes everything on the writing thread.
+    ///
+    /// Fields are only split between threads when the writer can make room for the whole field at once,
+    /// like slice and `Vec` writers and stream writers with buffers larger than the field.
+    pub fn with_threads(mut self, threads: usize) -> Self {
+        self.threads = threads;
+        self
+    }
+    /// Gets the number of threads the writer can use to write large repeated message and packed fields.
+    pub fn threads(&self) -> usize {
+        self.threads
+    }
+    /// Gets the counters for everything written so far. Writers made with `as_any` keep no counters of their own,
+    /// so everything they write is counted by the writer they were made from.
+    #[cfg(feature = "metrics")]
+    pub fn metrics(&self) -> WriteMetrics {
+        self.inner.metrics()
+    }
+    /// Reserves `len` bytes at the current position and passes them to the function to fill,
+    /// advancing past them if it succeeds. This returns `None` without calling the function
+    /// if the output can't provide the bytes at once.
+    pub(crate) fn write_reserved<F: FnOnce(&mut [u8]) -> Result>(&mut self, len: usize, f: F) -> Option<Result> {
+        if !self.inner.reserve(len) {
+            return None;
+        }
+        let position = self.inner.position();
+        let result = f(unsafe { slice::from_raw_parts_mut(*position, len) });
+        if result.is_ok() {
+            *position = unsafe { position.add(len) };
+        }
+        Some(result)
+    }
 
     /// Writes a 32-bit varint value to the output
     #[inline]
@@ -707,6 +1397,43 @@ impl<T: Output> CodedWriter<T> {
     pub fn write_length_delimited(&mut self, value: &[u8]) -> Result {
         self.inner.write_length_delimited(value)
     }
+    /// Writes a string of bytes to the output as is, without a length delimiter
+    #[inline]
+    pub fn write_raw_bytes(&mut self, value: &[u8]) -> Result {
+        self.inner.write_bytes(value)
+    }
+    /// Writes a slice of 32-bit varint values to the output. Values are encoded
+    /// without checking the space left in the output for each value where possible.
+    #[inline]
+    pub fn write_varint32_slice(&mut self, values: &[u32]) -> Result {
+        self.inner.write_varint32_slice(values)
+    }
+    /// Writes a slice of 64-bit varint values to the output. Values are encoded
+    /// without checking the space left in the output for each value where possible.
+    #[inline]
+    pub fn write_varint64_slice(&mut self, values: &[u64]) -> Result {
+        self.inner.write_varint64_slice(values)
+    }
+    /// Writes a slice of little-endian 4-byte integers to the output. On little endian targets this is a single copy.
+    #[inline]
+    pub fn write_fixed32_slice(&mut self, values: &[u32]) -> Result {
+        if cfg!(target_endian = "little") {
+            let bytes = unsafe { slice::from_raw_parts(values.as_ptr() as *const u8, values.len() * 4) };
+            self.inner.write_bytes(bytes)
+        } else {
+            values.iter().try_for_each(|&v| self.inner.write_bit32(v))
+        }
+    }
+    /// Writes a slice of little-endian 8-byte integers to the output. On little endian targets this is a single copy.
+    #[inline]
+    pub fn write_fixed64_slice(&mut self, values: &[u64]) -> Result {
+        if cfg!(target_endian = "little") {
+            let bytes = unsafe { slice::from_raw_parts(values.as_ptr() as *const u8, values.len() * 8) };
+            self.inner.write_bytes(bytes)
+        } else {
+            values.iter().try_for_each(|&v| self.inner.write_bit64(v))
+        }
+    }
 
     /// Writes a length to the output
     #[inline]
@@ -719,6 +1446,17 @@ impl<T: Output> CodedWriter<T> {
         self.write_varint32(tag.get())
     }
 
+    /// Writes a message preceded by its length, the framing read by
+    /// [`CodedReader::read_delimited`](../read/struct.CodedReader.html#method.read_delimited).
+    /// 
+    /// A stream writer only flushes when its buffer fills, so writing a sequence of small
+    /// messages to one stream shares each write to the underlying output between many messages.
+    pub fn write_delimited<M: Message>(&mut self, message: &M) -> Result {
+        let length = message.compute_and_cache_size().ok_or(Error::ValueTooLarge)?;
+        self.write_length(length)?;
+        message.write_to(self)
+    }
+
     /// Writes the value to the output. This uses an alias to `Value::write_to`.
     #[inline]
     pub fn write_value<V: Value>(&mut self, value: &V::Inner) -> Result {
@@ -729,11 +1467,20 @@ impl<T: Output> CodedWriter<T> {
     pub fn write_field<V: Value>(&mut self, num: FieldNumber, value: &V::Inner) -> Result {
         self.write_tag(Tag::new(num, V::WIRE_TYPE))?;
         self.write_value::<V>(value)?;
-        if V::WIRE_TYPE != WireType::StartGroup {
+        if V::WIRE_TYPE == WireType::StartGroup {
             self.write_tag(Tag::new(num, WireType::EndGroup))?;
         }
         Ok(())
     }
+    /// Writes a length delimited field of bytes that are already encoded, such as a message encoded ahead of time.
+    ///
+    /// The tag, length and bytes are written as they are, so nothing is sized or encoded again. The field's size can be
+    /// added to a length with [`LengthBuilder::add_encoded_field`](../struct.LengthBuilder.html#method.add_encoded_field).
+    #[inline]
+    pub fn write_encoded_field(&mut self, num: FieldNumber, value: &[u8]) -> Result {
+        self.write_tag(Tag::new(num, WireType::LengthDelimited))?;
+        self.write_length_delimited(value)
+    }
     /// Writes the values in the repeated field to the output. This uses an alias to `RepeatedValue::write_to`.
     #[inline]
     pub fn write_values<U: RepeatedValue<V>, V>(&mut self, value: &U, num: FieldNumber) -> Result {
@@ -847,6 +1594,22 @@ mod test {
             w.write_length_delimited(&[1, 2, 3])
         } => Ok(([3, 1, 2, 3], [])),
 
+        (write_varint32_slice | write_varint32_slice_any | size: 8) = |w| {
+            w.write_varint32_slice(&[0, 128, 268435456])
+        } => Ok(([0, 128, 1, 128, 128, 128, 128, 1], [])),
+
+        (write_varint64_slice | write_varint64_slice_any | size: 13) = |w| {
+            w.write_varint64_slice(&[1, 0x8000000000000000, 300])
+        } => Ok(([1, 128, 128, 128, 128, 128, 128, 128, 128, 128, 1, 172, 2], [])),
+
+        (write_fixed32_slice | write_fixed32_slice_any | size: 8) = |w| {
+            w.write_fixed32_slice(&[1, 0x01020304])
+        } => Ok(([1, 0, 0, 0, 4, 3, 2, 1], [])),
+
+        (write_fixed64_slice | write_fixed64_slice_any | size: 8) = |w| {
+            w.write_fixed64_slice(&[0x0102030405060708])
+        } => Ok(([8, 7, 6, 5, 4, 3, 2, 1], [])),
+
         (write_as_any | write_as_any_any | size: 6) = |w| {
             w.write_varint32(8)?;
 
@@ -854,7 +1617,12 @@ mod test {
             any.write_length_delimited(&[1, 2, 3])?;
 
             w.write_varint32(1)
-        } => Ok(([8, 3, 1, 2, 3, 1], []))
+        } => Ok(([8, 3, 1, 2, 3, 1], [])),
+
+        (write_field | write_field_any | size: 2) = |w| {
+            let num = crate::io::FieldNumber::new(1).unwrap();
+            w.write_field::<crate::raw::Int32>(num, &1)
+        } => Ok(([8, 1], []))
     }
 
     macro_rules! run {
@@ -886,7 +1654,12 @@ mod test {
                     write_bit32, write_bit32_any,
                     write_bit64, write_bit64_any,
                     write_length_delimited, write_length_delimited_any,
-                    write_as_any, write_as_any_any
+                    write_varint32_slice, write_varint32_slice_any,
+                    write_varint64_slice, write_varint64_slice_any,
+                    write_fixed32_slice, write_fixed32_slice_any,
+                    write_fixed64_slice, write_fixed64_slice_any,
+                    write_as_any, write_as_any_any,
+                    write_field, write_field_any
                 }
             }
         };
@@ -909,6 +1682,31 @@ mod test {
             }
 
             run_suite!(SliceOutput);
+
+            #[test]
+            fn write_slices_past_end() {
+                let mut output = [0; 3];
+                let mut writer = CodedWriter::with_slice(&mut output);
+                assert!(writer.write_varint64_slice(&[1, 300, 1]).is_err());
+                assert!(writer.write_fixed32_slice(&[1]).is_err());
+            }
+
+            #[test]
+            fn varint_slices_leave_trailing_bytes() {
+                for len in 1..12 {
+                    let values: Vec<u32> = (1..=len).collect();
+                    let mut output = [0xff; 32];
+                    let mut writer = CodedWriter::with_slice(&mut output);
+                    writer.write_varint32_slice(&values).unwrap();
+                    writer.write_varint64_slice(&[1, 2]).unwrap();
+                    let written = len as usize + 2;
+                    assert_eq!(writer.into_inner().len(), 32 - written);
+
+                    let expected: Vec<u32> = values.iter().copied().chain(vec![1, 2]).collect();
+                    assert_eq!(output[..written].iter().map(|&b| u32::from(b)).collect::<Vec<_>>(), expected);
+                    assert!(output[written..].iter().all(|&b| b == 0xff), "length {}", len);
+                }
+            }
         }
         mod slice_unchecked {
             use crate::io::write::{self, SliceUnchecked, CodedWriter, test::WriterOutput};
@@ -973,5 +1771,240 @@ mod test {
                 run_suite!(StreamTinyBuffer);
             }
         }
+        mod vec {
+            use crate::io::write::CodedWriter;
+
+            #[test]
+            fn write_values() {
+                let mut output = Vec::new();
+                let mut writer = CodedWriter::with_vec(&mut output);
+                writer.write_varint32(300).unwrap();
+                writer.write_varint64(u64::max_value()).unwrap();
+                writer.write_bit32(1).unwrap();
+                writer.write_bit64(2).unwrap();
+                writer.write_length_delimited(&[1, 2, 3]).unwrap();
+                writer.write_varint32_slice(&[1, 300]).unwrap();
+                writer.write_varint64_slice(&[u64::max_value()]).unwrap();
+                writer.write_fixed32_slice(&[3]).unwrap();
+                drop(writer);
+
+                let mut expected = vec![172, 2, 255, 255, 255, 255, 255, 255, 255, 255, 255, 1];
+                expected.extend_from_slice(&[1, 0, 0, 0, 2, 0, 0, 0, 0, 0, 0, 0, 3, 1, 2, 3, 1, 172, 2]);
+                expected.extend_from_slice(&[255, 255, 255, 255, 255, 255, 255, 255, 255, 1, 3, 0, 0, 0]);
+                assert_eq!(output, expected);
+            }
+
+            #[test]
+            fn varint_slices_stay_in_capacity() {
+                for len in 0..8 {
+                    let values: Vec<u32> = (1..=len).collect();
+                    let mut output = Vec::with_capacity(len as usize);
+                    let mut writer = CodedWriter::with_vec(&mut output);
+                    writer.write_varint32_slice(&values).unwrap();
+                    let output = writer.into_inner();
+                    assert_eq!(output.iter().map(|&b| u32::from(b)).collect::<Vec<_>>(), values);
+                    assert!(output.capacity() >= output.len());
+                }
+
+                let mut output = Vec::with_capacity(5);
+                let mut writer = CodedWriter::with_vec(&mut output);
+                writer.write_varint32_slice(&[1]).unwrap();
+                assert_eq!(writer.into_inner(), &[1]);
+
+                let mut output = Vec::with_capacity(10);
+                let mut writer = CodedWriter::with_vec(&mut output);
+                writer.write_varint64_slice(&[u64::max_value()]).unwrap();
+                assert_eq!(writer.into_inner().len(), 10);
+            }
+
+            #[test]
+            fn reserved_vec_is_not_grown() {
+                let mut output = Vec::with_capacity(4);
+                let ptr = output.as_ptr();
+                let mut writer = CodedWriter::with_vec(&mut output);
+                writer.write_bit32(5).unwrap();
+                let output = writer.into_inner();
+
+                assert_eq!(output, &[5, 0, 0, 0]);
+                assert_eq!(output.as_ptr(), ptr);
+            }
+
+            #[test]
+            fn any_grows_vec() {
+                let mut output = vec![9];
+                let mut writer = CodedWriter::with_vec(&mut output);
+                writer.write_varint32(1).unwrap();
+                {
+                    let mut any = writer.as_any();
+                    for i in 0..100 {
+                        any.write_varint32(i).unwrap();
+                    }
+                    any.write_length_delimited(&[1; 300]).unwrap();
+                }
+                writer.write_varint32(2).unwrap();
+                drop(writer);
+
+                let mut expected = vec![9, 1];
+                expected.extend(0..100);
+                expected.extend_from_slice(&[172, 2]);
+                expected.extend_from_slice(&[1; 300]);
+                expected.push(2);
+                assert_eq!(output, expected);
+            }
+        }
+        mod vectored {
+            macro_rules! vectored_case {
+                ($i:ident($s:expr, $t:expr)) => {
+                    use crate::io::write::{self, CodedWriter, Vectored, test::WriterOutput};
+
+                    pub struct $i;
+
+                    impl<'a> WriterOutput<'a> for $i {
+                        type Writer = Vectored<'a, &'a mut [u8]>;
+
+                        fn new(b: &'a mut [u8]) -> CodedWriter<Self::Writer> {
+                            CodedWriter::with_vectored_capacity($s, $t, b)
+                        }
+                        fn into_inner(mut w: CodedWriter<Self::Writer>) -> Result<&'a mut [u8], write::Error> {
+                            w.flush()?;
+                            Ok(w.into_inner())
+                        }
+                    }
+                };
+            }
+
+            mod default {
+                vectored_case!(VectoredDefault(crate::io::DEFAULT_BUF_SIZE, write::DEFAULT_VECTORED_THRESHOLD));
+                run_suite!(VectoredDefault);
+            }
+
+            mod reference_all {
+                vectored_case!(VectoredReferenceAll(crate::io::DEFAULT_BUF_SIZE, 1));
+                run_suite!(VectoredReferenceAll);
+            }
+
+            mod no_buffer {
+                vectored_case!(VectoredNoBuffer(0, 1));
+                run_suite!(VectoredNoBuffer);
+            }
+
+            mod byte5_buffer {
+                vectored_case!(VectoredTinyBuffer(5, 2));
+                run_suite!(VectoredTinyBuffer);
+            }
+
+            use crate::io::write::CodedWriter;
+            use std::io::{self, IoSlice, Write};
+
+            /// A writer recording each call made to it
+            #[derive(Default)]
+            struct Recorder {
+                data: Vec<u8>,
+                calls: usize,
+            }
+
+            impl Write for &mut Recorder {
+                fn write(&mut self, buf: &[u8]) -> io::Result<usize> {
+                    self.calls += 1;
+                    self.data.extend_from_slice(buf);
+                    Ok(buf.len())
+                }
+                fn write_vectored(&mut self, bufs: &[IoSlice]) -> io::Result<usize> {
+                    self.calls += 1;
+                    // write part of the last slice to check partial writes resume where they left off
+                    let mut written = 0;
+                    for (i, buf) in bufs.iter().enumerate() {
+                        let buf = if i + 1 == bufs.len() && bufs.len() > 1 { &buf[..buf.len() / 2] } else { &buf[..] };
+                        self.data.extend_from_slice(buf);
+                        written += buf.len();
+                    }
+                    Ok(written)
+                }
+                fn flush(&mut self) -> io::Result<()> {
+                    Ok(())
+                }
+            }
+
+            #[test]
+            fn large_fields_are_written_together() {
+                let blobs: Vec<Vec<u8>> = (0..8u8).map(|i| vec![i; 4096]).collect();
+                let mut expected = Vec::new();
+                for blob in &blobs {
+                    expected.extend_from_slice(&[10, 128, 32]);
+                    expected.extend_from_slice(blob);
+                }
+
+                let mut output = Recorder::default();
+                let mut writer = CodedWriter::with_vectored_capacity(64, 512, &mut output);
+                for blob in &blobs {
+                    writer.write_varint32(10).unwrap();
+                    writer.write_borrowed_length_delimited(blob).unwrap();
+                }
+                writer.flush().unwrap();
+                drop(writer);
+
+                assert_eq!(output.data, expected);
+                // one vectored write, then one more for the half of the last slice it left
+                assert_eq!(output.calls, 2);
+            }
+
+            #[test]
+            fn any_writes_pending_pieces_first() {
+                let blob = vec![7u8; 600];
+                let mut output = Recorder::default();
+                let mut writer = CodedWriter::with_vectored_capacity(16, 512, &mut output);
+                writer.write_varint32(1).unwrap();
+                writer.write_borrowed_raw_bytes(&blob).unwrap();
+                {
+                    let mut any = writer.as_any();
+                    for i in 0..32 {
+                        any.write_varint32(i).unwrap();
+                    }
+                }
+                writer.write_varint32(2).unwrap();
+                writer.flush().unwrap();
+                drop(writer);
+
+                let mut expected = vec![1];
+                expected.extend_from_slice(&blob);
+                expected.extend(0..32);
+                expected.push(2);
+                assert_eq!(output.data, expected);
+            }
+
+            #[test]
+            fn large_fields_are_referenced_for_one_call() {
+                let blob = vec![7u8; 600];
+                let mut output = Recorder::default();
+                let mut writer = CodedWriter::with_vectored_capacity(64, 512, &mut output);
+                writer.write_varint32(10).unwrap();
+                // the tag and length are written together with the blob before the call returns
+                writer.write_length_delimited(&blob).unwrap();
+                writer.write_length_delimited(&[1, 2, 3]).unwrap();
+                writer.flush().unwrap();
+                drop(writer);
+
+                let mut expected = vec![10, 216, 4];
+                expected.extend_from_slice(&blob);
+                expected.extend_from_slice(&[3, 1, 2, 3]);
+                assert_eq!(output.data, expected);
+            }
+
+            #[test]
+            fn copies_the_size_of_the_buffer_follow_pending_pieces() {
+                let blob = vec![7u8; 600];
+                let copy = [3u8; 16];
+                let mut output = Recorder::default();
+                let mut writer = CodedWriter::with_vectored_capacity(16, 512, &mut output);
+                writer.write_borrowed_raw_bytes(&blob).unwrap();
+                writer.write_raw_bytes(&copy).unwrap();
+                writer.flush().unwrap();
+                drop(writer);
+
+                let mut expected = blob.clone();
+                expected.extend_from_slice(&copy);
+                assert_eq!(output.data, expected);
+            }
+        }
     }
 }
\ No newline at end of file
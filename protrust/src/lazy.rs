@@ -0,0 +1,955 @@
+//! Defines the `Lazy` container, a message value that's parsed the first time it's accessed, `Frozen`,
+//! an immutable shared message that's encoded the first time it's written, and `LazyString`,
+//! a string value that's validated the first time it's accessed.
+//!
+//! Values read with [`raw::LazyMessage`](../raw/struct.LazyMessage.html) only keep the encoded bytes of the message.
+//! The bytes are checked to be well formed fields when they're read, but the fields themselves aren't parsed until
+//! the message is accessed. A message that's never accessed mutably is written back out as the bytes it was read from.
+//!
+//! Values read with [`raw::LazyString`](../raw/struct.LazyString.html) keep the bytes of the string without checking
+//! they're valid UTF-8, so strings that are only compared or written back out are never validated.
+//!
+//! A [`raw::FrozenMessage`](../raw/struct.FrozenMessage.html) is sized and written from its cached encoding, so a
+//! message written into many different outer messages is only encoded once.
+//!
+//! # Examples
+//!
+//! ```ignore
+//! use protrust::lazy::Lazy;
+//! use protrust::io::CodedReader;
+//! use protrust::raw;
+//! # use protrust::doctest::timestamp::Timestamp;
+//!
+//! let data = [2, 8, 1];
+//! let timestamp: Lazy<Timestamp> = CodedReader::with_slice(&data).read_value::<raw::LazyMessage<Timestamp>>()?;
+//!
+//! assert!(!timestamp.is_parsed());
+//! assert_eq!(timestamp.as_bytes(), Some(&[8, 1][..]));
+//!
+//! assert_eq!(timestamp.get()?.seconds(), &1);
+//! # Ok::<(), protrust::io::read::Error>(())
+//! ```
+
+use crate::{Message, Mergable};
+use crate::internal::OnceBox;
+use crate::io::{self, read, write, reverse::ReverseWriter, Length, LengthBuilder, CodedReader, CodedWriter, Input, Output};
+use crate::raw::{self, NewFor, Value};
+use std::convert::TryFrom;
+use std::fmt::{self, Debug, Formatter};
+use std::hash::{Hash, Hasher};
+use std::str::Utf8Error;
+use std::string::FromUtf8Error;
+use std::sync::Arc;
+use std::sync::atomic::{AtomicU8, Ordering};
+
+/// A message that's parsed from its encoded bytes the first time it's accessed.
+///
+/// Shared access parses the message into a cached value, keeping the bytes to write back out.
+/// Mutable access parses the message and discards the bytes, so the value is written instead.
+pub struct Lazy<T> {
+    /// The encoded message. This is only used while `modified` is false.
+    bytes: Vec<u8>,
+    /// The parsed message. This is a cache of the bytes until the message is accessed mutably.
+    value: OnceBox<T>,
+    modified: bool,
+    /// The options the message is parsed with, including what was left of the recursion limit when it was read
+    builder: read::Builder,
+}
+
+impl<T> Lazy<T> {
+    /// Creates a new lazy message containing the already parsed value
+    pub fn new(value: T) -> Self {
+        let mut lazy = Lazy { modified: true, ..Self::default() };
+        lazy.value.set(value);
+        lazy
+    }
+    /// Returns whether the message has been parsed
+    pub fn is_parsed(&self) -> bool {
+        self.value.get().is_some()
+    }
+    /// Gets the encoded bytes of the message if it hasn't been accessed mutably since it was read
+    pub fn as_bytes(&self) -> Option<&[u8]> {
+        if self.modified {
+            None
+        } else {
+            Some(&self.bytes)
+        }
+    }
+}
+
+impl<T: Message> Lazy<T> {
+    fn parse(&self) -> read::Result<T> {
+        let mut input = self.builder.with_slice(&self.bytes);
+        let mut value = T::new_for(&input);
+        input.merge_message(&mut value)?;
+        Ok(value)
+    }
+    /// Gets the message, parsing it if it hasn't been parsed yet
+    ///
+    /// # Errors
+    ///
+    /// This returns any error the message returns while parsing. The error isn't cached,
+    /// so the message is parsed again the next time it's accessed.
+    pub fn get(&self) -> read::Result<&T> {
+        self.value.get_or_try_init(|| self.parse())
+    }
+    /// Gets a mutable reference to the message, parsing it if it hasn't been parsed yet.
+    /// The encoded bytes are discarded, so later writes encode the value instead.
+    pub fn get_mut(&mut self) -> read::Result<&mut T> {
+        if !self.modified {
+            if self.value.get().is_none() {
+                let value = self.parse()?;
+                self.value.set(value);
+            }
+            self.bytes = Vec::new();
+            self.modified = true;
+        }
+        Ok(self.value.get_mut().expect("modified messages are parsed"))
+    }
+    /// Consumes the lazy message, returning the parsed message
+    pub fn into_inner(mut self) -> read::Result<T> {
+        self.get_mut()?;
+        Ok(self.value.take().expect("modified messages are parsed"))
+    }
+    /// Replaces the message with a new value
+    pub fn set(&mut self, value: T) {
+        self.bytes = Vec::new();
+        self.modified = true;
+        self.value.set(value);
+    }
+
+    pub(crate) fn calculate_size(&self, builder: LengthBuilder) -> Option<LengthBuilder> {
+        let len = match self.as_bytes() {
+            Some(bytes) => i32::try_from(bytes.len()).ok().and_then(Length::new)?,
+            None => self.value.get().expect("modified messages are parsed").compute_and_cache_size()?,
+        };
+        builder
+            .add_value::<raw::Uint32>(&(len.get() as u32))?
+            .add_bytes(len)
+    }
+    pub(crate) fn cached_size(&self, builder: LengthBuilder) -> Option<LengthBuilder> {
+        match self.as_bytes() {
+            Some(_) => self.calculate_size(builder),
+            None => raw::Message::<T>::cached_size(self.value.get().expect("modified messages are parsed"), builder),
+        }
+    }
+    pub(crate) fn merge_from<U: Input>(&mut self, input: &mut CodedReader<U>) -> read::Result<()> {
+        if self.modified {
+            let value = self.value.get_mut().expect("modified messages are parsed");
+            return raw::Message::<T>::merge_from(value, input);
+        }
+
+        // merging an encoded message is the same as appending its bytes to ours
+        self.value.take();
+        let start = self.bytes.len();
+        let bytes = &mut self.bytes;
+        // the message is parsed later with the reader's options and what's left of its recursion limit
+        let result =
+            input.recurse(move |input| {
+                input.read_length_delimited_with(move |len| {
+                    // the bytes are truncated if the read fails
+                    bytes.resize(start + len, 0);
+                    &mut bytes[start..]
+                })?;
+                Ok(input.nested_builder())
+            });
+        let result = result.and_then(|builder| {
+            validate(&self.bytes[start..])?;
+            self.builder = builder;
+            Ok(())
+        });
+        if result.is_err() {
+            self.bytes.truncate(start);
+        }
+        result
+    }
+    pub(crate) fn write_to<U: Output>(&self, output: &mut CodedWriter<U>) -> write::Result {
+        match self.as_bytes() {
+            Some(bytes) => output.write_length_delimited(bytes),
+            None => raw::Message::<T>::write_to(self.value.get().expect("modified messages are parsed"), output),
+        }
+    }
+    pub(crate) fn write_reverse(&self, output: &mut ReverseWriter) -> write::Result {
+        match self.as_bytes() {
+            Some(bytes) => output.write_length_delimited(bytes),
+            None => raw::Message::<T>::write_reverse(self.value.get().expect("modified messages are parsed"), output),
+        }
+    }
+    pub(crate) fn is_initialized(&self) -> bool {
+        self.get().map_or(false, T::is_initialized)
+    }
+}
+
+/// Checks that the bytes are a series of well formed fields without parsing their values
+fn validate(bytes: &[u8]) -> read::Result<()> {
+    let mut input = CodedReader::with_slice(bytes);
+    while input.read_tag()?.is_some() {
+        input.skip()?;
+    }
+    Ok(())
+}
+
+/// Encodes the message, appending it to the bytes
+fn encode<T: Message>(value: &T, bytes: &mut Vec<u8>) {
+    let len = value.compute_and_cache_size().expect("merged message is too large").get() as usize;
+    let start = bytes.len();
+    bytes.resize(start + len, 0);
+    value.write_to(&mut CodedWriter::with_slice(&mut bytes[start..])).expect("message size was calculated");
+}
+
+impl<T> Default for Lazy<T> {
+    fn default() -> Self {
+        Lazy {
+            bytes: Vec::new(),
+            value: OnceBox::new(),
+            modified: false,
+            builder: read::Builder::new(),
+        }
+    }
+}
+
+impl<T: Clone> Clone for Lazy<T> {
+    fn clone(&self) -> Self {
+        let mut value = OnceBox::new();
+        if let Some(v) = self.value.get() {
+            value.set(v.clone());
+        }
+        Lazy {
+            bytes: self.bytes.clone(),
+            value,
+            modified: self.modified,
+            builder: self.builder.clone(),
+        }
+    }
+}
+
+impl<T: Message> PartialEq for Lazy<T> {
+    fn eq(&self, other: &Self) -> bool {
+        if let (Some(a), Some(b)) = (self.as_bytes(), other.as_bytes()) {
+            if a == b {
+                return true;
+            }
+        }
+        match (self.get(), other.get()) {
+            (Ok(a), Ok(b)) => a == b,
+            _ => false,
+        }
+    }
+}
+
+impl<T: Message> Debug for Lazy<T> {
+    fn fmt(&self, f: &mut Formatter) -> fmt::Result {
+        match self.get() {
+            Ok(value) => f.debug_tuple("Lazy").field(value).finish(),
+            Err(_) => f.debug_struct("Lazy").field("bytes", &self.bytes).finish(),
+        }
+    }
+}
+
+impl<T: Message> From<T> for Lazy<T> {
+    fn from(value: T) -> Self {
+        Self::new(value)
+    }
+}
+
+impl<T: Message + Mergable> Mergable for Lazy<T> {
+    /// Merges the messages. Unless both messages have been accessed mutably, this appends the
+    /// encoded messages instead of parsing them, leaving the merged message unparsed.
+    fn merge(&mut self, other: &Self) {
+        match (self.modified, other.as_bytes()) {
+            (true, None) => {
+                let value = self.value.get_mut().expect("modified messages are parsed");
+                value.merge(other.value.get().expect("modified messages are parsed"));
+            },
+            (true, Some(bytes)) => {
+                let value = self.value.take().expect("modified messages are parsed");
+                self.bytes.clear();
+                encode(&value, &mut self.bytes);
+                self.bytes.extend_from_slice(bytes);
+                self.modified = false;
+            },
+            (false, Some(bytes)) => {
+                self.value.take();
+                self.bytes.extend_from_slice(bytes);
+            },
+            (false, None) => {
+                self.value.take();
+                encode(other.value.get().expect("modified messages are parsed"), &mut self.bytes);
+            }
+        }
+    }
+}
+
+/// An immutable message that's shared between clones and encoded the first time it's written.
+///
+/// Cloning a frozen message only clones a reference to it, and every clone shares the same encoding, so once it's
+/// been encoded writing the message anywhere is a single copy of its bytes. Frozen messages read with
+/// [`raw::FrozenMessage`](../raw/struct.FrozenMessage.html) keep the bytes they were read from as their encoding.
+///
+/// # Examples
+///
+/// ```ignore
+/// use protrust::lazy::Frozen;
+/// use protrust::io::{CodedWriter, FieldNumber};
+/// use protrust::raw;
+/// # use protrust::doctest::timestamp::Timestamp;
+///
+/// let mut timestamp = Timestamp::default();
+/// *timestamp.seconds_mut() = 1;
+/// let timestamp = Frozen::new(timestamp);
+///
+/// let num = FieldNumber::new(1).unwrap();
+/// for _ in 0..3 {
+///     let mut output = Vec::new();
+///     CodedWriter::with_vec(&mut output).write_field::<raw::FrozenMessage<Timestamp>>(num, &timestamp.clone()).unwrap();
+///     assert_eq!(output, [10, 2, 8, 1]);
+/// }
+/// assert_eq!(timestamp.encoded().unwrap(), &[8, 1]);
+/// ```
+pub struct Frozen<T>(Arc<FrozenInner<T>>);
+
+struct FrozenInner<T> {
+    value: T,
+    /// The encoded message, set the first time it's sized or written
+    bytes: OnceBox<Vec<u8>>,
+}
+
+impl<T> Frozen<T> {
+    /// Freezes the message
+    pub fn new(value: T) -> Self {
+        Frozen(Arc::new(FrozenInner { value, bytes: OnceBox::new() }))
+    }
+    fn with_bytes(value: T, bytes: Vec<u8>) -> Self {
+        let mut inner = FrozenInner { value, bytes: OnceBox::new() };
+        inner.bytes.set(bytes);
+        Frozen(Arc::new(inner))
+    }
+    /// Gets the message
+    pub fn get(&self) -> &T {
+        &self.0.value
+    }
+    /// Returns whether the message has been encoded
+    pub fn is_encoded(&self) -> bool {
+        self.0.bytes.get().is_some()
+    }
+    /// Returns whether both frozen messages are clones of the same message
+    pub fn ptr_eq(this: &Self, other: &Self) -> bool {
+        Arc::ptr_eq(&this.0, &other.0)
+    }
+}
+
+impl<T: Message> Frozen<T> {
+    /// Gets the encoded message, encoding it if it hasn't been encoded yet
+    ///
+    /// # Errors
+    ///
+    /// This returns any error the message returns while being encoded. The error isn't cached,
+    /// so the message is encoded again the next time it's written.
+    pub fn encoded(&self) -> Result<&[u8], write::Error> {
+        self.0.bytes.get_or_try_init(|| self.0.value.to_bytes()).map(Vec::as_slice)
+    }
+    /// Consumes the frozen message, returning the message if this is the last reference to it or a clone otherwise
+    pub fn into_inner(self) -> T {
+        match Arc::try_unwrap(self.0) {
+            Ok(inner) => inner.value,
+            Err(shared) => shared.value.clone(),
+        }
+    }
+
+    pub(crate) fn calculate_size(&self, builder: LengthBuilder) -> Option<LengthBuilder> {
+        let len = i32::try_from(self.encoded().ok()?.len()).ok().and_then(Length::new)?;
+        builder
+            .add_value::<raw::Uint32>(&(len.get() as u32))?
+            .add_bytes(len)
+    }
+    pub(crate) fn merge_from<U: Input>(&mut self, input: &mut CodedReader<U>) -> read::Result<()> {
+        let mut value = std::mem::take(self).into_inner();
+        let result = raw::Message::<T>::merge_from(&mut value, input);
+        *self = Frozen::new(value);
+        result
+    }
+    pub(crate) fn read_new<U: Input>(input: &mut CodedReader<U>) -> read::Result<Self> {
+        // the message is parsed from its own reader, which keeps the options and what's left of the recursion limit
+        input.recurse(|input| {
+            let bytes = input.read_value::<raw::Bytes<Vec<u8>>>()?;
+            let builder = input.nested_builder();
+            let mut reader = builder.with_slice(&bytes);
+            let mut value = T::new_for(&reader);
+            reader.merge_message(&mut value)?;
+            Ok(Frozen::with_bytes(value, bytes))
+        })
+    }
+    pub(crate) fn write_to<U: Output>(&self, output: &mut CodedWriter<U>) -> write::Result {
+        output.write_length_delimited(self.encoded()?)
+    }
+    pub(crate) fn write_reverse(&self, output: &mut ReverseWriter) -> write::Result {
+        output.write_length_delimited(self.encoded()?)
+    }
+}
+
+impl<T: Default> Default for Frozen<T> {
+    fn default() -> Self {
+        Self::new(T::default())
+    }
+}
+
+impl<T> Clone for Frozen<T> {
+    fn clone(&self) -> Self {
+        Frozen(self.0.clone())
+    }
+}
+
+impl<T: PartialEq> PartialEq for Frozen<T> {
+    fn eq(&self, other: &Self) -> bool {
+        Self::ptr_eq(self, other) || self.get() == other.get()
+    }
+}
+
+impl<T: Debug> Debug for Frozen<T> {
+    fn fmt(&self, f: &mut Formatter) -> fmt::Result {
+        f.debug_tuple("Frozen").field(self.get()).finish()
+    }
+}
+
+impl<T> From<T> for Frozen<T> {
+    fn from(value: T) -> Self {
+        Self::new(value)
+    }
+}
+
+const UNCHECKED: u8 = 0;
+const VALID: u8 = 1;
+const INVALID: u8 = 2;
+
+/// A string that's checked to be valid UTF-8 the first time it's accessed as a `str`.
+///
+/// The result of the check is cached, along with the error of an invalid string, so the string is validated at
+/// most once. Comparing and hashing strings uses their bytes and never validates them.
+///
+/// # Examples
+///
+/// ```
+/// use protrust::lazy::LazyString;
+/// use protrust::io::CodedReader;
+/// use protrust::raw;
+///
+/// let data = [5, b'h', b'e', b'l', b'l', b'o', 2, 0xc3, 0x28];
+/// let mut reader = CodedReader::with_slice(&data);
+///
+/// let hello = reader.read_value::<raw::LazyString>()?;
+/// assert!(!hello.is_checked());
+/// assert_eq!(hello, "hello");
+/// assert_eq!(hello.as_str(), Ok("hello"));
+/// assert!(hello.is_checked());
+///
+/// let invalid = reader.read_value::<raw::LazyString>()?;
+/// assert_eq!(invalid.as_bytes(), &[0xc3, 0x28]);
+/// assert!(invalid.as_str().is_err());
+/// # Ok::<(), protrust::io::read::Error>(())
+/// ```
+pub struct LazyString {
+    bytes: Vec<u8>,
+    /// Whether the bytes are unchecked, valid or invalid
+    state: AtomicU8,
+    /// The error found checking invalid bytes, set before the state is invalid
+    error: OnceBox<Utf8Error>,
+}
+
+impl LazyString {
+    /// Creates a new empty string
+    pub fn new() -> Self {
+        Self::default()
+    }
+    /// Creates a string of the bytes, which are checked when the string is first accessed
+    pub fn from_bytes(bytes: Vec<u8>) -> Self {
+        let state = if bytes.is_empty() { VALID } else { UNCHECKED };
+        LazyString { bytes, state: AtomicU8::new(state), error: OnceBox::new() }
+    }
+    /// Returns whether the string has been checked to be valid UTF-8
+    pub fn is_checked(&self) -> bool {
+        self.state.load(Ordering::Relaxed) != UNCHECKED
+    }
+    /// Gets the bytes of the string
+    pub fn as_bytes(&self) -> &[u8] {
+        &self.bytes
+    }
+    /// Gets the length of the string in bytes
+    pub fn len(&self) -> usize {
+        self.bytes.len()
+    }
+    /// Returns whether the string is empty
+    pub fn is_empty(&self) -> bool {
+        self.bytes.is_empty()
+    }
+    /// Gets the string as a `str`, checking it's valid UTF-8 if it hasn't been checked yet
+    pub fn as_str(&self) -> Result<&str, Utf8Error> {
+        match self.state.load(Ordering::Acquire) {
+            VALID => Ok(unsafe { std::str::from_utf8_unchecked(&self.bytes) }),
+            INVALID => Err(*self.error.get().expect("invalid strings keep their error")),
+            _ => match io::utf8::as_str(&self.bytes) {
+                Ok(value) => {
+                    self.state.store(VALID, Ordering::Release);
+                    Ok(value)
+                }
+                Err(error) => {
+                    let error = *self.error.get_or_init(|| error);
+                    self.state.store(INVALID, Ordering::Release);
+                    Err(error)
+                }
+            },
+        }
+    }
+    /// Converts the string into its bytes
+    pub fn into_bytes(self) -> Vec<u8> {
+        self.bytes
+    }
+    /// Converts the string into a `String`, checking it's valid UTF-8 if it hasn't been checked yet
+    pub fn into_string(self) -> Result<String, FromUtf8Error> {
+        match self.state.load(Ordering::Relaxed) {
+            VALID => Ok(unsafe { String::from_utf8_unchecked(self.bytes) }),
+            _ => io::utf8::into_string(self.bytes),
+        }
+    }
+}
+
+impl Default for LazyString {
+    fn default() -> Self {
+        LazyString { bytes: Vec::new(), state: AtomicU8::new(VALID), error: OnceBox::new() }
+    }
+}
+
+impl Clone for LazyString {
+    fn clone(&self) -> Self {
+        let error = OnceBox::new();
+        let state = match self.state.load(Ordering::Acquire) {
+            INVALID => {
+                error.get_or_init(|| *self.error.get().expect("invalid strings keep their error"));
+                INVALID
+            }
+            state => state,
+        };
+        LazyString { bytes: self.bytes.clone(), state: AtomicU8::new(state), error }
+    }
+}
+
+impl PartialEq for LazyString {
+    fn eq(&self, other: &Self) -> bool {
+        self.bytes == other.bytes
+    }
+}
+
+impl Eq for LazyString { }
+
+impl PartialEq<str> for LazyString {
+    fn eq(&self, other: &str) -> bool {
+        self.bytes == other.as_bytes()
+    }
+}
+
+impl PartialEq<&str> for LazyString {
+    fn eq(&self, other: &&str) -> bool {
+        self.bytes == other.as_bytes()
+    }
+}
+
+impl Hash for LazyString {
+    fn hash<H: Hasher>(&self, state: &mut H) {
+        self.bytes.hash(state)
+    }
+}
+
+impl Debug for LazyString {
+    fn fmt(&self, f: &mut Formatter) -> fmt::Result {
+        match self.as_str() {
+            Ok(value) => Debug::fmt(value, f),
+            Err(_) => f.debug_tuple("LazyString").field(&self.bytes).finish(),
+        }
+    }
+}
+
+impl From<String> for LazyString {
+    fn from(value: String) -> Self {
+        LazyString { bytes: value.into_bytes(), state: AtomicU8::new(VALID), error: OnceBox::new() }
+    }
+}
+
+impl From<&str> for LazyString {
+    fn from(value: &str) -> Self {
+        Self::from(value.to_owned())
+    }
+}
+
+#[cfg(test)]
+mod test {
+    use crate::{Message, Mergable, UnknownFieldSet};
+    use crate::io::{read, write, reverse::ReverseWriter, CodedReader, CodedWriter, FieldNumber, Input, Length, LengthBuilder, Output};
+    use crate::raw::{self, Value};
+    use crate::test_support::Record;
+    use super::{Frozen, Lazy, LazyString};
+
+    // a record with an id of 5, a name of "abc" and the unknown field 3 with an overlong varint of 0
+    const INPUT: [u8; 12] = [11, 8, 5, 18, 3, b'a', b'b', b'c', 24, 128, 128, 0];
+
+    fn read(data: &[u8]) -> read::Result<Lazy<Record>> {
+        CodedReader::with_slice(data).read_value::<raw::LazyMessage<Record>>()
+    }
+
+    fn write(value: &Lazy<Record>) -> Vec<u8> {
+        let len = Length::of_value::<raw::LazyMessage<Record>>(value).unwrap().get() as usize;
+        let mut output = vec![0; len];
+        let mut writer = CodedWriter::with_slice(&mut output);
+        writer.write_value::<raw::LazyMessage<Record>>(value).unwrap();
+        assert!(writer.into_inner().is_empty());
+        output
+    }
+
+    #[test]
+    fn read_defers_parsing() {
+        let lazy = read(&INPUT).unwrap();
+
+        assert!(!lazy.is_parsed());
+        assert_eq!(lazy.as_bytes(), Some(&INPUT[1..]));
+    }
+
+    #[test]
+    fn untouched_writes_original_bytes() {
+        let lazy = read(&INPUT).unwrap();
+        assert_eq!(write(&lazy), INPUT);
+
+        let _ = lazy.get().unwrap();
+        assert!(lazy.is_parsed());
+        // the overlong varint would be shortened if the parsed message was written
+        assert_eq!(write(&lazy), INPUT);
+    }
+
+    #[test]
+    fn get_parses() {
+        let lazy = read(&INPUT).unwrap();
+        let body = lazy.get().unwrap();
+
+        assert_eq!(body.id, 5);
+        assert_eq!(body.name, "abc");
+        assert_eq!(body.unknown_fields.field_len(), 1);
+    }
+
+    #[test]
+    fn get_mut_writes_value() {
+        let mut lazy = read(&INPUT).unwrap();
+        lazy.get_mut().unwrap().id = 6;
+
+        assert!(lazy.as_bytes().is_none());
+        let written = write(&lazy);
+        assert_eq!(written, [9, 8, 6, 18, 3, b'a', b'b', b'c', 24, 0]);
+        assert_eq!(read(&written).unwrap().into_inner().unwrap().id, 6);
+    }
+
+    #[test]
+    fn reverse_write() {
+        let mut lazy = read(&INPUT).unwrap();
+        let mut writer = ReverseWriter::new();
+        writer.write_value::<raw::LazyMessage<Record>>(&lazy).unwrap();
+        assert_eq!(writer.as_bytes(), INPUT);
+
+        lazy.get_mut().unwrap().id = 6;
+        let mut writer = ReverseWriter::new();
+        writer.write_value::<raw::LazyMessage<Record>>(&lazy).unwrap();
+        assert_eq!(writer.as_bytes(), write(&lazy).as_slice());
+    }
+
+    #[test]
+    fn merge_from_appends() {
+        let mut input = CodedReader::with_slice(&[2, 8, 1, 2, 8, 2]);
+        let mut lazy = Lazy::<Record>::default();
+        input.merge_value::<raw::LazyMessage<Record>>(&mut lazy).unwrap();
+        let _ = lazy.get().unwrap();
+        input.merge_value::<raw::LazyMessage<Record>>(&mut lazy).unwrap();
+
+        assert_eq!(lazy.as_bytes(), Some(&[8, 1, 8, 2][..]));
+        assert_eq!(lazy.get().unwrap().id, 2);
+    }
+
+    #[test]
+    fn merge_from_modified_parses() {
+        let mut lazy = Lazy::new(Record { name: "a".to_string(), ..Record::default() });
+        CodedReader::with_slice(&[2, 8, 2]).merge_value::<raw::LazyMessage<Record>>(&mut lazy).unwrap();
+
+        assert!(lazy.as_bytes().is_none());
+        assert_eq!(lazy.get().unwrap().id, 2);
+        assert_eq!(lazy.get().unwrap().name, "a");
+    }
+
+    #[test]
+    fn malformed_fields_fail_read() {
+        assert!(read(&[2, 8, 128]).is_err());
+        assert!(read(&[3, 18, 5, 1]).is_err());
+        assert!(read(&[1, 0]).is_err());
+    }
+
+    #[test]
+    fn failed_merge_keeps_bytes() {
+        let mut lazy = read(&[2, 8, 1]).unwrap();
+        assert!(CodedReader::with_slice(&[2, 18, 5]).merge_value::<raw::LazyMessage<Record>>(&mut lazy).is_err());
+
+        assert_eq!(lazy.as_bytes(), Some(&[8, 1][..]));
+    }
+
+    #[test]
+    fn invalid_values_fail_access() {
+        let mut lazy = read(&[3, 18, 1, 0xff]).unwrap();
+
+        assert!(lazy.get().is_err());
+        assert!(!lazy.is_parsed());
+        assert!(lazy.get_mut().is_err());
+        assert_eq!(lazy.as_bytes(), Some(&[18, 1, 0xff][..]));
+        assert!(!raw::LazyMessage::<Record>::is_initialized(&lazy));
+    }
+
+    #[test]
+    fn merge() {
+        let mut unparsed = read(&[2, 8, 1]).unwrap();
+        unparsed.merge(&read(&[4, 18, 2, b'h', b'i']).unwrap());
+        assert_eq!(unparsed.as_bytes(), Some(&[8, 1, 18, 2, b'h', b'i'][..]));
+
+        unparsed.merge(&Lazy::new(Record { id: 3, ..Record::default() }));
+        assert_eq!(unparsed.as_bytes(), Some(&[8, 1, 18, 2, b'h', b'i', 8, 3][..]));
+
+        let mut modified = Lazy::new(Record { id: 4, ..Record::default() });
+        modified.merge(&read(&[4, 18, 2, b'h', b'i']).unwrap());
+        assert_eq!(modified.as_bytes(), Some(&[8, 4, 18, 2, b'h', b'i'][..]));
+
+        let mut modified = Lazy::new(Record { id: 4, ..Record::default() });
+        modified.merge(&Lazy::new(Record { name: "hi".to_string(), ..Record::default() }));
+        assert_eq!(modified.get().unwrap(), &Record { id: 4, name: "hi".to_string(), ..Record::default() });
+    }
+
+    #[test]
+    fn eq() {
+        assert_eq!(read(&INPUT).unwrap(), read(&INPUT).unwrap());
+        assert_eq!(read(&[2, 8, 1]).unwrap(), Lazy::new(Record { id: 1, ..Record::default() }));
+        assert_ne!(read(&[2, 8, 1]).unwrap(), read(&[2, 8, 2]).unwrap());
+    }
+
+    #[test]
+    fn strings_are_checked_on_access() {
+        let data = [2, b'h', b'i', 3, 0xe2, 0x82, 0xac];
+        let mut reader = CodedReader::with_slice(&data);
+        let value = reader.read_value::<raw::LazyString>().unwrap();
+        assert!(!value.is_checked());
+        assert_eq!(value, "hi");
+        assert!(!value.is_checked());
+        assert_eq!(value.as_str(), Ok("hi"));
+        assert!(value.is_checked());
+        assert_eq!(format!("{:?}", value), "\"hi\"");
+
+        let mut merged = value.clone();
+        assert!(merged.is_checked());
+        raw::LazyString::merge_from(&mut merged, &mut reader).unwrap();
+        assert!(!merged.is_checked());
+        assert_eq!(merged.into_string().unwrap(), "\u{20ac}");
+
+        assert!(LazyString::new().is_checked());
+        assert!(LazyString::from("hi").is_checked());
+        assert_eq!(LazyString::from("hi"), value);
+    }
+
+    #[test]
+    fn invalid_strings_round_trip() {
+        let data = [3, b'a', 0xc3, 0x28];
+        let value = CodedReader::with_slice(&data).read_value::<raw::LazyString>().unwrap();
+        assert_eq!(value.as_bytes(), &[b'a', 0xc3, 0x28]);
+        let error = value.as_str().unwrap_err();
+        assert_eq!(error.valid_up_to(), 1);
+        assert!(value.is_checked());
+        // the cached error is returned without checking the string again
+        assert_eq!(value.as_str(), Err(error));
+        assert_eq!(value.clone().as_str(), Err(error));
+        assert_eq!(format!("{:?}", value), "LazyString([97, 195, 40])");
+
+        let mut output = Vec::new();
+        CodedWriter::with_vec(&mut output).write_value::<raw::LazyString>(&value).unwrap();
+        assert_eq!(output, data);
+        assert_eq!(raw::LazyString::calculate_size(&value, LengthBuilder::new()).unwrap().build().get(), 4);
+        assert!(value.into_string().is_err());
+    }
+
+    #[test]
+    fn frozen_messages_are_encoded_once() {
+        let body = Frozen::new(Record { id: 1, name: "hi".to_string(), ..Record::default() });
+        let shared = body.clone();
+        assert!(Frozen::ptr_eq(&body, &shared));
+        assert!(!shared.is_encoded());
+
+        let num = FieldNumber::new(3).unwrap();
+        let len = LengthBuilder::new().add_field::<raw::FrozenMessage<Record>>(num, &body).unwrap().build();
+        assert!(shared.is_encoded());
+        assert_eq!(len.get(), 8);
+
+        let mut expected = Vec::new();
+        CodedWriter::with_vec(&mut expected).write_field::<raw::Message<Record>>(num, body.get()).unwrap();
+        let mut output = Vec::new();
+        CodedWriter::with_vec(&mut output).write_field::<raw::FrozenMessage<Record>>(num, &shared).unwrap();
+        assert_eq!(output, expected);
+
+        let mut reverse = ReverseWriter::new();
+        reverse.write_field::<raw::FrozenMessage<Record>>(num, &shared).unwrap();
+        assert_eq!(reverse.as_bytes(), expected.as_slice());
+
+        drop(shared);
+        assert_eq!(body.into_inner(), Record { id: 1, name: "hi".to_string(), ..Record::default() });
+    }
+
+    #[test]
+    fn frozen_messages_keep_read_bytes() {
+        let data = [4, 18, 2, b'h', b'i', 2, 8, 5];
+        let mut reader = CodedReader::with_slice(&data);
+        let mut body = reader.read_value::<raw::FrozenMessage<Record>>().unwrap();
+        assert!(body.is_encoded());
+        assert_eq!(body.encoded().unwrap(), &data[1..5]);
+        assert_eq!(body.get().name, "hi");
+
+        let shared = body.clone();
+        raw::FrozenMessage::<Record>::merge_from(&mut body, &mut reader).unwrap();
+        assert!(!body.is_encoded());
+        assert_eq!(body.get(), &Record { id: 5, name: "hi".to_string(), ..Record::default() });
+        assert_eq!(shared.get().id, 0);
+
+        assert!(CodedReader::with_slice(&[2, 8]).read_value::<raw::FrozenMessage<Record>>().is_err());
+    }
+
+    #[test]
+    fn encoded_fields() {
+        let num = FieldNumber::new(5).unwrap();
+        let body = Record { id: 2, ..Record::default() };
+        let encoded = body.to_bytes().unwrap();
+
+        let mut expected = Vec::new();
+        CodedWriter::with_vec(&mut expected).write_field::<raw::Message<Record>>(num, &body).unwrap();
+        let mut output = Vec::new();
+        CodedWriter::with_vec(&mut output).write_encoded_field(num, &encoded).unwrap();
+        assert_eq!(output, expected);
+
+        let mut reverse = ReverseWriter::new();
+        reverse.write_encoded_field(num, &encoded).unwrap();
+        assert_eq!(reverse.as_bytes(), expected.as_slice());
+
+        let len = LengthBuilder::new().add_encoded_field(num, &encoded).unwrap().build();
+        assert_eq!(len.get() as usize, expected.len());
+    }
+
+    /// A recursive message whose child is frozen or lazy, so every level is parsed by its own reader
+    #[derive(Default, Clone, Debug, PartialEq)]
+    struct Chain {
+        child: Option<Frozen<Chain>>,
+        lazy_child: Option<Lazy<Chain>>,
+        unknown_fields: UnknownFieldSet,
+    }
+
+    impl Chain {
+        const CHILD_NUMBER: FieldNumber = unsafe { FieldNumber::new_unchecked(1) };
+        const LAZY_CHILD_NUMBER: FieldNumber = unsafe { FieldNumber::new_unchecked(2) };
+    }
+
+    impl Message for Chain {
+        fn merge_from<T: Input>(&mut self, input: &mut CodedReader<T>) -> read::Result<()> {
+            while let Some(field) = input.read_field()? {
+                match field.tag() {
+                    10 => self.child = Some(field.read_value::<raw::FrozenMessage<Chain>>(Self::CHILD_NUMBER)?),
+                    18 => self.lazy_child = Some(field.read_value::<raw::LazyMessage<Chain>>(Self::LAZY_CHILD_NUMBER)?),
+                    _ => field.check_and_try_add_field_to(&mut self.unknown_fields)?.or_skip()?,
+                }
+            }
+            Ok(())
+        }
+        fn calculate_size(&self) -> Option<Length> {
+            let mut builder = LengthBuilder::new();
+            if let Some(child) = &self.child {
+                builder = builder.add_field::<raw::FrozenMessage<Chain>>(Self::CHILD_NUMBER, child)?;
+            }
+            if let Some(child) = &self.lazy_child {
+                builder = builder.add_field::<raw::LazyMessage<Chain>>(Self::LAZY_CHILD_NUMBER, child)?;
+            }
+            Some(builder.add_fields(&self.unknown_fields)?.build())
+        }
+        fn write_to<T: Output>(&self, output: &mut CodedWriter<T>) -> write::Result {
+            if let Some(child) = &self.child {
+                output.write_field::<raw::FrozenMessage<Chain>>(Self::CHILD_NUMBER, child)?;
+            }
+            if let Some(child) = &self.lazy_child {
+                output.write_field::<raw::LazyMessage<Chain>>(Self::LAZY_CHILD_NUMBER, child)?;
+            }
+            output.write_fields(&self.unknown_fields)
+        }
+        fn is_initialized(&self) -> bool {
+            true
+        }
+        fn unknown_fields(&self) -> &UnknownFieldSet {
+            &self.unknown_fields
+        }
+        fn unknown_fields_mut(&mut self) -> &mut UnknownFieldSet {
+            &mut self.unknown_fields
+        }
+    }
+
+    /// Encodes a chain of messages `depth` levels deep, nesting each in the specified field of the last
+    fn chain(depth: usize, num: FieldNumber) -> Vec<u8> {
+        let mut data = Vec::new();
+        for _ in 0..depth {
+            let mut outer = Vec::new();
+            CodedWriter::with_vec(&mut outer).write_encoded_field(num, &data).unwrap();
+            data = outer;
+        }
+        data
+    }
+
+    #[test]
+    fn frozen_messages_keep_recursion_limit() {
+        let limited = || read::Builder::new().recursion_limit(5);
+        let mut value = Chain::default();
+        value.merge_from(&mut limited().with_slice(&chain(5, Chain::CHILD_NUMBER))).unwrap();
+        assert_eq!(value.to_bytes().unwrap(), chain(5, Chain::CHILD_NUMBER));
+        assert!(value.child.unwrap().get().child.is_some());
+
+        let mut value = Chain::default();
+        assert!(matches!(value.merge_from(&mut limited().with_slice(&chain(6, Chain::CHILD_NUMBER))), Err(read::Error::RecursionLimitExceeded)));
+
+        // every frozen level counts toward the default limit, so deep input can't overflow the stack
+        let mut value = Chain::default();
+        assert!(matches!(value.merge_from(&mut CodedReader::with_slice(&chain(1000, Chain::CHILD_NUMBER))), Err(read::Error::RecursionLimitExceeded)));
+    }
+
+    #[test]
+    fn lazy_messages_keep_recursion_limit() {
+        // every level is parsed with what was left of the limit when its bytes were read
+        let parse_all = |depth| -> read::Result<()> {
+            let mut value = Chain::default();
+            value.merge_from(&mut read::Builder::new().recursion_limit(5).with_slice(&chain(depth, Chain::LAZY_CHILD_NUMBER)))?;
+            let mut child = value.lazy_child;
+            while let Some(lazy) = child {
+                child = lazy.into_inner()?.lazy_child;
+            }
+            Ok(())
+        };
+        assert!(parse_all(5).is_ok());
+        assert!(matches!(parse_all(6), Err(read::Error::RecursionLimitExceeded)));
+    }
+
+    #[test]
+    fn lazy_messages_keep_projection() {
+        // a lazy child with the unknown field 3 and a lazy child of its own
+        let mut child = chain(1, Chain::LAZY_CHILD_NUMBER);
+        child.extend_from_slice(&[24, 7]);
+        let mut data = Vec::new();
+        CodedWriter::with_vec(&mut data).write_encoded_field(Chain::LAZY_CHILD_NUMBER, &child).unwrap();
+
+        let projection = read::Projection::new()
+            .nested(Chain::LAZY_CHILD_NUMBER, read::Projection::new().field(Chain::LAZY_CHILD_NUMBER));
+        let mut value = Chain::default();
+        value.merge_from(&mut read::Builder::new().projection(Some(projection)).with_slice(&data)).unwrap();
+
+        // the child is parsed with its field's projection, but its bytes are kept in full
+        let lazy = value.lazy_child.as_ref().unwrap();
+        assert!(lazy.get().unwrap().unknown_fields.is_empty());
+        assert!(lazy.get().unwrap().lazy_child.is_some());
+        assert_eq!(value.to_bytes().unwrap(), data);
+    }
+}
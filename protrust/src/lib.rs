@@ -10,25 +10,114 @@
 #![feature(result_copied)]
 #![feature(read_initializer)]
 #![feature(hash_raw_entry)]
+#![feature(new_uninit)]
 
 #![warn(missing_docs)]
 
 #[cfg(not(any(target_pointer_width = "32", target_pointer_width = "64")))]
 compile_error!("This library does not support 16-bit platforms");
 
+/// Runs the statements only when the `metrics` feature is enabled, so counting costs nothing without it
+macro_rules! record {
+    ($($stmt:tt)*) => {
+        #[cfg(feature = "metrics")]
+        { $($stmt)* }
+    };
+}
+
 mod internal {
+    use std::marker::PhantomData;
+    use std::ptr;
+    use std::sync::atomic::{AtomicPtr, Ordering};
+
     pub trait Sealed { }
+
+    /// A box that can be set once through a shared reference, used to cache values that are computed lazily.
+    pub struct OnceBox<T> {
+        inner: AtomicPtr<T>,
+        _owned: PhantomData<*mut T>,
+    }
+
+    unsafe impl<T: Send> Send for OnceBox<T> { }
+    // values can be created through a shared reference and dropped by the owner, so they must be Send too
+    unsafe impl<T: Send + Sync> Sync for OnceBox<T> { }
+
+    impl<T> OnceBox<T> {
+        pub const fn new() -> Self {
+            OnceBox { inner: AtomicPtr::new(ptr::null_mut()), _owned: PhantomData }
+        }
+        pub fn get(&self) -> Option<&T> {
+            unsafe { self.inner.load(Ordering::Acquire).as_ref() }
+        }
+        pub fn get_mut(&mut self) -> Option<&mut T> {
+            unsafe { self.inner.get_mut().as_mut() }
+        }
+        pub fn get_or_init<F: FnOnce() -> T>(&self, f: F) -> &T {
+            match self.get_or_try_init(|| Ok::<_, ()>(f())) {
+                Ok(value) => value,
+                Err(()) => unreachable!(),
+            }
+        }
+        pub fn get_or_try_init<E, F: FnOnce() -> Result<T, E>>(&self, f: F) -> Result<&T, E> {
+            if let Some(value) = self.get() {
+                return Ok(value);
+            }
+
+            let new = Box::into_raw(Box::new(f()?));
+            match self.inner.compare_exchange(ptr::null_mut(), new, Ordering::AcqRel, Ordering::Acquire) {
+                Ok(_) => Ok(unsafe { &*new }),
+                Err(existing) => {
+                    // another thread set the value first
+                    drop(unsafe { Box::from_raw(new) });
+                    Ok(unsafe { &*existing })
+                }
+            }
+        }
+        pub fn set(&mut self, value: T) -> &mut T {
+            self.take();
+            let new = Box::into_raw(Box::new(value));
+            *self.inner.get_mut() = new;
+            unsafe { &mut *new }
+        }
+        pub fn take(&mut self) -> Option<T> {
+            let current = std::mem::replace(self.inner.get_mut(), ptr::null_mut());
+            if current.is_null() {
+                None
+            } else {
+                Some(*unsafe { Box::from_raw(current) })
+            }
+        }
+    }
+
+    impl<T> Default for OnceBox<T> {
+        fn default() -> Self {
+            Self::new()
+        }
+    }
+
+    impl<T> Drop for OnceBox<T> {
+        fn drop(&mut self) {
+            self.take();
+        }
+    }
 }
 
 #[cfg(doctest)]
 pub mod doctest;
 
+pub mod arena;
 pub mod collections;
 pub mod extend;
 pub mod io;
+pub mod lazy;
+pub mod pool;
 pub mod raw;
+pub mod table;
+
+#[cfg(test)]
+mod test_support;
 
-use crate::io::{read, write, Length, CodedReader, CodedWriter, Input, Output};
+use crate::io::{read, write, reverse::ReverseWriter, Length, CodedReader, CodedWriter, Input, Output};
 use std::fmt::Debug;
 use std::hash::Hash;
 
@@ -96,6 +185,21 @@ pub trait Message: Default + Clone + PartialEq + Debug + Sized {
     /// assert_eq!(timestamp.nanos(), &100);
     /// ```
     fn merge_from<T: Input>(&mut self, input: &mut CodedReader<T>) -> read::Result<()>;
+    /// Clears this message, resetting every field to its default value.
+    /// 
+    /// Implementations should keep any capacity the message has already allocated, clearing repeated fields,
+    /// map fields, strings, bytes, and unknown fields in place, so a cleared message can be reused to read
+    /// another message of the same shape without reallocating. By default this replaces the message
+    /// with a new default instance.
+    fn clear(&mut self) {
+        *self = Self::default();
+    }
+    /// Clears this message and merges it with data from the [`CodedReader`](io/read/struct.CodedReader.html),
+    /// reusing the message's existing capacity.
+    fn clear_and_merge_from<T: Input>(&mut self, input: &mut CodedReader<T>) -> read::Result<()> {
+        self.clear();
+        self.merge_from(input)
+    }
     /// Calculates the size of this message, returning None if the size overflows an `i32`.
     /// 
     /// # Examples
@@ -111,8 +215,31 @@ pub trait Message: Default + Clone + PartialEq + Debug + Sized {
     /// assert_eq!(timestamp.calculate_size(), Length::new(2));
     /// ```
     fn calculate_size(&self) -> Option<Length>;
+    /// Calculates the size of this message and caches it so it can be retrieved later
+    /// with [`cached_size`](#method.cached_size), returning None if the size overflows an `i32`.
+    ///
+    /// Nested messages are sized through this method when their containing message is sized,
+    /// so a single top-down call to `calculate_size` caches the sizes of the entire message tree.
+    ///
+    /// Messages that don't keep a [`CachedSize`](io/struct.CachedSize.html) can rely on the default
+    /// implementation, which doesn't cache anything.
+    fn compute_and_cache_size(&self) -> Option<Length> {
+        self.calculate_size()
+    }
+    /// Gets the size cached by the last call to [`compute_and_cache_size`](#method.compute_and_cache_size).
+    ///
+    /// If the message was modified after its size was cached, the cached size is stale and
+    /// should not be used to write the message.
+    ///
+    /// The default implementation calculates the size of the message again.
+    fn cached_size(&self) -> Option<Length> {
+        self.calculate_size()
+    }
     /// Writes this message's data to the [`CodedWriter`](io/write/struct.CodedWriter.html).
-    /// 
+    ///
+    /// Nested messages are written using the sizes cached by the last call to `calculate_size`,
+    /// so the message must not be modified between calculating its size and writing it.
+    ///
     /// # Examples
     /// 
     /// ```ignore
@@ -132,8 +259,48 @@ pub trait Message: Default + Clone + PartialEq + Debug + Sized {
     /// timestamp.write_to(&mut writer).expect("size is calculated ahead of time");
     /// ```
     fn write_to<T: Output>(&self, output: &mut CodedWriter<T>) -> write::Result;
+    /// Appends this message's data to the `Vec`.
+    ///
+    /// The message's size is calculated first, so the `Vec` grows at most once before the message is written.
+    /// If the message can't be written, the `Vec` is left as it was.
+    fn write_to_vec(&self, output: &mut Vec<u8>) -> write::Result {
+        let len = self.compute_and_cache_size().ok_or(write::Error::ValueTooLarge)?;
+        let start = output.len();
+        output.reserve_exact(len.get() as usize);
+        let result = self.write_to(&mut CodedWriter::with_vec(output));
+        if result.is_err() {
+            output.truncate(start);
+        }
+        result
+    }
+    /// Writes this message's data to a new `Vec`, allocating it once with the size of the message.
+    fn to_bytes(&self) -> Result<Vec<u8>, write::Error> {
+        let mut output = Vec::new();
+        self.write_to_vec(&mut output)?;
+        Ok(output)
+    }
+    /// Writes this message's data back to front to the [`ReverseWriter`](io/reverse/struct.ReverseWriter.html),
+    /// without calculating the size of this message or any message nested in it.
+    ///
+    /// Implementations write their fields in the opposite order of `write_to`, starting with the unknown fields.
+    /// The default implementation calculates the size of the message and writes it forward.
+    fn write_reverse(&self, output: &mut ReverseWriter) -> write::Result {
+        let len = self.compute_and_cache_size().ok_or(write::Error::ValueTooLarge)?;
+        output.write_forward(len, |output| self.write_to(output))
+    }
     /// Returns whether the message value is initialized.
     fn is_initialized(&self) -> bool;
+    /// Returns whether the required fields of this message are set, without checking any message nested in it,
+    /// or `None` if the message doesn't check its own fields.
+    ///
+    /// Readers that [check messages are initialized](io/read/struct.Builder.html#method.check_initialized) call this
+    /// on every message as soon as it's read, so each message in the tree is only checked once. Messages with
+    /// required fields should check their own presence here. The default implementation returns `None`, and
+    /// the outermost message read is then checked once with [`is_initialized`](#tymethod.is_initialized)
+    /// after it's read in full.
+    fn required_fields_set(&self) -> Option<bool> {
+        None
+    }
 
     /// Gets a shared reference to the unknown fields in this message.
     /// 
@@ -187,6 +354,16 @@ pub trait Message: Default + Clone + PartialEq + Debug + Sized {
     fn unknown_fields_mut(&mut self) -> &mut UnknownFieldSet;
 }
 
+/// A message that can borrow length delimited data from a slice input, allowing strings and bytes
+/// in the message to reference the input instead of being copied out of it.
+/// 
+/// Implementations merge fields with [`FieldReader::merge_borrowed_value`](io/read/struct.FieldReader.html#method.merge_borrowed_value)
+/// where a field can borrow, and with the normal [`Message`](trait.Message.html) functions everywhere else.
+pub trait BorrowedMessage<'a>: Message {
+    /// Merges this message with data from the [`CodedReader`](io/read/struct.CodedReader.html) over the borrowed slice.
+    fn merge_from_slice<A: read::SliceArena<'a>>(&mut self, input: &mut CodedReader<read::Slice<'a, A>>) -> read::Result<()>;
+}
+
 /// A marker trait used to mark enum types in generated code.
 /// This defines all the main traits the enum types implement,
 /// allowing code to refer to them easily.
@@ -0,0 +1,395 @@
+//! Defines a pool of reusable messages and the pool of stream buffers kept by each thread.
+//!
+//! Messages returned to a [`Pool`] are [cleared](../trait.Message.html#method.clear) instead of dropped, so reading
+//! another message of the same shape into a pooled instance reuses the capacity allocated by the last one.
+//!
+//! Pools are not thread safe. Use a pool per thread, such as a pool in a `thread_local!`, to
+//! share messages between parses on that thread.
+//!
+//! Readers and writers created with `with_pooled_stream` take their buffer from the pool of the thread that creates
+//! them and return it to the pool of the thread that drops them, so short lived streams don't allocate a new buffer
+//! each time. Each thread keeps up to 8 buffers of each kind. Read buffers still shared by byte strings taken from
+//! them aren't returned.
+//!
+//! # Examples
+//!
+//! ```ignore
+//! # use protrust::doctest::timestamp::Timestamp;
+//! use protrust::io::CodedReader;
+//! use protrust::pool::Pool;
+//!
+//! let pool = Pool::<Timestamp>::new();
+//! for _ in 0..3 {
+//!     let mut reader = CodedReader::with_slice(&[8, 1]);
+//!     let message = pool.read_from(&mut reader)?;
+//!     assert_eq!(message.seconds(), &1);
+//! }
+//! assert_eq!(pool.len(), 1);
+//! # Ok::<(), protrust::io::read::Error>(())
+//! ```
+//!
+//! [`Pool`]: struct.Pool.html
+
+use crate::Message;
+use crate::io::{read, CodedReader, Input};
+use std::cell::RefCell;
+use std::fmt::{self, Debug, Formatter};
+use std::mem::{ManuallyDrop, MaybeUninit};
+use std::ops::{Deref, DerefMut};
+use std::ptr;
+use std::sync::Arc;
+
+const DEFAULT_MAX_LEN: usize = 16;
+
+/// The most buffers of each kind a thread's buffer pool keeps
+const MAX_BUFFERS: usize = 8;
+
+thread_local! {
+    static READ_BUFFERS: RefCell<Vec<ReadBuffer>> = RefCell::new(Vec::new());
+    static WRITE_BUFFERS: RefCell<Vec<Box<[MaybeUninit<u8>]>>> = RefCell::new(Vec::new());
+}
+
+/// A read buffer and whether every byte of it has been initialized.
+/// New buffers are allocated uninitialized and only zeroed if an input that might read them needs them to be.
+pub(crate) struct ReadBuffer {
+    pub chunk: Arc<[u8]>,
+    pub initialized: bool,
+}
+
+impl ReadBuffer {
+    /// Allocates a new uninitialized read buffer
+    pub fn new(len: usize) -> Self {
+        Self { chunk: unsafe { Arc::<[u8]>::new_uninit_slice(len).assume_init() }, initialized: false }
+    }
+}
+
+impl AsRef<[u8]> for ReadBuffer {
+    fn as_ref(&self) -> &[u8] {
+        &self.chunk
+    }
+}
+
+/// Allocates a new uninitialized write buffer
+pub(crate) fn new_write_buffer(len: usize) -> Box<[MaybeUninit<u8>]> {
+    Box::new_uninit_slice(len)
+}
+
+/// Takes a buffer at least `len` elements long out of the pool, allocating one with `new` if there isn't one
+fn take_buffer<E, T: AsRef<[E]>, F: FnOnce(usize) -> T>(pool: &RefCell<Vec<T>>, len: usize, new: F) -> T {
+    let mut pool = pool.borrow_mut();
+    match pool.iter().position(|b| b.as_ref().len() >= len) {
+        Some(i) => pool.swap_remove(i),
+        None => new(len),
+    }
+}
+
+fn put_buffer<T>(pool: &RefCell<Vec<T>>, buf: T) {
+    let mut pool = pool.borrow_mut();
+    if pool.len() < MAX_BUFFERS {
+        pool.push(buf);
+    }
+}
+
+/// Takes a read buffer from this thread's pool. The buffer is unique, but may contain data read into it before.
+pub(crate) fn take_read_buffer(len: usize) -> ReadBuffer {
+    READ_BUFFERS
+        .try_with(|pool| take_buffer(pool, len, ReadBuffer::new))
+        .unwrap_or_else(|_| ReadBuffer::new(len))
+}
+
+/// Returns a read buffer to this thread's pool if nothing else shares it
+pub(crate) fn put_read_buffer(mut buf: ReadBuffer) {
+    if Arc::get_mut(&mut buf.chunk).is_some() {
+        // the pool is gone if the thread is exiting, so the buffer is just dropped
+        let _ = READ_BUFFERS.try_with(|pool| put_buffer(pool, buf));
+    }
+}
+
+/// Takes a write buffer from this thread's pool. The buffer may hold data from a previous writer,
+/// and is only ever read where it's been written.
+pub(crate) fn take_write_buffer(len: usize) -> Box<[MaybeUninit<u8>]> {
+    WRITE_BUFFERS
+        .try_with(|pool| take_buffer(pool, len, new_write_buffer))
+        .unwrap_or_else(|_| new_write_buffer(len))
+}
+
+/// Returns a write buffer to this thread's pool
+pub(crate) fn put_write_buffer(buf: Box<[MaybeUninit<u8>]>) {
+    let _ = WRITE_BUFFERS.try_with(|pool| put_buffer(pool, buf));
+}
+
+/// Gets the number of unused stream buffers in this thread's pool
+pub fn pooled_buffers() -> usize {
+    let read = READ_BUFFERS.try_with(|pool| pool.borrow().len()).unwrap_or(0);
+    let write = WRITE_BUFFERS.try_with(|pool| pool.borrow().len()).unwrap_or(0);
+    read + write
+}
+
+/// Gets the lengths of the unused read buffers in this thread's pool
+#[cfg(test)]
+pub(crate) fn read_buffer_lens() -> Vec<usize> {
+    READ_BUFFERS.with(|pool| pool.borrow().iter().map(|b| b.chunk.len()).collect())
+}
+
+/// Drops every unused stream buffer in this thread's pool
+pub fn clear_buffers() {
+    let _ = READ_BUFFERS.try_with(|pool| pool.borrow_mut().clear());
+    let _ = WRITE_BUFFERS.try_with(|pool| pool.borrow_mut().clear());
+}
+
+/// A pool of reusable messages of one type.
+pub struct Pool<T> {
+    free: RefCell<Vec<Box<T>>>,
+    max_len: usize,
+}
+
+impl<T: Message> Pool<T> {
+    /// Creates a new empty pool that keeps up to 16 unused messages
+    pub fn new() -> Self {
+        Self::with_max_len(DEFAULT_MAX_LEN)
+    }
+    /// Creates a new empty pool that keeps up to the specified number of unused messages.
+    /// Messages returned to a full pool are dropped.
+    pub fn with_max_len(max_len: usize) -> Self {
+        Self { free: RefCell::new(Vec::new()), max_len }
+    }
+    /// Gets the number of unused messages in the pool
+    pub fn len(&self) -> usize {
+        self.free.borrow().len()
+    }
+    /// Returns whether the pool has no unused messages
+    pub fn is_empty(&self) -> bool {
+        self.free.borrow().is_empty()
+    }
+    /// Gets a cleared message from the pool, or a new default message if the pool is empty.
+    /// The message is returned to the pool when the guard is dropped.
+    pub fn get(&self) -> Pooled<T> {
+        let value = self.free.borrow_mut().pop().unwrap_or_default();
+        Pooled { value: ManuallyDrop::new(value), pool: self }
+    }
+    /// Gets a cleared message from the pool and merges it with data from the reader
+    pub fn read_from<I: Input>(&self, input: &mut CodedReader<I>) -> read::Result<Pooled<T>> {
+        let mut value = self.get();
+        value.merge_from(input)?;
+        Ok(value)
+    }
+    /// Clears the message and adds it to the pool if the pool isn't full
+    pub fn put(&self, mut value: Box<T>) {
+        let mut free = self.free.borrow_mut();
+        if free.len() < self.max_len {
+            value.clear();
+            free.push(value);
+        }
+    }
+}
+
+impl<T: Message> Default for Pool<T> {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+impl<T> Debug for Pool<T> {
+    fn fmt(&self, f: &mut Formatter) -> fmt::Result {
+        f.debug_struct("Pool")
+            .field("len", &self.free.borrow().len())
+            .field("max_len", &self.max_len)
+            .finish()
+    }
+}
+
+/// A message borrowed from a [`Pool`](struct.Pool.html). The message is cleared and returned to the pool when this is dropped.
+pub struct Pooled<'a, T: Message> {
+    value: ManuallyDrop<Box<T>>,
+    pool: &'a Pool<T>,
+}
+
+impl<T: Message> Pooled<'_, T> {
+    /// Takes the message out of the pool, preventing it from being returned
+    pub fn into_inner(self) -> Box<T> {
+        let this = ManuallyDrop::new(self);
+        unsafe { ptr::read(&*this.value) }
+    }
+}
+
+impl<T: Message> Drop for Pooled<'_, T> {
+    fn drop(&mut self) {
+        let value = unsafe { ptr::read(&*self.value) };
+        self.pool.put(value);
+    }
+}
+
+impl<T: Message> Deref for Pooled<'_, T> {
+    type Target = T;
+
+    fn deref(&self) -> &T {
+        &self.value
+    }
+}
+
+impl<T: Message> DerefMut for Pooled<'_, T> {
+    fn deref_mut(&mut self) -> &mut T {
+        &mut self.value
+    }
+}
+
+impl<T: Message> Debug for Pooled<'_, T> {
+    fn fmt(&self, f: &mut Formatter) -> fmt::Result {
+        T::fmt(self, f)
+    }
+}
+
+#[cfg(test)]
+mod test {
+    use crate::{Message, UnknownFieldSet};
+    use crate::collections::RepeatedField;
+    use crate::io::{read, write, CodedReader, CodedWriter, FieldNumber, Input, Length, LengthBuilder, Output};
+    use crate::raw;
+    use crate::io::SharedBytes;
+    use super::{clear_buffers, pooled_buffers, Pool};
+
+    #[derive(Default, Clone, Debug, PartialEq)]
+    struct Batch {
+        name: String,
+        values: RepeatedField<i32>,
+        unknown_fields: UnknownFieldSet,
+    }
+
+    impl Batch {
+        const NAME_NUMBER: FieldNumber = unsafe { FieldNumber::new_unchecked(1) };
+        const VALUES_NUMBER: FieldNumber = unsafe { FieldNumber::new_unchecked(2) };
+    }
+
+    impl Message for Batch {
+        fn merge_from<T: Input>(&mut self, input: &mut CodedReader<T>) -> read::Result<()> {
+            while let Some(field) = input.read_field()? {
+                match field.tag() {
+                    10 => field.merge_value::<raw::String>(Self::NAME_NUMBER, &mut self.name)?,
+                    16 => field.add_entries_to::<_, raw::Int32>(Self::VALUES_NUMBER, &mut self.values)?,
+                    _ => field.check_and_try_add_field_to(&mut self.unknown_fields)?.or_skip()?,
+                }
+            }
+            Ok(())
+        }
+        fn clear(&mut self) {
+            self.name.clear();
+            self.values.clear();
+            self.unknown_fields.clear();
+        }
+        fn calculate_size(&self) -> Option<Length> {
+            LengthBuilder::new()
+                .add_field::<raw::String>(Self::NAME_NUMBER, &self.name)?
+                .add_values::<_, raw::Int32>(&self.values, Self::VALUES_NUMBER)?
+                .add_fields(&self.unknown_fields)
+                .map(LengthBuilder::build)
+        }
+        fn write_to<T: Output>(&self, output: &mut CodedWriter<T>) -> write::Result {
+            output.write_field::<raw::String>(Self::NAME_NUMBER, &self.name)?;
+            output.write_values::<_, raw::Int32>(&self.values, Self::VALUES_NUMBER)?;
+            output.write_fields(&self.unknown_fields)
+        }
+        fn is_initialized(&self) -> bool {
+            true
+        }
+        fn unknown_fields(&self) -> &UnknownFieldSet {
+            &self.unknown_fields
+        }
+        fn unknown_fields_mut(&mut self) -> &mut UnknownFieldSet {
+            &mut self.unknown_fields
+        }
+    }
+
+    const INPUT: [u8; 9] = [10, 1, b'a', 16, 1, 16, 2, 16, 3];
+
+    #[test]
+    fn clear_and_merge_keeps_capacity() {
+        let mut batch = Batch::default();
+        batch.merge_from(&mut CodedReader::with_slice(&INPUT)).unwrap();
+        let (values, name) = (batch.values.as_ptr(), batch.name.as_ptr());
+
+        let mut input = INPUT;
+        input[2] = b'b';
+        batch.clear_and_merge_from(&mut CodedReader::with_slice(&input)).unwrap();
+
+        assert_eq!(batch.name, "b");
+        assert_eq!(batch.values, [1, 2, 3]);
+        assert_eq!(batch.values.as_ptr(), values);
+        assert_eq!(batch.name.as_ptr(), name);
+    }
+
+    #[test]
+    fn pool_reuses_messages() {
+        let pool = Pool::<Batch>::new();
+        let first = pool.read_from(&mut CodedReader::with_slice(&INPUT)).unwrap();
+        let values = first.values.as_ptr();
+        assert_eq!(first.values, [1, 2, 3]);
+        drop(first);
+        assert_eq!(pool.len(), 1);
+
+        let second = pool.get();
+        assert_eq!(*second, Batch::default());
+        assert_eq!(second.values.as_ptr(), values);
+        assert!(pool.is_empty());
+    }
+
+    #[test]
+    fn full_pool_drops_messages() {
+        let pool = Pool::<Batch>::with_max_len(1);
+        let first = pool.get();
+        let second = pool.get();
+        drop(first);
+        drop(second);
+        assert_eq!(pool.len(), 1);
+    }
+
+    #[test]
+    fn into_inner_detaches() {
+        let pool = Pool::<Batch>::new();
+        let message = pool.read_from(&mut CodedReader::with_slice(&INPUT)).unwrap().into_inner();
+        assert_eq!(message.name, "a");
+        assert!(pool.is_empty());
+    }
+
+    #[test]
+    fn streams_reuse_buffers() {
+        clear_buffers();
+        let mut batch = Batch::default();
+        for _ in 0..2 {
+            let mut reader = CodedReader::with_pooled_stream(&INPUT[..]);
+            assert_eq!(pooled_buffers(), 0);
+            batch.clear_and_merge_from(&mut reader).unwrap();
+            drop(reader);
+            assert_eq!(pooled_buffers(), 1);
+        }
+
+        let mut output = Vec::new();
+        let mut writer = CodedWriter::with_pooled_stream(&mut output);
+        batch.write_to(&mut writer).unwrap();
+        writer.flush().unwrap();
+        drop(writer);
+        assert_eq!(output, INPUT);
+        assert_eq!(pooled_buffers(), 2);
+
+        // the write buffer is taken again, but not the read buffer
+        let mut writer = CodedWriter::with_pooled_stream(Vec::new());
+        assert_eq!(pooled_buffers(), 1);
+        batch.write_to(&mut writer).unwrap();
+        writer.flush().unwrap();
+        assert_eq!(writer.into_inner(), INPUT);
+        assert_eq!(pooled_buffers(), 2);
+
+        clear_buffers();
+        assert_eq!(pooled_buffers(), 0);
+    }
+
+    #[test]
+    fn shared_buffers_are_not_pooled() {
+        clear_buffers();
+        let data = [3, 1, 2, 3];
+        let mut reader = CodedReader::with_pooled_stream(&data[..]);
+        let bytes = reader.read_length_delimited::<SharedBytes>().unwrap();
+        drop(reader);
+        assert_eq!(pooled_buffers(), 0);
+        assert_eq!(bytes.as_ref(), &[1, 2, 3]);
+    }
+}
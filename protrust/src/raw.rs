@@ -1,8 +1,11 @@
 //! Contains types for protobuf values and traits for value operations.
 
-use crate::{internal::Sealed, Message as TraitMessage};
+use crate::{internal::Sealed, Message as TraitMessage, BorrowedMessage};
+use crate::arena::{Arena, ArenaBox, ArenaBytes};
 use crate::extend::ExtendableMessage;
-use crate::io::{self, read, write, WireType, ByteString, Length, LengthBuilder, CodedReader, CodedWriter, Input, Output};
+use crate::lazy::{self, Frozen, Lazy};
+use crate::io::{self, read, write, reverse::ReverseWriter, WireType, ByteString, Length, LengthBuilder, CodedReader, CodedWriter, Input, Output};
+use std::borrow::Cow;
 use std::convert::TryInto;
 
 /// A protobuf value type paired with a Rust type used to represent that type in generated code.
@@ -21,18 +24,39 @@ pub trait Value: ValueType {
     /// Calculates the size of the value as encoded on the wire
     fn calculate_size(this: &Self::Inner, builder: LengthBuilder) -> Option<LengthBuilder>;
 
+    /// Gets the size of the value as encoded on the wire, using any sizes cached by a previous call to
+    /// [`calculate_size`](#tymethod.calculate_size). By default this calculates the size again.
+    fn cached_size(this: &Self::Inner, builder: LengthBuilder) -> Option<LengthBuilder> {
+        Self::calculate_size(this, builder)
+    }
+
     /// Merges the value with the [`CodedReader`](../io/read/struct.CodedReader.html)
     fn merge_from<T: Input>(this: &mut Self::Inner, input: &mut CodedReader<T>) -> read::Result<()>;
 
     /// Writes the value to the [`CodedWriter`](../io/write/struct.CodedWriter.html)
     fn write_to<T: Output>(this: &Self::Inner, output: &mut CodedWriter<T>) -> write::Result;
 
+    /// Writes the value back to front to the [`ReverseWriter`](../io/reverse/struct.ReverseWriter.html)
+    fn write_reverse(this: &Self::Inner, output: &mut ReverseWriter) -> write::Result;
+
     /// Returns whether the value is initialized, that is, if all the required fields in the value are set.
     fn is_initialized(this: &Self::Inner) -> bool;
 
     /// Reads a new instance of the value
     fn read_new<T: Input>(input: &mut CodedReader<T>) -> read::Result<Self::Inner>;
 }
+/// A value that can borrow length delimited data from the input of a [`CodedReader`](../io/read/struct.CodedReader.html)
+/// reading from a slice instead of copying it.
+pub trait BorrowedValue<'a>: Value {
+    /// Reads a new instance of the value, borrowing data from the input slice
+    fn read_borrowed<A: read::SliceArena<'a>>(input: &mut CodedReader<read::Slice<'a, A>>) -> read::Result<Self::Inner>;
+
+    /// Merges the value with the input, borrowing data from the input slice. By default this replaces the value
+    /// with a new instance read with [`read_borrowed`](#tymethod.read_borrowed).
+    fn merge_borrowed<A: read::SliceArena<'a>>(this: &mut Self::Inner, input: &mut CodedReader<read::Slice<'a, A>>) -> read::Result<()> {
+        Self::read_borrowed(input).map(|v| *this = v)
+    }
+}
 /// A value with a constant size. This can be specialized over to enable certain optimizations with size caculations.
 pub trait ConstSized: Value {
     /// The constant size of the value
@@ -87,6 +111,13 @@ impl Value for Int32 {
             output.write_varint64(i64::from(this) as u64)
         }
     }
+    fn write_reverse(&this: &Self::Inner, output: &mut ReverseWriter) -> write::Result {
+        if this >= 0 {
+            output.write_varint32(this as u32)
+        } else {
+            output.write_varint64(i64::from(this) as u64)
+        }
+    }
     fn is_initialized(_this: &Self::Inner) -> bool { true }
     fn read_new<T: Input>(input: &mut CodedReader<T>) -> read::Result<Self::Inner> {
         input.read_varint32().map(|v| v as i32)
@@ -111,6 +142,9 @@ impl Value for Uint32 {
     fn write_to<T: Output>(&this: &Self::Inner, output: &mut CodedWriter<T>) -> write::Result {
         output.write_varint32(this)
     }
+    fn write_reverse(&this: &Self::Inner, output: &mut ReverseWriter) -> write::Result {
+        output.write_varint32(this)
+    }
     fn is_initialized(_this: &Self::Inner) -> bool { true }
     fn read_new<T: Input>(input: &mut CodedReader<T>) -> read::Result<Self::Inner> {
         input.read_varint32()
@@ -135,6 +169,9 @@ impl Value for Int64 {
     fn write_to<T: Output>(&this: &Self::Inner, output: &mut CodedWriter<T>) -> write::Result {
         output.write_varint64(this as u64)
     }
+    fn write_reverse(&this: &Self::Inner, output: &mut ReverseWriter) -> write::Result {
+        output.write_varint64(this as u64)
+    }
     fn is_initialized(_this: &Self::Inner) -> bool { true }
     fn read_new<T: Input>(input: &mut CodedReader<T>) -> read::Result<Self::Inner> {
         input.read_varint64().map(|v| v as i64)
@@ -159,6 +196,9 @@ impl Value for Uint64 {
     fn write_to<T: Output>(&this: &Self::Inner, output: &mut CodedWriter<T>) -> write::Result {
         output.write_varint64(this)
     }
+    fn write_reverse(&this: &Self::Inner, output: &mut ReverseWriter) -> write::Result {
+        output.write_varint64(this)
+    }
     fn is_initialized(_this: &Self::Inner) -> bool { true }
     fn read_new<T: Input>(input: &mut CodedReader<T>) -> read::Result<Self::Inner> {
         input.read_varint64()
@@ -184,9 +224,12 @@ impl Value for Sint32 {
     fn write_to<T: Output>(&this: &Self::Inner, output: &mut CodedWriter<T>) -> write::Result {
         output.write_varint32(((this << 1) ^ (this >> 31)) as u32)
     }
+    fn write_reverse(&this: &Self::Inner, output: &mut ReverseWriter) -> write::Result {
+        output.write_varint32(((this << 1) ^ (this >> 31)) as u32)
+    }
     fn is_initialized(_this: &Self::Inner) -> bool { true }
     fn read_new<T: Input>(input: &mut CodedReader<T>) -> read::Result<Self::Inner> {
-        input.read_varint32().map(|v| ((v >> 1) ^ (v << 31)) as i32)
+        input.read_varint32().map(|v| (v >> 1) as i32 ^ -((v & 1) as i32))
     }
 }
 
@@ -209,9 +252,12 @@ impl Value for Sint64 {
     fn write_to<T: Output>(&this: &Self::Inner, output: &mut CodedWriter<T>) -> write::Result {
         output.write_varint64(((this << 1) ^ (this >> 63)) as u64)
     }
+    fn write_reverse(&this: &Self::Inner, output: &mut ReverseWriter) -> write::Result {
+        output.write_varint64(((this << 1) ^ (this >> 63)) as u64)
+    }
     fn is_initialized(_this: &Self::Inner) -> bool { true }
     fn read_new<T: Input>(input: &mut CodedReader<T>) -> read::Result<Self::Inner> {
-        input.read_varint64().map(|v| ((v >> 1) ^ (v << 63)) as i64)
+        input.read_varint64().map(|v| (v >> 1) as i64 ^ -((v & 1) as i64))
     }
 }
 
@@ -233,6 +279,9 @@ impl Value for Fixed32 {
     fn write_to<T: Output>(&this: &Self::Inner, output: &mut CodedWriter<T>) -> write::Result {
         output.write_bit32(this)
     }
+    fn write_reverse(&this: &Self::Inner, output: &mut ReverseWriter) -> write::Result {
+        output.write_bit32(this)
+    }
     fn is_initialized(_this: &Self::Inner) -> bool { true }
     fn read_new<T: Input>(input: &mut CodedReader<T>) -> read::Result<Self::Inner> {
         input.read_bit32()
@@ -260,6 +309,9 @@ impl Value for Fixed64 {
     fn write_to<T: Output>(&this: &Self::Inner, output: &mut CodedWriter<T>) -> write::Result {
         output.write_bit64(this)
     }
+    fn write_reverse(&this: &Self::Inner, output: &mut ReverseWriter) -> write::Result {
+        output.write_bit64(this)
+    }
     fn is_initialized(_this: &Self::Inner) -> bool { true }
     fn read_new<T: Input>(input: &mut CodedReader<T>) -> read::Result<Self::Inner> {
         input.read_bit64()
@@ -287,6 +339,9 @@ impl Value for Sfixed32 {
     fn write_to<T: Output>(&this: &Self::Inner, output: &mut CodedWriter<T>) -> write::Result {
         output.write_bit32(this as u32)
     }
+    fn write_reverse(&this: &Self::Inner, output: &mut ReverseWriter) -> write::Result {
+        output.write_bit32(this as u32)
+    }
     fn is_initialized(_this: &Self::Inner) -> bool { true }
     fn read_new<T: Input>(input: &mut CodedReader<T>) -> read::Result<Self::Inner> {
         input.read_bit32().map(|v| v as i32)
@@ -314,6 +369,9 @@ impl Value for Sfixed64 {
     fn write_to<T: Output>(&this: &Self::Inner, output: &mut CodedWriter<T>) -> write::Result {
         output.write_bit64(this as u64)
     }
+    fn write_reverse(&this: &Self::Inner, output: &mut ReverseWriter) -> write::Result {
+        output.write_bit64(this as u64)
+    }
     fn is_initialized(_this: &Self::Inner) -> bool { true }
     fn read_new<T: Input>(input: &mut CodedReader<T>) -> read::Result<Self::Inner> {
         input.read_bit64().map(|v| v as i64)
@@ -341,6 +399,9 @@ impl Value for Bool {
     fn write_to<T: Output>(&this: &Self::Inner, output: &mut CodedWriter<T>) -> write::Result {
         output.write_varint32(this as u32)
     }
+    fn write_reverse(&this: &Self::Inner, output: &mut ReverseWriter) -> write::Result {
+        output.write_varint32(this as u32)
+    }
     fn is_initialized(_this: &Self::Inner) -> bool { true }
     fn read_new<T: Input>(input: &mut CodedReader<T>) -> read::Result<Self::Inner> {
         input.read_varint64().map(|v| v != 0)
@@ -366,18 +427,67 @@ impl Value for String {
             .add_bytes(unsafe { Length::new_unchecked(len) })
     }
     fn merge_from<T: Input>(this: &mut Self::Inner, input: &mut CodedReader<T>) -> read::Result<()> {
-        Self::read_new(input).map(|v| *this = v)
+        if !this.is_empty() {
+            // the bytes would be overwritten by the read, so only replace the value once it's valid
+            *this = Self::read_new(input)?;
+            return Ok(());
+        }
+        // reuse the empty string's capacity, a failed read leaves it empty as it was
+        let mut bytes = std::mem::take(this).into_bytes();
+        Bytes::<Vec<u8>>::merge_from(&mut bytes, input)?;
+        *this = io::utf8::into_string(bytes).map_err(io::read::Error::InvalidString)?;
+        Ok(())
     }
     fn write_to<T: Output>(this: &Self::Inner, output: &mut CodedWriter<T>) -> write::Result {
         output.write_length_delimited(this.as_bytes())
     }
+    fn write_reverse(this: &Self::Inner, output: &mut ReverseWriter) -> write::Result {
+        output.write_length_delimited(this.as_bytes())
+    }
     fn is_initialized(_this: &Self::Inner) -> bool { true }
     fn read_new<T: Input>(input: &mut CodedReader<T>) -> read::Result<Self::Inner> {
-        std::string::String::from_utf8(input.read_value::<Bytes<Vec<_>>>()?)
+        io::utf8::into_string(input.read_value::<Bytes<Vec<_>>>()?)
             .map_err(io::read::Error::InvalidString)
     }
 }
 
+/// A string value that's only checked to be valid UTF-8 when it's accessed. This is encoded the same way as a
+/// [`String`](struct.String.html).
+/// 
+/// Reading the value keeps the bytes as they are. See [`LazyString`](../lazy/struct.LazyString.html) for more.
+pub struct LazyString;
+impl Sealed for LazyString { }
+impl ValueType for LazyString {
+    type Inner = lazy::LazyString;
+}
+impl Value for LazyString {
+    const WIRE_TYPE: WireType = WireType::LengthDelimited;
+
+    fn calculate_size(this: &Self::Inner, builder: LengthBuilder) -> Option<LengthBuilder> {
+        let len: i32 = this.len().try_into().ok()?;
+        builder
+            .add_value::<Uint32>(&(len as u32))?
+            .add_bytes(unsafe { Length::new_unchecked(len) })
+    }
+    fn merge_from<T: Input>(this: &mut Self::Inner, input: &mut CodedReader<T>) -> read::Result<()> {
+        // reuse the existing string's capacity
+        let mut bytes = std::mem::take(this).into_bytes();
+        Bytes::<Vec<u8>>::merge_from(&mut bytes, input)?;
+        *this = lazy::LazyString::from_bytes(bytes);
+        Ok(())
+    }
+    fn write_to<T: Output>(this: &Self::Inner, output: &mut CodedWriter<T>) -> write::Result {
+        output.write_length_delimited(this.as_bytes())
+    }
+    fn write_reverse(this: &Self::Inner, output: &mut ReverseWriter) -> write::Result {
+        output.write_length_delimited(this.as_bytes())
+    }
+    fn is_initialized(_this: &Self::Inner) -> bool { true }
+    fn read_new<T: Input>(input: &mut CodedReader<T>) -> read::Result<Self::Inner> {
+        input.read_value::<Bytes<Vec<_>>>().map(lazy::LazyString::from_bytes)
+    }
+}
+
 /// A bytes value. This is encoded as a length-delimited series of bytes.
 pub struct Bytes<T>(T);
 impl<T> Sealed for Bytes<T> { }
@@ -393,17 +503,113 @@ impl<T: ByteString> Value for Bytes<T> {
             .add_value::<Uint32>(&(len as u32))?
             .add_bytes(unsafe { Length::new_unchecked(len) })
     }
-    fn merge_from<U: Input>(this: &mut Self::Inner, input: &mut CodedReader<U>) -> read::Result<()> {
+    default fn merge_from<U: Input>(this: &mut Self::Inner, input: &mut CodedReader<U>) -> read::Result<()> {
         Self::read_new(input).map(|v| *this = v)
     }
     fn write_to<U: Output>(this: &Self::Inner, output: &mut CodedWriter<U>) -> write::Result {
         output.write_length_delimited(this.as_ref())
     }
+    fn write_reverse(this: &Self::Inner, output: &mut ReverseWriter) -> write::Result {
+        output.write_length_delimited(this.as_ref())
+    }
     fn is_initialized(_this: &Self::Inner) -> bool { true }
-    fn read_new<U: Input>(input: &mut CodedReader<U>) -> read::Result<Self::Inner> {
+    default fn read_new<U: Input>(input: &mut CodedReader<U>) -> read::Result<Self::Inner> {
         input.read_length_delimited::<T>()
     }
 }
+impl Value for Bytes<Vec<u8>> {
+    fn merge_from<U: Input>(this: &mut Self::Inner, input: &mut CodedReader<U>) -> read::Result<()> {
+        // reuse the existing vec's capacity
+        let mut bytes = std::mem::take(this);
+        bytes.clear();
+        *this = input.read_length_delimited_with(|len| {
+            bytes.resize(len, 0);
+            bytes
+        })?;
+        Ok(())
+    }
+}
+impl<'a> BorrowedValue<'a> for Bytes<ArenaBytes<'a>> {
+    fn read_borrowed<A: read::SliceArena<'a>>(input: &mut CodedReader<read::Slice<'a, A>>) -> read::Result<Self::Inner> {
+        input.read_arena_bytes()
+    }
+}
+
+/// A string value that can borrow from the input. This is encoded as a length-delimited series of bytes.
+/// 
+/// When read with [`BorrowedValue`](trait.BorrowedValue.html) from a slice the string references the input directly.
+/// Reading from any other input copies the string into an owned value.
+pub struct BorrowedString<'a>(&'a str);
+impl Sealed for BorrowedString<'_> { }
+impl<'a> ValueType for BorrowedString<'a> {
+    type Inner = Cow<'a, str>;
+}
+impl<'a> Value for BorrowedString<'a> {
+    const WIRE_TYPE: WireType = WireType::LengthDelimited;
+
+    fn calculate_size(this: &Self::Inner, builder: LengthBuilder) -> Option<LengthBuilder> {
+        let len: i32 = this.len().try_into().ok()?;
+        builder
+            .add_value::<Uint32>(&(len as u32))?
+            .add_bytes(unsafe { Length::new_unchecked(len) })
+    }
+    fn merge_from<T: Input>(this: &mut Self::Inner, input: &mut CodedReader<T>) -> read::Result<()> {
+        Self::read_new(input).map(|v| *this = v)
+    }
+    fn write_to<T: Output>(this: &Self::Inner, output: &mut CodedWriter<T>) -> write::Result {
+        output.write_length_delimited(this.as_bytes())
+    }
+    fn write_reverse(this: &Self::Inner, output: &mut ReverseWriter) -> write::Result {
+        output.write_length_delimited(this.as_bytes())
+    }
+    fn is_initialized(_this: &Self::Inner) -> bool { true }
+    fn read_new<T: Input>(input: &mut CodedReader<T>) -> read::Result<Self::Inner> {
+        String::read_new(input).map(Cow::Owned)
+    }
+}
+impl<'a> BorrowedValue<'a> for BorrowedString<'a> {
+    fn read_borrowed<A: read::SliceArena<'a>>(input: &mut CodedReader<read::Slice<'a, A>>) -> read::Result<Self::Inner> {
+        input.read_str_borrowed().map(Cow::Borrowed)
+    }
+}
+
+/// A bytes value that can borrow from the input. This is encoded as a length-delimited series of bytes.
+/// 
+/// When read with [`BorrowedValue`](trait.BorrowedValue.html) from a slice the bytes reference the input directly.
+/// Reading from any other input copies the bytes into an owned value.
+pub struct BorrowedBytes<'a>(&'a [u8]);
+impl Sealed for BorrowedBytes<'_> { }
+impl<'a> ValueType for BorrowedBytes<'a> {
+    type Inner = Cow<'a, [u8]>;
+}
+impl<'a> Value for BorrowedBytes<'a> {
+    const WIRE_TYPE: WireType = WireType::LengthDelimited;
+
+    fn calculate_size(this: &Self::Inner, builder: LengthBuilder) -> Option<LengthBuilder> {
+        let len: i32 = this.len().try_into().ok()?;
+        builder
+            .add_value::<Uint32>(&(len as u32))?
+            .add_bytes(unsafe { Length::new_unchecked(len) })
+    }
+    fn merge_from<T: Input>(this: &mut Self::Inner, input: &mut CodedReader<T>) -> read::Result<()> {
+        Self::read_new(input).map(|v| *this = v)
+    }
+    fn write_to<T: Output>(this: &Self::Inner, output: &mut CodedWriter<T>) -> write::Result {
+        output.write_length_delimited(this.as_ref())
+    }
+    fn write_reverse(this: &Self::Inner, output: &mut ReverseWriter) -> write::Result {
+        output.write_length_delimited(this.as_ref())
+    }
+    fn is_initialized(_this: &Self::Inner) -> bool { true }
+    fn read_new<T: Input>(input: &mut CodedReader<T>) -> read::Result<Self::Inner> {
+        input.read_length_delimited::<Vec<u8>>().map(Cow::Owned)
+    }
+}
+impl<'a> BorrowedValue<'a> for BorrowedBytes<'a> {
+    fn read_borrowed<A: read::SliceArena<'a>>(input: &mut CodedReader<read::Slice<'a, A>>) -> read::Result<Self::Inner> {
+        input.read_length_delimited_borrowed()
+    }
+}
 
 /// An enum value. This is encoded as a 32-bit varint value.
 pub struct Enum<T>(T);
@@ -423,6 +629,9 @@ impl<T: crate::Enum> Value for Enum<T> {
     fn write_to<U: Output>(&this: &Self::Inner, output: &mut CodedWriter<U>) -> write::Result {
         output.write_value::<Int32>(&this.into())
     }
+    fn write_reverse(&this: &Self::Inner, output: &mut ReverseWriter) -> write::Result {
+        output.write_value::<Int32>(&this.into())
+    }
     fn is_initialized(_this: &Self::Inner) -> bool { true }
     fn read_new<U: Input>(input: &mut CodedReader<U>) -> read::Result<Self::Inner> {
         Int32::read_new(input).map(|v| v.into())
@@ -439,38 +648,190 @@ impl<T: TraitMessage> Value for Message<T> {
     const WIRE_TYPE: WireType = WireType::LengthDelimited;
 
     fn calculate_size(this: &Self::Inner, builder: LengthBuilder) -> Option<LengthBuilder> {
-        let len = this.calculate_size()?;
+        let len = this.compute_and_cache_size()?;
+        builder
+            .add_value::<Uint32>(&(len.get() as u32))?
+            .add_bytes(len)
+    }
+    fn cached_size(this: &Self::Inner, builder: LengthBuilder) -> Option<LengthBuilder> {
+        let len = this.cached_size()?;
         builder
             .add_value::<Uint32>(&(len.get() as u32))?
             .add_bytes(len)
     }
     fn merge_from<U: Input>(this: &mut Self::Inner, input: &mut CodedReader<U>) -> read::Result<()> {
-        input.read_limit()?.then(|input| input.recurse(|input| this.merge_from(input)))
+        input.read_limit()?.then(|input| input.recurse(|input| input.read_nested(|input| input.merge_message(this))))
     }
     fn write_to<U: Output>(this: &Self::Inner, output: &mut CodedWriter<U>) -> write::Result {
-        let length = this.calculate_size().ok_or(io::write::Error::ValueTooLarge)?;
+        let length = this.cached_size().ok_or(io::write::Error::ValueTooLarge)?;
         output.write_length(length)?;
         TraitMessage::write_to::<U>(this, output)?;
         Ok(())
     }
+    fn write_reverse(this: &Self::Inner, output: &mut ReverseWriter) -> write::Result {
+        output.write_length_delimited_with(|output| this.write_reverse(output))
+    }
     fn is_initialized(this: &Self::Inner) -> bool {
         this.is_initialized()
     }
-    default fn read_new<U: Input>(input: &mut CodedReader<U>) -> read::Result<Self::Inner> {
-        input.recurse(|input| {
-            let mut t = T::default();
-            t.merge_from(input)?;
-            Ok(t)
-        })
+    fn read_new<U: Input>(input: &mut CodedReader<U>) -> read::Result<Self::Inner> {
+        let mut t = T::new_for(input);
+        Self::merge_from(&mut t, input)?;
+        Ok(t)
+    }
+}
+
+/// A message value that's kept encoded until it's accessed. This is encoded the same way as a [`Message`](struct.Message.html).
+/// 
+/// Reading the value only checks the encoded fields are well formed. See [`Lazy`](../lazy/struct.Lazy.html) for more.
+pub struct LazyMessage<T>(T);
+impl<T> Sealed for LazyMessage<T> { }
+impl<T: TraitMessage> ValueType for LazyMessage<T> {
+    type Inner = Lazy<T>;
+}
+impl<T: TraitMessage> Value for LazyMessage<T> {
+    const WIRE_TYPE: WireType = WireType::LengthDelimited;
+
+    fn calculate_size(this: &Self::Inner, builder: LengthBuilder) -> Option<LengthBuilder> {
+        this.calculate_size(builder)
+    }
+    fn cached_size(this: &Self::Inner, builder: LengthBuilder) -> Option<LengthBuilder> {
+        this.cached_size(builder)
+    }
+    fn merge_from<U: Input>(this: &mut Self::Inner, input: &mut CodedReader<U>) -> read::Result<()> {
+        this.merge_from(input)
+    }
+    fn write_to<U: Output>(this: &Self::Inner, output: &mut CodedWriter<U>) -> write::Result {
+        this.write_to(output)
+    }
+    fn write_reverse(this: &Self::Inner, output: &mut ReverseWriter) -> write::Result {
+        this.write_reverse(output)
+    }
+    fn is_initialized(this: &Self::Inner) -> bool {
+        this.is_initialized()
+    }
+    fn read_new<U: Input>(input: &mut CodedReader<U>) -> read::Result<Self::Inner> {
+        let mut lazy = Lazy::default();
+        lazy.merge_from(input)?;
+        Ok(lazy)
     }
 }
-impl<T: TraitMessage + ExtendableMessage + 'static> Value for Message<T> {
+
+/// A message value that's shared and only encoded once. This is encoded the same way as a
+/// [`Message`](struct.Message.html).
+///
+/// Reading the value parses the message and keeps the bytes it was read from as its encoding.
+/// See [`Frozen`](../lazy/struct.Frozen.html) for more.
+pub struct FrozenMessage<T>(T);
+impl<T> Sealed for FrozenMessage<T> { }
+impl<T: TraitMessage> ValueType for FrozenMessage<T> {
+    type Inner = Frozen<T>;
+}
+impl<T: TraitMessage> Value for FrozenMessage<T> {
+    const WIRE_TYPE: WireType = WireType::LengthDelimited;
+
+    fn calculate_size(this: &Self::Inner, builder: LengthBuilder) -> Option<LengthBuilder> {
+        this.calculate_size(builder)
+    }
+    fn merge_from<U: Input>(this: &mut Self::Inner, input: &mut CodedReader<U>) -> read::Result<()> {
+        this.merge_from(input)
+    }
+    fn write_to<U: Output>(this: &Self::Inner, output: &mut CodedWriter<U>) -> write::Result {
+        this.write_to(output)
+    }
+    fn write_reverse(this: &Self::Inner, output: &mut ReverseWriter) -> write::Result {
+        this.write_reverse(output)
+    }
+    fn is_initialized(this: &Self::Inner) -> bool {
+        this.get().is_initialized()
+    }
     fn read_new<U: Input>(input: &mut CodedReader<U>) -> read::Result<Self::Inner> {
+        Frozen::read_new(input)
+    }
+}
+
+/// Creates new messages to be read from a [`CodedReader`](../io/read/struct.CodedReader.html),
+/// giving extendable messages the registry of the reader.
+pub(crate) trait NewFor: TraitMessage {
+    fn new_for<U: Input>(input: &CodedReader<U>) -> Self;
+}
+impl<T: TraitMessage> NewFor for T {
+    default fn new_for<U: Input>(_input: &CodedReader<U>) -> Self {
+        T::default()
+    }
+}
+impl<T: TraitMessage + ExtendableMessage + 'static> NewFor for T {
+    fn new_for<U: Input>(input: &CodedReader<U>) -> Self {
         let mut t = T::default();
         t.extensions_mut().replace_registry(input.registry());
-        t.merge_from(input)?;
+        t
+    }
+}
+
+impl<'a, T: TraitMessage + BorrowedMessage<'a>> BorrowedValue<'a> for Message<T> {
+    fn read_borrowed<A: read::SliceArena<'a>>(input: &mut CodedReader<read::Slice<'a, A>>) -> read::Result<Self::Inner> {
+        let mut t = T::default();
+        Self::merge_borrowed(&mut t, input)?;
         Ok(t)
     }
+    fn merge_borrowed<A: read::SliceArena<'a>>(this: &mut Self::Inner, input: &mut CodedReader<read::Slice<'a, A>>) -> read::Result<()> {
+        input.read_limit()?.then(|input| input.recurse(|input| {
+            this.merge_from_slice(input)?;
+            input.check_required(this)
+        }))
+    }
+}
+
+/// A value allocated in the reader's arena. This is encoded the same way as the value it contains.
+/// 
+/// When read with [`BorrowedValue`](trait.BorrowedValue.html), new values are allocated in the arena of the
+/// [`CodedReader`](../io/read/struct.CodedReader.html) they're read from. Values read without an arena are
+/// allocated on the heap.
+pub struct InArena<'a, V>(&'a Arena, V);
+impl<V> Sealed for InArena<'_, V> { }
+impl<'a, V: Value> ValueType for InArena<'a, V> {
+    type Inner = ArenaBox<'a, V::Inner>;
+}
+impl<V: Value> Value for InArena<'_, V>
+    where V::Inner: Default
+{
+    const WIRE_TYPE: WireType = V::WIRE_TYPE;
+
+    fn calculate_size(this: &Self::Inner, builder: LengthBuilder) -> Option<LengthBuilder> {
+        V::calculate_size(this, builder)
+    }
+    fn cached_size(this: &Self::Inner, builder: LengthBuilder) -> Option<LengthBuilder> {
+        V::cached_size(this, builder)
+    }
+    fn merge_from<U: Input>(this: &mut Self::Inner, input: &mut CodedReader<U>) -> read::Result<()> {
+        V::merge_from(this, input)
+    }
+    fn write_to<U: Output>(this: &Self::Inner, output: &mut CodedWriter<U>) -> write::Result {
+        V::write_to(this, output)
+    }
+    fn write_reverse(this: &Self::Inner, output: &mut ReverseWriter) -> write::Result {
+        V::write_reverse(this, output)
+    }
+    fn is_initialized(this: &Self::Inner) -> bool {
+        V::is_initialized(this)
+    }
+    fn read_new<U: Input>(input: &mut CodedReader<U>) -> read::Result<Self::Inner> {
+        let mut value = ArenaBox::new(V::Inner::default());
+        V::merge_from(&mut value, input)?;
+        Ok(value)
+    }
+}
+impl<'a, V: BorrowedValue<'a>> BorrowedValue<'a> for InArena<'a, V>
+    where V::Inner: Default
+{
+    fn read_borrowed<A: read::SliceArena<'a>>(input: &mut CodedReader<read::Slice<'a, A>>) -> read::Result<Self::Inner> {
+        let mut value = ArenaBox::new_maybe_in(V::Inner::default(), input.arena());
+        V::merge_borrowed(&mut value, input)?;
+        Ok(value)
+    }
+    fn merge_borrowed<A: read::SliceArena<'a>>(this: &mut Self::Inner, input: &mut CodedReader<read::Slice<'a, A>>) -> read::Result<()> {
+        V::merge_borrowed(this, input)
+    }
 }
 
 /// A group value. This is encoded by putting a start and end tag between its encoded fields.
@@ -483,14 +844,23 @@ impl<T: TraitMessage> Value for Group<T> {
     const WIRE_TYPE: WireType = WireType::StartGroup;
 
     fn calculate_size(this: &Self::Inner, builder: LengthBuilder) -> Option<LengthBuilder> {
-        builder.add_bytes(this.calculate_size()?)
+        builder.add_bytes(this.compute_and_cache_size()?)
+    }
+    fn cached_size(this: &Self::Inner, builder: LengthBuilder) -> Option<LengthBuilder> {
+        builder.add_bytes(this.cached_size()?)
     }
     fn merge_from<U: Input>(this: &mut Self::Inner, input: &mut CodedReader<U>) -> read::Result<()> {
-        input.recurse(|input| input.read_group(this))
+        input.recurse(|input| input.read_nested(|input| {
+            input.read_group(this)?;
+            input.check_required(this)
+        }))
     }
     fn write_to<U: Output>(this: &Self::Inner, output: &mut CodedWriter<U>) -> write::Result {
         this.write_to(output)
     }
+    fn write_reverse(this: &Self::Inner, output: &mut ReverseWriter) -> write::Result {
+        this.write_reverse(output)
+    }
     fn is_initialized(this: &Self::Inner) -> bool {
         this.is_initialized()
     }
@@ -676,10 +1046,52 @@ mod test {
 
     }
     mod sint32 {
+        use crate::raw::Sint32;
 
+        test_cases! {
+            Sint32 => {
+                write: write_sint32 => {
+                    0 => [0],
+                    -1 => [1],
+                    1 => [2],
+                    -2 => [3],
+                    i32::max_value() => [254, 255, 255, 255, 15],
+                    i32::min_value() => [255, 255, 255, 255, 15],
+                },
+                read: read_sint32 => {
+                    [0] => Ok(0),
+                    [1] => Ok(-1),
+                    [2] => Ok(1),
+                    [3] => Ok(-2),
+                    [254, 255, 255, 255, 15] => Ok(v) if v == i32::max_value(),
+                    [255, 255, 255, 255, 15] => Ok(v) if v == i32::min_value(),
+                },
+            }
+        }
     }
     mod sint64 {
+        use crate::raw::Sint64;
 
+        test_cases! {
+            Sint64 => {
+                write: write_sint64 => {
+                    0 => [0],
+                    -1 => [1],
+                    1 => [2],
+                    -2 => [3],
+                    i64::max_value() => [254, 255, 255, 255, 255, 255, 255, 255, 255, 1],
+                    i64::min_value() => [255, 255, 255, 255, 255, 255, 255, 255, 255, 1],
+                },
+                read: read_sint64 => {
+                    [0] => Ok(0),
+                    [1] => Ok(-1),
+                    [2] => Ok(1),
+                    [3] => Ok(-2),
+                    [254, 255, 255, 255, 255, 255, 255, 255, 255, 1] => Ok(v) if v == i64::max_value(),
+                    [255, 255, 255, 255, 255, 255, 255, 255, 255, 1] => Ok(v) if v == i64::min_value(),
+                },
+            }
+        }
     }
     mod fixed32 {
 
@@ -806,7 +1218,303 @@ mod test {
         }
     }
     mod message {
+        use crate::{Message, UnknownFieldSet};
+        use crate::io::{read, write, reverse::ReverseWriter, CachedSize, CodedReader, CodedWriter, FieldNumber, Input, Length, LengthBuilder, Output};
+        use crate::raw;
+        use std::cell::Cell;
+
+        thread_local! {
+            static SIZE_CALLS: Cell<usize> = Cell::new(0);
+        }
 
+        #[derive(Default, Clone, Debug, PartialEq)]
+        struct Node {
+            value: i32,
+            child: Option<Box<Node>>,
+            cached_size: CachedSize,
+            unknown_fields: UnknownFieldSet,
+        }
+
+        impl Node {
+            const VALUE_NUMBER: FieldNumber = unsafe { FieldNumber::new_unchecked(1) };
+            const CHILD_NUMBER: FieldNumber = unsafe { FieldNumber::new_unchecked(2) };
+
+            fn with_depth(depth: i32) -> Node {
+                let mut node = Node { value: depth, ..Default::default() };
+                if depth > 1 {
+                    node.child = Some(Box::new(Node::with_depth(depth - 1)));
+                }
+                node
+            }
+        }
+
+        impl Message for Node {
+            fn merge_from<T: Input>(&mut self, input: &mut CodedReader<T>) -> read::Result<()> {
+                while let Some(field) = input.read_field()? {
+                    match field.tag() {
+                        8 => field.merge_value::<raw::Int32>(Self::VALUE_NUMBER, &mut self.value)?,
+                        18 => field.merge_value::<raw::Message<Node>>(Self::CHILD_NUMBER, self.child.get_or_insert_with(Default::default))?,
+                        _ => field.check_and_try_add_field_to(&mut self.unknown_fields)?.or_skip()?,
+                    }
+                }
+                Ok(())
+            }
+            fn calculate_size(&self) -> Option<Length> {
+                SIZE_CALLS.with(|c| c.set(c.get() + 1));
+
+                let mut builder = LengthBuilder::new();
+                if self.value != 0 {
+                    builder = builder.add_field::<raw::Int32>(Self::VALUE_NUMBER, &self.value)?;
+                }
+                if let Some(child) = &self.child {
+                    builder = builder.add_field::<raw::Message<Node>>(Self::CHILD_NUMBER, child)?;
+                }
+                builder = builder.add_fields(&self.unknown_fields)?;
+                Some(builder.build())
+            }
+            fn compute_and_cache_size(&self) -> Option<Length> {
+                let size = self.calculate_size()?;
+                self.cached_size.set(size);
+                Some(size)
+            }
+            fn cached_size(&self) -> Option<Length> {
+                Some(self.cached_size.get())
+            }
+            fn write_to<T: Output>(&self, output: &mut CodedWriter<T>) -> write::Result {
+                if self.value != 0 {
+                    output.write_field::<raw::Int32>(Self::VALUE_NUMBER, &self.value)?;
+                }
+                if let Some(child) = &self.child {
+                    output.write_field::<raw::Message<Node>>(Self::CHILD_NUMBER, child)?;
+                }
+                output.write_fields(&self.unknown_fields)
+            }
+            fn write_reverse(&self, output: &mut ReverseWriter) -> write::Result {
+                output.write_fields(&self.unknown_fields)?;
+                if let Some(child) = &self.child {
+                    output.write_field::<raw::Message<Node>>(Self::CHILD_NUMBER, child)?;
+                }
+                if self.value != 0 {
+                    output.write_field::<raw::Int32>(Self::VALUE_NUMBER, &self.value)?;
+                }
+                Ok(())
+            }
+            fn is_initialized(&self) -> bool {
+                true
+            }
+            fn unknown_fields(&self) -> &UnknownFieldSet {
+                &self.unknown_fields
+            }
+            fn unknown_fields_mut(&mut self) -> &mut UnknownFieldSet {
+                &mut self.unknown_fields
+            }
+        }
+
+        #[test]
+        fn nested_sizes_calculated_once() {
+            const DEPTH: usize = 8;
+
+            let node = Node::with_depth(DEPTH as i32);
+
+            SIZE_CALLS.with(|c| c.set(0));
+            let len = node.calculate_size().expect("size fits in an i32");
+            assert_eq!(SIZE_CALLS.with(Cell::get), DEPTH);
+
+            let mut output = vec![0; len.get() as usize].into_boxed_slice();
+            let mut writer = CodedWriter::with_slice(&mut output);
+            node.write_to(&mut writer).expect("size calculated ahead of time");
+            assert!(writer.into_inner().is_empty());
+            assert_eq!(SIZE_CALLS.with(Cell::get), DEPTH);
+
+            let mut reader = CodedReader::with_slice(&output);
+            let mut read = Node::default();
+            read.merge_from(&mut reader).expect("output is valid protobuf data");
+            assert_eq!(read, node);
+        }
+
+        #[test]
+        fn write_nested_message() {
+            let node = Node::with_depth(2);
+            let expected = [8, 2, 18, 2, 8, 1];
+
+            assert_eq!(Length::of_value::<raw::Message<Node>>(&node), Length::new(expected.len() as i32 + 1));
+
+            let mut output = [0u8; 7];
+            let mut writer = CodedWriter::with_slice(&mut output);
+            writer.write_value::<raw::Message<Node>>(&node).expect("size calculated ahead of time");
+            assert!(writer.into_inner().is_empty());
+            assert_eq!(output[0], expected.len() as u8);
+            assert_eq!(&output[1..], &expected);
+        }
+
+        #[test]
+        fn to_bytes_allocates_once() {
+            const DEPTH: usize = 8;
+
+            let node = Node::with_depth(DEPTH as i32);
+            SIZE_CALLS.with(|c| c.set(0));
+            let bytes = node.to_bytes().expect("size fits in an i32");
+
+            assert_eq!(SIZE_CALLS.with(Cell::get), DEPTH);
+            assert_eq!(bytes.len(), bytes.capacity());
+            assert_eq!(node.cached_size(), Length::new(bytes.len() as i32));
+
+            let mut read = Node::default();
+            read.merge_from(&mut CodedReader::with_slice(&bytes)).expect("output is valid protobuf data");
+            assert_eq!(read, node);
+        }
+
+        #[test]
+        fn write_to_vec_appends() {
+            let node = Node::with_depth(2);
+            let mut output = vec![1, 2, 3];
+            node.write_to_vec(&mut output).expect("size fits in an i32");
+
+            assert_eq!(output, [1, 2, 3, 8, 2, 18, 2, 8, 1]);
+        }
+
+        #[test]
+        fn reverse_write_calculates_no_sizes() {
+            const DEPTH: usize = 8;
+
+            let mut node = Node::with_depth(DEPTH as i32);
+            node.merge_from(&mut CodedReader::with_slice(&[24, 5])).expect("input is valid protobuf data");
+
+            SIZE_CALLS.with(|c| c.set(0));
+            let mut writer = ReverseWriter::new();
+            writer.write_message(&node).expect("message fits in an i32");
+            assert_eq!(SIZE_CALLS.with(Cell::get), 0);
+
+            assert_eq!(writer.as_bytes(), node.to_bytes().unwrap().as_slice());
+        }
+
+        #[test]
+        fn reverse_write_nested_message() {
+            let node = Node::with_depth(2);
+            let mut writer = ReverseWriter::new();
+            writer.write_value::<raw::Message<Node>>(&node).expect("message fits in an i32");
+
+            assert_eq!(writer.as_bytes(), &[6, 8, 2, 18, 2, 8, 1]);
+        }
+    }
+    mod borrowed {
+        use crate::{BorrowedMessage, Message, UnknownFieldSet};
+        use crate::io::{read, write, reverse::ReverseWriter, CodedReader, CodedWriter, FieldNumber, Input, Length, LengthBuilder, Output};
+        use crate::raw;
+        use std::borrow::Cow;
+
+        #[derive(Default, Clone, Debug, PartialEq)]
+        struct Named<'a> {
+            name: Cow<'a, str>,
+            data: Cow<'a, [u8]>,
+            unknown_fields: UnknownFieldSet,
+        }
+
+        impl Named<'_> {
+            const NAME_NUMBER: FieldNumber = unsafe { FieldNumber::new_unchecked(1) };
+            const DATA_NUMBER: FieldNumber = unsafe { FieldNumber::new_unchecked(2) };
+        }
+
+        impl<'a> Message for Named<'a> {
+            fn merge_from<T: Input>(&mut self, input: &mut CodedReader<T>) -> read::Result<()> {
+                while let Some(field) = input.read_field()? {
+                    match field.tag() {
+                        10 => field.merge_value::<raw::BorrowedString>(Self::NAME_NUMBER, &mut self.name)?,
+                        18 => field.merge_value::<raw::BorrowedBytes>(Self::DATA_NUMBER, &mut self.data)?,
+                        _ => field.check_and_try_add_field_to(&mut self.unknown_fields)?.or_skip()?,
+                    }
+                }
+                Ok(())
+            }
+            fn calculate_size(&self) -> Option<Length> {
+                LengthBuilder::new()
+                    .add_field::<raw::BorrowedString>(Self::NAME_NUMBER, &self.name)?
+                    .add_field::<raw::BorrowedBytes>(Self::DATA_NUMBER, &self.data)?
+                    .add_fields(&self.unknown_fields)
+                    .map(LengthBuilder::build)
+            }
+            fn write_to<T: Output>(&self, output: &mut CodedWriter<T>) -> write::Result {
+                output.write_field::<raw::BorrowedString>(Self::NAME_NUMBER, &self.name)?;
+                output.write_field::<raw::BorrowedBytes>(Self::DATA_NUMBER, &self.data)?;
+                output.write_fields(&self.unknown_fields)
+            }
+            fn is_initialized(&self) -> bool {
+                true
+            }
+            fn unknown_fields(&self) -> &UnknownFieldSet {
+                &self.unknown_fields
+            }
+            fn unknown_fields_mut(&mut self) -> &mut UnknownFieldSet {
+                &mut self.unknown_fields
+            }
+        }
+
+        impl<'a> BorrowedMessage<'a> for Named<'a> {
+            fn merge_from_slice<A: read::SliceArena<'a>>(&mut self, input: &mut CodedReader<read::Slice<'a, A>>) -> read::Result<()> {
+                while let Some(field) = input.read_field()? {
+                    match field.tag() {
+                        10 => field.merge_borrowed_value::<raw::BorrowedString>(Self::NAME_NUMBER, &mut self.name)?,
+                        18 => field.merge_borrowed_value::<raw::BorrowedBytes>(Self::DATA_NUMBER, &mut self.data)?,
+                        _ => field.check_and_try_add_field_to(&mut self.unknown_fields)?.or_skip()?,
+                    }
+                }
+                Ok(())
+            }
+        }
+
+        const INPUT: [u8; 9] = [8, 10, 2, b'h', b'i', 18, 2, 1, 2];
+
+        #[test]
+        fn read_message_borrows_slice() {
+            let mut reader = CodedReader::with_slice(&INPUT);
+            let named = reader.read_borrowed_value::<raw::Message<Named>>().expect("input is valid protobuf data");
+            assert!(reader.into_inner().is_empty());
+
+            match (&named.name, &named.data) {
+                (Cow::Borrowed(name), Cow::Borrowed(data)) => {
+                    assert_eq!(*name, "hi");
+                    assert_eq!(name.as_ptr(), INPUT[3..].as_ptr());
+                    assert_eq!(data.as_ptr(), INPUT[7..].as_ptr());
+                },
+                _ => panic!("expected borrowed fields: {:?}", named),
+            }
+        }
+
+        #[test]
+        fn read_message_from_stream_copies() {
+            let mut reader = CodedReader::with_stream(&INPUT[1..]);
+            let mut named = Named::default();
+            named.merge_from(&mut reader).expect("input is valid protobuf data");
+
+            assert!(matches!(named.name, Cow::Owned(_)));
+            assert!(matches!(named.data, Cow::Owned(_)));
+            assert_eq!(named.name, "hi");
+            assert_eq!(named.data.as_ref(), &[1, 2]);
+        }
+
+        #[test]
+        fn write_borrowed_message() {
+            let mut reader = CodedReader::with_slice(&INPUT);
+            let named = reader.read_borrowed_value::<raw::Message<Named>>().expect("input is valid protobuf data");
+
+            let mut output = [0u8; 9];
+            let mut writer = CodedWriter::with_slice(&mut output);
+            assert_eq!(Length::of_value::<raw::Message<Named>>(&named), Length::new(9));
+            writer.write_value::<raw::Message<Named>>(&named).expect("size calculated ahead of time");
+            assert_eq!(output, INPUT);
+        }
+
+        #[test]
+        fn reverse_write_without_override_writes_forward() {
+            let mut reader = CodedReader::with_slice(&INPUT);
+            let named = reader.read_borrowed_value::<raw::Message<Named>>().expect("input is valid protobuf data");
+
+            let mut writer = ReverseWriter::new();
+            writer.write_varint32(1).unwrap();
+            writer.write_value::<raw::Message<Named>>(&named).expect("size fits in an i32");
+            assert_eq!(&writer.as_bytes()[..9], INPUT);
+            assert_eq!(&writer.as_bytes()[9..], &[1]);
+        }
     }
     mod group {
 
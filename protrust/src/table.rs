@@ -0,0 +1,757 @@
+//! Defines a table-driven engine for reading and writing messages.
+//!
+//! Instead of matching on every tag in its own `merge_from`, a [`TableMessage`] describes its fields once in a static
+//! table, and the functions in this module read, size, and write the message by walking that table. Every message then
+//! shares the same small loop, which keeps the code size of large schemas down.
+//!
+//! While reading, the engine expects fields to arrive in the order of the table and checks the tag of the next field
+//! in the table before anything else. Fields numbered from 1 without gaps are found directly by their number, and
+//! other fields are found with a binary search.
+//!
+//! Singular scalar fields are described with implicit proto3 presence or, with the `Optional` kinds, explicit presence.
+//! Embedded messages, repeated fields, and maps are described with [`Kind::message`] and [`Kind::repeated`], which read
+//! and write them through a [`FieldCodec`] trait object. Fields that the table can't describe, like oneofs, groups, and
+//! the unpacked form of a packed field, are handled by the message's `merge_other`, `other_size`, `write_other`,
+//! and `write_other_reverse` methods.
+//!
+//! [`TableMessage`]: trait.TableMessage.html
+//! [`Kind::message`]: enum.Kind.html#method.message
+//! [`Kind::repeated`]: enum.Kind.html#method.repeated
+//! [`FieldCodec`]: trait.FieldCodec.html
+//!
+//! # Examples
+//!
+//! ```
+//! use protrust::{Message, UnknownFieldSet};
+//! use protrust::io::{read, write, reverse::ReverseWriter, CodedReader, CodedWriter, FieldNumber, Input, Length, Output};
+//! use protrust::table::{self, Access, Field, Kind, TableMessage};
+//!
+//! #[derive(Default, Clone, Debug, PartialEq)]
+//! struct Point {
+//!     x: i32,
+//!     y: i32,
+//!     label: String,
+//!     unknown_fields: UnknownFieldSet,
+//! }
+//!
+//! impl TableMessage for Point {
+//!     const FIELDS: &'static [Field<Self>] = &[
+//!         Field::new(unsafe { FieldNumber::new_unchecked(1) }, Kind::Int32(Access { get: |p| &p.x, get_mut: |p| &mut p.x })),
+//!         Field::new(unsafe { FieldNumber::new_unchecked(2) }, Kind::Int32(Access { get: |p| &p.y, get_mut: |p| &mut p.y })),
+//!         Field::new(unsafe { FieldNumber::new_unchecked(3) }, Kind::String(Access { get: |p| &p.label, get_mut: |p| &mut p.label })),
+//!     ];
+//! }
+//!
+//! impl Message for Point {
+//!     fn merge_from<T: Input>(&mut self, input: &mut CodedReader<T>) -> read::Result<()> { table::merge_from(self, input) }
+//!     fn calculate_size(&self) -> Option<Length> { table::calculate_size(self) }
+//!     fn write_to<T: Output>(&self, output: &mut CodedWriter<T>) -> write::Result { table::write_to(self, output) }
+//!     fn write_reverse(&self, output: &mut ReverseWriter) -> write::Result { table::write_reverse(self, output) }
+//!     fn is_initialized(&self) -> bool { true }
+//!     fn unknown_fields(&self) -> &UnknownFieldSet { &self.unknown_fields }
+//!     fn unknown_fields_mut(&mut self) -> &mut UnknownFieldSet { &mut self.unknown_fields }
+//! }
+//!
+//! let data = [8, 3, 16, 4, 26, 1, b'a'];
+//! let mut point = Point::default();
+//! point.merge_from(&mut CodedReader::with_slice(&data))?;
+//!
+//! assert_eq!((point.x, point.y, point.label.as_str()), (3, 4, "a"));
+//! assert_eq!(point.to_bytes().unwrap(), data);
+//! # Ok::<(), protrust::io::read::Error>(())
+//! ```
+
+use crate::Message;
+use crate::collections::RepeatedValue;
+use crate::io::{read::{self, FieldReader}, write, reverse::ReverseWriter, CodedReader, CodedWriter, FieldNumber, Input, Length, LengthBuilder, Output, Tag, WireType};
+use crate::raw::{self, NewFor, Value};
+use std::marker::PhantomData;
+
+/// Accessors for a field of type `T` in a message of type `M`
+pub struct Access<M, T> {
+    /// Gets a shared reference to the field
+    pub get: fn(&M) -> &T,
+    /// Gets a mutable reference to the field
+    pub get_mut: fn(&mut M) -> &mut T,
+}
+
+/// The presence of a singular field: proto3 fields without a label are only written if they aren't their default value,
+/// and fields with explicit presence are kept in an `Option` and written whenever they're set
+trait Presence {
+    type Value;
+
+    /// Gets the value to write, or `None` if the field shouldn't be written
+    fn present(&self) -> Option<&Self::Value>;
+    /// Gets the value to merge a new value into, setting the field if it isn't set
+    fn slot(&mut self) -> &mut Self::Value;
+}
+
+macro_rules! implicit_presence {
+    ($($t:ty => |$v:ident| $is_set:expr),* $(,)?) => {
+        $(
+            impl Presence for $t {
+                type Value = $t;
+
+                #[inline]
+                fn present(&self) -> Option<&$t> {
+                    let $v = self;
+                    if $is_set { Some(self) } else { None }
+                }
+                #[inline]
+                fn slot(&mut self) -> &mut $t { self }
+            }
+        )*
+    };
+}
+
+implicit_presence! {
+    i32 => |v| *v != 0,
+    u32 => |v| *v != 0,
+    i64 => |v| *v != 0,
+    u64 => |v| *v != 0,
+    bool => |v| *v,
+    String => |v| !v.is_empty(),
+    Vec<u8> => |v| !v.is_empty(),
+}
+
+impl<T: Default> Presence for Option<T> {
+    type Value = T;
+
+    #[inline]
+    fn present(&self) -> Option<&T> {
+        self.as_ref()
+    }
+    #[inline]
+    fn slot(&mut self) -> &mut T {
+        self.get_or_insert_with(Default::default)
+    }
+}
+
+/// A field that the table reads and writes through a trait object, for kinds of fields that depend on the type of their
+/// values, like embedded messages and repeated fields. The reader and writer are passed as `Any` readers and writers, so
+/// the table can hold the field without knowing its type.
+pub trait FieldCodec<M> {
+    /// Merges a value of the field from the input
+    fn merge(&self, message: &mut M, input: &mut CodedReader<read::Any>) -> read::Result<()>;
+    /// Adds the size of the field to the builder
+    fn add_size(&self, message: &M, num: FieldNumber, builder: LengthBuilder) -> Option<LengthBuilder>;
+    /// Writes the field to the output
+    fn write_to(&self, message: &M, num: FieldNumber, output: &mut CodedWriter<write::Any>) -> write::Result;
+    /// Writes the field back to front to the reverse writer
+    fn write_reverse(&self, message: &M, num: FieldNumber, output: &mut ReverseWriter) -> write::Result;
+    /// Returns whether the values of the field are initialized
+    fn is_initialized(&self, message: &M) -> bool;
+}
+
+impl<M, T: Message> FieldCodec<M> for Access<M, Option<Box<T>>> {
+    fn merge(&self, message: &mut M, input: &mut CodedReader<read::Any>) -> read::Result<()> {
+        let field = (self.get_mut)(message).get_or_insert_with(|| Box::new(T::new_for(input)));
+        input.merge_value::<raw::Message<T>>(field)
+    }
+    fn add_size(&self, message: &M, num: FieldNumber, builder: LengthBuilder) -> Option<LengthBuilder> {
+        match (self.get)(message) {
+            Some(value) => builder.add_field::<raw::Message<T>>(num, value),
+            None => Some(builder),
+        }
+    }
+    fn write_to(&self, message: &M, num: FieldNumber, output: &mut CodedWriter<write::Any>) -> write::Result {
+        match (self.get)(message) {
+            Some(value) => output.write_field::<raw::Message<T>>(num, value),
+            None => Ok(()),
+        }
+    }
+    fn write_reverse(&self, message: &M, num: FieldNumber, output: &mut ReverseWriter) -> write::Result {
+        match (self.get)(message) {
+            Some(value) => output.write_field::<raw::Message<T>>(num, value),
+            None => Ok(()),
+        }
+    }
+    fn is_initialized(&self, message: &M) -> bool {
+        (self.get)(message).as_ref().map_or(true, |value| value.is_initialized())
+    }
+}
+
+/// Accessors for a repeated or map field of type `T` in a message of type `M`, with values read and written as `V`,
+/// like `raw::Packed<raw::Int32>` for a packed `repeated int32` or `(raw::String, raw::Int64)` for a `map<string, int64>`
+pub struct Repeated<M, T, V> {
+    access: Access<M, T>,
+    value: PhantomData<fn() -> V>,
+}
+
+impl<M, T, V> Repeated<M, T, V> {
+    /// Creates new accessors for the repeated field
+    pub const fn new(access: Access<M, T>) -> Self {
+        Repeated { access, value: PhantomData }
+    }
+}
+
+impl<M, T: RepeatedValue<V>, V> FieldCodec<M> for Repeated<M, T, V> {
+    fn merge(&self, message: &mut M, input: &mut CodedReader<read::Any>) -> read::Result<()> {
+        input.add_entries_to::<T, V>((self.access.get_mut)(message))
+    }
+    fn add_size(&self, message: &M, num: FieldNumber, builder: LengthBuilder) -> Option<LengthBuilder> {
+        builder.add_values::<T, V>((self.access.get)(message), num)
+    }
+    fn write_to(&self, message: &M, num: FieldNumber, output: &mut CodedWriter<write::Any>) -> write::Result {
+        output.write_values::<T, V>((self.access.get)(message), num)
+    }
+    fn write_reverse(&self, message: &M, num: FieldNumber, output: &mut ReverseWriter) -> write::Result {
+        output.write_values::<T, V>((self.access.get)(message), num)
+    }
+    fn is_initialized(&self, message: &M) -> bool {
+        (self.access.get)(message).is_initialized()
+    }
+}
+
+macro_rules! kinds {
+    ($($(#[$attr:meta])* $name:ident($inner:ty) => $value:ty),* $(,)?) => {
+        /// The protobuf type of a field in a table and the accessors to reach it in the message
+        pub enum Kind<M: 'static> {
+            $(
+                $(#[$attr])*
+                $name(Access<M, $inner>),
+            )*
+            /// An enum field, accessed through its `i32` value
+            Enum {
+                /// Gets the value of the field
+                get: fn(&M) -> i32,
+                /// Sets the value of the field
+                set: fn(&mut M, i32),
+            },
+            /// An enum field with explicit presence, accessed through its `i32` value
+            OptionalEnum {
+                /// Gets the value of the field, or `None` if it isn't set
+                get: fn(&M) -> Option<i32>,
+                /// Sets the value of the field
+                set: fn(&mut M, i32),
+            },
+            /// An embedded message field, created with [`Kind::message`](#method.message)
+            Message(&'static dyn FieldCodec<M>),
+            /// A repeated or map field and the wire type of its tags, created with [`Kind::repeated`](#method.repeated)
+            Repeated(WireType, &'static dyn FieldCodec<M>),
+        }
+
+        impl<M: 'static> Kind<M> {
+            /// Gets the wire type of values of this kind
+            pub const fn wire_type(&self) -> WireType {
+                match self {
+                    $(Kind::$name(_) => <$value as Value>::WIRE_TYPE,)*
+                    Kind::Enum { .. } | Kind::OptionalEnum { .. } => WireType::Varint,
+                    Kind::Message(_) => WireType::LengthDelimited,
+                    Kind::Repeated(wire_type, _) => *wire_type,
+                }
+            }
+
+            #[inline]
+            fn merge<T: Input>(&self, message: &mut M, input: &mut CodedReader<T>) -> read::Result<()> {
+                match self {
+                    $(Kind::$name(access) => input.merge_value::<$value>((access.get_mut)(message).slot()),)*
+                    Kind::Enum { set, .. } | Kind::OptionalEnum { set, .. } => input.read_value::<raw::Int32>().map(|v| set(message, v)),
+                    Kind::Message(codec) | Kind::Repeated(_, codec) => codec.merge(message, &mut input.as_any()),
+                }
+            }
+
+            #[inline]
+            fn add_size(&self, message: &M, num: FieldNumber, builder: LengthBuilder) -> Option<LengthBuilder> {
+                match self {
+                    $(Kind::$name(access) => match (access.get)(message).present() {
+                        Some(value) => builder.add_field::<$value>(num, value),
+                        None => Some(builder),
+                    },)*
+                    Kind::Enum { get, .. } => {
+                        let value = get(message);
+                        if value != 0 { builder.add_field::<raw::Int32>(num, &value) } else { Some(builder) }
+                    },
+                    Kind::OptionalEnum { get, .. } => match get(message) {
+                        Some(value) => builder.add_field::<raw::Int32>(num, &value),
+                        None => Some(builder),
+                    },
+                    Kind::Message(codec) | Kind::Repeated(_, codec) => codec.add_size(message, num, builder),
+                }
+            }
+
+            #[inline]
+            fn write_to<T: Output>(&self, message: &M, num: FieldNumber, output: &mut CodedWriter<T>) -> write::Result {
+                match self {
+                    $(Kind::$name(access) => match (access.get)(message).present() {
+                        Some(value) => output.write_field::<$value>(num, value),
+                        None => Ok(()),
+                    },)*
+                    Kind::Enum { get, .. } => {
+                        let value = get(message);
+                        if value != 0 { output.write_field::<raw::Int32>(num, &value) } else { Ok(()) }
+                    },
+                    Kind::OptionalEnum { get, .. } => match get(message) {
+                        Some(value) => output.write_field::<raw::Int32>(num, &value),
+                        None => Ok(()),
+                    },
+                    Kind::Message(codec) | Kind::Repeated(_, codec) => codec.write_to(message, num, &mut output.as_any()),
+                }
+            }
+
+            #[inline]
+            fn write_reverse(&self, message: &M, num: FieldNumber, output: &mut ReverseWriter) -> write::Result {
+                match self {
+                    $(Kind::$name(access) => match (access.get)(message).present() {
+                        Some(value) => output.write_field::<$value>(num, value),
+                        None => Ok(()),
+                    },)*
+                    Kind::Enum { get, .. } => {
+                        let value = get(message);
+                        if value != 0 { output.write_field::<raw::Int32>(num, &value) } else { Ok(()) }
+                    },
+                    Kind::OptionalEnum { get, .. } => match get(message) {
+                        Some(value) => output.write_field::<raw::Int32>(num, &value),
+                        None => Ok(()),
+                    },
+                    Kind::Message(codec) | Kind::Repeated(_, codec) => codec.write_reverse(message, num, output),
+                }
+            }
+
+            #[inline]
+            fn is_initialized(&self, message: &M) -> bool {
+                match self {
+                    Kind::Message(codec) | Kind::Repeated(_, codec) => codec.is_initialized(message),
+                    _ => true,
+                }
+            }
+        }
+    };
+}
+
+kinds! {
+    /// An `int32` field
+    Int32(i32) => raw::Int32,
+    /// A `uint32` field
+    Uint32(u32) => raw::Uint32,
+    /// An `int64` field
+    Int64(i64) => raw::Int64,
+    /// A `uint64` field
+    Uint64(u64) => raw::Uint64,
+    /// A `sint32` field
+    Sint32(i32) => raw::Sint32,
+    /// A `sint64` field
+    Sint64(i64) => raw::Sint64,
+    /// A `fixed32` field
+    Fixed32(u32) => raw::Fixed32,
+    /// A `fixed64` field
+    Fixed64(u64) => raw::Fixed64,
+    /// An `sfixed32` field
+    Sfixed32(i32) => raw::Sfixed32,
+    /// An `sfixed64` field
+    Sfixed64(i64) => raw::Sfixed64,
+    /// A `bool` field
+    Bool(bool) => raw::Bool,
+    /// A `string` field
+    String(String) => raw::String,
+    /// A `bytes` field
+    Bytes(Vec<u8>) => raw::Bytes<Vec<u8>>,
+    /// An `optional int32` field, with explicit presence
+    OptionalInt32(Option<i32>) => raw::Int32,
+    /// An `optional uint32` field, with explicit presence
+    OptionalUint32(Option<u32>) => raw::Uint32,
+    /// An `optional int64` field, with explicit presence
+    OptionalInt64(Option<i64>) => raw::Int64,
+    /// An `optional uint64` field, with explicit presence
+    OptionalUint64(Option<u64>) => raw::Uint64,
+    /// An `optional sint32` field, with explicit presence
+    OptionalSint32(Option<i32>) => raw::Sint32,
+    /// An `optional sint64` field, with explicit presence
+    OptionalSint64(Option<i64>) => raw::Sint64,
+    /// An `optional fixed32` field, with explicit presence
+    OptionalFixed32(Option<u32>) => raw::Fixed32,
+    /// An `optional fixed64` field, with explicit presence
+    OptionalFixed64(Option<u64>) => raw::Fixed64,
+    /// An `optional sfixed32` field, with explicit presence
+    OptionalSfixed32(Option<i32>) => raw::Sfixed32,
+    /// An `optional sfixed64` field, with explicit presence
+    OptionalSfixed64(Option<i64>) => raw::Sfixed64,
+    /// An `optional bool` field, with explicit presence
+    OptionalBool(Option<bool>) => raw::Bool,
+    /// An `optional string` field, with explicit presence
+    OptionalString(Option<String>) => raw::String,
+    /// An `optional bytes` field, with explicit presence
+    OptionalBytes(Option<Vec<u8>>) => raw::Bytes<Vec<u8>>,
+}
+
+impl<M: 'static> Kind<M> {
+    /// Creates the kind of an embedded message field, kept in an `Option<Box<T>>` that's `None` when the field isn't set
+    pub const fn message<T: Message + 'static>(access: &'static Access<M, Option<Box<T>>>) -> Kind<M> {
+        Kind::Message(access)
+    }
+    /// Creates the kind of a repeated or map field. The field is read and written with the tags of its wire form,
+    /// so the unpacked form of a packed field is passed to the message's `merge_other`.
+    pub const fn repeated<T: RepeatedValue<V> + 'static, V: 'static>(field: &'static Repeated<M, T, V>) -> Kind<M> {
+        Kind::Repeated(T::WIRE_TYPE, field)
+    }
+}
+
+/// A field in a message's table
+pub struct Field<M: 'static> {
+    number: FieldNumber,
+    tag: Tag,
+    kind: Kind<M>,
+}
+
+impl<M: 'static> Field<M> {
+    /// Creates a new field entry with the specified field number and kind
+    pub const fn new(number: FieldNumber, kind: Kind<M>) -> Field<M> {
+        Field { number, tag: Tag::new(number, kind.wire_type()), kind }
+    }
+    /// Gets the field number of the field
+    pub const fn number(&self) -> FieldNumber {
+        self.number
+    }
+    /// Gets the tag the field is read and written with
+    pub const fn tag(&self) -> Tag {
+        self.tag
+    }
+}
+
+/// A message whose fields are described by a static table, read and written by the functions in this module.
+pub trait TableMessage: Message + 'static {
+    /// The fields of the message, sorted by field number
+    const FIELDS: &'static [Field<Self>];
+
+    /// Reads a field that isn't in the table. By default this adds it to the message's unknown fields.
+    fn merge_other<T: Input>(&mut self, field: FieldReader<T>) -> read::Result<()> {
+        field.check_and_try_add_field_to(self.unknown_fields_mut())?.or_skip()
+    }
+    /// Adds the size of the fields that aren't in the table, not including unknown fields
+    fn other_size(&self, builder: LengthBuilder) -> Option<LengthBuilder> {
+        Some(builder)
+    }
+    /// Writes the fields that aren't in the table, not including unknown fields
+    fn write_other<T: Output>(&self, _output: &mut CodedWriter<T>) -> write::Result {
+        Ok(())
+    }
+    /// Writes the fields that aren't in the table back to front, not including unknown fields
+    fn write_other_reverse(&self, _output: &mut ReverseWriter) -> write::Result {
+        Ok(())
+    }
+}
+
+/// Finds the index of the field with the tag in the table
+#[inline]
+fn find<M: 'static>(fields: &[Field<M>], tag: u32) -> Option<usize> {
+    let number = tag >> 3;
+    let direct = (number as usize).wrapping_sub(1);
+    match fields.get(direct) {
+        Some(field) if field.tag.get() == tag => Some(direct),
+        _ => fields.binary_search_by_key(&number, |f| f.number.get()).ok().filter(|&i| fields[i].tag.get() == tag),
+    }
+}
+
+/// Merges the message's fields from the input, using the message's table.
+pub fn merge_from<M: TableMessage, T: Input>(message: &mut M, input: &mut CodedReader<T>) -> read::Result<()> {
+    let fields = M::FIELDS;
+    let mut next = 0;
+    while let Some(field) = input.read_field()? {
+        let tag = field.tag();
+        let index = match fields.get(next) {
+            Some(expected) if expected.tag.get() == tag => next,
+            _ => match find(fields, tag) {
+                Some(index) => index,
+                None => {
+                    message.merge_other(field)?;
+                    continue;
+                }
+            }
+        };
+        let entry = &fields[index];
+        field.and_then(entry.tag, |input| entry.kind.merge(message, input))?;
+        next = index + 1;
+    }
+    Ok(())
+}
+
+/// Returns whether the embedded message, repeated, and map fields in the message's table are initialized.
+/// Fields that aren't in the table are checked by the message.
+pub fn is_initialized<M: TableMessage>(message: &M) -> bool {
+    M::FIELDS.iter().all(|field| field.kind.is_initialized(message))
+}
+
+/// Calculates the size of the message, using the message's table.
+pub fn calculate_size<M: TableMessage>(message: &M) -> Option<Length> {
+    let mut builder = LengthBuilder::new();
+    for field in M::FIELDS {
+        builder = field.kind.add_size(message, field.number, builder)?;
+    }
+    Some(message.other_size(builder)?.add_fields(message.unknown_fields())?.build())
+}
+
+/// Writes the message to the output, using the message's table.
+pub fn write_to<M: TableMessage, T: Output>(message: &M, output: &mut CodedWriter<T>) -> write::Result {
+    for field in M::FIELDS {
+        field.kind.write_to(message, field.number, output)?;
+    }
+    message.write_other(output)?;
+    output.write_fields(message.unknown_fields())
+}
+
+/// Writes the message back to front to the reverse writer, using the message's table.
+pub fn write_reverse<M: TableMessage>(message: &M, output: &mut ReverseWriter) -> write::Result {
+    output.write_fields(message.unknown_fields())?;
+    message.write_other_reverse(output)?;
+    for field in M::FIELDS.iter().rev() {
+        field.kind.write_reverse(message, field.number, output)?;
+    }
+    Ok(())
+}
+
+#[cfg(test)]
+mod test {
+    use crate::{Message, UnknownFieldSet};
+    use crate::io::{read::{self, FieldReader}, write, reverse::ReverseWriter, CodedReader, CodedWriter, FieldNumber, Input, Length, LengthBuilder, Output};
+    use crate::collections::{MapField, RepeatedField};
+    use crate::raw;
+    use super::{Access, Field, Kind, Repeated, TableMessage};
+
+    const fn num(n: u32) -> FieldNumber {
+        unsafe { FieldNumber::new_unchecked(n) }
+    }
+
+    #[derive(Default, Clone, Debug, PartialEq)]
+    struct Sample {
+        id: i64,
+        stamp: u64,
+        flag: bool,
+        kind: i32,
+        name: String,
+        data: Vec<u8>,
+        delta: i32,
+        children: Vec<i32>,
+        unknown_fields: UnknownFieldSet,
+    }
+
+    impl TableMessage for Sample {
+        const FIELDS: &'static [Field<Self>] = &[
+            Field::new(num(1), Kind::Int64(Access { get: |s| &s.id, get_mut: |s| &mut s.id })),
+            Field::new(num(2), Kind::Fixed64(Access { get: |s| &s.stamp, get_mut: |s| &mut s.stamp })),
+            Field::new(num(3), Kind::Bool(Access { get: |s| &s.flag, get_mut: |s| &mut s.flag })),
+            Field::new(num(4), Kind::Enum { get: |s| s.kind, set: |s, v| s.kind = v }),
+            Field::new(num(5), Kind::String(Access { get: |s| &s.name, get_mut: |s| &mut s.name })),
+            Field::new(num(6), Kind::Bytes(Access { get: |s| &s.data, get_mut: |s| &mut s.data })),
+            Field::new(num(100), Kind::Sint32(Access { get: |s| &s.delta, get_mut: |s| &mut s.delta })),
+        ];
+
+        fn merge_other<T: Input>(&mut self, field: FieldReader<T>) -> read::Result<()> {
+            match field.tag() {
+                56 => field.add_entries_to::<_, raw::Int32>(num(7), &mut self.children),
+                _ => field.check_and_try_add_field_to(&mut self.unknown_fields)?.or_skip(),
+            }
+        }
+        fn other_size(&self, builder: LengthBuilder) -> Option<LengthBuilder> {
+            builder.add_values::<_, raw::Int32>(&self.children, num(7))
+        }
+        fn write_other<T: Output>(&self, output: &mut CodedWriter<T>) -> write::Result {
+            output.write_values::<_, raw::Int32>(&self.children, num(7))
+        }
+        fn write_other_reverse(&self, output: &mut ReverseWriter) -> write::Result {
+            output.write_values::<_, raw::Int32>(&self.children, num(7))
+        }
+    }
+
+    impl Message for Sample {
+        fn merge_from<T: Input>(&mut self, input: &mut CodedReader<T>) -> read::Result<()> {
+            super::merge_from(self, input)
+        }
+        fn calculate_size(&self) -> Option<Length> {
+            super::calculate_size(self)
+        }
+        fn write_to<T: Output>(&self, output: &mut CodedWriter<T>) -> write::Result {
+            super::write_to(self, output)
+        }
+        fn write_reverse(&self, output: &mut ReverseWriter) -> write::Result {
+            super::write_reverse(self, output)
+        }
+        fn is_initialized(&self) -> bool {
+            true
+        }
+        fn unknown_fields(&self) -> &UnknownFieldSet {
+            &self.unknown_fields
+        }
+        fn unknown_fields_mut(&mut self) -> &mut UnknownFieldSet {
+            &mut self.unknown_fields
+        }
+    }
+
+    fn sample() -> Sample {
+        Sample {
+            id: -5,
+            stamp: 1 << 40,
+            flag: true,
+            kind: 2,
+            name: "sample".to_string(),
+            data: vec![1, 2, 3],
+            delta: -300,
+            children: vec![7, 8, 9],
+            ..Default::default()
+        }
+    }
+
+    fn read(data: &[u8]) -> Sample {
+        let mut message = Sample::default();
+        message.merge_from(&mut CodedReader::with_slice(data)).unwrap();
+        message
+    }
+
+    #[test]
+    fn round_trip() {
+        let message = sample();
+        let data = message.to_bytes().unwrap();
+        assert_eq!(message.calculate_size().map(Length::get), Some(data.len() as i32));
+        assert_eq!(read(&data), message);
+
+        let mut reverse = ReverseWriter::new();
+        message.write_reverse(&mut reverse).unwrap();
+        assert_eq!(reverse.as_bytes(), data.as_slice());
+    }
+
+    #[test]
+    fn defaults_are_not_written() {
+        assert_eq!(Sample::default().to_bytes().unwrap(), Vec::<u8>::new());
+
+        let message = Sample { kind: 1, ..Default::default() };
+        assert_eq!(message.to_bytes().unwrap(), [32, 1]);
+    }
+
+    #[test]
+    fn fields_out_of_order() {
+        let message = sample();
+        let mut data = Vec::new();
+        {
+            let mut output = CodedWriter::with_vec(&mut data);
+            output.write_field::<raw::Sint32>(num(100), &message.delta).unwrap();
+            output.write_field::<raw::String>(num(5), &message.name).unwrap();
+            output.write_values::<_, raw::Int32>(&message.children, num(7)).unwrap();
+            output.write_field::<raw::Int64>(num(1), &message.id).unwrap();
+            output.write_field::<raw::Int64>(num(1), &3).unwrap();
+        }
+
+        let read = read(&data);
+        assert_eq!((read.id, read.name.as_str(), read.delta), (3, "sample", -300));
+        assert_eq!(read.children, message.children);
+    }
+
+    #[test]
+    fn unknown_and_mismatched_fields() {
+        // field 9 isn't in the table and field 1 has the wrong wire type, so both are kept as unknown fields
+        let data = [72, 1, 13, 1, 0, 0, 0, 8, 2];
+        let read = read(&data);
+        assert_eq!(read.id, 2);
+        assert_eq!(read.unknown_fields.field_len(), 2);
+        assert_eq!(read.to_bytes().unwrap().len(), data.len());
+    }
+
+    #[derive(Default, Clone, Debug, PartialEq)]
+    struct Document {
+        version: Option<i32>,
+        title: Option<String>,
+        state: Option<i32>,
+        body: Option<Box<Sample>>,
+        scores: RepeatedField<i32>,
+        tags: RepeatedField<String>,
+        counts: MapField<String, i64>,
+        unknown_fields: UnknownFieldSet,
+    }
+
+    impl TableMessage for Document {
+        const FIELDS: &'static [Field<Self>] = &[
+            Field::new(num(1), Kind::OptionalInt32(Access { get: |d| &d.version, get_mut: |d| &mut d.version })),
+            Field::new(num(2), Kind::OptionalString(Access { get: |d| &d.title, get_mut: |d| &mut d.title })),
+            Field::new(num(3), Kind::OptionalEnum { get: |d| d.state, set: |d, v| d.state = Some(v) }),
+            Field::new(num(4), Kind::message(&Access { get: |d| &d.body, get_mut: |d| &mut d.body })),
+            Field::new(num(5), Kind::repeated(&Repeated::<_, _, raw::Packed<raw::Int32>>::new(Access { get: |d| &d.scores, get_mut: |d| &mut d.scores }))),
+            Field::new(num(6), Kind::repeated(&Repeated::<_, _, raw::String>::new(Access { get: |d| &d.tags, get_mut: |d| &mut d.tags }))),
+            Field::new(num(7), Kind::repeated(&Repeated::<_, _, (raw::String, raw::Int64)>::new(Access { get: |d| &d.counts, get_mut: |d| &mut d.counts }))),
+        ];
+    }
+
+    impl Message for Document {
+        fn merge_from<T: Input>(&mut self, input: &mut CodedReader<T>) -> read::Result<()> {
+            super::merge_from(self, input)
+        }
+        fn calculate_size(&self) -> Option<Length> {
+            super::calculate_size(self)
+        }
+        fn write_to<T: Output>(&self, output: &mut CodedWriter<T>) -> write::Result {
+            super::write_to(self, output)
+        }
+        fn write_reverse(&self, output: &mut ReverseWriter) -> write::Result {
+            super::write_reverse(self, output)
+        }
+        fn is_initialized(&self) -> bool {
+            super::is_initialized(self)
+        }
+        fn unknown_fields(&self) -> &UnknownFieldSet {
+            &self.unknown_fields
+        }
+        fn unknown_fields_mut(&mut self) -> &mut UnknownFieldSet {
+            &mut self.unknown_fields
+        }
+    }
+
+    fn document() -> Document {
+        Document {
+            version: Some(0),
+            title: Some(String::new()),
+            state: Some(0),
+            body: Some(Box::new(sample())),
+            scores: vec![3, -1, 1 << 20],
+            tags: vec!["a".to_string(), String::new(), "c".to_string()],
+            counts: vec![("x".to_string(), 1), ("y".to_string(), -2)].into_iter().collect(),
+            ..Default::default()
+        }
+    }
+
+    #[test]
+    fn explicit_presence() {
+        // set fields are written even when they're their default value, and unset fields aren't
+        let message = Document { version: Some(0), title: Some(String::new()), state: Some(0), ..Default::default() };
+        let data = message.to_bytes().unwrap();
+        assert_eq!(data, [8, 0, 18, 0, 24, 0]);
+
+        let mut read = Document::default();
+        read.merge_from(&mut CodedReader::with_slice(&data)).unwrap();
+        assert_eq!(read, message);
+        assert_eq!(Document::default().to_bytes().unwrap(), Vec::<u8>::new());
+    }
+
+    #[test]
+    fn message_and_repeated_round_trip() {
+        let message = document();
+        let data = message.to_bytes().unwrap();
+        let without_map = Document { counts: MapField::new(), ..message.clone() };
+        assert_eq!(without_map.calculate_size().map(Length::get), Some(without_map.to_bytes().unwrap().len() as i32));
+
+        let mut read = Document::default();
+        read.merge_from(&mut CodedReader::with_slice(&data)).unwrap();
+        assert_eq!(read, message);
+        assert!(read.is_initialized());
+
+        let mut reverse = ReverseWriter::new();
+        message.write_reverse(&mut reverse).unwrap();
+        let mut read = Document::default();
+        read.merge_from(&mut CodedReader::with_slice(reverse.as_bytes())).unwrap();
+        assert_eq!(read, message);
+    }
+
+    #[test]
+    fn embedded_messages_merge() {
+        let mut data = Vec::new();
+        {
+            let mut output = CodedWriter::with_vec(&mut data);
+            output.write_field::<raw::Message<Sample>>(num(4), &Sample { id: 1, name: "a".to_string(), ..Default::default() }).unwrap();
+            output.write_field::<raw::Message<Sample>>(num(4), &Sample { id: 2, ..Default::default() }).unwrap();
+            output.write_values::<_, raw::Packed<raw::Int32>>(&vec![1, 2], num(5)).unwrap();
+            output.write_values::<_, raw::Packed<raw::Int32>>(&vec![3], num(5)).unwrap();
+        }
+
+        let mut read = Document::default();
+        read.merge_from(&mut CodedReader::with_slice(&data)).unwrap();
+        let body = read.body.unwrap();
+        assert_eq!((body.id, body.name.as_str()), (2, "a"));
+        assert_eq!(read.scores, [1, 2, 3]);
+    }
+}
@@ -0,0 +1,135 @@
+//! Defines messages shared by the tests of different modules
+
+use crate::{Message, Mergable, UnknownFieldSet};
+use crate::io::{read, write, CodedReader, CodedWriter, FieldNumber, Input, Length, LengthBuilder, Output};
+use crate::raw;
+
+/// A small message with an `int32` field, a `string` field, and unknown fields
+#[derive(Default, Clone, Debug, PartialEq)]
+pub struct Record {
+    pub id: i32,
+    pub name: String,
+    pub unknown_fields: UnknownFieldSet,
+}
+
+impl Record {
+    pub const ID_NUMBER: FieldNumber = unsafe { FieldNumber::new_unchecked(1) };
+    pub const NAME_NUMBER: FieldNumber = unsafe { FieldNumber::new_unchecked(2) };
+
+    /// Creates a record with the id and a name of `name_len` bytes
+    pub fn new(id: i32, name_len: usize) -> Self {
+        Record { id, name: "r".repeat(name_len), ..Default::default() }
+    }
+}
+
+impl Mergable for Record {
+    fn merge(&mut self, other: &Self) {
+        if other.id != 0 {
+            self.id = other.id;
+        }
+        if !other.name.is_empty() {
+            self.name = other.name.clone();
+        }
+        self.unknown_fields.merge(&other.unknown_fields);
+    }
+}
+
+impl Message for Record {
+    fn merge_from<T: Input>(&mut self, input: &mut CodedReader<T>) -> read::Result<()> {
+        while let Some(field) = input.read_field()? {
+            match field.tag() {
+                8 => field.merge_value::<raw::Int32>(Self::ID_NUMBER, &mut self.id)?,
+                18 => field.merge_value::<raw::String>(Self::NAME_NUMBER, &mut self.name)?,
+                _ => field.check_and_try_add_field_to(&mut self.unknown_fields)?.or_skip()?,
+            }
+        }
+        Ok(())
+    }
+    fn clear(&mut self) {
+        self.id = 0;
+        self.name.clear();
+        self.unknown_fields.clear();
+    }
+    fn calculate_size(&self) -> Option<Length> {
+        let mut builder = LengthBuilder::new();
+        if self.id != 0 {
+            builder = builder.add_field::<raw::Int32>(Self::ID_NUMBER, &self.id)?;
+        }
+        if !self.name.is_empty() {
+            builder = builder.add_field::<raw::String>(Self::NAME_NUMBER, &self.name)?;
+        }
+        builder.add_fields(&self.unknown_fields).map(LengthBuilder::build)
+    }
+    fn write_to<T: Output>(&self, output: &mut CodedWriter<T>) -> write::Result {
+        if self.id != 0 {
+            output.write_field::<raw::Int32>(Self::ID_NUMBER, &self.id)?;
+        }
+        if !self.name.is_empty() {
+            output.write_field::<raw::String>(Self::NAME_NUMBER, &self.name)?;
+        }
+        output.write_fields(&self.unknown_fields)
+    }
+    fn is_initialized(&self) -> bool {
+        true
+    }
+    fn unknown_fields(&self) -> &UnknownFieldSet {
+        &self.unknown_fields
+    }
+    fn unknown_fields_mut(&mut self) -> &mut UnknownFieldSet {
+        &mut self.unknown_fields
+    }
+}
+
+/// A message with a required `int32` field, which leaves checking it to `is_initialized`
+#[derive(Default, Clone, Debug, PartialEq)]
+pub struct Required {
+    pub id: Option<i32>,
+    pub unknown_fields: UnknownFieldSet,
+}
+
+impl Required {
+    pub const ID_NUMBER: FieldNumber = unsafe { FieldNumber::new_unchecked(1) };
+
+    /// Creates a message with the id set, or missing if it's `None`
+    pub fn new(id: Option<i32>) -> Self {
+        Required { id, ..Default::default() }
+    }
+}
+
+impl Message for Required {
+    fn merge_from<T: Input>(&mut self, input: &mut CodedReader<T>) -> read::Result<()> {
+        while let Some(field) = input.read_field()? {
+            match field.tag() {
+                8 => self.id = Some(field.read_value::<raw::Int32>(Self::ID_NUMBER)?),
+                _ => field.check_and_try_add_field_to(&mut self.unknown_fields)?.or_skip()?,
+            }
+        }
+        Ok(())
+    }
+    fn clear(&mut self) {
+        self.id = None;
+        self.unknown_fields.clear();
+    }
+    fn calculate_size(&self) -> Option<Length> {
+        let mut builder = LengthBuilder::new();
+        if let Some(id) = &self.id {
+            builder = builder.add_field::<raw::Int32>(Self::ID_NUMBER, id)?;
+        }
+        builder.add_fields(&self.unknown_fields).map(LengthBuilder::build)
+    }
+    fn write_to<T: Output>(&self, output: &mut CodedWriter<T>) -> write::Result {
+        if let Some(id) = &self.id {
+            output.write_field::<raw::Int32>(Self::ID_NUMBER, id)?;
+        }
+        output.write_fields(&self.unknown_fields)
+    }
+    fn is_initialized(&self) -> bool {
+        self.id.is_some()
+    }
+    fn unknown_fields(&self) -> &UnknownFieldSet {
+        &self.unknown_fields
+    }
+    fn unknown_fields_mut(&mut self) -> &mut UnknownFieldSet {
+        &mut self.unknown_fields
+    }
+}